@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+// portable interface for the encoding backend of transform_aac_encoder;
+// the interface doesn't use the media foundation types, so that the software backends
+// can be built on any platform;
+// the backend receives interleaved 16 bit pcm frames and produces raw aac-lc frames
+// (raw_data_block elements only)
+
+class aac_encoder_backend;
+using aac_encoder_backend_t = std::shared_ptr<aac_encoder_backend>;
+
+// the pooled memory of the encoded frames
+class media_buffer_packet;
+
+struct aac_encoder_params
+{
+    uint32_t sample_rate, channels;
+    // in bytes per second
+    uint32_t bitrate;
+    uint32_t profile_level_indication;
+};
+
+// an encoded frame
+struct aac_encoder_packet
+{
+    // in 100 nanosecond units
+    int64_t pts, duration;
+    // the data is in the length of the buffer;
+    // the memory returns to the pool of the backend when the buffer is released
+    std::shared_ptr<media_buffer_packet> buffer;
+};
+
+class aac_encoder_backend
+{
+public:
+    // the number of pcm frames in one aac-lc frame
+    static const uint32_t frame_length = 1024;
+
+    virtual ~aac_encoder_backend() = default;
+
+    // creates a new uninitialized backend of the same type
+    virtual aac_encoder_backend_t create_instance() const = 0;
+
+    virtual void initialize(const aac_encoder_params&) = 0;
+    // time is the time of the first pcm frame, in 100 nanosecond units;
+    // the input can be shorter than an encoder frame, in which case the backend
+    // accumulates the input until a full encoder frame is available;
+    // all the output that is available after consuming the input is appended to packets,
+    // which means that the backend must not delay frames it could output;
+    // each full encoder frame of input produces one packet that is timestamped with
+    // the time of its input, because transform_aac_encoder interleaves the backend output
+    // with cached silent frames; encoders with a lookahead delay don't fit this interface;
+    // returns true if packets were appended
+    virtual bool encode(const int16_t* samples, uint32_t frame_count, int64_t time,
+        std::vector<aac_encoder_packet>& packets) = 0;
+    // encodes the accumulated input and appends the remaining output;
+    // returns true if packets were appended
+    virtual bool drain(std::vector<aac_encoder_packet>& packets) = 0;
+};
@@ -0,0 +1,181 @@
+#include "aac_encoder_benchmark.h"
+#include "aac_encoder_mft.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <utility>
+#include "assert.h"
+
+#undef min
+#undef max
+
+namespace
+{
+
+// the signal is a tone in each channel that is modulated by a slower tone, and noise
+// 30 db below the tones, so that the encoder has both tonal and noisy content
+void create_signal(std::vector<int16_t>& signal, UINT32 sample_rate, UINT32 frame_count)
+{
+    const double pi = 3.14159265358979323846;
+    const double tones[aac_encoder_benchmark::channels] = {440.0, 660.0};
+    UINT32 seed = 1;
+
+    signal.resize((size_t)frame_count * aac_encoder_benchmark::channels);
+    for(UINT32 i = 0; i < frame_count; i++)
+    {
+        const double t = (double)i / sample_rate;
+        const double envelope = 0.5 + 0.25 * std::sin(2.0 * pi * 3.0 * t);
+        for(UINT32 j = 0; j < aac_encoder_benchmark::channels; j++)
+        {
+            // linear congruential generator, so that the noise is deterministic
+            seed = seed * 1664525u + 1013904223u;
+            const double noise = ((double)(seed >> 8) / (1u << 24) - 0.5) * 0.03;
+            const double sample = envelope * std::sin(2.0 * pi * tones[j] * t) + noise;
+            signal[(size_t)i * aac_encoder_benchmark::channels + j] = (int16_t)(sample * 32767.0);
+        }
+    }
+}
+
+UINT64 get_process_cpu_time()
+{
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if(!GetProcessTimes(GetCurrentProcess(),
+        &creation_time, &exit_time, &kernel_time, &user_time))
+        throw HR_EXCEPTION(HRESULT_FROM_WIN32(GetLastError()));
+
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernel_time.dwLowDateTime;
+    kernel.HighPart = kernel_time.dwHighDateTime;
+    user.LowPart = user_time.dwLowDateTime;
+    user.HighPart = user_time.dwHighDateTime;
+
+    // in 100 nanosecond units
+    return kernel.QuadPart + user.QuadPart;
+}
+
+}
+
+aac_encoder_backend_t aac_encoder_benchmark::create_backend(backend_t backend)
+{
+    switch(backend)
+    {
+    case BACKEND_MFT:
+        return aac_encoder_backend_t(new aac_encoder_mft);
+    default:
+        return nullptr;
+    }
+}
+
+aac_encoder_benchmark::result_t aac_encoder_benchmark::run(backend_t backend_type,
+    const params_t& params)
+{
+    typedef std::chrono::steady_clock steady_clock;
+
+    // the audio mixer outputs 10 milliseconds at a time
+    const UINT32 chunk_length = params.sample_rate / 100;
+    const UINT32 frame_count = params.sample_rate * params.seconds;
+    const aac_encoder_backend_t backend = create_backend(backend_type);
+    aac_encoder_params encoder_params;
+    std::vector<int16_t> signal;
+    std::vector<aac_encoder_packet> packets;
+    result_t result;
+
+    if(!backend)
+        throw HR_EXCEPTION(E_NOTIMPL);
+
+    encoder_params.sample_rate = params.sample_rate;
+    encoder_params.channels = channels;
+    encoder_params.bitrate = params.bitrate * 1000 / 8;
+    // aac-lc level 2
+    encoder_params.profile_level_indication = 0x29;
+    backend->initialize(encoder_params);
+
+    create_signal(signal, params.sample_rate, frame_count);
+    // the packets are released right after they are counted, like the outputs release them
+    packets.reserve(16);
+
+    int64_t next_pts = 0;
+    bool contiguous = true;
+    auto count_packets = [&]()
+    {
+        for(const auto& packet : packets)
+        {
+            // the media foundation encoder rounds the timestamps by itself
+            contiguous = contiguous && std::abs(packet.pts - next_pts) <= 1;
+            next_pts = packet.pts + packet.duration;
+            result.bytes += packet.buffer->get_length();
+        }
+        result.packets += packets.size();
+        packets.clear();
+    };
+
+    const UINT64 cpu_start = get_process_cpu_time();
+    const steady_clock::time_point start = steady_clock::now();
+
+    for(UINT32 pos = 0; pos < frame_count; pos += chunk_length)
+    {
+        const UINT32 len = std::min(chunk_length, frame_count - pos);
+        backend->encode(signal.data() + (size_t)pos * channels, len,
+            convert_to_time_unit(pos, params.sample_rate, 1), packets);
+        count_packets();
+    }
+    backend->drain(packets);
+    count_packets();
+
+    const double wall_time =
+        std::chrono::duration<double>(steady_clock::now() - start).count();
+    const double cpu_time = (double)(get_process_cpu_time() - cpu_start) / 10000000.0;
+
+    result.frames = frame_count;
+    result.realtime_factor = wall_time > 0.0 ? params.seconds / wall_time : 0.0;
+    result.frames_per_core_second = cpu_time > 0.0 ? frame_count / cpu_time : 0.0;
+    result.bitrate = (double)result.bytes * 8.0 / 1000.0 / params.seconds;
+    // the drained output covers the input and the timestamps have no gaps
+    result.match = contiguous &&
+        result.packets * aac_encoder_backend::frame_length >= result.frames;
+
+    return result;
+}
+
+void aac_encoder_benchmark::run_all(const params_t& params)
+{
+    std::cout << "aac encoder benchmark: " << params.sample_rate << " hz, " <<
+        params.bitrate << " kbps, " << params.seconds << " seconds" << std::endl;
+    std::cout << "backend  realtime  frames/s/core  packets    kbps  match" << std::endl;
+
+    const std::pair<backend_t, const char*> backends[] =
+    {
+        {BACKEND_MFT, "mft"},
+    };
+    for(const auto& backend : backends)
+    {
+        if(!create_backend(backend.first))
+        {
+            std::cout << std::left << std::setw(9) << backend.second << std::right <<
+                "not built" << std::endl;
+            continue;
+        }
+
+        result_t result;
+        try
+        {
+            result = run(backend.first, params);
+        }
+        catch(streaming::exception err)
+        {
+            std::cout << "EXCEPTION THROWN: " << err.what() << std::flush;
+            continue;
+        }
+
+        std::cout << std::left << std::setw(9) << backend.second << std::right <<
+            std::fixed << std::setprecision(1) <<
+            std::setw(8) << result.realtime_factor << "x" <<
+            std::setw(15) << std::setprecision(0) << result.frames_per_core_second <<
+            std::setw(9) << result.packets <<
+            std::setw(8) << std::setprecision(1) << result.bitrate <<
+            std::setw(7) << (result.match ? "yes" : "NO") << std::endl;
+    }
+}
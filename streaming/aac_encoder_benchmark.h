@@ -0,0 +1,56 @@
+#pragma once
+
+#include "aac_encoder_backend.h"
+#include <Windows.h>
+
+/*
+
+headless benchmark of the aac encoder backends;
+a deterministic stereo signal of tones and noise is generated before the measurement starts
+and fed to a backend in chunks of 10 milliseconds as fast as it encodes them, which is
+how the audio mixer feeds the transform;
+the results report the realtime factor, the pcm frames encoded per second of
+the cpu time of the process, which is the throughput of a single core because
+the backends encode synchronously, and the output bitrate;
+the output is checked for contiguous timestamps that cover the input
+
+*/
+
+class aac_encoder_benchmark
+{
+public:
+    enum backend_t
+    {
+        BACKEND_MFT,
+    };
+
+    struct params_t
+    {
+        UINT32 sample_rate = 48000;
+        // in kbps
+        UINT32 bitrate = 128;
+        // the length of the signal
+        UINT32 seconds = 60;
+    };
+
+    struct result_t
+    {
+        UINT64 frames = 0, packets = 0, bytes = 0;
+        double realtime_factor = 0.0;
+        double frames_per_core_second = 0.0;
+        // in kbps
+        double bitrate = 0.0;
+        bool match = false;
+    };
+
+    static const UINT32 channels = 2;
+private:
+    aac_encoder_benchmark() = delete;
+public:
+    // creates the backend; returns null if the backend isn't built
+    static aac_encoder_backend_t create_backend(backend_t);
+    // encodes the signal with the backend and drains it
+    static result_t run(backend_t, const params_t&);
+    // runs the backends that are built and prints the results
+    static void run_all(const params_t&);
+};
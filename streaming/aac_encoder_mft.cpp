@@ -0,0 +1,256 @@
+#include "aac_encoder_mft.h"
+#include <Mferror.h>
+#include <iostream>
+
+#define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
+#undef min
+#undef max
+
+aac_encoder_mft::aac_encoder_mft() :
+    input_id(0), output_id(0),
+    params(),
+    input_frames(0), output_frames(0),
+    buffer_pool_memory(new buffer_pool_memory_t),
+    buffer_pool_packet(new buffer_pool_packet_t(PACKET_POOL_BUCKET_LIMIT, PACKET_POOL_MAX_AGE))
+{
+    this->input_sample_pool.Attach(new media_sample_pool);
+}
+
+aac_encoder_mft::~aac_encoder_mft()
+{
+    this->input_sample_pool->dispose();
+
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
+        this->buffer_pool_memory->dispose();
+    }
+    {
+        buffer_pool_packet_t::scoped_lock lock(this->buffer_pool_packet->mutex);
+        this->buffer_pool_packet->dispose();
+    }
+}
+
+HRESULT aac_encoder_mft::create_output_type(const aac_encoder_params& params,
+    CComPtr<IMFMediaType>& type)
+{
+    HRESULT hr = S_OK;
+
+    type = NULL;
+    CHECK_HR(hr = MFCreateMediaType(&type));
+    CHECK_HR(hr = type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio));
+    CHECK_HR(hr = type->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_AAC));
+    CHECK_HR(hr = type->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, sizeof(int16_t) * 8));
+    CHECK_HR(hr = type->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, params.sample_rate));
+    CHECK_HR(hr = type->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, params.channels));
+    CHECK_HR(hr = type->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, params.bitrate));
+    CHECK_HR(hr = type->SetUINT32(
+        MF_MT_AAC_AUDIO_PROFILE_LEVEL_INDICATION, params.profile_level_indication));
+    // raw_data_block elements only
+    CHECK_HR(hr = type->SetUINT32(MF_MT_AAC_PAYLOAD_TYPE, 0));
+
+done:
+    return hr;
+}
+
+bool aac_encoder_mft::encode(const int16_t* samples, uint32_t frame_count, int64_t time,
+    std::vector<aac_encoder_packet>& packets)
+{
+    HRESULT hr = S_OK;
+    const size_t old_packet_count = packets.size();
+    const DWORD len = frame_count * this->params.channels * sizeof(int16_t);
+    media_buffer_memory_t buffer;
+    CComPtr<IMFSample> sample;
+    BYTE* data;
+
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
+        buffer = this->buffer_pool_memory->acquire_buffer();
+    }
+    buffer->initialize(len);
+
+    CHECK_HR(hr = buffer->buffer->Lock(&data, NULL, NULL));
+    memcpy(data, samples, len);
+    CHECK_HR(hr = buffer->buffer->Unlock());
+    CHECK_HR(hr = buffer->buffer->SetCurrentLength(len));
+
+    sample = this->input_sample_pool->acquire_sample();
+    CHECK_HR(hr = sample->AddBuffer(buffer->buffer));
+    CHECK_HR(hr = sample->SetSampleTime(time));
+    CHECK_HR(hr = sample->SetSampleDuration(
+        (LONGLONG)convert_to_time_unit(frame_count, this->params.sample_rate, 1)));
+
+    // the encoder doesn't accept input while it has output pending
+    while((hr = this->encoder->ProcessInput(this->input_id, sample, 0)) == MF_E_NOTACCEPTING)
+        if(!this->process_output(packets))
+            break;
+    CHECK_HR(hr);
+    this->input_frames += frame_count;
+    this->memory_hosts.emplace_back(this->input_frames, std::move(buffer));
+
+    // collect the output that became available
+    while(this->process_output(packets));
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return packets.size() > old_packet_count;
+}
+
+bool aac_encoder_mft::drain(std::vector<aac_encoder_packet>& packets)
+{
+    std::cout << "drain on aac encoder" << std::endl;
+
+    HRESULT hr = S_OK;
+    const size_t old_packet_count = packets.size();
+
+    CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0));
+    while(this->process_output(packets));
+
+    // the encoder has consumed all the input after draining;
+    // the padding of the last frame isn't counted for the next input
+    this->memory_hosts.clear();
+    this->input_frames = this->output_frames = 0;
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return packets.size() > old_packet_count;
+}
+
+bool aac_encoder_mft::process_output(std::vector<aac_encoder_packet>& packets)
+{
+    HRESULT hr = S_OK;
+
+    MFT_OUTPUT_DATA_BUFFER output = {0};
+    DWORD status = 0;
+    media_buffer_packet_t buffer;
+    aac_encoder_packet packet;
+    LONGLONG ts, dur;
+    bool received = false;
+
+    // the encoder writes to the packet directly
+    {
+        buffer_pool_packet_t::scoped_lock lock(this->buffer_pool_packet->mutex);
+        buffer = this->buffer_pool_packet->acquire_buffer(
+            media_buffer_packet::get_pool_key(this->output_stream_info.cbSize));
+    }
+    buffer->initialize(this->output_stream_info.cbSize);
+
+    CHECK_HR(hr = this->output_sample->RemoveAllBuffers());
+    CHECK_HR(hr = this->output_sample->DeleteAllItems());
+    CHECK_HR(hr = this->output_sample->AddBuffer(media_buffer_packet::get_media_buffer(buffer)));
+
+    output.dwStreamID = this->output_id;
+    output.dwStatus = 0;
+    output.pEvents = NULL;
+    output.pSample = this->output_sample;
+
+    hr = this->encoder->ProcessOutput(0, 1, &output, &status);
+    if(hr == MF_E_TRANSFORM_NEED_MORE_INPUT)
+    {
+        hr = S_OK;
+        goto done;
+    }
+    CHECK_HR(hr);
+
+    CHECK_HR(hr = this->output_sample->GetSampleTime(&ts));
+    CHECK_HR(hr = this->output_sample->GetSampleDuration(&dur));
+    packet.pts = ts;
+    packet.duration = dur;
+    packet.buffer = std::move(buffer);
+    packets.push_back(std::move(packet));
+    received = true;
+
+    // release the input buffers that the output covers
+    this->output_frames += frame_length;
+    while(!this->memory_hosts.empty() &&
+        this->memory_hosts.front().first <= this->output_frames)
+        this->memory_hosts.pop_front();
+
+done:
+    // the media buffer of the packet is released from the reused output sample
+    this->output_sample->RemoveAllBuffers();
+
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return received;
+}
+
+void aac_encoder_mft::initialize(const aac_encoder_params& params)
+{
+    HRESULT hr = S_OK;
+
+    IMFActivate** activate = NULL;
+    UINT count = 0;
+    MFT_REGISTER_TYPE_INFO info = {MFMediaType_Audio, MFAudioFormat_AAC};
+    const UINT32 flags = MFT_ENUM_FLAG_SYNCMFT | MFT_ENUM_FLAG_LOCALMFT | MFT_ENUM_FLAG_SORTANDFILTER;
+
+    this->params = params;
+
+    CHECK_HR(hr = MFTEnumEx(
+        MFT_CATEGORY_AUDIO_ENCODER,
+        flags,
+        NULL,
+        &info,
+        &activate,
+        &count));
+
+    if(!count)
+        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+
+    CHECK_HR(hr = activate[0]->ActivateObject(__uuidof(IMFTransform), (void**)&this->encoder));
+
+    // set input type
+    CHECK_HR(hr = MFCreateMediaType(&this->input_type));
+    CHECK_HR(hr = this->input_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio));
+    CHECK_HR(hr = this->input_type->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_PCM));
+    CHECK_HR(hr = this->input_type->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, sizeof(int16_t) * 8));
+    CHECK_HR(hr = this->input_type->SetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, params.sample_rate));
+    CHECK_HR(hr = this->input_type->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, params.channels));
+
+    // set output type
+    CHECK_HR(hr = create_output_type(params, this->output_type));
+
+    // get streams
+    DWORD input_stream_count, output_stream_count;
+    CHECK_HR(hr = this->encoder->GetStreamCount(&input_stream_count, &output_stream_count));
+    if(input_stream_count != 1 || output_stream_count != 1)
+        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+    hr = this->encoder->GetStreamIDs(
+        input_stream_count, &this->input_id, output_stream_count, &this->output_id);
+    if(hr == E_NOTIMPL)
+        this->input_id = this->output_id = 0;
+    else if(FAILED(hr))
+        CHECK_HR(hr);
+
+    // set stream types
+    CHECK_HR(hr = this->encoder->SetInputType(this->input_id, this->input_type, 0));
+    CHECK_HR(hr = this->encoder->SetOutputType(this->output_id, this->output_type, 0));
+
+    // get stream info
+    CHECK_HR(hr = this->encoder->GetInputStreamInfo(this->input_id, &this->input_stream_info));
+    CHECK_HR(hr = this->encoder->GetOutputStreamInfo(this->output_id, &this->output_stream_info));
+
+    // the output is written to the pooled packets
+    if(this->output_stream_info.dwFlags & MFT_OUTPUT_STREAM_PROVIDES_SAMPLES)
+        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+    CHECK_HR(hr = MFCreateSample(&this->output_sample));
+
+    CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, NULL));
+    CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL));
+    CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL));
+
+done:
+    if(activate)
+    {
+        for(UINT i = 0; i < count; i++)
+            activate[i]->Release();
+        CoTaskMemFree(activate);
+    }
+
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
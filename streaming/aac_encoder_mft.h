@@ -0,0 +1,65 @@
+#pragma once
+
+#include "aac_encoder_backend.h"
+#include "media_sample.h"
+#include <mfapi.h>
+#include <mftransform.h>
+#include <vector>
+#include <deque>
+#include <utility>
+
+#pragma comment(lib, "Mfplat.lib")
+
+/*
+
+The Microsoft Media Foundation AAC encoder is a Media Foundation Transform that encodes
+Advanced Audio Coding (AAC) Low Complexity (LC) profile, as defined by ISO/IEC 13818-7
+(MPEG-2 Audio Part 7).
+
+*/
+
+class aac_encoder_mft final : public aac_encoder_backend
+{
+public:
+    typedef buffer_pool<media_buffer_memory_pooled> buffer_pool_memory_t;
+    typedef buffer_pool<media_buffer_packet_pooled> buffer_pool_packet_t;
+private:
+    CComPtr<IMFTransform> encoder;
+    CComPtr<IMFMediaType> input_type, output_type;
+    MFT_INPUT_STREAM_INFO input_stream_info;
+    MFT_OUTPUT_STREAM_INFO output_stream_info;
+    DWORD input_id, output_id;
+    aac_encoder_params params;
+
+    std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
+    std::shared_ptr<buffer_pool_packet_t> buffer_pool_packet;
+    // the input samples are returned to the pool when the encoder releases them
+    CComPtr<media_sample_pool> input_sample_pool;
+    // reused for each output
+    CComPtr<IMFSample> output_sample;
+    // the input buffers with the total input frame count at their end;
+    // the encoder accumulates the input to full encoder frames, so that a buffer is
+    // kept until the encoder has produced the output that covers it
+    std::deque<std::pair<uint64_t, media_buffer_memory_t>> memory_hosts;
+    uint64_t input_frames, output_frames;
+
+    // receives one frame to the packets;
+    // returns false if no output was available
+    bool process_output(std::vector<aac_encoder_packet>&);
+public:
+    aac_encoder_mft();
+    ~aac_encoder_mft();
+
+    // the media type of the encoded stream, used for configuring the outputs
+    static HRESULT create_output_type(const aac_encoder_params&, CComPtr<IMFMediaType>&);
+
+    aac_encoder_backend_t create_instance() const override
+    {
+        return aac_encoder_backend_t(new aac_encoder_mft);
+    }
+
+    void initialize(const aac_encoder_params&) override;
+    bool encode(const int16_t* samples, uint32_t frame_count, int64_t time,
+        std::vector<aac_encoder_packet>& packets) override;
+    bool drain(std::vector<aac_encoder_packet>& packets) override;
+};
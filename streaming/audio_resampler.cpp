@@ -16,14 +16,70 @@ EXTERN_GUID(CLSID_CResamplerMediaObject, 0xf447b69e, 0x1884, 0x4a7e, 0x80, 0x55,
 
 audio_resampler::audio_resampler() : 
     buffer_pool_memory(new buffer_pool_memory_t),
+    buffer_pool_memory_planar(new buffer_pool_memory_t),
     initialized(false)
 {
 }
 
 audio_resampler::~audio_resampler()
 {
-    buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
-    this->buffer_pool_memory->dispose();
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
+        this->buffer_pool_memory->dispose();
+    }
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory_planar->mutex);
+        this->buffer_pool_memory_planar->dispose();
+    }
+}
+
+media_buffer_memory_t audio_resampler::deinterleave(IMFMediaBuffer* interleaved,
+    frame_unit frame_count, frame_unit& plane_stride)
+{
+    typedef float bit_depth_t;
+    assert_(this->out_bit_depth == sizeof(bit_depth_t) * 8);
+
+    HRESULT hr = S_OK;
+    media_buffer_memory_t buffer;
+    const bit_depth_t* in_data = NULL;
+    bit_depth_t* out_data = NULL;
+
+    plane_stride = media_sample_audio_consecutive_frames::get_plane_stride(
+        frame_count, sizeof(bit_depth_t));
+    const DWORD len = (DWORD)(plane_stride * this->out_channels * sizeof(bit_depth_t));
+
+    {
+        buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory_planar->mutex);
+        buffer = this->buffer_pool_memory_planar->acquire_buffer();
+    }
+    buffer->initialize(len);
+
+    CHECK_HR(hr = interleaved->Lock((BYTE**)&in_data, NULL, NULL));
+    CHECK_HR(hr = buffer->buffer->Lock((BYTE**)&out_data, NULL, NULL));
+
+    for(UINT32 j = 0; j < this->out_channels; j++)
+    {
+        bit_depth_t* plane = out_data + plane_stride * j;
+        const bit_depth_t* in = in_data + j;
+        for(frame_unit i = 0; i < frame_count; i++)
+            plane[i] = in[i * this->out_channels];
+    }
+
+    CHECK_HR(hr = buffer->buffer->Unlock());
+    out_data = NULL;
+    CHECK_HR(hr = interleaved->Unlock());
+    in_data = NULL;
+    CHECK_HR(hr = buffer->buffer->SetCurrentLength(len));
+
+done:
+    if(out_data)
+        buffer->buffer->Unlock();
+    if(in_data)
+        interleaved->Unlock();
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return buffer;
 }
 
 bool audio_resampler::process_output(IMFSample* sample)
@@ -9,6 +9,7 @@
 #pragma comment(lib, "Mfplat.lib")
 
 // resamples, maps channels and changes bit depth;
+// the output is converted to the planar float format of the pipeline;
 // audio resampler is very similar to aac encoder component
 
 // not multithread safe
@@ -32,13 +33,17 @@ private:
     // keeps the hosts alive until the resampler has processed the input samples
     // TODO: the vector shouldn't allocate dynamic memory that much
     std::vector<media_buffer_memory_t> memory_hosts;
-    std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
+    std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory, buffer_pool_memory_planar;
     bool process_output(IMFSample* sample);
+    // converts the interleaved output of the resampler to planes
+    media_buffer_memory_t deinterleave(IMFMediaBuffer*, frame_unit frame_count,
+        frame_unit& plane_stride);
 public:
     audio_resampler();
     ~audio_resampler();
 
     // TODO: resample only if resampling is actually needed
+    // out bit depth must be 32 for the planar float output
     void initialize(
         UINT32 out_sample_rate, UINT32 out_channels, UINT32 out_bit_depth,
         UINT32 in_sample_rate, UINT32 in_channels, UINT32 in_bit_depth);
@@ -135,13 +140,17 @@ frame_unit audio_resampler::resample(
         CHECK_HR(hr = mf_buffer->GetCurrentLength(&buflen));
 
         frame_dur = buflen / block_align;
-
-        consec_frames.memory_host = buffer;
-        consec_frames.pos = frame_pos;
-        consec_frames.dur = frame_dur;
-        consec_frames.buffer = mf_buffer;
-
-        frames.add_consecutive_frames(consec_frames);
+        if(frame_dur > 0)
+        {
+            consec_frames.memory_host = this->deinterleave(
+                mf_buffer, frame_dur, consec_frames.plane_stride);
+            consec_frames.buffer = consec_frames.memory_host->buffer;
+            consec_frames.offset = 0;
+            consec_frames.pos = frame_pos;
+            consec_frames.dur = frame_dur;
+
+            frames.add_consecutive_frames(consec_frames);
+        }
 
         frame_next_pos += frame_dur;
         frames_added += frame_dur;
@@ -0,0 +1,95 @@
+#include "bitrate_controller.h"
+#include <algorithm>
+#include <iostream>
+
+#undef min
+#undef max
+
+bitrate_controller::bitrate_controller() :
+    bitrate(0),
+    started(false),
+    min_delay(0), backlog(0), last_backlog(0),
+    interval_start(0),
+    interval_bytes(0),
+    low_intervals(0)
+{
+}
+
+void bitrate_controller::initialize(const params_t& params, UINT32 initial_bitrate,
+    const on_bitrate_change_t& on_bitrate_change)
+{
+    assert_(params.min_bitrate <= params.max_bitrate);
+    assert_(params.interval > 0);
+
+    this->params = params;
+    this->on_bitrate_change = on_bitrate_change;
+    this->bitrate = std::clamp(initial_bitrate, params.min_bitrate, params.max_bitrate);
+    this->started = false;
+}
+
+void bitrate_controller::on_frame_sent(time_unit media_time, time_unit now, size_t bytes)
+{
+    const time_unit delay = now - media_time;
+
+    if(!this->started)
+    {
+        this->started = true;
+        this->min_delay = delay;
+        this->last_backlog = 0;
+        this->interval_start = now;
+        this->interval_bytes = 0;
+        this->low_intervals = 0;
+    }
+
+    this->min_delay = std::min(this->min_delay, delay);
+    this->backlog = delay - this->min_delay;
+    this->interval_bytes += bytes;
+
+    if(now - this->interval_start >= this->params.interval)
+        this->adjust(now);
+}
+
+void bitrate_controller::adjust(time_unit now)
+{
+    // the rate at which the frames were sent during the interval
+    const UINT64 throughput =
+        this->interval_bytes * 8 * SECOND_IN_TIME_UNIT / (now - this->interval_start);
+    UINT64 new_bitrate = this->bitrate;
+
+    if(this->backlog > this->params.backlog_high && this->backlog >= this->last_backlog)
+    {
+        // the connection doesn't keep up with the stream;
+        // the sends were blocked for the whole interval, so the throughput is close to the
+        // available bandwidth
+        new_bitrate = std::min((UINT64)this->bitrate * 3 / 4, throughput * 9 / 10);
+        this->low_intervals = 0;
+    }
+    else if(this->backlog < this->params.backlog_low)
+    {
+        if(++this->low_intervals >= this->params.increase_delay)
+        {
+            new_bitrate = (UINT64)this->bitrate + this->params.max_bitrate / 20;
+            this->low_intervals = 0;
+        }
+    }
+    else
+        this->low_intervals = 0;
+
+    new_bitrate = std::clamp(new_bitrate,
+        (UINT64)this->params.min_bitrate, (UINT64)this->params.max_bitrate);
+
+    this->last_backlog = this->backlog;
+    this->interval_start = now;
+    this->interval_bytes = 0;
+
+    if(new_bitrate != this->bitrate)
+    {
+        std::cout << "bitrate controller: " << this->bitrate / 1000 << "kbps -> " <<
+            new_bitrate / 1000 << "kbps, backlog " <<
+            this->backlog / (SECOND_IN_TIME_UNIT / 1000) << "ms" << std::endl;
+
+        this->bitrate = (UINT32)new_bitrate;
+        if(this->on_bitrate_change)
+            this->on_bitrate_change(this->bitrate);
+    }
+}
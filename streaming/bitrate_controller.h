@@ -0,0 +1,57 @@
+#pragma once
+
+#include "media_sample.h"
+#include <functional>
+
+// adapts the video bitrate of a streaming output to the throughput of the connection;
+// the output reports each sent video frame, and the backlog is the growth of the delay
+// between the media time of the frame and the time it was sent;
+// the bitrate is decreased multiplicatively when the backlog grows and
+// increased additively after the backlog has stayed low;
+// the times are passed by the caller so that the controller can be driven by any clock
+
+class bitrate_controller
+{
+public:
+    // bitrates are in bits per second
+    struct params_t
+    {
+        UINT32 min_bitrate = 0, max_bitrate = 0;
+        // the backlog above which the bitrate is decreased
+        time_unit backlog_high = SECOND_IN_TIME_UNIT / 2;
+        // the backlog below which the bitrate can be increased
+        time_unit backlog_low = SECOND_IN_TIME_UNIT / 10;
+        // the interval between the bitrate adjustments
+        time_unit interval = SECOND_IN_TIME_UNIT;
+        // the number of consecutive low backlog intervals before an increase
+        UINT32 increase_delay = 5;
+    };
+    // called from the thread that reports the frames
+    typedef std::function<void(UINT32 bitrate)> on_bitrate_change_t;
+private:
+    params_t params;
+    on_bitrate_change_t on_bitrate_change;
+    UINT32 bitrate;
+
+    bool started;
+    // the smallest delay is the latency of the pipeline, which isn't part of the backlog
+    time_unit min_delay, backlog, last_backlog;
+    time_unit interval_start;
+    UINT64 interval_bytes;
+    UINT32 low_intervals;
+
+    void adjust(time_unit now);
+public:
+    bitrate_controller();
+
+    // the initial bitrate is clamped to the bounds
+    void initialize(const params_t&, UINT32 initial_bitrate, const on_bitrate_change_t&);
+
+    // media time is the timestamp of the frame and now is the time after the frame
+    // has been sent, both in time units
+    void on_frame_sent(time_unit media_time, time_unit now, size_t bytes);
+
+    UINT32 get_bitrate() const {return this->bitrate;}
+    // the backlog at the last sent frame
+    time_unit get_backlog() const {return this->backlog;}
+};
@@ -4,6 +4,8 @@
 #include "enable_shared_from_this.h"
 #include <memory>
 #include <stack>
+#include <deque>
+#include <unordered_map>
 #include <mutex>
 #include <utility>
 #include <limits>
@@ -16,6 +18,38 @@
 #undef min
 #undef max
 
+// the buckets of a pool are keyed by the shape of the buffers;
+// textures use the fields of the texture desc;
+// cpu frame buffers use the frame size and the pixel format and leave the bind flags at 0
+struct buffer_pool_key
+{
+    UINT32 width = 0, height = 0;
+    UINT32 format = 0;
+    UINT32 bind_flags = 0;
+
+    bool operator==(const buffer_pool_key& other) const
+    {
+        return this->width == other.width && this->height == other.height &&
+            this->format == other.format && this->bind_flags == other.bind_flags;
+    }
+};
+
+struct buffer_pool_key_hash
+{
+    size_t operator()(const buffer_pool_key& key) const
+    {
+        size_t hash = std::hash<UINT32>()(key.width);
+        hash = hash * 31 + std::hash<UINT32>()(key.height);
+        hash = hash * 31 + std::hash<UINT32>()(key.format);
+        return hash * 31 + std::hash<UINT32>()(key.bind_flags);
+    }
+};
+
+// the released buffers are kept in a bucket for each key in the order of release;
+// the least recently used buffers of a bucket are evicted when the bucket limit is exceeded,
+// and the buffers of the stale buckets are evicted after they have been unused
+// for max age releases;
+// the keyless methods use the bucket of the default key
 template<class PooledBuffer>
 class buffer_pool : public enable_shared_from_this
 {
@@ -34,21 +68,36 @@ public:
 
     typedef std::unique_lock<std::recursive_mutex> scoped_lock;
     typedef PooledBuffer pooled_buffer_t;
-    typedef std::stack<std::shared_ptr<pooled_buffer_t>> buffer_pool_t;
+    // the most recently released buffer is at the back
+    typedef std::deque<std::shared_ptr<pooled_buffer_t>> buffer_pool_t;
+    typedef std::unordered_map<buffer_pool_key, buffer_pool_t, buffer_pool_key_hash> buckets_t;
     typedef std::stack<std::shared_ptr<control_block_desc_t>> control_block_pool_t;
 private:
     volatile bool disposed;
-    buffer_pool_t container;
+    // the number of buckets stays small, because the keys are the shapes of the buffers
+    // that are in use
+    buckets_t buckets;
     control_block_pool_t control_block_descs;
+    size_t bucket_limit;
+    UINT64 max_age, release_count;
+
+    // called when the buffer is released to the pool
+    void evict(const buffer_pool_key&);
 public:
-    buffer_pool();
+    // bucket limit is the maximum number of released buffers in a bucket;
+    // max age is in the number of releases to the pool
+    explicit buffer_pool(
+        size_t bucket_limit = std::numeric_limits<size_t>::max(),
+        UINT64 max_age = std::numeric_limits<UINT64>::max());
 
     // mutex must be locked when using buffer_pool methods
     std::recursive_mutex mutex;
 
-    // the buffer is uninitialized
-    typename pooled_buffer_t::buffer_t acquire_buffer();
-    bool is_empty() const {return this->container.empty();}
+    // the buffer is uninitialized;
+    // returns the most recently released buffer of the bucket, so that the buffer
+    // doesn't need to be reallocated for a different shape
+    typename pooled_buffer_t::buffer_t acquire_buffer(const buffer_pool_key& = buffer_pool_key());
+    bool is_empty(const buffer_pool_key& = buffer_pool_key()) const;
 
     // the pool must be manually disposed;
     // it breaks the circular dependency between the pool and its objects
@@ -78,12 +127,17 @@ class buffer_pooled final : public Poolable, public enable_shared_from_this
         "template parameter must inherit from poolable");
     static_assert(!std::is_base_of_v<enable_shared_from_this, Poolable>,
         "pooled buffers do not work with enable_shared_from_this");
+    friend class buffer_pool<buffer_pooled>;
 public:
     typedef Poolable buffer_raw_t;
     typedef std::shared_ptr<Poolable> buffer_t;
     typedef buffer_pool<buffer_pooled> buffer_pool;
 private:
     std::shared_ptr<buffer_pool> pool;
+    // the bucket that the buffer was acquired from
+    buffer_pool_key pool_key;
+    // the release count of the pool when the buffer was last released
+    UINT64 release_index;
     void deleter(buffer_raw_t*);
 public:
     explicit buffer_pooled(const std::shared_ptr<buffer_pool>& pool);
@@ -208,28 +262,59 @@ void control_block_allocator<T, U>::deallocate([[maybe_unused]] T* p, size_type
 
 
 template<class T>
-buffer_pool<T>::buffer_pool() : disposed(false)
+buffer_pool<T>::buffer_pool(size_t bucket_limit, UINT64 max_age) :
+    disposed(false), bucket_limit(bucket_limit), max_age(max_age), release_count(0)
 {
 }
 
 template<class T>
-typename buffer_pool<T>::pooled_buffer_t::buffer_t buffer_pool<T>::acquire_buffer()
+typename buffer_pool<T>::pooled_buffer_t::buffer_t buffer_pool<T>::acquire_buffer(
+    const buffer_pool_key& key)
 {
-    if(this->is_empty())
+    auto it = this->buckets.find(key);
+    if(it == this->buckets.end() || it->second.empty())
     {
-        /*return std::shared_ptr<pooled_buffer_t>(new pooled_buffer_t(
-            this->shared_from_this<buffer_pool>()));*/
         std::shared_ptr<pooled_buffer_t> pooled_buffer(new pooled_buffer_t(
             this->shared_from_this<buffer_pool>()));
-        typename pooled_buffer_t::buffer_t buffer = pooled_buffer->create_pooled_buffer();
-        return buffer;
+        pooled_buffer->pool_key = key;
+        return pooled_buffer->create_pooled_buffer();
     }
-    else
+
+    // the emptied bucket is kept, so that releasing the buffer doesn't reallocate it
+    typename pooled_buffer_t::buffer_t buffer = it->second.back()->create_pooled_buffer();
+    it->second.pop_back();
+    return buffer;
+}
+
+template<class T>
+bool buffer_pool<T>::is_empty(const buffer_pool_key& key) const
+{
+    auto it = this->buckets.find(key);
+    return it == this->buckets.end() || it->second.empty();
+}
+
+template<class T>
+void buffer_pool<T>::evict(const buffer_pool_key& key)
+{
+    // the buffers are destroyed when the pool releases them
+    buffer_pool_t& bucket = this->buckets[key];
+    while(bucket.size() > this->bucket_limit)
+        bucket.pop_front();
+
+    if(this->max_age == std::numeric_limits<UINT64>::max())
+        return;
+
+    for(auto it = this->buckets.begin(); it != this->buckets.end();)
     {
-        typename pooled_buffer_t::buffer_t buffer = 
-            this->container.top()->create_pooled_buffer();
-        this->container.pop();
-        return buffer;
+        buffer_pool_t& stale_bucket = it->second;
+        while(!stale_bucket.empty() &&
+            this->release_count - stale_bucket.front()->release_index > this->max_age)
+            stale_bucket.pop_front();
+
+        if(stale_bucket.empty() && !(it->first == key))
+            it = this->buckets.erase(it);
+        else
+            it++;
     }
 }
 
@@ -239,7 +324,7 @@ void buffer_pool<T>::dispose()
     assert_(!this->disposed);
 
     this->disposed = true;
-    this->container = buffer_pool_t();
+    this->buckets = buckets_t();
     while(!this->control_block_descs.empty())
     {
         assert_(!this->control_block_descs.top()->in_use);
@@ -255,7 +340,8 @@ void buffer_pool<T>::dispose()
 
 
 template<class T>
-buffer_pooled<T>::buffer_pooled(const std::shared_ptr<buffer_pool>& pool) : pool(pool)
+buffer_pooled<T>::buffer_pooled(const std::shared_ptr<buffer_pool>& pool) :
+    pool(pool), release_index(0)
 {
 }
 
@@ -286,5 +372,9 @@ void buffer_pooled<T>::deleter(buffer_raw_t* buffer)
     // otherwise, this object will be destroyed after the std bind releases the last reference
     typename buffer_pool::scoped_lock lock(this->pool->mutex);
     if(!this->pool->is_disposed())
-        this->pool->container.push(this->shared_from_this<buffer_pooled>());
+    {
+        this->release_index = ++this->pool->release_count;
+        this->pool->buckets[this->pool_key].push_back(this->shared_from_this<buffer_pooled>());
+        this->pool->evict(this->pool_key);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,372 @@
+#include "color_converter_benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include "assert.h"
+
+#undef min
+#undef max
+
+namespace
+{
+
+// deterministic noise
+UINT32 hash(UINT32 x, UINT32 y, UINT32 seed)
+{
+    UINT32 h = x * 73856093u ^ y * 19349663u ^ seed * 83492791u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return h;
+}
+
+// noise in the upper half covers the whole gamut and smooth gradients in the lower half
+// cover the rounding of the flat areas
+void create_frame(std::vector<BYTE>& bgra, UINT32 width, UINT32 height, UINT32 seed)
+{
+    const UINT32 pitch = width * 4;
+    bgra.resize((size_t)pitch * height);
+    for(UINT32 row = 0; row < height; row++)
+        for(UINT32 x = 0; x < width; x++)
+        {
+            BYTE* px = bgra.data() + (size_t)row * pitch + x * 4;
+            const UINT32 h = hash(x, row, seed);
+            if(row < height / 2)
+            {
+                px[0] = (BYTE)h;
+                px[1] = (BYTE)(h >> 8);
+                px[2] = (BYTE)(h >> 16);
+            }
+            else
+            {
+                px[0] = (BYTE)((x + seed) * 255 / std::max(width - 1, 1u));
+                px[1] = (BYTE)(row * 255 / std::max(height - 1, 1u));
+                px[2] = (BYTE)((x + row) * 255 / std::max(width + height - 2, 1u));
+            }
+            px[3] = 255;
+        }
+}
+
+// gray zone plate on the left, color gradients in the middle and hard edged cells
+// on the right; the zone plate reaches half of the nyquist frequency at its corners
+void create_test_image(std::vector<BYTE>& bgra, UINT32 width, UINT32 height)
+{
+    constexpr double pi = 3.14159265358979323846;
+    const UINT32 pitch = width * 4;
+    const UINT32 third = width / 3;
+    const double cx = third / 2.0, cy = height / 2.0;
+    const double radius = std::sqrt(cx * cx + cy * cy);
+    const UINT32 cell_size = 7;
+
+    bgra.resize((size_t)pitch * height);
+    for(UINT32 row = 0; row < height; row++)
+        for(UINT32 x = 0; x < width; x++)
+        {
+            BYTE* px = bgra.data() + (size_t)row * pitch + x * 4;
+            if(x < third)
+            {
+                const double dx = x + 0.5 - cx, dy = row + 0.5 - cy;
+                const BYTE value = (BYTE)std::lround(
+                    127.5 + 127.5 * std::cos(pi * (dx * dx + dy * dy) / (4.0 * radius)));
+                px[0] = px[1] = px[2] = value;
+            }
+            else if(x < third * 2)
+            {
+                px[0] = (BYTE)((x - third) * 255 / std::max(third - 1, 1u));
+                px[1] = (BYTE)(row * 255 / std::max(height - 1, 1u));
+                px[2] = (BYTE)(255 - px[0] / 2 - px[1] / 2);
+            }
+            else
+            {
+                const UINT32 h = hash(x / cell_size, row / cell_size, 0);
+                px[0] = (BYTE)h;
+                px[1] = (BYTE)(h >> 8);
+                px[2] = (BYTE)(h >> 16);
+            }
+            px[3] = 255;
+        }
+}
+
+// the source pixels that an output pixel covers and their coverage
+struct area_t
+{
+    UINT32 first;
+    std::vector<double> weights;
+};
+
+// returns the area average weights of each output pixel
+std::vector<area_t> area_weights(UINT32 size_in, UINT32 size_out)
+{
+    const double scale = (double)size_in / size_out;
+    std::vector<area_t> areas(size_out);
+    for(UINT32 i = 0; i < size_out; i++)
+    {
+        const double begin = i * scale, end = (i + 1) * scale;
+        areas[i].first = (UINT32)begin;
+        for(UINT32 j = areas[i].first; j < size_in && j < end; j++)
+            areas[i].weights.push_back(
+                (std::min(j + 1.0, end) - std::max((double)j, begin)) / scale);
+    }
+    return areas;
+}
+
+const char* get_name(color_converter_cpu::filter_t filter)
+{
+    switch(filter)
+    {
+    case color_converter_cpu::FILTER_BILINEAR:
+        return "bilinear";
+    case color_converter_cpu::FILTER_BICUBIC:
+        return "bicubic";
+    default:
+        return "lanczos3";
+    }
+}
+
+// the nv12 output of a frame
+struct nv12_frame_t
+{
+    std::vector<BYTE> y, uv;
+    color_converter_cpu::planes_t planes;
+
+    nv12_frame_t(UINT32 width, UINT32 height)
+    {
+        const UINT32 chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+        this->y.resize((size_t)width * height);
+        this->uv.resize((size_t)chroma_width * 2 * chroma_height);
+        this->planes.y = this->y.data();
+        this->planes.y_pitch = width;
+        this->planes.u = this->uv.data();
+        this->planes.u_pitch = chroma_width * 2;
+        this->planes.v = nullptr;
+        this->planes.v_pitch = 0;
+    }
+};
+
+}
+
+color_converter_benchmark::reference_check_t color_converter_benchmark::check_reference(
+    UINT32 width, UINT32 height)
+{
+    const UINT32 pitch = width * 4;
+    const UINT32 chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    std::vector<BYTE> bgra;
+    std::vector<BYTE> y((size_t)width * height);
+    std::vector<BYTE> u((size_t)chroma_width * chroma_height), v(u.size());
+    nv12_frame_t nv12(width, height);
+    color_converter_cpu converter;
+    color_converter_cpu::planes_t planes;
+    reference_check_t result;
+
+    create_frame(bgra, width, height, 0);
+    converter.initialize(DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709,
+        width, height, width, height);
+
+    planes.y = y.data();
+    planes.y_pitch = width;
+    planes.u = u.data();
+    planes.u_pitch = chroma_width;
+    planes.v = v.data();
+    planes.v_pitch = chroma_width;
+    converter.convert(bgra.data(), pitch, color_converter_cpu::FORMAT_I420, planes);
+    converter.convert(bgra.data(), pitch, color_converter_cpu::FORMAT_NV12, nv12.planes);
+
+    // bt.709 studio range
+    const double kr = 0.2126, kb = 0.0722, kg = 1.0 - kr - kb;
+    const double y_scale = 219.0 / 255.0, uv_scale = 224.0 / 255.0;
+    auto to_code = [](double value) {return (int)std::floor(value + 0.5);};
+
+    for(UINT32 row = 0; row < height; row++)
+        for(UINT32 x = 0; x < width; x++)
+        {
+            const BYTE* px = bgra.data() + (size_t)row * pitch + x * 4;
+            const int reference = to_code(16.0 + (kb * px[0] + kg * px[1] + kr * px[2]) * y_scale);
+            result.max_error_y = std::max(result.max_error_y,
+                std::abs(y[(size_t)row * width + x] - reference));
+        }
+
+    result.nv12_match = (y == nv12.y);
+    for(UINT32 row = 0; row < chroma_height; row++)
+        for(UINT32 x = 0; x < chroma_width; x++)
+        {
+            // the chroma is left sited: [1, 2, 1] over the columns around the even column
+            // and the average of the two rows; the edge samples are repeated
+            double b = 0.0, g = 0.0, r = 0.0;
+            for(UINT32 i = 0; i < 6; i++)
+            {
+                const int column = (int)x * 2 + (int)(i % 3) - 1;
+                const UINT32 sx = (UINT32)std::clamp(column, 0, (int)width - 1);
+                const UINT32 sy = std::min(row * 2 + i / 3, height - 1);
+                const BYTE* px = bgra.data() + (size_t)sy * pitch + sx * 4;
+                const double weight = (i % 3 == 1 ? 2.0 : 1.0) / 8.0;
+                b += px[0] * weight;
+                g += px[1] * weight;
+                r += px[2] * weight;
+            }
+            const double luma = kb * b + kg * g + kr * r;
+            const int reference_u = to_code(128.0 + (b - luma) / (2.0 * (1.0 - kb)) * uv_scale);
+            const int reference_v = to_code(128.0 + (r - luma) / (2.0 * (1.0 - kr)) * uv_scale);
+            const size_t i = (size_t)row * chroma_width + x;
+
+            result.max_error_u = std::max(result.max_error_u, std::abs(u[i] - reference_u));
+            result.max_error_v = std::max(result.max_error_v, std::abs(v[i] - reference_v));
+            result.nv12_match = result.nv12_match &&
+                nv12.uv[i * 2] == u[i] && nv12.uv[i * 2 + 1] == v[i];
+        }
+
+    return result;
+}
+
+double color_converter_benchmark::measure_psnr(UINT32 width_in, UINT32 height_in,
+    UINT32 width_out, UINT32 height_out, color_converter_cpu::filter_t filter)
+{
+    std::vector<BYTE> bgra;
+    nv12_frame_t output(width_out, height_out);
+    color_converter_cpu converter;
+
+    create_test_image(bgra, width_in, height_in);
+    converter.initialize(DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709,
+        width_in, height_in, width_out, height_out, filter);
+    converter.convert(bgra.data(), width_in * 4, color_converter_cpu::FORMAT_NV12, output.planes);
+
+    // the luma is linear in the source values, so the area average of the luma
+    // equals the luma of the area average
+    const double kr = 0.2126, kb = 0.0722, kg = 1.0 - kr - kb;
+    std::vector<double> luma((size_t)width_in * height_in);
+    for(size_t i = 0; i < luma.size(); i++)
+    {
+        const BYTE* px = bgra.data() + i * 4;
+        luma[i] = 16.0 + (kb * px[0] + kg * px[1] + kr * px[2]) * 219.0 / 255.0;
+    }
+
+    // filter the columns and then the rows
+    const std::vector<area_t> areas_x = area_weights(width_in, width_out);
+    const std::vector<area_t> areas_y = area_weights(height_in, height_out);
+    std::vector<double> columns((size_t)width_out * height_in, 0.0);
+    for(UINT32 row = 0; row < height_in; row++)
+        for(UINT32 x = 0; x < width_out; x++)
+        {
+            const area_t& area = areas_x[x];
+            double sum = 0.0;
+            for(size_t k = 0; k < area.weights.size(); k++)
+                sum += area.weights[k] * luma[(size_t)row * width_in + area.first + k];
+            columns[(size_t)row * width_out + x] = sum;
+        }
+
+    double squared_error = 0.0;
+    for(UINT32 row = 0; row < height_out; row++)
+        for(UINT32 x = 0; x < width_out; x++)
+        {
+            const area_t& area = areas_y[row];
+            double reference = 0.0;
+            for(size_t k = 0; k < area.weights.size(); k++)
+                reference += area.weights[k] * columns[(area.first + k) * width_out + x];
+            const double error = output.y[(size_t)row * width_out + x] - reference;
+            squared_error += error * error;
+        }
+
+    const double mse = squared_error / ((double)width_out * height_out);
+    return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : INFINITY;
+}
+
+color_converter_benchmark::result_t color_converter_benchmark::run(
+    UINT32 width_in, UINT32 height_in, UINT32 width_out, UINT32 height_out,
+    color_converter_cpu::filter_t filter, UINT32 frame_count)
+{
+    typedef std::chrono::steady_clock steady_clock;
+
+    // two source frames so that the same frame isn't converted from the cache every time
+    std::vector<BYTE> frames[2];
+    nv12_frame_t output(width_out, height_out), scalar_output(width_out, height_out);
+    color_converter_cpu converter, scalar_converter;
+    result_t result;
+
+    for(UINT32 i = 0; i < ARRAYSIZE(frames); i++)
+        create_frame(frames[i], width_in, height_in, i);
+
+    // the converters are configured like in the pipeline
+    converter.initialize(DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709,
+        width_in, height_in, width_out, height_out, filter, true, true);
+    scalar_converter.initialize(DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709,
+        width_in, height_in, width_out, height_out, filter, true, false);
+
+    // returns the milliseconds per frame
+    auto measure = [&](const color_converter_cpu& converter, nv12_frame_t& output)
+    {
+        const steady_clock::time_point start = steady_clock::now();
+        for(UINT32 i = 0; i < frame_count; i++)
+            converter.convert(frames[i % ARRAYSIZE(frames)].data(), width_in * 4,
+                color_converter_cpu::FORMAT_NV12, output.planes);
+        return std::chrono::duration<double, std::milli>(
+            steady_clock::now() - start).count() / frame_count;
+    };
+
+    result.time_per_frame = measure(converter, output);
+    result.scalar_time_per_frame = measure(scalar_converter, scalar_output);
+    result.fps = result.time_per_frame > 0.0 ? 1000.0 / result.time_per_frame : 0.0;
+    result.scalar_fps =
+        result.scalar_time_per_frame > 0.0 ? 1000.0 / result.scalar_time_per_frame : 0.0;
+
+    // both outputs are of the same last frame
+    result.match = (output.y == scalar_output.y && output.uv == scalar_output.uv);
+
+    return result;
+}
+
+void color_converter_benchmark::run_all(const params_t& params)
+{
+    std::cout << "color converter benchmark: " << params.frame_count << " frames" << std::endl;
+    {
+        const reference_check_t check = check_reference(1920, 1080);
+        std::cout << "1920x1080 i420 max error to the reference: y " << check.max_error_y <<
+            ", u " << check.max_error_u << ", v " << check.max_error_v <<
+            ", nv12 " << (check.nv12_match ? "match" : "MISMATCH") << std::endl;
+    }
+
+    std::cout << "size       target  sse2 fps  ms/frame  scalar fps  ms/frame  realtime  "
+        "sse2=scalar" << std::endl;
+    const UINT32 sizes[][3] = {{1920, 1080, 60}, {3840, 2160, 30}};
+    for(const auto& size : sizes)
+    {
+        const result_t result = run(size[0], size[1], size[0], size[1],
+            color_converter_cpu::FILTER_BICUBIC, params.frame_count);
+        std::cout << std::left << std::setw(10) <<
+            (std::to_string(size[0]) + "x" + std::to_string(size[1])) << std::right <<
+            std::setw(7) << size[2] <<
+            std::fixed << std::setprecision(1) <<
+            std::setw(10) << result.fps <<
+            std::setw(10) << std::setprecision(3) << result.time_per_frame <<
+            std::setw(12) << std::setprecision(1) << result.scalar_fps <<
+            std::setw(10) << std::setprecision(3) << result.scalar_time_per_frame <<
+            std::setw(10) << (result.fps >= size[2] ? "yes" : "NO") <<
+            std::setw(13) << (result.match ? "yes" : "NO") << std::endl;
+    }
+
+    std::cout << "scaling               filter    psnr db  ms/frame  scalar ms/frame  "
+        "sse2=scalar" << std::endl;
+    const UINT32 scalings[][4] = {{3840, 2160, 1920, 1080}, {1920, 1080, 1280, 720}};
+    for(const auto& scaling : scalings)
+    {
+        for(color_converter_cpu::filter_t filter : {color_converter_cpu::FILTER_BILINEAR,
+            color_converter_cpu::FILTER_BICUBIC, color_converter_cpu::FILTER_LANCZOS3})
+        {
+            const double psnr = measure_psnr(scaling[0], scaling[1], scaling[2], scaling[3],
+                filter);
+            const result_t result = run(scaling[0], scaling[1], scaling[2], scaling[3],
+                filter, params.frame_count);
+            std::cout << std::left << std::setw(22) <<
+                (std::to_string(scaling[0]) + "x" + std::to_string(scaling[1]) + "->" +
+                    std::to_string(scaling[2]) + "x" + std::to_string(scaling[3])) <<
+                std::setw(8) << get_name(filter) << std::right <<
+                std::fixed << std::setprecision(2) <<
+                std::setw(9) << psnr <<
+                std::setw(10) << std::setprecision(3) << result.time_per_frame <<
+                std::setw(17) << result.scalar_time_per_frame <<
+                std::setw(13) << (result.match ? "yes" : "NO") << std::endl;
+        }
+    }
+}
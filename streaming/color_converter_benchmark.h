@@ -0,0 +1,62 @@
+#pragma once
+
+#include "color_converter_cpu.h"
+#include <Windows.h>
+
+/*
+
+headless benchmark of the cpu color converter;
+the bgra frames are synthetic and generated before the measurement starts;
+the output of the converter is checked against a floating point reference of
+the bt.709 studio range matrix, and the sse2 path is checked against the scalar path,
+which must produce the same output bit for bit;
+the throughput is measured at 1080p and 4k for both paths, and compared to
+the 60 fps and 30 fps rates that the converter has to sustain at those sizes;
+the scaling filters are compared by the psnr of the luma of a downscaled test image of
+gradients, a zone plate and hard edges against a floating point area average of the source,
+and by the time per frame
+
+*/
+
+class color_converter_benchmark
+{
+public:
+    struct params_t
+    {
+        // the number of frames of each measurement
+        UINT32 frame_count = 120;
+    };
+
+    // the largest deviations of the converter from the reference, in code values
+    struct reference_check_t
+    {
+        int max_error_y = 0, max_error_u = 0, max_error_v = 0;
+        // the i420 planes equal the deinterleaved nv12 plane
+        bool nv12_match = false;
+    };
+
+    struct result_t
+    {
+        // the sse2 path and the scalar path
+        double fps = 0.0, scalar_fps = 0.0;
+        // in milliseconds
+        double time_per_frame = 0.0, scalar_time_per_frame = 0.0;
+        // the sse2 output equals the scalar output
+        bool match = false;
+    };
+private:
+    color_converter_benchmark() = delete;
+public:
+    // converts a synthetic frame to i420 and nv12 and compares the i420 output to
+    // the reference
+    static reference_check_t check_reference(UINT32 width, UINT32 height);
+    // downscales the test image with the filter and returns the psnr of the luma
+    // against the area average reference, in db
+    static double measure_psnr(UINT32 width_in, UINT32 height_in,
+        UINT32 width_out, UINT32 height_out, color_converter_cpu::filter_t);
+    // converts the frames with both paths, scaling them if the sizes differ
+    static result_t run(UINT32 width_in, UINT32 height_in, UINT32 width_out, UINT32 height_out,
+        color_converter_cpu::filter_t, UINT32 frame_count);
+    // runs the checks and the measurements and prints the results
+    static void run_all(const params_t&);
+};
@@ -0,0 +1,558 @@
+#include "color_converter_cpu.h"
+#include "assert.h"
+#include <algorithm>
+#include <execution>
+#include <vector>
+#include <cmath>
+#include <thread>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define COLOR_CONVERTER_CPU_SSE2
+#include <emmintrin.h>
+#endif
+
+#undef min
+#undef max
+
+namespace
+{
+
+// the coefficients are in 2.14 fixed point;
+// the chroma is computed from the [1, 2, 1] filtered sum of two rows,
+// which adds 3 bits to the shift
+constexpr int luma_shift = 14, chroma_shift = luma_shift + 3;
+constexpr int chroma_offset = 128;
+
+struct kernel_t
+{
+    int y_round, uv_round;
+    const short *y_coefs, *u_coefs, *v_coefs;
+
+    BYTE luma(const BYTE* px) const
+    {
+        const int y = (this->y_coefs[0] * px[0] + this->y_coefs[1] * px[1] +
+            this->y_coefs[2] * px[2] + this->y_round) >> luma_shift;
+        return (BYTE)std::clamp(y, 0, 255);
+    }
+
+    // b, g and r are the filtered sums of the chroma sample
+    void chroma(int b, int g, int r, BYTE& u, BYTE& v) const
+    {
+        const int u_ = (this->u_coefs[0] * b + this->u_coefs[1] * g +
+            this->u_coefs[2] * r + this->uv_round) >> chroma_shift;
+        const int v_ = (this->v_coefs[0] * b + this->v_coefs[1] * g +
+            this->v_coefs[2] * r + this->uv_round) >> chroma_shift;
+        u = (BYTE)std::clamp(u_, 0, 255);
+        v = (BYTE)std::clamp(v_, 0, 255);
+    }
+};
+
+#ifdef COLOR_CONVERTER_CPU_SSE2
+struct kernel_sse2_t
+{
+    __m128i y_coefs, u_coefs, v_coefs;
+    __m128i y_round, uv_round;
+
+    explicit kernel_sse2_t(const kernel_t& kernel)
+    {
+        auto coefs = [](const short* c)
+        {
+            return _mm_setr_epi16(c[0], c[1], c[2], 0, c[0], c[1], c[2], 0);
+        };
+        this->y_coefs = coefs(kernel.y_coefs);
+        this->u_coefs = coefs(kernel.u_coefs);
+        this->v_coefs = coefs(kernel.v_coefs);
+        this->y_round = _mm_set1_epi32(kernel.y_round);
+        this->uv_round = _mm_set1_epi32(kernel.uv_round);
+    }
+
+    // returns the unshifted luma of 4 pixels
+    __m128i luma4(const BYTE* src) const
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i px = _mm_loadu_si128((const __m128i*)src);
+
+        // (b*cb + g*cg, r*cr) pairs for each pixel
+        const __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(px, zero), this->y_coefs);
+        const __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(px, zero), this->y_coefs);
+        const __m128i even = _mm_castps_si128(_mm_shuffle_ps(
+            _mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+        const __m128i odd = _mm_castps_si128(_mm_shuffle_ps(
+            _mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+        return _mm_srai_epi32(_mm_add_epi32(_mm_add_epi32(even, odd), this->y_round), luma_shift);
+    }
+
+    void luma16(const BYTE* src, BYTE* dst) const
+    {
+        const __m128i y0 = _mm_packs_epi32(this->luma4(src), this->luma4(src + 16));
+        const __m128i y1 = _mm_packs_epi32(this->luma4(src + 32), this->luma4(src + 48));
+        _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(y0, y1));
+    }
+
+    // returns the 2x2 block sums of 4 pixel columns as (b, g, r, a) 16 bit pairs
+    static __m128i block_sums(const BYTE* row0, const BYTE* row1)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i px0 = _mm_loadu_si128((const __m128i*)row0);
+        const __m128i px1 = _mm_loadu_si128((const __m128i*)row1);
+
+        __m128i lo = _mm_add_epi16(_mm_unpacklo_epi8(px0, zero), _mm_unpacklo_epi8(px1, zero));
+        __m128i hi = _mm_add_epi16(_mm_unpackhi_epi8(px0, zero), _mm_unpackhi_epi8(px1, zero));
+        lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+        hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+        return _mm_unpacklo_epi64(lo, hi);
+    }
+
+    // returns the chroma of the 2 blocks in the lanes 0 and 2
+    static __m128i chroma2(__m128i sums, __m128i coefs)
+    {
+        const __m128i c = _mm_madd_epi16(sums, coefs);
+        return _mm_add_epi32(c, _mm_shuffle_epi32(c, _MM_SHUFFLE(2, 3, 0, 1)));
+    }
+
+    // returns the filtered sums of the 2 chroma samples of 4 pixel columns;
+    // the blocks that start one column to the left add the left and the center column,
+    // which makes the [1, 2, 1] filter; the column left of src must be readable
+    static __m128i chroma_sums(const BYTE* row0, const BYTE* row1)
+    {
+        return _mm_add_epi16(block_sums(row0, row1), block_sums(row0 - 4, row1 - 4));
+    }
+
+    // converts 16 pixel columns to 8 u and 8 v samples
+    void chroma16(const BYTE* row0, const BYTE* row1, __m128i& u, __m128i& v) const
+    {
+        __m128i u4[2], v4[2];
+        for(int i = 0; i < 2; i++)
+        {
+            const __m128i sums0 = chroma_sums(row0 + i * 32, row1 + i * 32);
+            const __m128i sums1 = chroma_sums(row0 + i * 32 + 16, row1 + i * 32 + 16);
+
+            u4[i] = _mm_castps_si128(_mm_shuffle_ps(
+                _mm_castsi128_ps(chroma2(sums0, this->u_coefs)),
+                _mm_castsi128_ps(chroma2(sums1, this->u_coefs)), _MM_SHUFFLE(2, 0, 2, 0)));
+            v4[i] = _mm_castps_si128(_mm_shuffle_ps(
+                _mm_castsi128_ps(chroma2(sums0, this->v_coefs)),
+                _mm_castsi128_ps(chroma2(sums1, this->v_coefs)), _MM_SHUFFLE(2, 0, 2, 0)));
+            u4[i] = _mm_srai_epi32(_mm_add_epi32(u4[i], this->uv_round), chroma_shift);
+            v4[i] = _mm_srai_epi32(_mm_add_epi32(v4[i], this->uv_round), chroma_shift);
+        }
+
+        u = _mm_packs_epi32(u4[0], u4[1]);
+        v = _mm_packs_epi32(v4[0], v4[1]);
+    }
+};
+#endif
+
+// the pixels past the end of the vertically filtered row that the horizontal filter
+// might read with zero weights
+constexpr UINT32 row_padding = 2;
+
+double filter_support(color_converter_cpu::filter_t filter)
+{
+    switch(filter)
+    {
+    case color_converter_cpu::FILTER_BILINEAR:
+        return 1.0;
+    case color_converter_cpu::FILTER_BICUBIC:
+        return 2.0;
+    default:
+        return 3.0;
+    }
+}
+
+double filter_weight(color_converter_cpu::filter_t filter, double x)
+{
+    constexpr double pi = 3.14159265358979323846;
+    x = std::abs(x);
+
+    switch(filter)
+    {
+    case color_converter_cpu::FILTER_BILINEAR:
+        return std::max(0.0, 1.0 - x);
+    case color_converter_cpu::FILTER_BICUBIC:
+    {
+        constexpr double a = -0.5;
+        if(x < 1.0)
+            return ((a + 2.0) * x - (a + 3.0)) * x * x + 1.0;
+        if(x < 2.0)
+            return ((a * x - 5.0 * a) * x + 8.0 * a) * x - 4.0 * a;
+        return 0.0;
+    }
+    default:
+        if(x < 1e-8)
+            return 1.0;
+        if(x >= 3.0)
+            return 0.0;
+        return 3.0 * std::sin(pi * x) * std::sin(pi * x / 3.0) / (pi * pi * x * x);
+    }
+}
+
+// returns the clamped 2.14 fixed point sum of a channel
+BYTE filtered(int sum)
+{
+    return (BYTE)std::clamp((sum + (1 << (luma_shift - 1))) >> luma_shift, 0, 255);
+}
+
+}
+
+color_converter_cpu::color_converter_cpu() :
+    parallel(true), simd(true),
+    y_coefs{}, u_coefs{}, v_coefs{},
+    y_offset(0),
+    width_in(0), height_in(0), width_out(0), height_out(0),
+    scaling(false)
+{
+}
+
+bool color_converter_cpu::is_supported(DXGI_COLOR_SPACE_TYPE color_space)
+{
+    switch(color_space)
+    {
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P709:
+    case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709:
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P601:
+    case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P601:
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_NONE_P709_X601:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void color_converter_cpu::build_filter_table(UINT32 size_in, UINT32 size_out,
+    filter_t filter, filter_table_t& table)
+{
+    // the filter is stretched when downscaling so that it covers all the source pixels
+    const double scale = (double)size_in / size_out;
+    const double filter_scale = std::max(1.0, scale);
+    const double support = filter_support(filter) * filter_scale;
+    const UINT32 taps = std::min((UINT32)std::ceil(support * 2.0) + 1, size_in);
+    std::vector<double> weights(taps);
+
+    table.taps = taps + (taps & 1);
+    table.first.resize(size_out);
+    table.weights.assign((size_t)table.taps * size_out, 0);
+
+    for(UINT32 i = 0; i < size_out; i++)
+    {
+        const double center = (i + 0.5) * scale - 0.5;
+        const int start = (int)std::floor(center - support) + 1;
+        // the taps that fall outside of the source are moved to the edges
+        const int first = std::clamp(start, 0, (int)(size_in - taps));
+
+        std::fill(weights.begin(), weights.end(), 0.0);
+        double sum = 0.0;
+        for(UINT32 k = 0; k < taps; k++)
+        {
+            const int j = start + (int)k;
+            const double weight = filter_weight(filter, (j - center) / filter_scale);
+            weights[std::clamp(j, 0, (int)size_in - 1) - first] += weight;
+            sum += weight;
+        }
+
+        // the rounding error is added to the largest weight
+        short* fixed_weights = &table.weights[(size_t)i * table.taps];
+        int fixed_sum = 0;
+        UINT32 largest = 0;
+        for(UINT32 k = 0; k < taps; k++)
+        {
+            fixed_weights[k] = (short)std::lround(weights[k] / sum * (1 << luma_shift));
+            fixed_sum += fixed_weights[k];
+            if(fixed_weights[k] > fixed_weights[largest])
+                largest = k;
+        }
+        fixed_weights[largest] += (short)((1 << luma_shift) - fixed_sum);
+
+        table.first[i] = (UINT32)first;
+    }
+}
+
+void color_converter_cpu::scale_row(const BYTE* bgra, UINT32 pitch, UINT32 y,
+    BYTE* dst, BYTE* scratch) const
+{
+    const UINT32 row_bytes = this->width_in * 4;
+
+    // filter the source rows vertically to the scratch row;
+    // the padding tap of an odd tap count has a zero weight
+    const short* weights_y = &this->filter_y.weights[(size_t)y * this->filter_y.taps];
+    const UINT32 taps_y = this->filter_y.taps;
+    const BYTE* first_row = bgra + (size_t)this->filter_y.first[y] * pitch;
+    const UINT32 last_tap = this->height_in - 1 - this->filter_y.first[y];
+    auto row = [&](UINT32 k) { return first_row + (size_t)std::min(k, last_tap) * pitch; };
+
+    UINT32 x = 0;
+#ifdef COLOR_CONVERTER_CPU_SSE2
+    if(this->simd)
+    {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i round = _mm_set1_epi32(1 << (luma_shift - 1));
+        for(; x + 16 <= row_bytes; x += 16)
+        {
+            __m128i acc[4] = {zero, zero, zero, zero};
+            for(UINT32 k = 0; k < taps_y; k += 2)
+            {
+                const __m128i w = _mm_set1_epi32(
+                    (int)(((UINT32)(UINT16)weights_y[k + 1] << 16) | (UINT16)weights_y[k]));
+                const __m128i r0 = _mm_loadu_si128((const __m128i*)(row(k) + x));
+                const __m128i r1 = _mm_loadu_si128((const __m128i*)(row(k + 1) + x));
+                const __m128i lo0 = _mm_unpacklo_epi8(r0, zero), lo1 = _mm_unpacklo_epi8(r1, zero);
+                const __m128i hi0 = _mm_unpackhi_epi8(r0, zero), hi1 = _mm_unpackhi_epi8(r1, zero);
+                acc[0] = _mm_add_epi32(acc[0], _mm_madd_epi16(_mm_unpacklo_epi16(lo0, lo1), w));
+                acc[1] = _mm_add_epi32(acc[1], _mm_madd_epi16(_mm_unpackhi_epi16(lo0, lo1), w));
+                acc[2] = _mm_add_epi32(acc[2], _mm_madd_epi16(_mm_unpacklo_epi16(hi0, hi1), w));
+                acc[3] = _mm_add_epi32(acc[3], _mm_madd_epi16(_mm_unpackhi_epi16(hi0, hi1), w));
+            }
+            for(auto& a : acc)
+                a = _mm_srai_epi32(_mm_add_epi32(a, round), luma_shift);
+            _mm_storeu_si128((__m128i*)(scratch + x), _mm_packus_epi16(
+                _mm_packs_epi32(acc[0], acc[1]), _mm_packs_epi32(acc[2], acc[3])));
+        }
+    }
+#endif
+    for(; x < row_bytes; x++)
+    {
+        int sum = 0;
+        for(UINT32 k = 0; k < taps_y; k++)
+            sum += weights_y[k] * row(k)[x];
+        scratch[x] = filtered(sum);
+    }
+
+    // filter the scratch row horizontally to dst
+    for(UINT32 x = 0; x < this->width_out; x++)
+    {
+        const short* weights_x = &this->filter_x.weights[(size_t)x * this->filter_x.taps];
+        const BYTE* src = scratch + (size_t)this->filter_x.first[x] * 4;
+#ifdef COLOR_CONVERTER_CPU_SSE2
+        if(this->simd)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i acc = zero;
+            for(UINT32 k = 0; k < this->filter_x.taps; k += 2)
+            {
+                // (b0, b1, g0, g1, r0, r1, a0, a1) pairs for the two taps
+                const __m128i w = _mm_set1_epi32(
+                    (int)(((UINT32)(UINT16)weights_x[k + 1] << 16) | (UINT16)weights_x[k]));
+                const __m128i px = _mm_unpacklo_epi8(
+                    _mm_loadl_epi64((const __m128i*)(src + k * 4)), zero);
+                acc = _mm_add_epi32(acc,
+                    _mm_madd_epi16(_mm_unpacklo_epi16(px, _mm_srli_si128(px, 8)), w));
+            }
+            acc = _mm_srai_epi32(
+                _mm_add_epi32(acc, _mm_set1_epi32(1 << (luma_shift - 1))), luma_shift);
+            acc = _mm_packs_epi32(acc, acc);
+            *(UINT32*)(dst + (size_t)x * 4) =
+                (UINT32)_mm_cvtsi128_si32(_mm_packus_epi16(acc, acc));
+            continue;
+        }
+#endif
+        for(UINT32 c = 0; c < 4; c++)
+        {
+            int sum = 0;
+            for(UINT32 k = 0; k < this->filter_x.taps; k++)
+                sum += weights_x[k] * src[k * 4 + c];
+            dst[(size_t)x * 4 + c] = filtered(sum);
+        }
+    }
+}
+
+void color_converter_cpu::initialize(DXGI_COLOR_SPACE_TYPE color_space,
+    UINT32 width_in, UINT32 height_in, UINT32 width_out, UINT32 height_out,
+    filter_t filter, bool parallel, bool simd)
+{
+    double kr, kb;
+    bool full_range;
+
+    switch(color_space)
+    {
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P709:
+        kr = 0.2126; kb = 0.0722; full_range = true;
+        break;
+    case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709:
+        kr = 0.2126; kb = 0.0722; full_range = false;
+        break;
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P601:
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_NONE_P709_X601:
+        kr = 0.299; kb = 0.114; full_range = true;
+        break;
+    case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P601:
+        kr = 0.299; kb = 0.114; full_range = false;
+        break;
+    default:
+        throw HR_EXCEPTION(E_INVALIDARG);
+    }
+
+    this->parallel = parallel;
+    this->simd = simd;
+    this->width_in = width_in;
+    this->height_in = height_in;
+    this->width_out = width_out;
+    this->height_out = height_out;
+    this->scaling = (width_in != width_out || height_in != height_out);
+    if(this->scaling)
+    {
+        build_filter_table(width_in, width_out, filter, this->filter_x);
+        build_filter_table(height_in, height_out, filter, this->filter_y);
+    }
+
+    // the studio range maps the luma to 16-235 and the chroma to 16-240
+    const double kg = 1.0 - kr - kb;
+    const double y_scale = full_range ? 1.0 : 219.0 / 255.0;
+    const double uv_scale = full_range ? 1.0 : 224.0 / 255.0;
+    const double one = (double)(1 << luma_shift);
+    auto to_fixed = [&](double c) { return (short)std::lround(c * one); };
+
+    this->y_offset = full_range ? 0 : 16;
+    this->y_coefs[0] = to_fixed(kb * y_scale);
+    this->y_coefs[1] = to_fixed(kg * y_scale);
+    this->y_coefs[2] = to_fixed(kr * y_scale);
+    // u = (b - y) / (2 * (1 - kb)), v = (r - y) / (2 * (1 - kr))
+    this->u_coefs[0] = to_fixed(0.5 * uv_scale);
+    this->u_coefs[1] = to_fixed(-kg / (2.0 * (1.0 - kb)) * uv_scale);
+    this->u_coefs[2] = to_fixed(-kr / (2.0 * (1.0 - kb)) * uv_scale);
+    this->v_coefs[0] = to_fixed(-kb / (2.0 * (1.0 - kr)) * uv_scale);
+    this->v_coefs[1] = to_fixed(-kg / (2.0 * (1.0 - kr)) * uv_scale);
+    this->v_coefs[2] = to_fixed(0.5 * uv_scale);
+}
+
+void color_converter_cpu::convert(const BYTE* bgra, UINT32 pitch,
+    format_t format, const planes_t& planes, std::atomic_uint64_t* worker_cycles) const
+{
+    kernel_t kernel;
+    kernel.y_round = (this->y_offset << luma_shift) + (1 << (luma_shift - 1));
+    kernel.uv_round = (chroma_offset << chroma_shift) + (1 << (chroma_shift - 1));
+    kernel.y_coefs = this->y_coefs;
+    kernel.u_coefs = this->u_coefs;
+    kernel.v_coefs = this->v_coefs;
+#ifdef COLOR_CONVERTER_CPU_SSE2
+    const kernel_sse2_t kernel_sse2(kernel);
+#endif
+
+    const bool nv12 = (format == FORMAT_NV12);
+    const UINT32 width = this->width_out, height = this->height_out;
+
+    // converts the chroma rows and their two luma rows;
+    // the chroma is sited at the even columns and filtered with [1, 2, 1] horizontally,
+    // and sited between the two rows vertically;
+    // the edge rows and columns are repeated;
+    // the scaled rows are converted directly so that the scaled image isn't stored
+    auto convert_rows = [&](UINT32 cy_begin, UINT32 cy_end)
+    {
+        std::vector<BYTE> scratch, scaled;
+        if(this->scaling)
+        {
+            scratch.resize(((size_t)this->width_in + row_padding) * 4);
+            scaled.resize((size_t)width * 4 * 2);
+        }
+
+        for(UINT32 cy = cy_begin; cy < cy_end; cy++)
+        {
+            const UINT32 y = cy * 2;
+            const bool second_row = (y + 1 < height);
+            const BYTE* src0 = this->scaling ? scaled.data() : bgra + (size_t)y * pitch;
+            UINT32 src_pitch = pitch;
+            if(this->scaling)
+            {
+                src_pitch = width * 4;
+                this->scale_row(bgra, pitch, y, scaled.data(), scratch.data());
+                if(second_row)
+                    this->scale_row(bgra, pitch, y + 1, scaled.data() + src_pitch,
+                        scratch.data());
+            }
+            const BYTE* src1 = second_row ? src0 + src_pitch : src0;
+            BYTE* dst_y0 = planes.y + (size_t)y * planes.y_pitch;
+            BYTE* dst_y1 = dst_y0 + planes.y_pitch;
+            BYTE* dst_u = planes.u + (size_t)cy * planes.u_pitch;
+            BYTE* dst_v = nv12 ? NULL : planes.v + (size_t)cy * planes.v_pitch;
+
+            // converts the columns x and x + 1
+            auto convert_pair = [&](UINT32 x)
+            {
+                const UINT32 x0 = x ? x - 1 : 0, x1 = std::min(x + 1, width - 1);
+                const BYTE* p0 = src0 + x * 4, * p0l = src0 + x0 * 4, * p0r = src0 + x1 * 4;
+                const BYTE* p1 = src1 + x * 4, * p1l = src1 + x0 * 4, * p1r = src1 + x1 * 4;
+
+                dst_y0[x] = kernel.luma(p0);
+                if(x1 != x)
+                    dst_y0[x1] = kernel.luma(p0r);
+                if(second_row)
+                {
+                    dst_y1[x] = kernel.luma(p1);
+                    if(x1 != x)
+                        dst_y1[x1] = kernel.luma(p1r);
+                }
+
+                int sums[3];
+                for(int c = 0; c < 3; c++)
+                    sums[c] = p0l[c] + p1l[c] + 2 * (p0[c] + p1[c]) + p0r[c] + p1r[c];
+
+                BYTE u, v;
+                kernel.chroma(sums[0], sums[1], sums[2], u, v);
+                if(nv12)
+                {
+                    dst_u[x] = u;
+                    dst_u[x + 1] = v;
+                }
+                else
+                {
+                    dst_u[x / 2] = u;
+                    dst_v[x / 2] = v;
+                }
+            };
+
+            UINT32 x = 0;
+#ifdef COLOR_CONVERTER_CPU_SSE2
+            if(this->simd && width > 16)
+            {
+                // the vector path reads the column left of the first chroma sample,
+                // so it starts after the first pair
+                convert_pair(0);
+                for(x = 2; x + 16 <= width; x += 16)
+                {
+                    kernel_sse2.luma16(src0 + x * 4, dst_y0 + x);
+                    if(second_row)
+                        kernel_sse2.luma16(src1 + x * 4, dst_y1 + x);
+
+                    __m128i u, v;
+                    kernel_sse2.chroma16(src0 + x * 4, src1 + x * 4, u, v);
+                    const __m128i uv = _mm_packus_epi16(u, v);
+                    if(nv12)
+                        _mm_storeu_si128((__m128i*)(dst_u + x),
+                            _mm_unpacklo_epi8(uv, _mm_srli_si128(uv, 8)));
+                    else
+                    {
+                        _mm_storel_epi64((__m128i*)(dst_u + x / 2), uv);
+                        _mm_storel_epi64((__m128i*)(dst_v + x / 2), _mm_srli_si128(uv, 8));
+                    }
+                }
+            }
+#endif
+            for(; x < width; x += 2)
+                convert_pair(x);
+        }
+    };
+
+    const UINT32 chroma_height = (height + 1) / 2;
+    if(!this->parallel)
+    {
+        convert_rows(0, chroma_height);
+        return;
+    }
+
+    // the bands write to disjoint rows
+    std::vector<UINT32> bands;
+    for(UINT32 cy = 0; cy < chroma_height; cy += band_height / 2)
+        bands.push_back(cy);
+    const std::thread::id calling_thread = std::this_thread::get_id();
+    std::for_each(std::execution::par, bands.begin(), bands.end(), [&](UINT32 cy)
+        {
+            ULONG64 begin = 0, end = 0;
+            const bool measure = worker_cycles && std::this_thread::get_id() != calling_thread;
+            if(measure)
+                QueryThreadCycleTime(GetCurrentThread(), &begin);
+
+            convert_rows(cy, std::min(cy + band_height / 2, chroma_height));
+
+            if(measure && QueryThreadCycleTime(GetCurrentThread(), &end) && end > begin)
+                *worker_cycles += end - begin;
+        });
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <d3d11.h>
+#include <Windows.h>
+#include <vector>
+#include <atomic>
+
+// cpu implementation of the bgra to yuv 4:2:0 conversion of transform_color_converter;
+// the alpha channel of the source is ignored;
+// the chroma is left sited like in the supported color spaces, which means that
+// it is co-sited with the even luma columns and sited between the two luma rows;
+// the _NONE_ color space doesn't define the siting and is converted in the same way;
+// the source is optionally scaled in the same pass with a separable filter
+
+class color_converter_cpu
+{
+public:
+    // the rows are converted in bands of this height;
+    // the bands are processed in parallel
+    static const UINT32 band_height = 32;
+
+    enum format_t
+    {
+        // interleaved uv plane
+        FORMAT_NV12,
+        // separate u and v planes
+        FORMAT_I420
+    };
+
+    enum filter_t : int
+    {
+        FILTER_BILINEAR,
+        // catmull-rom
+        FILTER_BICUBIC,
+        FILTER_LANCZOS3
+    };
+
+    // the nv12 format uses only the u plane
+    struct planes_t
+    {
+        BYTE *y, *u, *v;
+        UINT32 y_pitch, u_pitch, v_pitch;
+    };
+private:
+    // the filter weights of each output pixel along one axis;
+    // the taps of an output pixel are contiguous and start at first
+    struct filter_table_t
+    {
+        // the tap count is even so that the taps can be processed in pairs
+        UINT32 taps;
+        std::vector<UINT32> first;
+        // 2.14 fixed point weights that sum to one; taps * output size
+        std::vector<short> weights;
+    };
+
+    bool parallel, simd;
+    // the b, g and r coefficients in 2.14 fixed point
+    short y_coefs[3], u_coefs[3], v_coefs[3];
+    int y_offset;
+
+    UINT32 width_in, height_in, width_out, height_out;
+    bool scaling;
+    filter_table_t filter_x, filter_y;
+
+    static void build_filter_table(UINT32 size_in, UINT32 size_out, filter_t, filter_table_t&);
+    // scales the output row y to dst
+    void scale_row(const BYTE* bgra, UINT32 pitch, UINT32 y, BYTE* dst, BYTE* scratch) const;
+public:
+    color_converter_cpu();
+
+    // returns true for the bt.601 and bt.709 matrices in full and studio range
+    static bool is_supported(DXGI_COLOR_SPACE_TYPE);
+
+    // throws if the color space isn't supported;
+    // the filter is used if the input and output sizes differ;
+    // parallel enables row parallel conversion;
+    // simd enables the sse2 path if it is built, otherwise the scalar path is used;
+    // both paths produce the same output
+    void initialize(DXGI_COLOR_SPACE_TYPE,
+        UINT32 width_in, UINT32 height_in, UINT32 width_out, UINT32 height_out,
+        filter_t = FILTER_BICUBIC, bool parallel = true, bool simd = true);
+
+    // the source is width_in by height_in pixels;
+    // the chroma planes are (width_out + 1) / 2 by (height_out + 1) / 2 samples;
+    // the cpu cycles that the bands spend on other threads than the calling thread
+    // are added to worker_cycles if it is not null
+    void convert(const BYTE* bgra, UINT32 pitch, format_t, const planes_t&,
+        std::atomic_uint64_t* worker_cycles = nullptr) const;
+};
@@ -0,0 +1,311 @@
+#include "compositor_benchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include "assert.h"
+
+#undef min
+#undef max
+
+namespace
+{
+
+struct image_t
+{
+    std::vector<UINT32> pixels;
+    videomixer_cpu_image view;
+};
+
+// fills the image with a pattern that differs for each seed;
+// the colors are premultiplied by the alpha
+void create_image(image_t& image, UINT32 width, UINT32 height, UINT32 seed, UINT32 alpha = 0xff)
+{
+    image.pixels.resize((size_t)width * height);
+    for(UINT32 y = 0; y < height; y++)
+        for(UINT32 x = 0; x < width; x++)
+        {
+            const UINT32 r = ((x + seed * 37) & 0xff) * alpha / 0xff,
+                g = ((y + seed * 11) & 0xff) * alpha / 0xff,
+                b = (((x ^ y) + seed * 5) & 0xff) * alpha / 0xff;
+            image.pixels[(size_t)y * width + x] = (alpha << 24) | (r << 16) | (g << 8) | b;
+        }
+
+    image.view.data = (BYTE*)image.pixels.data();
+    image.view.width = width;
+    image.view.height = height;
+    image.view.pitch = width * sizeof(UINT32);
+}
+
+// stretches the source to the destination rectangle of the canvas;
+// a rotated layer is rotated around the center of the destination and clipped by
+// the rotated destination
+videomixer_cpu_layer make_layer(const videomixer_cpu_image& source, const D2D1_RECT_F& dest,
+    FLOAT angle = 0.f)
+{
+    const D2D1::Matrix3x2F rotation = D2D1::Matrix3x2F::Rotation(angle, D2D1::Point2F(
+        (dest.left + dest.right) / 2.f, (dest.top + dest.bottom) / 2.f));
+
+    videomixer_cpu_layer layer = {};
+    layer.source = source;
+    layer.source_rect = D2D1::RectF(0.f, 0.f, (FLOAT)source.width, (FLOAT)source.height);
+    layer.brush = D2D1::Matrix3x2F::Identity();
+    layer.world =
+        D2D1::Matrix3x2F::Scale(D2D1::SizeF(
+            (dest.right - dest.left) / source.width, (dest.bottom - dest.top) / source.height)) *
+        D2D1::Matrix3x2F::Translation(dest.left, dest.top) * rotation;
+    layer.clip_rect = dest;
+    layer.clip_m = rotation;
+    layer.axis_aligned_clip = angle == 0.f;
+    return layer;
+}
+
+// the bounds of the layer extended by a pixel, the same way the videomixer computes
+// the dirty rects
+RECT get_dirty_rect(const videomixer_cpu_layer& layer, UINT32 width, UINT32 height)
+{
+    const D2D1_RECT_F bounds = videomixer_cpu_compositor::get_bounds(layer);
+    RECT rect;
+    rect.left = std::max((LONG)std::floor(bounds.left) - 1, 0L);
+    rect.top = std::max((LONG)std::floor(bounds.top) - 1, 0L);
+    rect.right = std::min((LONG)std::ceil(bounds.right) + 1, (LONG)width);
+    rect.bottom = std::min((LONG)std::ceil(bounds.bottom) + 1, (LONG)height);
+    return rect;
+}
+
+// the mask of the first cores of the process mask;
+// 0 if the process mask has fewer cores
+DWORD_PTR get_core_mask(DWORD_PTR process_mask, UINT32 core_count)
+{
+    DWORD_PTR mask = 0;
+    for(DWORD_PTR bit = 1; bit && core_count; bit <<= 1)
+        if(process_mask & bit)
+        {
+            mask |= bit;
+            core_count--;
+        }
+    return core_count ? 0 : mask;
+}
+
+bool equal(const videomixer_cpu_image& a, const videomixer_cpu_image& b)
+{
+    for(UINT32 y = 0; y < a.height; y++)
+        if(std::memcmp(a.data + (size_t)y * a.pitch, b.data + (size_t)y * b.pitch,
+            a.width * sizeof(UINT32)) != 0)
+            return false;
+    return true;
+}
+
+}
+
+compositor_benchmark::result_t compositor_benchmark::run_desktop_webcam(
+    const params_t& params, bool dirty_rects)
+{
+    typedef std::chrono::steady_clock steady_clock;
+
+    videomixer_cpu_compositor compositor;
+    image_t canvas, reference, desktop, webcam[webcam_period];
+    std::vector<videomixer_cpu_layer> layers;
+    result_t result;
+
+    compositor.initialize();
+    create_image(canvas, params.width, params.height, 0);
+    create_image(reference, params.width, params.height, 0);
+    create_image(desktop, params.width, params.height, 1);
+    for(UINT32 i = 0; i < webcam_period; i++)
+        create_image(webcam[i], webcam_width, webcam_height, i + 2);
+
+    // the webcam covers a sixteenth of the canvas at the bottom right corner
+    const FLOAT width = (FLOAT)params.width, height = (FLOAT)params.height;
+    const D2D1_RECT_F webcam_dest = D2D1::RectF(
+        width * 0.73f, height * 0.73f, width * 0.98f, height * 0.98f);
+    layers.push_back(make_layer(desktop.view, D2D1::RectF(0.f, 0.f, width, height)));
+    layers.push_back(make_layer(webcam[0].view, webcam_dest));
+
+    const RECT canvas_rect = {0, 0, (LONG)params.width, (LONG)params.height};
+    const RECT webcam_rect = get_dirty_rect(layers.back(), params.width, params.height);
+    const std::vector<RECT> rects(1, dirty_rects ? webcam_rect : canvas_rect);
+
+    // the first frame is always composed fully
+    compositor.compose(canvas.view, layers, std::vector<RECT>(1, canvas_rect));
+
+    const steady_clock::time_point start = steady_clock::now();
+    for(UINT32 i = 0; i < params.frame_count; i++)
+    {
+        layers.back().source = webcam[(i + 1) % webcam_period].view;
+        compositor.compose(canvas.view, layers, rects);
+    }
+    const double elapsed =
+        std::chrono::duration<double>(steady_clock::now() - start).count();
+
+    compositor.compose(reference.view, layers, std::vector<RECT>(1, canvas_rect));
+
+    const double rect_area = (double)(rects[0].right - rects[0].left) *
+        (rects[0].bottom - rects[0].top);
+    result.frames = params.frame_count;
+    result.fps = elapsed > 0.0 ? params.frame_count / elapsed : 0.0;
+    result.time_per_frame = params.frame_count ? elapsed * 1000.0 / params.frame_count : 0.0;
+    result.composed_area = rect_area * 100.0 / ((double)params.width * params.height);
+    result.match = equal(canvas.view, reference.view);
+    return result;
+}
+
+compositor_benchmark::result_t compositor_benchmark::run_layers(
+    UINT32 width, UINT32 height, UINT32 layer_count, UINT32 frame_count)
+{
+    typedef std::chrono::steady_clock steady_clock;
+
+    videomixer_cpu_compositor compositor, serial_compositor;
+    image_t canvas, reference, background, overlays[webcam_period];
+    std::vector<videomixer_cpu_layer> layers;
+    result_t result;
+
+    compositor.initialize();
+    serial_compositor.initialize(false);
+    create_image(canvas, width, height, 0);
+    create_image(reference, width, height, 0);
+    create_image(background, width, height, 1);
+    for(UINT32 i = 0; i < webcam_period; i++)
+        create_image(overlays[i], webcam_width, webcam_height, i + 2, 0xc0);
+
+    // the overlays are placed on a 4x4 grid over the background;
+    // the cells overlap their neighbours by a quarter
+    const FLOAT cell_width = width / 4.f, cell_height = height / 4.f;
+    layers.push_back(make_layer(background.view,
+        D2D1::RectF(0.f, 0.f, (FLOAT)width, (FLOAT)height)));
+    for(UINT32 i = 1; i < layer_count; i++)
+    {
+        const FLOAT left = ((i - 1) % 4) * cell_width, top = ((i - 1) / 4 % 4) * cell_height;
+        layers.push_back(make_layer(overlays[i % webcam_period].view,
+            D2D1::RectF(left, top, left + cell_width * 1.25f, top + cell_height * 1.25f),
+            (i % 3) ? 0.f : 15.f));
+    }
+
+    const std::vector<RECT> rects(1, RECT{0, 0, (LONG)width, (LONG)height});
+    compositor.compose(canvas.view, layers, rects);
+
+    const steady_clock::time_point start = steady_clock::now();
+    for(UINT32 i = 0; i < frame_count; i++)
+    {
+        for(UINT32 j = 1; j < layer_count; j++)
+            layers[j].source = overlays[(i + j) % webcam_period].view;
+        compositor.compose(canvas.view, layers, rects);
+    }
+    const double elapsed =
+        std::chrono::duration<double>(steady_clock::now() - start).count();
+
+    serial_compositor.compose(reference.view, layers, rects);
+
+    result.frames = frame_count;
+    result.fps = elapsed > 0.0 ? frame_count / elapsed : 0.0;
+    result.time_per_frame = frame_count ? elapsed * 1000.0 / frame_count : 0.0;
+    result.composed_area = 100.0;
+    result.match = equal(canvas.view, reference.view);
+    return result;
+}
+
+compositor_benchmark::result_t compositor_benchmark::run_cores(UINT32 width, UINT32 height,
+    UINT32 layer_count, UINT32 core_count, UINT32 frame_count)
+{
+    const HANDLE process = GetCurrentProcess();
+    DWORD_PTR process_mask, system_mask;
+    if(!GetProcessAffinityMask(process, &process_mask, &system_mask))
+        throw HR_EXCEPTION(HRESULT_FROM_WIN32(GetLastError()));
+
+    const DWORD_PTR mask = get_core_mask(process_mask, core_count);
+    if(!mask)
+        throw HR_EXCEPTION(E_INVALIDARG);
+    if(!SetProcessAffinityMask(process, mask))
+        throw HR_EXCEPTION(HRESULT_FROM_WIN32(GetLastError()));
+
+    result_t result;
+    try
+    {
+        result = run_layers(width, height, layer_count, frame_count);
+    }
+    catch(...)
+    {
+        SetProcessAffinityMask(process, process_mask);
+        throw;
+    }
+
+    SetProcessAffinityMask(process, process_mask);
+    return result;
+}
+
+void compositor_benchmark::run_all(const params_t& params)
+{
+    std::cout << "compositor benchmark: " << params.width << "x" << params.height << ", " <<
+        params.frame_count << " frames" << std::endl;
+    std::cout << "desktop and webcam scene" << std::endl;
+    std::cout << "compose         fps  ms/frame  area%  match" << std::endl;
+
+    auto print = [](const char* name, const result_t& result)
+    {
+        std::cout << std::left << std::setw(12) << name << std::right <<
+            std::fixed << std::setprecision(1) <<
+            std::setw(7) << result.fps <<
+            std::setw(10) << std::setprecision(3) << result.time_per_frame <<
+            std::setw(7) << std::setprecision(1) << result.composed_area <<
+            std::setw(7) << (result.match ? "yes" : "NO") << std::endl;
+    };
+
+    const result_t full = run_desktop_webcam(params, false);
+    const result_t dirty = run_desktop_webcam(params, true);
+    print("full", full);
+    print("dirty rects", dirty);
+    if(dirty.time_per_frame > 0.0)
+        std::cout << "dirty rects speedup " << std::setprecision(2) <<
+            full.time_per_frame / dirty.time_per_frame << "x" << std::endl;
+
+    std::cout << "layer sweep, " << params.sweep_frame_count << " frames" << std::endl;
+    std::cout << "canvas     layers    fps  ms/frame  match" << std::endl;
+    const UINT32 sizes[][2] = {{1920, 1080}, {3840, 2160}};
+    for(const auto& size : sizes)
+        for(UINT32 layer_count = 1; layer_count <= max_layers; layer_count *= 2)
+        {
+            const result_t result =
+                run_layers(size[0], size[1], layer_count, params.sweep_frame_count);
+            std::cout << std::left << std::setw(10) <<
+                (std::to_string(size[0]) + "x" + std::to_string(size[1])) << std::right <<
+                std::setw(7) << layer_count <<
+                std::fixed << std::setprecision(1) <<
+                std::setw(7) << result.fps <<
+                std::setw(10) << std::setprecision(3) << result.time_per_frame <<
+                std::setw(7) << (result.match ? "yes" : "NO") << std::endl;
+        }
+
+    const UINT32 core_layers = 8;
+    std::cout << "core sweep, 3840x2160 with " << core_layers << " layers, " <<
+        params.sweep_frame_count << " frames" << std::endl;
+    std::cout << "cores    fps  ms/frame  speedup  efficiency%  match" << std::endl;
+    double single_core_time = 0.0;
+    for(UINT32 core_count = 1; core_count <= max_cores; core_count *= 2)
+    {
+        result_t result;
+        try
+        {
+            result = run_cores(3840, 2160, core_layers, core_count, params.sweep_frame_count);
+        }
+        catch(streaming::exception)
+        {
+            // the process has fewer cores or its affinity can't be set
+            break;
+        }
+
+        if(core_count == 1)
+            single_core_time = result.time_per_frame;
+        const double speedup =
+            result.time_per_frame > 0.0 ? single_core_time / result.time_per_frame : 0.0;
+        std::cout << std::setw(5) << core_count <<
+            std::fixed << std::setprecision(1) <<
+            std::setw(7) << result.fps <<
+            std::setw(10) << std::setprecision(3) << result.time_per_frame <<
+            std::setw(9) << std::setprecision(2) << speedup <<
+            std::setw(13) << std::setprecision(1) << speedup * 100.0 / core_count <<
+            std::setw(7) << (result.match ? "yes" : "NO") << std::endl;
+    }
+}
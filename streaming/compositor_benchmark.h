@@ -0,0 +1,72 @@
+#pragma once
+
+#include "videomixer_cpu_compositor.h"
+#include <vector>
+
+/*
+
+headless benchmark of the cpu compositor of the videomixer;
+the scenes are composed from synthetic images that are generated before the measurement starts;
+the desktop and webcam scene is a static desktop layer that covers the canvas and
+a webcam layer that changes every frame, which is the common case of a screen capture with
+a camera overlay;
+the scene is composed both fully and only in the dirty rect of the webcam layer, which is how
+the videomixer composes it, and the composite of the dirty rect is checked against
+the full composite;
+the layer sweep composes a background with up to 15 translucent overlays that change every
+frame at 1080p and 4k, of which every third is rotated and clipped by its rotated rectangle,
+and checks the parallel composite against a serial one;
+the core sweep composes the 4k scene of the layer sweep with 8 layers on 1 to 16 cores,
+which are selected by the affinity mask of the process, because the parallel algorithms
+that the compositor uses don't take a thread count
+
+*/
+
+class compositor_benchmark
+{
+public:
+    struct params_t
+    {
+        UINT32 width = 1920, height = 1080;
+        UINT32 frame_count = 300;
+        // the number of frames of each point of the sweeps
+        UINT32 sweep_frame_count = 60;
+    };
+
+    struct result_t
+    {
+        UINT32 frames = 0;
+        double fps = 0.0;
+        // in milliseconds
+        double time_per_frame = 0.0;
+        // the composed area per frame, in percent of the canvas
+        double composed_area = 0.0;
+        // the last composite equals the full composite of the last frame,
+        // or the serial composite in the layer sweep
+        bool match = false;
+    };
+
+    // the size of the webcam source and the number of distinct webcam frames
+    static const UINT32 webcam_width = 640, webcam_height = 360;
+    static const UINT32 webcam_period = 8;
+    // the largest layer count of the layer sweep
+    static const UINT32 max_layers = 16;
+    // the largest core count of the core sweep
+    static const UINT32 max_cores = 16;
+private:
+    compositor_benchmark() = delete;
+public:
+    // composes the desktop and webcam scene;
+    // dirty_rects limits the composition of each frame to the bounds of the webcam layer
+    static result_t run_desktop_webcam(const params_t&, bool dirty_rects);
+    // composes the whole canvas of the background and the overlays of the layer sweep
+    static result_t run_layers(UINT32 width, UINT32 height, UINT32 layer_count,
+        UINT32 frame_count);
+    // runs the layer scene on the first cores of the affinity mask of the process;
+    // the affinity mask is restored afterwards;
+    // throws if the process doesn't have enough cores
+    static result_t run_cores(UINT32 width, UINT32 height, UINT32 layer_count,
+        UINT32 core_count, UINT32 frame_count);
+    // runs the scenes and prints the results
+    static void run_all(const params_t&);
+};
@@ -18,8 +18,10 @@
 #endif
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
+#undef min
+#undef max
 
-std::wstring control_output_config::create_file_path() const
+std::wstring control_output_config::create_file_path(const std::wstring_view& suffix) const
 {
     try
     {
@@ -29,6 +31,12 @@ std::wstring control_output_config::create_file_path() const
         // add a directory separator
         path /= L"";
         path.replace_filename(this->output_filename);
+        if(!suffix.empty())
+        {
+            std::wstring stem = path.stem();
+            stem += suffix;
+            path.replace_filename(stem);
+        }
         path.replace_extension(extension);
 
         if(!this->overwrite_old_file)
@@ -54,6 +62,62 @@ std::wstring control_output_config::create_file_path() const
 }
 
 
+frame_unit control_latency_config::get_audio_pull_periodicity() const
+{
+    switch(this->profile)
+    {
+    case LATENCY_PROFILE_LOW:
+        return 512;
+    case LATENCY_PROFILE_MONITORING:
+        return 128;
+    default:
+        return AUDIO_DEFAULT_PULL_PERIODICITY;
+    }
+}
+
+time_unit control_latency_config::get_video_buffering_latency() const
+{
+    switch(this->profile)
+    {
+    case LATENCY_PROFILE_LOW:
+        return SECOND_IN_TIME_UNIT / 5;
+    case LATENCY_PROFILE_MONITORING:
+        return SECOND_IN_TIME_UNIT / 10;
+    default:
+        return BUFFERING_DEFAULT_VIDEO_LATENCY;
+    }
+}
+
+time_unit control_latency_config::get_audio_buffering_latency() const
+{
+    // wasapi source captures in 40ms intervals
+    switch(this->profile)
+    {
+    case LATENCY_PROFILE_LOW:
+        return SECOND_IN_TIME_UNIT / 5;
+    case LATENCY_PROFILE_MONITORING:
+        return SECOND_IN_TIME_UNIT / 10;
+    default:
+        return BUFFERING_DEFAULT_AUDIO_LATENCY;
+    }
+}
+
+void control_canvas_config::get_canvas_size(const control_video_config& config_video,
+    UINT32& width, UINT32& height) const
+{
+    if(this->width_canvas && this->height_canvas)
+    {
+        width = this->width_canvas;
+        height = this->height_canvas;
+    }
+    else
+    {
+        width = config_video.width_frame;
+        height = config_video.height_frame;
+    }
+}
+
+
 /////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////
@@ -164,9 +228,9 @@ void control_pipeline::activate_components()
         this->audio_session.reset(new media_session(this->time_source,
             this->get_current_config().config_audio.sample_rate, 1));
 
-    // must be called after resetting the video session
-    frame_unit fps_num, fps_den;
-    this->get_session_frame_rate(fps_num, fps_den);
+    UINT32 canvas_width, canvas_height;
+    this->get_current_config().config_canvas.get_canvas_size(
+        this->get_current_config().config_video, canvas_width, canvas_height);
 
     // create videoprocessor transform
     if(!this->videomixer_transform ||
@@ -175,9 +239,9 @@ void control_pipeline::activate_components()
         transform_videomixer_t videomixer_transform(new transform_videomixer(this->session,
             this->context_mutex));
         videomixer_transform->initialize(this->shared_from_this<control_class>(),
-            this->get_current_config().config_video.width_frame,
-            this->get_current_config().config_video.height_frame,
-            this->d2d1factory, this->d2d1dev, this->d3d11dev, this->devctx);
+            canvas_width, canvas_height,
+            this->d2d1factory, this->d2d1dev, this->d3d11dev, this->devctx,
+            this->get_current_config().config_videomixer.compositor);
 
         this->videomixer_transform = videomixer_transform;
     }
@@ -186,96 +250,67 @@ void control_pipeline::activate_components()
     if(this->recording && (!this->h264_encoder_transform ||
         this->h264_encoder_transform->get_instance_type() == media_component::INSTANCE_NOT_SHAREABLE))
     {
-        // TODO: activating the encoder might fail for random reasons,
-        // so notify if the primary encoder cannot be used and use the software encoder as a
-        // fallback
-        // (signature error during activate call was fixed by a reboot)
-        transform_h264_encoder_t h264_encoder_transform;
-        try
-        {
-            h264_encoder_transform.reset(new transform_h264_encoder(
-                this->session, this->context_mutex));
-            h264_encoder_transform->initialize(this->shared_from_this<control_class>(),
-                this->d3d11dev, 
-                (UINT32)fps_num, (UINT32)fps_den,
-                this->get_current_config().config_video.width_frame,
-                this->get_current_config().config_video.height_frame,
-                this->get_current_config().config_video.bitrate * 1000,
-                this->get_current_config().config_video.quality_vs_speed,
-                this->get_current_config().config_video.h264_video_profile,
-                this->get_current_config().config_video.color_space,
-                this->get_current_config().config_video.encoder_use_default ? nullptr :
-                    &this->get_current_config().config_video.encoder,
-                false);
-        }
-        catch(streaming::exception err)
-        {
-            std::cout << "EXCEPTION THROWN: " << err.what() << std::flush;
-            std::cout << "using system ram for hardware video encoder" << std::endl;
-
-            try
-            {
-                // try to initialize the h264 encoder without utilizing vram
-                h264_encoder_transform.reset(new transform_h264_encoder(
-                    this->session, this->context_mutex));
-                h264_encoder_transform->initialize(this->shared_from_this<control_class>(),
-                    nullptr, (UINT32)fps_num, (UINT32)fps_den,
-                    this->get_current_config().config_video.width_frame,
-                    this->get_current_config().config_video.height_frame,
-                    this->get_current_config().config_video.bitrate * 1000,
-                    this->get_current_config().config_video.quality_vs_speed,
-                    this->get_current_config().config_video.h264_video_profile,
-                    this->get_current_config().config_video.color_space,
-                    this->get_current_config().config_video.encoder_use_default ? nullptr :
-                        &this->get_current_config().config_video.encoder,
-                    false);
-            }
-            catch(streaming::exception err)
-            {
-                std::cout << "EXCEPTION THROWN: " << err.what() << std::flush;
-                std::cout << "using software encoder" << std::endl;
-
-                // use software encoder;
-                // activate function will catch the failure of this
-                h264_encoder_transform.reset(new transform_h264_encoder(
-                    this->session, this->context_mutex));
-                h264_encoder_transform->initialize(this->shared_from_this<control_class>(),
-                    nullptr, (UINT32)fps_num, (UINT32)fps_den, 
-                    this->get_current_config().config_video.width_frame,
-                    this->get_current_config().config_video.height_frame,
-                    this->get_current_config().config_video.bitrate * 1000,
-                    this->get_current_config().config_video.quality_vs_speed,
-                    this->get_current_config().config_video.h264_video_profile,
-                    this->get_current_config().config_video.color_space,
-                    this->get_current_config().config_video.encoder_use_default ? nullptr :
-                        &this->get_current_config().config_video.encoder,
-                    true);
-            }
-        }
-
-        this->h264_encoder_transform = h264_encoder_transform;
+        this->h264_encoder_transform = this->create_h264_encoder(
+            this->get_current_config().config_video.width_frame,
+            this->get_current_config().config_video.height_frame,
+            this->get_current_config().config_video.bitrate);
     }
     else if(!this->recording)
         this->h264_encoder_transform = nullptr;
 
     // create color converter transform
     if(this->recording && (!this->color_converter_transform ||
-        this->color_converter_transform->get_instance_type() == media_component::INSTANCE_NOT_SHAREABLE))
+        this->color_converter_transform->get_instance_type() == media_component::INSTANCE_NOT_SHAREABLE ||
+        !is_color_converter_compatible(this->color_converter_transform, this->h264_encoder_transform)))
     {
-        transform_color_converter_t color_converter_transform(
-            new transform_color_converter(this->session, this->context_mutex));
-        color_converter_transform->initialize(this->shared_from_this<control_class>(),
+        this->color_converter_transform = this->create_color_converter(
             this->get_current_config().config_video.width_frame,
             this->get_current_config().config_video.height_frame,
-            this->get_current_config().config_video.width_frame,
-            this->get_current_config().config_video.height_frame,
-            this->get_current_config().config_video.color_space,
-            this->d3d11dev, this->devctx);
-        this->color_converter_transform = color_converter_transform;
+            this->h264_encoder_transform);
     }
     else if(!this->recording)
         this->color_converter_transform = nullptr;
 
+    // create the color converters and encoders of the additional video renditions;
+    // the color converters scale the composite to the frame size of the rendition
+    {
+        const control_video_renditions_config& config_video_renditions =
+            this->get_current_config().config_video_renditions;
+        const UINT32 rendition_count = this->recording ?
+            std::min(config_video_renditions.additional_rendition_count,
+                (UINT32)VIDEO_MAX_ADDITIONAL_RENDITIONS) : 0;
+
+        this->video_renditions.resize(rendition_count);
+        for(UINT32 i = 0; i < rendition_count; i++)
+        {
+            control_pipeline_video_rendition& rendition = this->video_renditions[i];
+            const control_video_rendition_config& config_rendition =
+                config_video_renditions.additional_renditions[i];
+            rendition.width_frame = config_rendition.width_frame;
+            rendition.height_frame = config_rendition.height_frame;
+
+            if(!rendition.h264_encoder_transform ||
+                rendition.h264_encoder_transform->get_instance_type() ==
+                media_component::INSTANCE_NOT_SHAREABLE)
+            {
+                rendition.h264_encoder_transform = this->create_h264_encoder(
+                    config_rendition.width_frame, config_rendition.height_frame,
+                    config_rendition.bitrate);
+            }
+
+            if(!rendition.color_converter_transform ||
+                rendition.color_converter_transform->get_instance_type() ==
+                media_component::INSTANCE_NOT_SHAREABLE ||
+                !is_color_converter_compatible(rendition.color_converter_transform,
+                    rendition.h264_encoder_transform))
+            {
+                rendition.color_converter_transform = this->create_color_converter(
+                    config_rendition.width_frame, config_rendition.height_frame,
+                    rendition.h264_encoder_transform);
+            }
+        }
+    }
+
     // create aac encoder transform
     if(this->recording && (!this->aac_encoder_transform ||
         this->aac_encoder_transform->get_instance_type() == media_component::INSTANCE_NOT_SHAREABLE))
@@ -300,6 +335,47 @@ void control_pipeline::activate_components()
         this->audiomixer_transform = audiomixer_transform;
     }
 
+    // create the mixers and encoders of the additional audio tracks;
+    // the additional audio tracks are only written to the file output
+    {
+        const control_audio_tracks_config& config_audio_tracks =
+            this->get_current_config().config_audio_tracks;
+        const UINT32 track_count = (this->recording && !this->streaming) ?
+            std::min(config_audio_tracks.additional_track_count,
+                (UINT32)AUDIO_MAX_ADDITIONAL_TRACKS) : 0;
+
+        this->audio_tracks.resize(track_count);
+        for(UINT32 i = 0; i < track_count; i++)
+        {
+            control_pipeline_audio_track& track = this->audio_tracks[i];
+            track.sources = config_audio_tracks.additional_track_sources[i];
+
+            if(!track.aac_encoder_transform ||
+                track.aac_encoder_transform->get_instance_type() ==
+                media_component::INSTANCE_NOT_SHAREABLE)
+            {
+                transform_aac_encoder_t aac_encoder_transform(
+                    new transform_aac_encoder(this->audio_session));
+                aac_encoder_transform->initialize(
+                    this->get_current_config().config_audio.bitrate,
+                    this->get_current_config().config_audio.profile_level_indication);
+
+                track.aac_encoder_transform = aac_encoder_transform;
+            }
+
+            if(!track.audiomixer_transform ||
+                track.audiomixer_transform->get_instance_type() ==
+                media_component::INSTANCE_NOT_SHAREABLE)
+            {
+                transform_audiomixer2_t audiomixer_transform(
+                    new transform_audiomixer2(this->audio_session));
+                audiomixer_transform->initialize();
+
+                track.audiomixer_transform = audiomixer_transform;
+            }
+        }
+    }
+
     output_class_t class_output;
 
     // create output sink video part
@@ -318,10 +394,56 @@ void control_pipeline::activate_components()
                 this->h264_encoder_transform->output_type,
                 this->aac_encoder_transform->output_type);
 
+            if(this->get_current_config().config_adaptive_bitrate.enabled)
+            {
+                const control_adaptive_bitrate_config& config =
+                    this->get_current_config().config_adaptive_bitrate;
+                const UINT32 bitrate = this->get_current_config().config_video.bitrate;
+                bitrate_controller::params_t params;
+                params.max_bitrate = (config.max_bitrate ? config.max_bitrate : bitrate) * 1000;
+                params.min_bitrate = std::min(config.min_bitrate * 1000, params.max_bitrate);
+
+                // the callback is called from the thread that writes the stream,
+                // so the errors of the encoder are logged instead of failing the stream
+                rtmp_output->enable_adaptive_bitrate(params, this->time_source,
+                    [encoder = std::weak_ptr<transform_h264_encoder>(
+                        this->h264_encoder_transform)](UINT32 bitrate)
+                    {
+                        transform_h264_encoder_t encoder_ = encoder.lock();
+                        if(!encoder_)
+                            return;
+
+                        try
+                        {
+                            if(!encoder_->reconfigure(bitrate))
+                                std::cout << "the video encoder doesn't support " <<
+                                    "changing the bitrate" << std::endl;
+                        }
+                        catch(streaming::exception err)
+                        {
+                            std::cout << "EXCEPTION THROWN: " << err.what() << std::flush;
+                            std::cout << "the video encoder rejected the bitrate " <<
+                                bitrate << std::endl;
+                        }
+                    });
+            }
+
+            // a stream that starts mid-gop isn't decodable until the next idr frame
+            rtmp_output->set_key_frame_requester(
+                [encoder = std::weak_ptr<transform_h264_encoder>(this->h264_encoder_transform)]()
+                {
+                    if(transform_h264_encoder_t encoder_ = encoder.lock())
+                        encoder_->request_key_frame();
+                });
+
             class_output = rtmp_output;
         }
         else
         {
+            std::vector<CComPtr<IMFMediaType>> additional_audio_types;
+            for(const auto& track : this->audio_tracks)
+                additional_audio_types.push_back(track.aac_encoder_transform->output_type);
+
             output_file_t file_output(new output_file);
             file_output->initialize(
                 false,
@@ -329,11 +451,15 @@ void control_pipeline::activate_components()
                 this->get_current_config().config_output.create_file_path(),
                 this->recording_initiator_wnd,
                 this->h264_encoder_transform->output_type,
-                this->aac_encoder_transform->output_type);
+                this->aac_encoder_transform->output_type,
+                additional_audio_types);
 
             class_output = file_output;
         }
 
+        if(this->get_current_config().config_vfr.enabled)
+            class_output->enable_vfr(this->get_vfr_max_frame_interval());
+
         sink_output_video_t output_sink(new sink_file_video(this->session));
         output_sink->initialize(class_output, true);
 
@@ -357,11 +483,62 @@ void control_pipeline::activate_components()
     else if(!this->recording)
         this->output_sink.second = nullptr;
 
+    // create output sinks for the additional audio tracks
+    for(size_t i = 0; i < this->audio_tracks.size(); i++)
+    {
+        control_pipeline_audio_track& track = this->audio_tracks[i];
+        if(track.output_sink &&
+            track.output_sink->get_instance_type() != media_component::INSTANCE_NOT_SHAREABLE)
+            continue;
+
+        // the additional tracks are created together with the file output
+        if(!class_output)
+            throw HR_EXCEPTION(E_UNEXPECTED);
+
+        sink_output_audio_t output_sink(new sink_file_audio(this->audio_session));
+        output_sink->initialize(class_output, false, (UINT32)i + 1);
+
+        track.output_sink = output_sink;
+    }
+
+    // create file outputs for the additional video renditions
+    for(auto& rendition : this->video_renditions)
+    {
+        if(rendition.output_sink.first && rendition.output_sink.second &&
+            rendition.output_sink.first->get_instance_type() !=
+            media_component::INSTANCE_NOT_SHAREABLE &&
+            rendition.output_sink.second->get_instance_type() !=
+            media_component::INSTANCE_NOT_SHAREABLE)
+            continue;
+
+        const std::wstring suffix = L"_" + std::to_wstring(rendition.width_frame) + L"x" +
+            std::to_wstring(rendition.height_frame);
+
+        output_file_t file_output(new output_file);
+        file_output->initialize(
+            false,
+            (bool)this->get_current_config().config_output.overwrite_old_file,
+            this->get_current_config().config_output.create_file_path(suffix),
+            this->recording_initiator_wnd,
+            rendition.h264_encoder_transform->output_type,
+            this->aac_encoder_transform->output_type);
+        if(this->get_current_config().config_vfr.enabled)
+            file_output->enable_vfr(this->get_vfr_max_frame_interval());
+
+        sink_output_video_t output_sink_video(new sink_file_video(this->session));
+        output_sink_video->initialize(file_output, true);
+        sink_output_audio_t output_sink_audio(new sink_file_audio(this->audio_session));
+        output_sink_audio->initialize(file_output, false);
+
+        rendition.output_sink = std::make_pair(output_sink_video, output_sink_audio);
+    }
+
     // create video sink(the main/real pull sink)
     if(!this->video_sink)
     {
         sink_video_t video_sink(new sink_video(this->session, this->audio_session));
-        video_sink->initialize();
+        video_sink->initialize(
+            this->get_current_config().config_latency.get_audio_pull_periodicity());
 
         this->video_sink = video_sink;
     }
@@ -381,7 +558,7 @@ void control_pipeline::activate_components()
     {
         source_buffering_video_t video_buffering_source(new source_buffering_video(this->session));
         video_buffering_source->initialize(this->shared_from_this<control_pipeline>(),
-            BUFFERING_DEFAULT_VIDEO_LATENCY);
+            this->get_current_config().config_latency.get_video_buffering_latency());
 
         this->video_buffering_source = video_buffering_source;
     }
@@ -392,12 +569,146 @@ void control_pipeline::activate_components()
     {
         source_buffering_audio_t audio_buffering_source(new source_buffering_audio(this->audio_session));
         audio_buffering_source->initialize(this->shared_from_this<control_pipeline>(),
-            BUFFERING_DEFAULT_AUDIO_LATENCY);
+            this->get_current_config().config_latency.get_audio_buffering_latency());
 
         this->audio_buffering_source = audio_buffering_source;
     }
 }
 
+transform_h264_encoder_t control_pipeline::create_h264_encoder(
+    UINT32 width, UINT32 height, UINT32 bitrate)
+{
+    // must be called after resetting the video session
+
+    // TODO: activating the encoder might fail for random reasons,
+    // so notify if the primary encoder cannot be used and use the software encoder as a
+    // fallback
+    // (signature error during activate call was fixed by a reboot)
+    transform_h264_encoder_t h264_encoder_transform;
+    try
+    {
+        h264_encoder_transform = this->initialize_h264_encoder(
+            width, height, bitrate, this->d3d11dev, false);
+    }
+    catch(streaming::exception err)
+    {
+        std::cout << "EXCEPTION THROWN: " << err.what() << std::flush;
+        std::cout << "using system ram for hardware video encoder" << std::endl;
+
+        try
+        {
+            // try to initialize the h264 encoder without utilizing vram
+            h264_encoder_transform = this->initialize_h264_encoder(
+                width, height, bitrate, nullptr, false);
+        }
+        catch(streaming::exception err)
+        {
+            std::cout << "EXCEPTION THROWN: " << err.what() << std::flush;
+            std::cout << "using software encoder" << std::endl;
+
+            // use software encoder;
+            // activate function will catch the failure of this
+            h264_encoder_transform = this->initialize_h264_encoder(
+                width, height, bitrate, nullptr, true);
+        }
+    }
+
+    if(this->get_current_config().config_encoder_degradation.enabled)
+    {
+        const control_encoder_degradation_config& config_degradation =
+            this->get_current_config().config_encoder_degradation;
+        degradation_controller::params_t params;
+
+        for(degradation_controller::step_t step : config_degradation.steps)
+        {
+            if(step == degradation_controller::STEP_NONE)
+                break;
+            params.steps.push_back(step);
+        }
+
+        h264_encoder_transform->enable_degradation(params,
+            config_degradation.quality_vs_speed, config_degradation.frame_decimation);
+    }
+
+    if(this->get_current_config().config_vfr.enabled)
+        h264_encoder_transform->enable_vfr(this->get_vfr_max_frame_interval());
+
+    return h264_encoder_transform;
+}
+
+time_unit control_pipeline::get_vfr_max_frame_interval() const
+{
+    return std::max((time_unit)this->get_current_config().config_vfr.max_frame_interval *
+        (SECOND_IN_TIME_UNIT / 1000), (time_unit)1);
+}
+
+transform_h264_encoder_t control_pipeline::initialize_h264_encoder(
+    UINT32 width, UINT32 height, UINT32 bitrate,
+    const CComPtr<ID3D11Device>& d3d11dev, bool software)
+{
+    frame_unit fps_num, fps_den;
+    this->get_session_frame_rate(fps_num, fps_den);
+
+    transform_h264_encoder_t h264_encoder_transform(new transform_h264_encoder(
+        this->session, this->context_mutex));
+    h264_encoder_transform->set_gop(this->get_current_config().config_video_gop.gop_size,
+        (bool)this->get_current_config().config_video_gop.closed_gop);
+    h264_encoder_transform->set_threading(
+        this->get_current_config().config_encoder_threading.worker_threads,
+        this->get_current_config().config_encoder_threading.slices,
+        this->get_current_config().config_encoder_threading.reserved_threads);
+    h264_encoder_transform->initialize(this->shared_from_this<control_class>(),
+        d3d11dev, (UINT32)fps_num, (UINT32)fps_den,
+        width, height,
+        bitrate * 1000,
+        this->get_current_config().config_video.quality_vs_speed,
+        this->get_current_config().config_video.h264_video_profile,
+        this->get_current_config().config_video.color_space,
+        this->get_current_config().config_video.encoder_use_default ? nullptr :
+            &this->get_current_config().config_video.encoder,
+        software);
+
+    return h264_encoder_transform;
+}
+
+transform_color_converter_t control_pipeline::create_color_converter(
+    UINT32 width, UINT32 height, const transform_h264_encoder_t& h264_encoder_transform)
+{
+    UINT32 canvas_width, canvas_height;
+    this->get_current_config().config_canvas.get_canvas_size(
+        this->get_current_config().config_video, canvas_width, canvas_height);
+
+    transform_color_converter_t color_converter_transform(
+        new transform_color_converter(this->session, this->context_mutex));
+    if(!h264_encoder_transform->uses_native_textures())
+        color_converter_transform->set_memory_output(
+            h264_encoder_transform->get_input_format() == H264_PIXEL_FORMAT_I420 ?
+            media_buffer_frame::FORMAT_I420 : media_buffer_frame::FORMAT_NV12);
+    color_converter_transform->initialize(this->shared_from_this<control_class>(),
+        canvas_width, canvas_height,
+        width, height,
+        this->get_current_config().config_video.color_space,
+        this->d3d11dev, this->devctx,
+        this->get_current_config().config_color_converter.converter,
+        this->get_current_config().config_canvas.scaling_filter);
+
+    return color_converter_transform;
+}
+
+bool control_pipeline::is_color_converter_compatible(
+    const transform_color_converter_t& color_converter_transform,
+    const transform_h264_encoder_t& h264_encoder_transform)
+{
+    if(h264_encoder_transform->uses_native_textures())
+        return !color_converter_transform->is_memory_output();
+
+    const media_buffer_frame::format_t format =
+        h264_encoder_transform->get_input_format() == H264_PIXEL_FORMAT_I420 ?
+        media_buffer_frame::FORMAT_I420 : media_buffer_frame::FORMAT_NV12;
+    return color_converter_transform->is_memory_output() &&
+        color_converter_transform->get_memory_output_format() == format;
+}
+
 void control_pipeline::deactivate_components()
 {
     if(this->is_recording())
@@ -419,6 +730,8 @@ void control_pipeline::deactivate_components()
     this->video_sink = nullptr;
     this->aac_encoder_transform = nullptr;
     this->audiomixer_transform = nullptr;
+    this->audio_tracks.clear();
+    this->video_renditions.clear();
     this->audio_sink = nullptr;
     this->video_buffering_source = nullptr;
     this->audio_buffering_source = nullptr;
@@ -634,6 +947,58 @@ void control_pipeline::build_and_switch_topology()
         encoder_stream_audio->connect_streams(audiomixer_stream, this->audio_topology);
         output_stream_audio->connect_streams(encoder_stream_audio, this->audio_topology);
         audio_stream->connect_streams(output_stream_audio, this->audio_topology);
+
+        // the additional video renditions share the composite and the encoded main audio
+        // track, so that the scene is composited and the audio is encoded only once;
+        // the topology requests a shared upstream once and gives its samples to
+        // every branch;
+        // the color conversions of the renditions run in succession, but the encoders
+        // are served in parallel
+        for(const auto& rendition : this->video_renditions)
+        {
+            media_stream_t rendition_color_converter_stream =
+                rendition.color_converter_transform->create_stream();
+            media_stream_t rendition_encoder_stream = rendition.h264_encoder_transform->
+                create_stream(this->video_topology->get_message_generator());
+            media_stream_t rendition_output_stream_video = rendition.output_sink.first->
+                create_stream(this->video_topology->get_message_generator());
+            media_stream_t rendition_output_stream_audio = rendition.output_sink.second->
+                create_stream(this->audio_topology->get_message_generator());
+
+            rendition_color_converter_stream->connect_streams(
+                videomixer_stream, this->video_topology);
+            rendition_encoder_stream->connect_streams(
+                rendition_color_converter_stream, this->video_topology);
+            rendition_output_stream_video->connect_streams(
+                rendition_encoder_stream, this->video_topology);
+            video_stream->connect_streams(rendition_output_stream_video, this->video_topology);
+
+            rendition_output_stream_audio->connect_streams(
+                encoder_stream_audio, this->audio_topology);
+            audio_stream->connect_streams(rendition_output_stream_audio, this->audio_topology);
+        }
+
+        // the additional audio tracks mix the source streams of the main audio track,
+        // so that the sources are captured and resampled only once;
+        // each track has its own mixer and encoder which are served in parallel
+        for(const auto& track : this->audio_tracks)
+        {
+            stream_audiomixer2_base_t track_audiomixer_stream = track.audiomixer_transform->
+                create_stream(this->audio_topology->get_message_generator());
+            media_stream_t track_encoder_stream = track.aac_encoder_transform->create_stream(
+                this->audio_topology->get_message_generator());
+            media_stream_t track_output_stream = track.output_sink->create_stream(
+                this->audio_topology->get_message_generator());
+
+            this->root_scene->build_audio_track_topology(
+                track.sources, track_audiomixer_stream, this->audio_topology);
+            track_audiomixer_stream->connect_streams(
+                audio_buffering_stream, nullptr, this->audio_topology);
+
+            track_encoder_stream->connect_streams(track_audiomixer_stream, this->audio_topology);
+            track_output_stream->connect_streams(track_encoder_stream, this->audio_topology);
+            audio_stream->connect_streams(track_output_stream, this->audio_topology);
+        }
     }
 
     // video sink ensures atomic topology starting/switching for audio and video
@@ -666,6 +1031,48 @@ void control_pipeline::get_session_frame_rate(frame_unit& num, frame_unit& den)
     den = this->session->frame_rate_den;
 }
 
+std::vector<control_pipeline_rendition_usage> control_pipeline::get_rendition_usage() const
+{
+    std::vector<control_pipeline_rendition_usage> usage;
+    if(!this->recording || !this->h264_encoder_transform || !this->color_converter_transform)
+        return usage;
+
+    usage.push_back({
+        this->get_current_config().config_video.width_frame,
+        this->get_current_config().config_video.height_frame,
+        this->color_converter_transform->get_processing_cycles(),
+        this->h264_encoder_transform->get_processing_cycles(),
+        this->h264_encoder_transform->get_metrics()});
+    for(const auto& rendition : this->video_renditions)
+        usage.push_back({
+            rendition.width_frame, rendition.height_frame,
+            rendition.color_converter_transform->get_processing_cycles(),
+            rendition.h264_encoder_transform->get_processing_cycles(),
+            rendition.h264_encoder_transform->get_metrics()});
+
+    return usage;
+}
+
+std::vector<control_pipeline_output_latency> control_pipeline::get_output_latency() const
+{
+    std::vector<control_pipeline_output_latency> latency;
+    if(!this->recording || !this->output_sink.first || !this->output_sink.second)
+        return latency;
+
+    latency.push_back({
+        this->get_current_config().config_video.width_frame,
+        this->get_current_config().config_video.height_frame,
+        this->output_sink.first->get_metrics(),
+        this->output_sink.second->get_metrics()});
+    for(const auto& rendition : this->video_renditions)
+        latency.push_back({
+            rendition.width_frame, rendition.height_frame,
+            rendition.output_sink.first->get_metrics(),
+            rendition.output_sink.second->get_metrics()});
+
+    return latency;
+}
+
 void control_pipeline::apply_config(const control_pipeline_config& new_config)
 {
     this->config = new_config;
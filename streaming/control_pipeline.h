@@ -29,6 +29,8 @@
 // NOTE: buffering slightly increases processing usage
 #define BUFFERING_DEFAULT_VIDEO_LATENCY (SECOND_IN_TIME_UNIT / 2) // 100ms default buffering
 #define BUFFERING_DEFAULT_AUDIO_LATENCY (SECOND_IN_TIME_UNIT / 2)
+// the length of one aac encoder packet
+#define AUDIO_DEFAULT_PULL_PERIODICITY 1024
 
 #pragma comment(lib, "D3D11.lib")
 #pragma comment(lib, "DXGI.lib")
@@ -36,6 +38,41 @@
 
 typedef std::pair<sink_output_video_t, sink_output_audio_t> sink_output_t;
 
+// a mixer and encoder chain for an additional audio track
+struct control_pipeline_audio_track
+{
+    control_audio_track_sources sources;
+    transform_audiomixer2_t audiomixer_transform;
+    transform_aac_encoder_t aac_encoder_transform;
+    sink_output_audio_t output_sink;
+};
+
+// a scaler and encoder chain for an additional video rendition;
+// the rendition is written with the main audio track to its own file output
+struct control_pipeline_video_rendition
+{
+    UINT32 width_frame, height_frame;
+    transform_color_converter_t color_converter_transform;
+    transform_h264_encoder_t h264_encoder_transform;
+    sink_output_t output_sink;
+};
+
+// the cpu cycles spent in the color conversion and encoding stages of a rendition;
+// the cycles of the hardware encoders and the video processor are spent mostly on the gpu
+struct control_pipeline_rendition_usage
+{
+    UINT32 width_frame, height_frame;
+    UINT64 color_converter_cycles, h264_encoder_cycles;
+    h264_encoder_metrics encoder_metrics;
+};
+
+// the capture-to-output latency of the file output of a rendition
+struct control_pipeline_output_latency
+{
+    UINT32 width_frame, height_frame;
+    sink_file_metrics video, audio;
+};
+
 //struct control_session_config
 //{
 //    frame_unit fps_num, fps_den;
@@ -97,6 +134,178 @@ struct control_audio_config
     UINT32 profile_level_indication = 0x29; // default
 };
 
+// latency profile controls the audio pull periodicity and the amount of source buffering;
+// lower latencies increase the processing usage and make the pipeline more prone to
+// dropped frames if the sources deliver late
+enum control_latency_profile : int
+{
+    LATENCY_PROFILE_DEFAULT,
+    // for low latency outputs
+    LATENCY_PROFILE_LOW,
+    // for monitoring; pulls audio at the finest granularity
+    LATENCY_PROFILE_MONITORING,
+};
+
+struct control_latency_config
+{
+    control_latency_profile profile = LATENCY_PROFILE_DEFAULT;
+
+    // in audio frames;
+    // the aac encoder accumulates smaller pulls into full encoder frames
+    frame_unit get_audio_pull_periodicity() const;
+    time_unit get_video_buffering_latency() const;
+    // must be larger than the capture interval of the audio sources
+    time_unit get_audio_buffering_latency() const;
+};
+
+// the maximum number of audio tracks in addition to the main audio track
+#define AUDIO_MAX_ADDITIONAL_TRACKS 4
+
+// selects the wasapi sources that are mixed to an additional audio track
+enum control_audio_track_sources : UINT32
+{
+    // microphones and other capture devices
+    AUDIO_TRACK_SOURCES_CAPTURE = 1,
+    // loopback sources of the render devices
+    AUDIO_TRACK_SOURCES_RENDER = 2,
+    AUDIO_TRACK_SOURCES_ALL = AUDIO_TRACK_SOURCES_CAPTURE | AUDIO_TRACK_SOURCES_RENDER,
+};
+
+// the main audio track always contains all the audio sources;
+// the additional tracks are written as separate audio tracks in the file output
+// and are not streamed
+struct control_audio_tracks_config
+{
+    UINT32 additional_track_count = 0;
+    control_audio_track_sources additional_track_sources[AUDIO_MAX_ADDITIONAL_TRACKS] =
+    {
+        AUDIO_TRACK_SOURCES_CAPTURE,
+        AUDIO_TRACK_SOURCES_RENDER,
+        AUDIO_TRACK_SOURCES_ALL,
+        AUDIO_TRACK_SOURCES_ALL
+    };
+};
+
+struct control_videomixer_config
+{
+    // the cpu compositor allows composing scenes on adapters without direct2d support,
+    // such as the warp adapter
+    transform_videomixer::compositor_t compositor = transform_videomixer::COMPOSITOR_D2D;
+};
+
+struct control_color_converter_config
+{
+    // the cpu converter allows recording on adapters without video processor support,
+    // such as the warp adapter
+    transform_color_converter::converter_t converter =
+        transform_color_converter::CONVERTER_VIDEO_PROCESSOR;
+};
+
+// the scene is composited at the canvas size and scaled to the frame size of the
+// video config in the color conversion stage
+struct control_canvas_config
+{
+    // the frame size is used if the canvas size is 0
+    UINT32 width_canvas = 0, height_canvas = 0;
+    // used by the cpu color converter;
+    // the video processor uses its own scaling filter
+    color_converter_cpu::filter_t scaling_filter = color_converter_cpu::FILTER_BICUBIC;
+
+    void get_canvas_size(const control_video_config&, UINT32& width, UINT32& height) const;
+};
+
+// the maximum number of video renditions in addition to the main video rendition
+#define VIDEO_MAX_ADDITIONAL_RENDITIONS 4
+
+struct control_video_rendition_config
+{
+    UINT32 width_frame, height_frame;
+    UINT32 bitrate; // avg bitrate (in kbps)
+};
+
+// the main rendition uses the frame size and the bitrate of the video config;
+// the additional renditions are scaled from the same composite as the main rendition
+// and are written to separate file outputs;
+// the rest of the encoder settings are shared with the main rendition
+struct control_video_renditions_config
+{
+    UINT32 additional_rendition_count = 0;
+    control_video_rendition_config additional_renditions[VIDEO_MAX_ADDITIONAL_RENDITIONS] =
+    {
+        {1280, 720, 3000},
+        {854, 480, 1500},
+        {640, 360, 800},
+        {426, 240, 400}
+    };
+};
+
+// the preview runs at its own rate and resolution;
+// the program output doesn't wait on the preview
+struct control_preview_config
+{
+    UINT32 fps = DEFAULT_PREVIEW_FPS;
+    // the frame is downscaled to the size of the preview window, limited by the max size;
+    // 0 doesn't limit the size
+    UINT32 max_width = 0, max_height = 0;
+};
+
+struct control_video_gop_config
+{
+    // the maximum distance between idr frames, in frames;
+    // 0 uses the default of the encoder
+    UINT32 gop_size = 0;
+    BOOL closed_gop = TRUE;
+};
+
+// adapts the video bitrate of the streaming output to the throughput of the connection;
+// the stream isn't padded to the video bitrate while the bitrate is below it
+struct control_adaptive_bitrate_config
+{
+    BOOL enabled = FALSE;
+    // in kbps;
+    // the video bitrate is used as the maximum if the maximum is 0
+    UINT32 min_bitrate = 1000, max_bitrate = 0;
+};
+
+// steps the video encoding load down while the encoder cannot keep up;
+// the steps are taken in order and reverted in the reverse order
+struct control_encoder_degradation_config
+{
+    BOOL enabled = FALSE;
+    // STEP_NONE ends the steps
+    degradation_controller::step_t steps[2] =
+    {
+        degradation_controller::STEP_QUALITY,
+        degradation_controller::STEP_FRAME_RATE
+    };
+    // the quality vs speed of the quality step
+    UINT32 quality_vs_speed = 0;
+    // the frame rate step encodes every nth frame
+    UINT32 frame_decimation = 2;
+};
+
+// the threading of the software video encoder
+struct control_encoder_threading_config
+{
+    // 0 uses the default of the encoder
+    UINT32 worker_threads = 0;
+    // 0 uses the default of the encoder
+    UINT32 slices = 0;
+    // the threads that are left for the capture, mixing and color conversion;
+    // the worker threads are capped to the cores that are left
+    UINT32 reserved_threads = 2;
+};
+
+// the frames of a static canvas aren't encoded until the max frame interval has passed;
+// the outputs don't wait for the video during the gaps, the rtmp output sends the audio
+// up to the max frame interval after the last video frame
+struct control_vfr_config
+{
+    BOOL enabled = FALSE;
+    // in milliseconds
+    UINT32 max_frame_interval = 1000;
+};
+
 struct control_output_config
 {
     // strs include the null character;
@@ -108,7 +317,8 @@ struct control_output_config
     CHAR ingest_server[MAX_PATH] = {};
     CHAR stream_key[MAX_PATH] = {};
 
-    std::wstring create_file_path() const;
+    // the suffix is appended to the file name
+    std::wstring create_file_path(const std::wstring_view& suffix = L"") const;
 };
 
 struct control_pipeline_config
@@ -117,7 +327,7 @@ struct control_pipeline_config
     // version must be increased every time the config struct is changed;
     // new config versions are only allowed to extend the previous config versions,
     // which also means that only the control_pipeline_config struct can be altered
-    static constexpr int VERSION = 1;
+    static constexpr int VERSION = 13;
     static constexpr int LATEST_VERSION = VERSION;
 
     int magic_number = MAGIC_NUMBER;
@@ -125,6 +335,30 @@ struct control_pipeline_config
     control_video_config config_video;
     control_audio_config config_audio;
     control_output_config config_output;
+    // version 2
+    control_latency_config config_latency;
+    // version 3
+    control_audio_tracks_config config_audio_tracks;
+    // version 4
+    control_videomixer_config config_videomixer;
+    // version 5
+    control_color_converter_config config_color_converter;
+    // version 6
+    control_canvas_config config_canvas;
+    // version 7
+    control_video_renditions_config config_video_renditions;
+    // version 8
+    control_preview_config config_preview;
+    // version 9
+    control_adaptive_bitrate_config config_adaptive_bitrate;
+    // version 10
+    control_video_gop_config config_video_gop;
+    // version 11
+    control_encoder_degradation_config config_encoder_degradation;
+    // version 12
+    control_encoder_threading_config config_encoder_threading;
+    // version 13
+    control_vfr_config config_vfr;
 };
 #pragma pack(pop)
 
@@ -156,6 +390,10 @@ private:
     sink_audio_t audio_sink;
     source_buffering_video_t video_buffering_source;
     source_buffering_audio_t audio_buffering_source;
+    // the additional audio tracks share the source streams with the main audio track
+    std::vector<control_pipeline_audio_track> audio_tracks;
+    // the additional video renditions share the composite and the encoded main audio track
+    std::vector<control_pipeline_video_rendition> video_renditions;
 
     control_pipeline_config config;
 
@@ -170,6 +408,23 @@ private:
 
     void activate_components();
     void deactivate_components();
+    // falls back to the system memory and the software encoder if the encoder cannot be
+    // initialized;
+    // bitrate is in kbps
+    transform_h264_encoder_t create_h264_encoder(UINT32 width, UINT32 height, UINT32 bitrate);
+    // the max frame interval of the vfr config in time units
+    time_unit get_vfr_max_frame_interval() const;
+    // creates the encoder with the gop and threading settings of the config;
+    // throws if the encoder cannot be initialized
+    transform_h264_encoder_t initialize_h264_encoder(UINT32 width, UINT32 height, UINT32 bitrate,
+        const CComPtr<ID3D11Device>&, bool software);
+    // the color converter outputs the frames in system memory in the input format of
+    // the encoder if the encoder doesn't use native textures
+    transform_color_converter_t create_color_converter(UINT32 width, UINT32 height,
+        const transform_h264_encoder_t&);
+    // returns whether the output of the color converter matches the input of the encoder
+    static bool is_color_converter_compatible(const transform_color_converter_t&,
+        const transform_h264_encoder_t&);
 
     static HRESULT get_adapter(
         const CComPtr<IDXGIFactory1>&,
@@ -224,6 +479,12 @@ public:
 
     void get_session_frame_rate(frame_unit& num, frame_unit& den) const;
     frame_unit get_session_sample_rate() const { return this->audio_session->frame_rate_num; }
+    // the main rendition is the first element;
+    // empty if not recording
+    std::vector<control_pipeline_rendition_usage> get_rendition_usage() const;
+    // the main rendition is the first element;
+    // empty if not recording
+    std::vector<control_pipeline_output_latency> get_output_latency() const;
 
     const control_pipeline_config& get_current_config() const { return this->config; }
     // stores and applies the new config(by calling activate());
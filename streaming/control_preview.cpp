@@ -74,6 +74,17 @@ void control_preview::activate(const control_set_t& last_set, control_set_t& new
 
     new_set.push_back(this->shared_from_this<control_preview>());
 
+    // apply the preview config
+    {
+        const control_preview_config& config = this->pipeline.get_current_config().config_preview;
+        {
+            sink_preview2::scoped_lock lock(component->d2d1_context_mutex);
+            component->set_max_preview_size(config.max_width, config.max_height);
+        }
+        if((frame_unit)config.fps != this->fps)
+            this->set_fps(config.fps);
+    }
+
 out:
     this->component = component;
 
@@ -3,8 +3,10 @@
 #include "gui_previewwnd.h"
 #include "sink_preview2.h"
 #include <d2d1.h>
+#include <algorithm>
 
-#define DEFAULT_PREVIEW_FPS 60 // 100fps is the maximum currently
+#define DEFAULT_PREVIEW_FPS 30
+#define MAX_PREVIEW_FPS 100 // 100fps is the maximum currently
 
 class control_preview : public control_class
 {
@@ -34,7 +36,10 @@ public:
     void set_parent(HWND parent) { this->parent = parent; }
 
     void set_fps(frame_unit fps) 
-    { this->fps = fps; this->wnd_preview.set_timer(1000 / (UINT)this->fps - 1); }
+    {
+        this->fps = std::clamp(fps, (frame_unit)1, (frame_unit)MAX_PREVIEW_FPS);
+        this->wnd_preview.set_timer(1000 / (UINT)this->fps - 1);
+    }
     frame_unit get_fps() const { return this->fps; }
 
     void set_state(bool render);
@@ -99,6 +99,29 @@ void control_scene::build_audio_topology(const media_stream_t& from,
     }
 }
 
+void control_scene::build_audio_track_topology(UINT32 track_sources,
+    const media_stream_t& to, const media_topology_t& topology)
+{
+    if(this->disabled)
+        return;
+
+    for(auto&& elem : this->video_controls)
+    {
+        control_scene* scene = dynamic_cast<control_scene*>(elem.get());
+        if(scene && !scene->disabled)
+            scene->build_audio_track_topology(track_sources, to, topology);
+    }
+
+    for(auto&& elem : this->audio_controls)
+    {
+        control_wasapi* wasapi = dynamic_cast<control_wasapi*>(elem.get());
+        if(!wasapi || wasapi->disabled)
+            continue;
+
+        wasapi->build_audio_track_topology(track_sources, to, topology);
+    }
+}
+
 void control_scene::activate(const control_set_t& last_set, control_set_t& new_set)
 {
     if(this->disabled)
@@ -36,6 +36,10 @@ private:
         const media_stream_t& to, const media_topology_t&);
     void build_audio_topology(const media_stream_t& from,
         const media_stream_t& to, const media_topology_t&);
+    // connects the wasapi streams that match the track sources to the 'to' stream;
+    // must be called after build_audio_topology
+    void build_audio_track_topology(UINT32 track_sources,
+        const media_stream_t& to, const media_topology_t&);
     void activate(const control_set_t& last_set, control_set_t& new_set);
 
     void switch_scene(controls_t::const_iterator new_scene);
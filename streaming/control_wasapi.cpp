@@ -230,6 +230,29 @@ void control_wasapi::build_audio_topology(const media_stream_t& from,
     }
 }
 
+void control_wasapi::build_audio_track_topology(UINT32 track_sources,
+    const media_stream_t& to, const media_topology_t& topology)
+{
+    // duplicate controls are mixed only once to the additional tracks
+    if(!this->component || this->reference || !this->stream)
+        return;
+
+    assert_(!this->disabled);
+
+    const UINT32 device_source = this->params->device_info.capture ?
+        AUDIO_TRACK_SOURCES_CAPTURE : AUDIO_TRACK_SOURCES_RENDER;
+    if(!(track_sources & device_source))
+        return;
+
+    stream_audiomixer2_base_t audiomixer_stream =
+        std::dynamic_pointer_cast<stream_audiomixer2_base>(to);
+    if(!audiomixer_stream)
+        throw HR_EXCEPTION(E_UNEXPECTED);
+
+    // the wasapi stream serves the same samples to every connected mixer
+    audiomixer_stream->connect_streams(this->stream, this->audiomixer_params, topology);
+}
+
 void control_wasapi::activate(const control_set_t& last_set, control_set_t& new_set)
 {
     source_wasapi_t component;
@@ -45,6 +45,10 @@ private:
 
     void build_audio_topology(const media_stream_t& from,
         const media_stream_t& to, const media_topology_t&);
+    // connects the stream established in build_audio_topology to an additional
+    // audio track mixer if the device matches the track sources
+    void build_audio_track_topology(UINT32 track_sources,
+        const media_stream_t& to, const media_topology_t&);
     void activate(const control_set_t& last_set, control_set_t& new_set);
 
     control_wasapi(control_set_t& active_controls, control_pipeline&);
@@ -0,0 +1,97 @@
+#include "degradation_controller.h"
+#include <iostream>
+
+degradation_controller::degradation_controller() :
+    level(0),
+    started(false),
+    interval_start(0),
+    frames(0), overloaded_frames(0),
+    clear_intervals(0)
+{
+}
+
+void degradation_controller::initialize(const params_t& params)
+{
+    assert_(params.interval > 0);
+
+    this->params = params;
+    this->level = 0;
+    this->started = false;
+    this->events.clear();
+}
+
+bool degradation_controller::on_frame(time_unit now, bool overloaded)
+{
+    const UINT32 last_level = this->level;
+
+    if(!this->started)
+    {
+        this->started = true;
+        this->interval_start = now;
+        this->frames = this->overloaded_frames = 0;
+        this->clear_intervals = 0;
+    }
+
+    this->frames++;
+    if(overloaded)
+        this->overloaded_frames++;
+
+    if(now - this->interval_start >= this->params.interval)
+        this->evaluate(now);
+
+    return this->level != last_level;
+}
+
+void degradation_controller::evaluate(time_unit now)
+{
+    const bool overloaded =
+        this->overloaded_frames * 100 > this->params.overload_threshold * this->frames;
+    event_t event;
+
+    event.time = now;
+    event.step = STEP_NONE;
+    event.degraded = false;
+
+    if(overloaded)
+    {
+        this->clear_intervals = 0;
+        if(this->level < this->params.steps.size())
+        {
+            event.step = this->params.steps[this->level++];
+            event.degraded = true;
+        }
+    }
+    else if(this->overloaded_frames == 0)
+    {
+        if(++this->clear_intervals >= this->params.recover_intervals && this->level > 0)
+        {
+            event.step = this->params.steps[--this->level];
+            this->clear_intervals = 0;
+        }
+    }
+    else
+        this->clear_intervals = 0;
+
+    if(event.step != STEP_NONE)
+    {
+        event.level = this->level;
+        if(this->events.size() >= max_events)
+            this->events.pop_front();
+        this->events.push_back(event);
+
+        std::cout << "encoder degradation: " << (event.degraded ? "took" : "reverted") <<
+            " step " << event.step << ", level " << event.level << ", " <<
+            this->overloaded_frames << "/" << this->frames << " frames overloaded" << std::endl;
+    }
+
+    this->interval_start = now;
+    this->frames = this->overloaded_frames = 0;
+}
+
+bool degradation_controller::is_step_active(step_t step) const
+{
+    for(UINT32 i = 0; i < this->level; i++)
+        if(this->params.steps[i] == step)
+            return true;
+    return false;
+}
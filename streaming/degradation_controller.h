@@ -0,0 +1,75 @@
+#pragma once
+
+#include "media_sample.h"
+#include <vector>
+#include <deque>
+
+// steps the encoding load down while the encoder cannot keep up and back up when
+// the encoder has headroom again;
+// the caller reports whether the encoder was overloaded when each frame arrived,
+// and the steps are taken in the configured order and reverted in the reverse order;
+// the times are passed by the caller so that the controller can be driven by any clock
+
+class degradation_controller
+{
+public:
+    enum step_t : UINT32
+    {
+        STEP_NONE,
+        // lowers the quality vs speed setting of the encoder
+        STEP_QUALITY,
+        // encodes only every nth frame
+        STEP_FRAME_RATE,
+    };
+
+    struct params_t
+    {
+        std::vector<step_t> steps;
+        // the interval between the evaluations
+        time_unit interval = SECOND_IN_TIME_UNIT;
+        // the share of the overloaded frames in an interval that takes the next step, in percent
+        UINT32 overload_threshold = 10;
+        // the number of consecutive intervals without overloaded frames before
+        // the last step is reverted
+        UINT32 recover_intervals = 10;
+    };
+
+    // a transition between the levels
+    struct event_t
+    {
+        time_unit time;
+        // the number of steps taken after the transition
+        UINT32 level;
+        step_t step;
+        bool degraded;
+    };
+
+    // the number of the latest transitions that are kept
+    static const size_t max_events = 64;
+private:
+    params_t params;
+    UINT32 level;
+
+    bool started;
+    time_unit interval_start;
+    UINT32 frames, overloaded_frames;
+    UINT32 clear_intervals;
+
+    // the oldest transitions are dropped after max events
+    std::deque<event_t> events;
+
+    void evaluate(time_unit now);
+public:
+    degradation_controller();
+
+    void initialize(const params_t&);
+
+    // returns true if the level changed
+    bool on_frame(time_unit now, bool overloaded);
+
+    UINT32 get_level() const {return this->level;}
+    // returns true if the step is taken at the current level
+    bool is_step_active(step_t) const;
+    // returns the latest transitions, the oldest first
+    const std::deque<event_t>& get_events() const {return this->events;}
+};
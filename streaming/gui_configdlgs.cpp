@@ -161,6 +161,12 @@ bool gui_configdlg_video::should_update_settings()
     case 1:
         this->config_video.color_space = DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709;
         break;
+    case 2:
+        this->config_video.color_space = DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P601;
+        break;
+    case 3:
+        this->config_video.color_space = DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P601;
+        break;
     default:
         throw std::invalid_argument("");
     }
@@ -266,6 +272,8 @@ LRESULT gui_configdlg_video::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPAR
 
     this->wnd_color_space.AddString(L"DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P709");
     this->wnd_color_space.AddString(L"DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709");
+    this->wnd_color_space.AddString(L"DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P601");
+    this->wnd_color_space.AddString(L"DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P601");
 
     this->wnd_color_space.SetDroppedWidth(this->wnd_color_space.GetDroppedWidth() + dropped_width_increase);
 
@@ -383,6 +391,12 @@ LRESULT gui_configdlg_video::OnInitDialog(UINT /*uMsg*/, WPARAM /*wParam*/, LPAR
     case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709:
         this->wnd_color_space.SetCurSel(1);
         break;
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P601:
+        this->wnd_color_space.SetCurSel(2);
+        break;
+    case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P601:
+        this->wnd_color_space.SetCurSel(3);
+        break;
     default:
         throw HR_EXCEPTION(E_UNEXPECTED);
     }
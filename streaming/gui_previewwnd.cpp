@@ -461,10 +461,10 @@ out:
     canvas_to_preview = canvas_to_preview * Matrix3x2F::Translation(
         preview_rect.left, preview_rect.top);
 
-    CComPtr<ID2D1Bitmap1> bitmap;
-    media_buffer_texture_t last_buffer = preview_window->get_last_buffer();
-    if(last_buffer)
-        bitmap = last_buffer->bitmap;
+    // the preview bitmap is only updated when a new frame has arrived
+    CComPtr<ID2D1Bitmap1> bitmap = preview_window->get_preview_bitmap(
+        (UINT32)std::max(ceilf(preview_rect.right - preview_rect.left), 1.f),
+        (UINT32)std::max(ceilf(preview_rect.bottom - preview_rect.top), 1.f));
 
     preview_window->d2d1devctx->BeginDraw();
     preview_window->d2d1devctx->Clear(ColorF(ColorF::DimGray));
@@ -473,10 +473,9 @@ out:
         preview_rect.top > std::numeric_limits<FLOAT>::epsilon())
     {
         // draw preview rect
-        preview_window->d2d1devctx->SetTransform(canvas_to_preview);
+        preview_window->d2d1devctx->SetTransform(Matrix3x2F::Identity());
         if(bitmap)
-            preview_window->d2d1devctx->DrawBitmap(bitmap, RectF(0.f, 0.f,
-            (FLOAT)canvas_width, (FLOAT)canvas_height));
+            preview_window->d2d1devctx->DrawBitmap(bitmap, preview_rect);
 
         if(has_video_control)
         {
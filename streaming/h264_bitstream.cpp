@@ -0,0 +1,184 @@
+#include "h264_bitstream.h"
+#include "assert.h"
+#include <limits>
+
+#undef min
+#undef max
+
+namespace
+{
+
+// from ffmpeg(LGPL)
+const uint8_t* ff_avc_find_startcode_internal(const uint8_t* p,
+    const uint8_t* end)
+{
+    const uint8_t* a = p + 4 - ((intptr_t)p & 3);
+
+    for(end -= 3; p < a && p < end; p++) {
+        if(p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    }
+
+    for(end -= 3; p < end; p += 4) {
+        uint32_t x = *(const uint32_t*)p;
+
+        if((x - 0x01010101) & (~x) & 0x80808080) {
+            if(p[1] == 0) {
+                if(p[0] == 0 && p[2] == 1)
+                    return p;
+                if(p[2] == 0 && p[3] == 1)
+                    return p + 1;
+            }
+
+            if(p[3] == 0) {
+                if(p[2] == 0 && p[4] == 1)
+                    return p + 2;
+                if(p[4] == 0 && p[5] == 1)
+                    return p + 3;
+            }
+        }
+    }
+
+    for(end += 3; p < end; p++) {
+        if(p[0] == 0 && p[1] == 0 && p[2] == 1)
+            return p;
+    }
+
+    return end + 3;
+}
+
+void append_big_endian_u16(std::string& str, size_t val)
+{
+    if(val > std::numeric_limits<uint16_t>::max())
+        throw HR_EXCEPTION(E_UNEXPECTED);
+
+    str += (char)(uint8_t)(val >> 8);
+    str += (char)(uint8_t)val;
+}
+
+}
+
+h264_parameter_sets::h264_parameter_sets(
+    const std::string_view& sps, const std::string_view& pps) :
+    sps(sps), pps(pps)
+{
+    // the profile, the constraint flags and the level follow the nalu header
+    if(sps.size() < 4 || pps.empty())
+        throw HR_EXCEPTION(E_UNEXPECTED);
+
+    // ISO/IEC 14496-15:2004(E) 5.2.4.1
+    std::string& record = this->avc_decoder_configuration_record;
+    record.reserve(11 + sps.size() + pps.size());
+
+    // configuration version
+    record += (char)1;
+    // profile indication, profile compatibility and level indication
+    record.append(sps.substr(1, 3));
+    // 6 reserved bits and length size minus one
+    record += (char)(0xfc | (sizeof(uint32_t) - 1));
+    // 3 reserved bits and the number of sequence parameter sets
+    record += (char)(0xe0 | 1);
+    append_big_endian_u16(record, sps.size());
+    record.append(sps);
+    // the number of picture parameter sets
+    record += (char)1;
+    append_big_endian_u16(record, pps.size());
+    record.append(pps);
+}
+
+void h264_frame_info::initialize()
+{
+    this->buffer_poolable::initialize();
+    this->nalus.clear();
+    this->key_frame = false;
+    this->parameter_sets_changed = false;
+}
+
+void h264_frame_info::uninitialize()
+{
+    this->parameter_sets = nullptr;
+    this->buffer_poolable::uninitialize();
+}
+
+h264_bitstream_parser::h264_bitstream_parser() :
+    buffer_pool_frame_info(new buffer_pool_frame_info_t)
+{
+}
+
+h264_bitstream_parser::~h264_bitstream_parser()
+{
+    buffer_pool_frame_info_t::scoped_lock lock(this->buffer_pool_frame_info->mutex);
+    this->buffer_pool_frame_info->dispose();
+}
+
+h264_frame_info_t h264_bitstream_parser::parse(const std::string_view& frame)
+{
+    std::shared_ptr<h264_frame_info> info;
+    std::string_view sps, pps;
+
+    {
+        buffer_pool_frame_info_t::scoped_lock lock(this->buffer_pool_frame_info->mutex);
+        info = this->buffer_pool_frame_info->acquire_buffer();
+    }
+    info->initialize();
+
+    const uint8_t* begin = (const uint8_t*)frame.data();
+    const uint8_t* end = begin + frame.size();
+    const uint8_t* p = ff_avc_find_startcode_internal(begin, end);
+
+    while(p < end)
+    {
+        // skip the start code prefix
+        while(p < end && !*p)
+            p++;
+        if(p == end)
+            break;
+        p++;
+
+        const uint8_t* nalu_start = p;
+        p = std::min(ff_avc_find_startcode_internal(nalu_start, end), end);
+
+        // the trailing zeros belong to the next start code prefix
+        const uint8_t* nalu_end = p;
+        while(nalu_end > nalu_start && !nalu_end[-1])
+            nalu_end--;
+        if(nalu_end == nalu_start)
+            continue;
+
+        // check that the forbidden zero isn't set
+        if(*nalu_start & 0x80)
+            throw HR_EXCEPTION(E_UNEXPECTED);
+
+        h264_nalu nalu;
+        nalu.offset = (UINT32)(nalu_start - begin);
+        nalu.size = (UINT32)(nalu_end - nalu_start);
+        nalu.type = *nalu_start & 0x1f;
+        info->nalus.push_back(nalu);
+
+        if(nalu.type == H264_NALU_IDR)
+            info->key_frame = true;
+        else if(nalu.type == H264_NALU_SPS)
+            sps = frame.substr(nalu.offset, nalu.size);
+        else if(nalu.type == H264_NALU_PPS)
+            pps = frame.substr(nalu.offset, nalu.size);
+    }
+
+    if(info->nalus.empty())
+        throw HR_EXCEPTION(E_UNEXPECTED);
+
+    // a frame might carry only one of the parameter sets
+    if(sps.empty() && this->parameter_sets)
+        sps = this->parameter_sets->sps;
+    if(pps.empty() && this->parameter_sets)
+        pps = this->parameter_sets->pps;
+
+    if(!sps.empty() && !pps.empty() && (!this->parameter_sets ||
+        sps != this->parameter_sets->sps || pps != this->parameter_sets->pps))
+    {
+        this->parameter_sets.reset(new h264_parameter_sets(sps, pps));
+        info->parameter_sets_changed = true;
+    }
+
+    info->parameter_sets = this->parameter_sets;
+    return info;
+}
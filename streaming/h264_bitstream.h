@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Windows.h>
+#include "buffer_pool.h"
+#include <stdint.h>
+#include <memory>
+#include <vector>
+#include <string>
+#include <string_view>
+
+// parses the annex b bitstream of the encoded h264 frames once in the encoder stage,
+// so that the outputs don't need to rescan the payload;
+// the parameter sets are cached by the parser and shared between the frames until
+// the encoder emits different parameter sets
+
+enum h264_nalu_type : uint8_t
+{
+    H264_NALU_SLICE = 1,
+    H264_NALU_IDR = 5,
+    H264_NALU_SEI = 6,
+    H264_NALU_SPS = 7,
+    H264_NALU_PPS = 8,
+    H264_NALU_AUD = 9,
+    H264_NALU_FILLER = 12,
+};
+
+struct h264_nalu
+{
+    // the position of the nalu in the frame, excluding the start code prefix
+    UINT32 offset, size;
+    uint8_t type;
+};
+
+class h264_parameter_sets
+{
+public:
+    // the nalus without the start code prefixes
+    std::string sps, pps;
+    // the avc decoder configuration record of iso/iec 14496-15 with 4 byte nalu lengths
+    std::string avc_decoder_configuration_record;
+
+    // throws if the sps or pps is malformed
+    h264_parameter_sets(const std::string_view& sps, const std::string_view& pps);
+};
+
+typedef std::shared_ptr<const h264_parameter_sets> h264_parameter_sets_t;
+
+// the frame infos are pooled by the parser, so that the nalu vector keeps its capacity
+// between the frames
+class h264_frame_info : public buffer_poolable
+{
+    friend class buffer_pooled<h264_frame_info>;
+private:
+    void uninitialize();
+public:
+    std::vector<h264_nalu> nalus;
+    bool key_frame;
+    // the frame carries parameter sets that differ from the previous ones
+    bool parameter_sets_changed;
+    // the parameter sets that are in effect for the frame;
+    // null if the encoder hasn't emitted them yet
+    h264_parameter_sets_t parameter_sets;
+
+    h264_frame_info() : key_frame(false), parameter_sets_changed(false) {}
+
+    void initialize();
+
+    std::string_view get_nalu(const std::string_view& frame, const h264_nalu& nalu) const
+    {return frame.substr(nalu.offset, nalu.size);}
+};
+
+typedef std::shared_ptr<const h264_frame_info> h264_frame_info_t;
+typedef buffer_pooled<h264_frame_info> h264_frame_info_pooled;
+
+class h264_bitstream_parser
+{
+public:
+    typedef buffer_pool<h264_frame_info_pooled> buffer_pool_frame_info_t;
+private:
+    h264_parameter_sets_t parameter_sets;
+    std::shared_ptr<buffer_pool_frame_info_t> buffer_pool_frame_info;
+public:
+    h264_bitstream_parser();
+    ~h264_bitstream_parser();
+    h264_bitstream_parser(const h264_bitstream_parser&) = delete;
+    h264_bitstream_parser& operator=(const h264_bitstream_parser&) = delete;
+
+    // the frame is an access unit in annex b format;
+    // throws if the frame doesn't contain any nalus
+    h264_frame_info_t parse(const std::string_view& frame);
+};
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// portable interface for the encoding backend of transform_h264_encoder;
+// the interface doesn't use the media foundation or direct3d types, so that the
+// software backends can be built on any platform;
+// the backend receives frames in the color space of the params and
+// produces h264 frames in annex b format
+
+class h264_encoder_backend;
+using h264_encoder_backend_t = std::shared_ptr<h264_encoder_backend>;
+
+enum h264_encoder_profile
+{
+    H264_PROFILE_BASELINE,
+    H264_PROFILE_MAIN,
+    H264_PROFILE_HIGH,
+};
+
+enum h264_encoder_color_space
+{
+    H264_COLOR_SPACE_BT601_LIMITED,
+    H264_COLOR_SPACE_BT601_FULL,
+    H264_COLOR_SPACE_BT709_LIMITED,
+    H264_COLOR_SPACE_BT709_FULL,
+};
+
+enum h264_encoder_pixel_format
+{
+    // a luma plane and an interleaved chroma plane
+    H264_PIXEL_FORMAT_NV12,
+    // a luma plane and two chroma planes
+    H264_PIXEL_FORMAT_I420,
+};
+
+// a rectangle in frame coordinates; the right and bottom edges are exclusive
+struct h264_encoder_rect
+{
+    int32_t left, top, right, bottom;
+};
+
+// the frame is either in cpu planes or in a native texture of the platform
+struct h264_encoder_frame
+{
+    // in 100 nanosecond units
+    int64_t time, duration;
+    h264_encoder_pixel_format format;
+    // the planes are null if the frame is a native texture;
+    // nv12 uses the first two planes
+    const uint8_t* planes[3];
+    uint32_t strides[3];
+    // the texture for the backends that encode on the gpu;
+    // an ID3D11Texture2D on windows
+    void* native_texture;
+    // keeps the planes or the native texture alive while the backend holds the frame
+    std::shared_ptr<const void> owner;
+    // the regions that changed since the previous submitted frame;
+    // the whole frame is assumed to have changed if the rects aren't valid;
+    // the backends may use them as a hint for the motion search
+    bool dirty_rects_valid;
+    std::vector<h264_encoder_rect> dirty_rects;
+};
+
+// the pooled memory of the encoded frames
+class media_buffer_packet;
+
+// an encoded frame in annex b format
+struct h264_encoder_packet
+{
+    // in 100 nanosecond units
+    int64_t pts, dts, duration;
+    bool key_frame;
+    // the data is in the length of the buffer;
+    // the memory returns to the pool of the backend when the buffer is released
+    std::shared_ptr<media_buffer_packet> buffer;
+};
+
+struct h264_encoder_backend_params
+{
+    uint32_t frame_rate_num, frame_rate_den;
+    uint32_t frame_width, frame_height;
+    // in bits per second
+    uint32_t avg_bitrate;
+    // 0: low quality, 100: high quality
+    uint32_t quality_vs_speed;
+    h264_encoder_profile profile;
+    h264_encoder_color_space color_space;
+    // the maximum distance between idr frames, in frames;
+    // 0 uses the default of the encoder
+    uint32_t gop_size = 0;
+    // the frames of a closed gop don't reference the frames of the previous gop
+    bool closed_gop = true;
+    // the number of threads of a software encoder;
+    // 0 uses the default of the encoder
+    uint32_t worker_threads = 0;
+    // the number of slices per frame that the threads encode in parallel;
+    // 0 uses the default of the encoder
+    uint32_t slices = 0;
+};
+
+class h264_encoder_backend
+{
+public:
+    // the events of asynchronous backends;
+    // the events are called from the threads of the backend
+    class listener
+    {
+    public:
+        virtual ~listener() = default;
+
+        // the backend accepts one more input frame
+        virtual void on_need_input() = 0;
+        // one output frame can be received
+        virtual void on_have_output() = 0;
+        // all of the output has been received after a drain
+        virtual void on_drain_complete() = 0;
+    };
+
+    virtual ~h264_encoder_backend() = default;
+
+    // synchronous backends accept input whenever they have room for it and
+    // don't send events
+    virtual bool is_async() const = 0;
+    // the backends that encode on the gpu consume native textures;
+    // the other backends consume cpu planes in the input format
+    virtual bool uses_native_textures() const = 0;
+    virtual h264_encoder_pixel_format get_input_format() const = 0;
+
+    // the listener is not used by synchronous backends
+    virtual void initialize(const h264_encoder_backend_params&,
+        const std::weak_ptr<listener>&) = 0;
+    // returns false if a synchronous backend doesn't accept input before its output
+    // has been received, in which case the frame must be submitted again;
+    // asynchronous backends accept input only after on_need_input
+    virtual bool submit(const h264_encoder_frame&) = 0;
+    // returns false if no output is available;
+    // asynchronous backends must receive only once for each on_have_output
+    virtual bool receive(h264_encoder_packet&) = 0;
+    // flushes the frames held by the encoder to the output;
+    // synchronous backends drain before returning and the output is available through receive;
+    // asynchronous backends send on_drain_complete after the last on_have_output
+    virtual void drain() = 0;
+    // the next submitted frame is encoded as an idr frame;
+    // can be called from any thread;
+    // returns false if the backend doesn't support forcing key frames
+    virtual bool request_key_frame() = 0;
+    // changes the quality vs speed setting of the running encoder;
+    // can be called from any thread;
+    // returns false if the backend doesn't support reconfiguration;
+    // throws if the encoder rejects the change
+    virtual bool set_quality_vs_speed(uint32_t quality_vs_speed) = 0;
+    // changes the average bitrate of the running encoder;
+    // can be called from any thread;
+    // returns false if the backend doesn't support reconfiguration;
+    // throws if the encoder rejects the change
+    virtual bool reconfigure(uint32_t avg_bitrate) = 0;
+    // the sps and pps nalus in annex b format, used for configuring the outputs;
+    // valid after initialize;
+    // empty if the encoder emits the parameter sets only in the first frame
+    virtual std::string get_sequence_header() const = 0;
+};
@@ -0,0 +1,523 @@
+#include "h264_encoder_benchmark.h"
+#include "h264_encoder_mft.h"
+#include <Mferror.h>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <iomanip>
+#include <thread>
+#include "assert.h"
+
+#pragma comment(lib, "D3D11.lib")
+
+#define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
+#undef min
+#undef max
+
+namespace
+{
+
+// deterministic noise
+UINT32 hash(UINT32 x, UINT32 y, UINT32 seed)
+{
+    UINT32 h = x * 73856093u ^ y * 19349663u ^ seed * 83492791u;
+    h ^= h >> 13;
+    h *= 0x5bd1e995u;
+    h ^= h >> 15;
+    return h;
+}
+
+UINT64 get_process_cpu_time()
+{
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if(!GetProcessTimes(GetCurrentProcess(),
+        &creation_time, &exit_time, &kernel_time, &user_time))
+        throw HR_EXCEPTION(HRESULT_FROM_WIN32(GetLastError()));
+
+    ULARGE_INTEGER kernel, user;
+    kernel.LowPart = kernel_time.dwLowDateTime;
+    kernel.HighPart = kernel_time.dwHighDateTime;
+    user.LowPart = user_time.dwLowDateTime;
+    user.HighPart = user_time.dwHighDateTime;
+
+    // in 100 nanosecond units
+    return kernel.QuadPart + user.QuadPart;
+}
+
+double get_percentile(const std::vector<double>& sorted, UINT32 percentile)
+{
+    if(sorted.empty())
+        return 0.0;
+    return sorted[std::min(sorted.size() - 1, sorted.size() * percentile / 100)];
+}
+
+}
+
+h264_encoder_benchmark::h264_encoder_benchmark(const context_mutex_t& context_mutex,
+    const CComPtr<ID3D11Device>& d3d11dev) :
+    context_mutex(context_mutex),
+    d3d11dev(d3d11dev),
+    params(),
+    need_input(0),
+    drained(false),
+    output_bytes(0)
+{
+    this->d3d11dev->GetImmediateContext(&this->d3d11devctx);
+}
+
+const char* h264_encoder_benchmark::get_name(backend_t backend)
+{
+    switch(backend)
+    {
+    case BACKEND_HARDWARE:
+        return "hardware";
+    case BACKEND_SOFTWARE:
+        return "software";
+    default:
+        return "unknown";
+    }
+}
+
+const char* h264_encoder_benchmark::get_name(pattern_t pattern)
+{
+    switch(pattern)
+    {
+    case PATTERN_STATIC:
+        return "static";
+    case PATTERN_MOTION:
+        return "motion";
+    case PATTERN_SCREEN:
+        return "screen";
+    default:
+        return "unknown";
+    }
+}
+
+void h264_encoder_benchmark::generate_frame(pattern_t pattern, UINT32 n,
+    UINT32 width, UINT32 height,
+    BYTE* luma, UINT32 luma_pitch, BYTE* u, BYTE* v, UINT32 chroma_pitch, UINT32 chroma_step)
+{
+    switch(pattern)
+    {
+    case PATTERN_STATIC:
+        for(UINT32 y = 0; y < height; y++)
+            for(UINT32 x = 0; x < width; x++)
+                luma[y * luma_pitch + x] = (BYTE)(16 + (x + y) * 219 / (width + height));
+        for(UINT32 y = 0; y < height / 2; y++)
+            for(UINT32 x = 0; x < width / 2; x++)
+            {
+                u[y * chroma_pitch + x * chroma_step] = (BYTE)(64 + x * 128 / (width / 2));
+                v[y * chroma_pitch + x * chroma_step] = (BYTE)(64 + y * 128 / (height / 2));
+            }
+        break;
+    case PATTERN_MOTION:
+        // the noise scrolls diagonally
+        for(UINT32 y = 0; y < height; y++)
+            for(UINT32 x = 0; x < width; x++)
+                luma[y * luma_pitch + x] = (BYTE)(hash(x + n * 16, y + n * 8, 0) >> 24);
+        for(UINT32 y = 0; y < height / 2; y++)
+            for(UINT32 x = 0; x < width / 2; x++)
+            {
+                u[y * chroma_pitch + x * chroma_step] = (BYTE)(hash(x + n * 8, y + n * 4, 1) >> 24);
+                v[y * chroma_pitch + x * chroma_step] = (BYTE)(hash(x + n * 8, y + n * 4, 2) >> 24);
+            }
+        break;
+    case PATTERN_SCREEN:
+    {
+        // the glyphs are 8x16 cells of which a third are filled;
+        // the glyphs of one text row change per frame
+        const UINT32 cell_width = 8, cell_height = 16;
+        const UINT32 rows = std::max(height / cell_height, 1u);
+        const UINT32 active_row = n % rows;
+
+        for(UINT32 y = 0; y < height; y++)
+        {
+            const UINT32 row = y / cell_height;
+            const UINT32 seed = (row == active_row) ? n + 1 : 0;
+            for(UINT32 x = 0; x < width; x++)
+            {
+                const UINT32 col = x / cell_width;
+                const bool filled = hash(col, row, seed) % 3 == 0;
+                const bool stroke = filled &&
+                    (hash(x % cell_width, y % cell_height, hash(col, row, seed)) & 3) == 0;
+                luma[y * luma_pitch + x] = stroke ? 16 : 235;
+            }
+        }
+        for(UINT32 y = 0; y < height / 2; y++)
+            for(UINT32 x = 0; x < width / 2; x++)
+                u[y * chroma_pitch + x * chroma_step] = v[y * chroma_pitch + x * chroma_step] = 128;
+        break;
+    }
+    default:
+        assert_(false);
+    }
+}
+
+void h264_encoder_benchmark::create_frames(pattern_t pattern)
+{
+    HRESULT hr = S_OK;
+    CComPtr<ID3D11Texture2D> staging_texture;
+    D3D11_TEXTURE2D_DESC desc;
+    const UINT32 width = this->params.width, height = this->params.height;
+    const UINT32 chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    const UINT32 period = (pattern == PATTERN_STATIC) ? 1 : frame_period;
+    const bool native_textures = this->backend->uses_native_textures();
+    const h264_encoder_pixel_format format = this->backend->get_input_format();
+
+    this->frames.clear();
+
+    if(native_textures)
+    {
+        desc.Width = width;
+        desc.Height = height;
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.SampleDesc.Count = 1;
+        desc.SampleDesc.Quality = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+        desc.MiscFlags = 0;
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.Format = DXGI_FORMAT_NV12;
+        desc.BindFlags = 0;
+        CHECK_HR(hr = this->d3d11dev->CreateTexture2D(&desc, NULL, &staging_texture));
+
+        // the frames are in the same format as the output of the color converter
+        desc.CPUAccessFlags = 0;
+        desc.Usage = D3D11_USAGE_DEFAULT;
+        desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    }
+
+    for(UINT32 i = 0; i < period; i++)
+    {
+        h264_encoder_frame frame = {};
+        frame.format = format;
+
+        if(native_textures)
+        {
+            media_buffer_texture_t texture(new media_buffer_texture);
+            D3D11_MAPPED_SUBRESOURCE mapped;
+
+            texture->initialize(this->d3d11dev, desc, nullptr);
+
+            std::lock_guard<std::recursive_mutex> lock(*this->context_mutex);
+            CHECK_HR(hr = this->d3d11devctx->Map(staging_texture, 0, D3D11_MAP_WRITE, 0, &mapped));
+            {
+                BYTE* chroma = (BYTE*)mapped.pData + mapped.RowPitch * height;
+                generate_frame(pattern, i, width, height,
+                    (BYTE*)mapped.pData, mapped.RowPitch, chroma, chroma + 1, mapped.RowPitch, 2);
+            }
+            this->d3d11devctx->Unmap(staging_texture, 0);
+            this->d3d11devctx->CopyResource(texture->texture, staging_texture);
+
+            frame.native_texture = texture->texture.p;
+            frame.owner = texture;
+        }
+        else
+        {
+            const size_t luma_len = (size_t)width * height;
+            const size_t chroma_len = (size_t)chroma_width * chroma_height;
+            std::shared_ptr<std::vector<BYTE>> memory(
+                new std::vector<BYTE>(luma_len + chroma_len * 2));
+            BYTE* luma = memory->data();
+            BYTE* chroma = luma + luma_len;
+
+            if(format == H264_PIXEL_FORMAT_NV12)
+            {
+                generate_frame(pattern, i, width, height,
+                    luma, width, chroma, chroma + 1, chroma_width * 2, 2);
+                frame.strides[1] = chroma_width * 2;
+            }
+            else
+            {
+                generate_frame(pattern, i, width, height,
+                    luma, width, chroma, chroma + chroma_len, chroma_width, 1);
+                frame.planes[2] = chroma + chroma_len;
+                frame.strides[1] = frame.strides[2] = chroma_width;
+            }
+            frame.planes[0] = luma;
+            frame.planes[1] = chroma;
+            frame.strides[0] = width;
+            frame.owner = memory;
+        }
+
+        this->frames.push_back(std::move(frame));
+    }
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
+
+h264_encoder_backend_t h264_encoder_benchmark::create_backend(backend_t backend) const
+{
+    switch(backend)
+    {
+    case BACKEND_HARDWARE:
+        return h264_encoder_backend_t(
+            new h264_encoder_mft(this->context_mutex, this->d3d11dev, nullptr, false));
+    case BACKEND_SOFTWARE:
+        return h264_encoder_backend_t(
+            new h264_encoder_mft(this->context_mutex, this->d3d11dev, nullptr, true));
+    default:
+        throw HR_EXCEPTION(MF_E_TOPO_CODEC_NOT_FOUND);
+    }
+}
+
+bool h264_encoder_benchmark::receive_output()
+{
+    h264_encoder_packet packet;
+
+    if(!this->backend->receive(packet))
+        return false;
+
+    const steady_clock::time_point now = steady_clock::now();
+
+    {
+        scoped_lock lock(this->mutex);
+
+        // the frames that the encoder dropped are discarded
+        while(!this->frames_in_flight.empty() && this->frames_in_flight.front().first < packet.pts)
+            this->frames_in_flight.pop_front();
+        if(!this->frames_in_flight.empty() && this->frames_in_flight.front().first == packet.pts)
+        {
+            this->latencies.push_back(std::chrono::duration<double, std::milli>(
+                now - this->frames_in_flight.front().second).count());
+            this->frames_in_flight.pop_front();
+        }
+
+        this->output_bytes += packet.buffer->get_length();
+        this->last_output_time = now;
+    }
+
+    return true;
+}
+
+void h264_encoder_benchmark::on_need_input()
+{
+    {
+        scoped_lock lock(this->mutex);
+        this->need_input++;
+    }
+    this->cv.notify_all();
+}
+
+void h264_encoder_benchmark::on_have_output()
+{
+    this->receive_output();
+}
+
+void h264_encoder_benchmark::on_drain_complete()
+{
+    {
+        scoped_lock lock(this->mutex);
+        this->drained = true;
+    }
+    this->cv.notify_all();
+}
+
+h264_encoder_benchmark::result_t h264_encoder_benchmark::run(
+    backend_t backend, pattern_t pattern, const params_t& params)
+{
+    result_t result;
+    h264_encoder_backend_params backend_params;
+    const time_unit sample_duration = convert_to_time_unit(1, params.fps_num, params.fps_den);
+
+    this->params = params;
+
+    backend_params.frame_rate_num = params.fps_num;
+    backend_params.frame_rate_den = params.fps_den;
+    backend_params.frame_width = params.width;
+    backend_params.frame_height = params.height;
+    backend_params.avg_bitrate = params.bitrate * 1000;
+    backend_params.quality_vs_speed = params.quality_vs_speed;
+    backend_params.profile = H264_PROFILE_MAIN;
+    backend_params.color_space = H264_COLOR_SPACE_BT709_LIMITED;
+    backend_params.worker_threads = params.worker_threads;
+    backend_params.slices = params.slices;
+
+    this->need_input = 0;
+    this->drained = false;
+    this->frames_in_flight.clear();
+    this->latencies.clear();
+    this->output_bytes = 0;
+
+    this->backend = this->create_backend(backend);
+    this->backend->initialize(backend_params, this->shared_from_this<h264_encoder_benchmark>());
+    this->create_frames(pattern);
+
+    const bool async = this->backend->is_async();
+    const UINT64 cpu_time_start = get_process_cpu_time();
+    const steady_clock::time_point start = steady_clock::now();
+    this->last_output_time = start;
+
+    for(UINT32 i = 0; i < params.frame_count; i++)
+    {
+        h264_encoder_frame frame = this->frames[i % this->frames.size()];
+        frame.time = i * sample_duration;
+        frame.duration = sample_duration;
+
+        // asynchronous backends accept input only after on_need_input
+        if(async)
+        {
+            std::unique_lock<std::mutex> lock(this->mutex);
+            this->cv.wait(lock, [this] {return this->need_input > 0;});
+            this->need_input--;
+        }
+
+        {
+            scoped_lock lock(this->mutex);
+            this->frames_in_flight.emplace_back(i * sample_duration, steady_clock::now());
+        }
+
+        if(async)
+            this->backend->submit(frame);
+        else
+        {
+            // a synchronous backend doesn't accept input before its output is received
+            while(!this->backend->submit(frame))
+                if(!this->receive_output())
+                    throw HR_EXCEPTION(E_UNEXPECTED);
+            while(this->receive_output());
+        }
+    }
+
+    this->backend->drain();
+    if(async)
+    {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->cv.wait(lock, [this] {return this->drained;});
+    }
+    else
+        while(this->receive_output());
+
+    const UINT64 cpu_time = get_process_cpu_time() - cpu_time_start;
+
+    // the backend shuts down the encoder
+    this->backend = nullptr;
+    this->frames.clear();
+
+    {
+        scoped_lock lock(this->mutex);
+
+        const double elapsed =
+            std::chrono::duration<double>(this->last_output_time - start).count();
+        const double media_duration =
+            (double)this->latencies.size() * params.fps_den / params.fps_num;
+
+        std::sort(this->latencies.begin(), this->latencies.end());
+
+        result.frames = (UINT32)this->latencies.size();
+        if(elapsed > 0.0)
+            result.fps = result.frames / elapsed;
+        result.latency_p50 = get_percentile(this->latencies, 50);
+        result.latency_p90 = get_percentile(this->latencies, 90);
+        result.latency_p99 = get_percentile(this->latencies, 99);
+        result.latency_max = this->latencies.empty() ? 0.0 : this->latencies.back();
+        if(media_duration > 0.0)
+            result.bitrate = this->output_bytes * 8 / 1000.0 / media_duration;
+        result.bitrate_error = (result.bitrate - params.bitrate) * 100.0 / params.bitrate;
+        if(result.frames > 0)
+            result.cpu_time_per_frame = cpu_time / 10000.0 / result.frames;
+    }
+
+    return result;
+}
+
+void h264_encoder_benchmark::run_all(const params_t& params)
+{
+    HRESULT hr = S_OK;
+    CComPtr<ID3D11Device> d3d11dev;
+    CComPtr<ID3D11DeviceContext> d3d11devctx;
+    CComPtr<ID3D11Multithread> multithread;
+    h264_encoder_benchmark_t benchmark;
+
+    // the encoders are used in the same configuration as in the pipeline
+    CHECK_HR(hr = D3D11CreateDevice(
+        nullptr, D3D_DRIVER_TYPE_HARDWARE, nullptr,
+        D3D11_CREATE_DEVICE_BGRA_SUPPORT | D3D11_CREATE_DEVICE_VIDEO_SUPPORT,
+        nullptr, 0, D3D11_SDK_VERSION, &d3d11dev, nullptr, &d3d11devctx));
+    CHECK_HR(hr = d3d11devctx->QueryInterface(&multithread));
+    multithread->SetMultithreadProtected(TRUE);
+
+    benchmark.reset(new h264_encoder_benchmark(
+        context_mutex_t(new std::recursive_mutex), d3d11dev));
+
+    std::cout << "h264 encoder benchmark: " << params.width << "x" << params.height << " " <<
+        (double)params.fps_num / params.fps_den << "fps, " << params.bitrate << "kbps, " <<
+        params.frame_count << " frames" << std::endl;
+    std::cout << "backend  pattern    fps   p50ms   p90ms   p99ms   maxms  kbps  err%  "
+        "cpums/frame" << std::endl;
+
+    for(backend_t backend : {BACKEND_HARDWARE, BACKEND_SOFTWARE})
+    {
+        for(pattern_t pattern : {PATTERN_STATIC, PATTERN_MOTION, PATTERN_SCREEN})
+        {
+            std::cout << std::left << std::setw(9) << get_name(backend) <<
+                std::setw(8) << get_name(pattern) << std::right;
+
+            try
+            {
+                const result_t result = benchmark->run(backend, pattern, params);
+                std::cout << std::fixed << std::setprecision(1) <<
+                    std::setw(7) << result.fps <<
+                    std::setw(8) << result.latency_p50 <<
+                    std::setw(8) << result.latency_p90 <<
+                    std::setw(8) << result.latency_p99 <<
+                    std::setw(8) << result.latency_max <<
+                    std::setw(6) << std::setprecision(0) << result.bitrate <<
+                    std::setw(6) << std::setprecision(1) << result.bitrate_error <<
+                    std::setw(8) << std::setprecision(2) << result.cpu_time_per_frame <<
+                    std::defaultfloat << std::endl;
+            }
+            catch(streaming::exception err)
+            {
+                std::cout << "  not available: " << err.what() << std::endl;
+                break;
+            }
+        }
+    }
+
+    // the scaling of the software encoder over the worker threads;
+    // the motion pattern keeps every thread busy
+    std::cout << "worker thread sweep, " << get_name(PATTERN_MOTION) << " pattern" << std::endl;
+    std::cout << "backend  threads    fps  speedup  cpums/frame" << std::endl;
+    for(backend_t backend : {BACKEND_SOFTWARE})
+    {
+        // hardware concurrency is 0 if it is unknown
+        const UINT32 cores = std::max(std::thread::hardware_concurrency(), 1u);
+        double single_thread_fps = 0.0;
+
+        for(UINT32 worker_threads = 1; worker_threads <= 16; worker_threads *= 2)
+        {
+            if(worker_threads > cores)
+                break;
+
+            params_t sweep_params = params;
+            sweep_params.worker_threads = worker_threads;
+            std::cout << std::left << std::setw(9) << get_name(backend) << std::right <<
+                std::setw(7) << worker_threads;
+
+            try
+            {
+                const result_t result = benchmark->run(backend, PATTERN_MOTION, sweep_params);
+                if(worker_threads == 1)
+                    single_thread_fps = result.fps;
+                std::cout << std::fixed << std::setprecision(1) <<
+                    std::setw(7) << result.fps <<
+                    std::setw(9) << std::setprecision(2) <<
+                    (single_thread_fps > 0.0 ? result.fps / single_thread_fps : 0.0) <<
+                    std::setw(13) << result.cpu_time_per_frame <<
+                    std::defaultfloat << std::endl;
+            }
+            catch(streaming::exception err)
+            {
+                std::cout << "  not available: " << err.what() << std::endl;
+                break;
+            }
+        }
+    }
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
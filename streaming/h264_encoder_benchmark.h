@@ -0,0 +1,132 @@
+#pragma once
+
+#include "h264_encoder_backend.h"
+#include "media_component.h"
+#include "enable_shared_from_this.h"
+#include <d3d11.h>
+#include <atlbase.h>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <vector>
+#include <deque>
+
+/*
+
+headless benchmark of the h264 encoder backends;
+deterministic synthetic frames are fed to a backend as fast as it accepts them,
+so that the encoding rate is the throughput of the backend instead of the real time rate
+of the pipeline;
+the frames are generated before the measurement starts, as textures for the gpu backends and
+in system memory for the software backends, and the results report
+the encoding rate, the per frame latency percentiles, the accuracy of the output bitrate
+and the cpu time of the process
+
+*/
+
+class h264_encoder_benchmark final :
+    public h264_encoder_backend::listener,
+    public enable_shared_from_this
+{
+public:
+    typedef std::lock_guard<std::mutex> scoped_lock;
+    typedef std::chrono::steady_clock steady_clock;
+
+    enum backend_t
+    {
+        BACKEND_HARDWARE,
+        BACKEND_SOFTWARE,
+    };
+
+    enum pattern_t
+    {
+        // the same frame is repeated
+        PATTERN_STATIC,
+        // scrolling noise, which is the worst case for the motion estimation
+        PATTERN_MOTION,
+        // flat background with text-like blocks, of which a few change per frame
+        PATTERN_SCREEN,
+    };
+
+    struct params_t
+    {
+        UINT32 width = 1920, height = 1080;
+        UINT32 fps_num = 60, fps_den = 1;
+        // in kbps
+        UINT32 bitrate = 6000;
+        UINT32 frame_count = 600;
+        UINT32 quality_vs_speed = 50;
+        UINT32 worker_threads = 0, slices = 0;
+    };
+
+    struct result_t
+    {
+        UINT32 frames = 0;
+        double fps = 0.0;
+        // in milliseconds
+        double latency_p50 = 0.0, latency_p90 = 0.0, latency_p99 = 0.0, latency_max = 0.0;
+        // in kbps
+        double bitrate = 0.0;
+        // the deviation of the output bitrate from the target bitrate, in percent
+        double bitrate_error = 0.0;
+        // the cpu time of the process during the encoding, in milliseconds per frame
+        double cpu_time_per_frame = 0.0;
+    };
+
+    // the number of distinct frames in a pattern;
+    // the frames are cycled after the period
+    static const UINT32 frame_period = 30;
+private:
+    context_mutex_t context_mutex;
+    CComPtr<ID3D11Device> d3d11dev;
+    CComPtr<ID3D11DeviceContext> d3d11devctx;
+
+    h264_encoder_backend_t backend;
+    params_t params;
+    // the owners of the frames keep the textures or the system memory
+    std::vector<h264_encoder_frame> frames;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    UINT32 need_input;
+    bool drained;
+
+    // the sample time and the submit time of the frames in the encoder;
+    // guarded by the mutex
+    std::deque<std::pair<time_unit, steady_clock::time_point>> frames_in_flight;
+    std::vector<double> latencies;
+    UINT64 output_bytes;
+    steady_clock::time_point last_output_time;
+
+    // fills the planes of the nth frame of the pattern;
+    // the chroma step is 2 for the interleaved nv12 chroma and 1 for the i420 chroma planes
+    static void generate_frame(pattern_t, UINT32 n, UINT32 width, UINT32 height,
+        BYTE* luma, UINT32 luma_pitch, BYTE* u, BYTE* v, UINT32 chroma_pitch, UINT32 chroma_step);
+    // creates the frames in the input format of the backend
+    void create_frames(pattern_t);
+    h264_encoder_backend_t create_backend(backend_t) const;
+    // receives the available output;
+    // returns false if no output was available
+    bool receive_output();
+
+    // h264_encoder_backend::listener
+    void on_need_input() override;
+    void on_have_output() override;
+    void on_drain_complete() override;
+public:
+    h264_encoder_benchmark(const context_mutex_t&, const CComPtr<ID3D11Device>&);
+
+    static const char* get_name(backend_t);
+    static const char* get_name(pattern_t);
+
+    // throws if the backend isn't available
+    result_t run(backend_t, pattern_t, const params_t&);
+
+    // runs every available backend with every pattern
+    // on the default adapter and sweeps the worker threads of the software backends;
+    // prints the results
+    static void run_all(const params_t&);
+};
+
+typedef std::shared_ptr<h264_encoder_benchmark> h264_encoder_benchmark_t;
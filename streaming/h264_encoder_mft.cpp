@@ -0,0 +1,801 @@
+#include "h264_encoder_mft.h"
+#include <Mferror.h>
+#include <initguid.h>
+#include <evr.h>
+#include <iostream>
+#include "assert.h"
+#include "IUnknownImpl.h"
+
+#pragma comment(lib, "dxguid.lib")
+
+#define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
+#undef max
+#undef min
+
+// wraps a texture sample
+class media_buffer_wrapper : public IMFMediaBuffer, IUnknownImpl
+{
+private:
+    const bool use_system_memory;
+    // the owner of the texture of the frame
+    std::shared_ptr<const void> owner;
+    CComPtr<IMFMediaBuffer> media_buffer;
+public:
+    explicit media_buffer_wrapper(const context_mutex_t& /*context_mutex*/,
+        const std::shared_ptr<const void>& owner,
+        const CComPtr<IMFMediaBuffer>& media_buffer,
+        bool use_system_memory = false) :
+        owner(owner), media_buffer(media_buffer), use_system_memory(use_system_memory)
+    {
+    }
+
+    ULONG STDMETHODCALLTYPE AddRef() {return IUnknownImpl::AddRef();}
+    ULONG STDMETHODCALLTYPE Release() {return IUnknownImpl::Release();}
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv)
+    {
+        // workaround for intel encoder where the encoder would try to use the directx
+        // buffer that has been allocated by a separate adapter
+        if(this->use_system_memory && riid == __uuidof(IMFDXGIBuffer))
+            return E_NOINTERFACE;
+
+        return this->media_buffer->QueryInterface(riid, ppv);
+    }
+
+    HRESULT STDMETHODCALLTYPE Lock(BYTE **ppbBuffer, DWORD *pcbMaxLength, DWORD *pcbCurrentLength)
+    {
+        return this->media_buffer->Lock(ppbBuffer, pcbMaxLength, pcbCurrentLength);
+    }
+    HRESULT STDMETHODCALLTYPE Unlock()
+    {
+        return this->media_buffer->Unlock();
+    }
+    HRESULT STDMETHODCALLTYPE GetCurrentLength(DWORD *pcbCurrentLength)
+    {
+        return this->media_buffer->GetCurrentLength(pcbCurrentLength);
+    }
+    HRESULT STDMETHODCALLTYPE SetCurrentLength(DWORD cbCurrentLength)
+    {
+        return this->media_buffer->SetCurrentLength(cbCurrentLength);
+    }
+    HRESULT STDMETHODCALLTYPE GetMaxLength(DWORD *pcbMaxLength)
+    {
+        return this->media_buffer->GetMaxLength(pcbMaxLength);
+    }
+};
+
+h264_encoder_mft::h264_encoder_mft(const context_mutex_t& context_mutex,
+    const CComPtr<ID3D11Device>& d3d11dev, const CLSID* clsid, bool software) :
+    context_mutex(context_mutex),
+    d3d11dev(software ? nullptr : d3d11dev),
+    use_system_memory(!d3d11dev || software),
+    software(software),
+    params(),
+    input_id(0), output_id(0),
+    reset_token(0),
+    key_frame_supported(false),
+    key_frame_requested(false),
+    frame_number(0),
+    buffer_pool_packet(new buffer_pool_packet_t(PACKET_POOL_BUCKET_LIMIT, PACKET_POOL_MAX_AGE))
+{
+    if(clsid)
+        this->clsid = *clsid;
+    this->events_callback.Attach(new async_callback_t(&h264_encoder_mft::events_cb));
+    this->input_sample_pool.Attach(new media_sample_pool);
+}
+
+h264_encoder_mft::~h264_encoder_mft()
+{
+    HRESULT hr = S_OK;
+    CComPtr<IMFShutdown> shutdown;
+    if(this->encoder && SUCCEEDED(hr = this->encoder->QueryInterface(&shutdown)))
+        hr = shutdown->Shutdown();
+
+    this->input_sample_pool->dispose();
+
+    buffer_pool_packet_t::scoped_lock lock(this->buffer_pool_packet->mutex);
+    this->buffer_pool_packet->dispose();
+}
+
+HRESULT h264_encoder_mft::set_color_space(
+    const CComPtr<IMFMediaType>& type, h264_encoder_color_space color_space)
+{
+    HRESULT hr = S_OK;
+
+    switch(color_space)
+    {
+    case H264_COLOR_SPACE_BT709_FULL:
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_PRIMARIES, MFVideoPrimaries_BT709));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_TRANSFER_FUNCTION, MFVideoTransFunc_709));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT709));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_CHROMA_SITING, MFVideoChromaSubsampling_MPEG2));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_0_255));
+
+        break;
+    case H264_COLOR_SPACE_BT709_LIMITED:
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_PRIMARIES, MFVideoPrimaries_BT709));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_TRANSFER_FUNCTION, MFVideoTransFunc_709));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT709));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_CHROMA_SITING, MFVideoChromaSubsampling_MPEG2));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_16_235));
+
+        break;
+    case H264_COLOR_SPACE_BT601_FULL:
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_PRIMARIES, MFVideoPrimaries_SMPTE170M));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_TRANSFER_FUNCTION, MFVideoTransFunc_709));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT601));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_CHROMA_SITING, MFVideoChromaSubsampling_MPEG2));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_0_255));
+
+        break;
+    case H264_COLOR_SPACE_BT601_LIMITED:
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_PRIMARIES, MFVideoPrimaries_SMPTE170M));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_TRANSFER_FUNCTION, MFVideoTransFunc_709));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT601));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_CHROMA_SITING, MFVideoChromaSubsampling_MPEG2));
+        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_16_235));
+
+        break;
+    default:
+        CHECK_HR(hr = E_UNEXPECTED);
+    }
+
+done:
+    return hr;
+}
+
+HRESULT h264_encoder_mft::set_input_stream_type()
+{
+    HRESULT hr = S_OK;
+
+    CComPtr<IMFMediaType> input_type;
+    CHECK_HR(hr = MFCreateMediaType(&input_type));
+    CHECK_HR(hr = input_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
+    CHECK_HR(hr = input_type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12));
+    CHECK_HR(hr = set_color_space(input_type, this->params.color_space));
+
+    /*CHECK_HR(hr = input_type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_ARGB32));*/
+
+    CHECK_HR(hr = MFSetAttributeRatio(input_type, MF_MT_FRAME_RATE, 
+        this->params.frame_rate_num, this->params.frame_rate_den));
+    CHECK_HR(hr = MFSetAttributeSize(input_type, MF_MT_FRAME_SIZE, 
+        this->params.frame_width, this->params.frame_height));
+    CHECK_HR(hr = input_type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
+    CHECK_HR(hr = input_type->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE));
+    CHECK_HR(hr = MFSetAttributeRatio(input_type, MF_MT_PIXEL_ASPECT_RATIO, 1, 1));
+
+    CHECK_HR(hr = this->encoder->SetInputType(this->input_id, input_type, 0));
+done:
+    return hr;
+}
+
+HRESULT h264_encoder_mft::create_output_type(const h264_encoder_backend_params& params,
+    const std::string& sequence_header, CComPtr<IMFMediaType>& type)
+{
+    HRESULT hr = S_OK;
+    eAVEncH264VProfile profile = eAVEncH264VProfile_Main;
+
+    switch(params.profile)
+    {
+    case H264_PROFILE_BASELINE:
+        profile = eAVEncH264VProfile_Base;
+        break;
+    case H264_PROFILE_MAIN:
+        profile = eAVEncH264VProfile_Main;
+        break;
+    case H264_PROFILE_HIGH:
+        profile = eAVEncH264VProfile_High;
+        break;
+    default:
+        CHECK_HR(hr = E_UNEXPECTED);
+    }
+
+    type = NULL;
+    CHECK_HR(hr = MFCreateMediaType(&type));
+    CHECK_HR(hr = type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
+    CHECK_HR(hr = type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_H264));
+    CHECK_HR(hr = set_color_space(type, params.color_space));
+    CHECK_HR(hr = type->SetUINT32(MF_MT_AVG_BITRATE, params.avg_bitrate));
+    CHECK_HR(hr = MFSetAttributeRatio(type, MF_MT_FRAME_RATE, 
+        params.frame_rate_num, params.frame_rate_den));
+    CHECK_HR(hr = MFSetAttributeSize(type, MF_MT_FRAME_SIZE, 
+        params.frame_width, params.frame_height));
+    CHECK_HR(hr = type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
+    // intel mft only supports main profile
+    // (There is no support for Baseline, Extended, or High-10 Profiles.);
+    // twitch requires main/high
+    CHECK_HR(hr = type->SetUINT32(MF_MT_MPEG2_PROFILE, profile));
+    // twitch requires level 4.2
+    CHECK_HR(hr = type->SetUINT32(MF_MT_MPEG2_LEVEL, eAVEncH264VLevel4_2));
+    /*CHECK_HR(hr = type->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE));*/
+    CHECK_HR(hr = MFSetAttributeRatio(type, MF_MT_PIXEL_ASPECT_RATIO, 1, 1));
+    if(!sequence_header.empty())
+        CHECK_HR(hr = type->SetBlob(MF_MT_MPEG_SEQUENCE_HEADER,
+            (const UINT8*)sequence_header.data(), (UINT32)sequence_header.size()));
+
+done:
+    return hr;
+}
+
+HRESULT h264_encoder_mft::set_output_stream_type()
+{
+    HRESULT hr = S_OK;
+    CComPtr<IMFMediaType> current_type;
+    UINT32 sequence_header_len = 0;
+
+    CHECK_HR(hr = create_output_type(this->params, "", this->output_type));
+    CHECK_HR(hr = this->encoder->SetOutputType(this->output_id, this->output_type, 0));
+
+    // most of the encoders set the sequence header only after the first output
+    this->sequence_header.clear();
+    CHECK_HR(hr = this->encoder->GetOutputCurrentType(this->output_id, &current_type));
+    if(SUCCEEDED(current_type->GetBlobSize(MF_MT_MPEG_SEQUENCE_HEADER, &sequence_header_len)))
+    {
+        this->sequence_header.resize(sequence_header_len);
+        CHECK_HR(hr = current_type->GetBlob(MF_MT_MPEG_SEQUENCE_HEADER,
+            (UINT8*)this->sequence_header.data(), sequence_header_len, NULL));
+    }
+
+done:
+    return hr;
+}
+
+HRESULT h264_encoder_mft::set_encoder_parameters()
+{
+    HRESULT hr = S_OK;
+    CComPtr<ICodecAPI> codec;
+    VARIANT v = {0};
+
+    CHECK_HR(hr = this->encoder->QueryInterface(&codec));
+
+    v = {0};
+    v.vt = VT_UI4;
+    v.ulVal = eAVEncCommonRateControlMode_CBR;
+    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonRateControlMode, &v));
+    v = {0};
+    v.vt = VT_UI4;
+    v.ullVal = this->params.quality_vs_speed;
+    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonQualityVsSpeed, &v));
+    v = {0};
+    v.vt = VT_UI4;
+    v.ullVal = this->params.avg_bitrate;
+    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonMeanBitRate, &v));
+
+    if(this->params.gop_size && codec->IsSupported(&CODECAPI_AVEncMPVGOPSize) == S_OK)
+    {
+        v = {0};
+        v.vt = VT_UI4;
+        v.ulVal = this->params.gop_size;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncMPVGOPSize, &v));
+    }
+
+    if(codec->IsSupported(&CODECAPI_AVEncMPVGOPOpen) == S_OK)
+    {
+        v = {0};
+        v.vt = VT_BOOL;
+        v.boolVal = this->params.closed_gop ? VARIANT_FALSE : VARIANT_TRUE;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncMPVGOPOpen, &v));
+    }
+
+    this->key_frame_supported =
+        codec->IsSupported(&CODECAPI_AVEncVideoForceKeyFrame) == S_OK;
+
+    /*{
+        VARIANT max_bitrate = {0};
+        max_bitrate.vt = VT_UI4;
+        max_bitrate.ullVal = this->params.avg_bitrate;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonMaxBitRate, &max_bitrate));
+
+        max_bitrate = {0};
+        max_bitrate.vt = VT_UI4;
+        max_bitrate.ullVal = this->params.avg_bitrate * 8;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonBufferSize, &max_bitrate));
+    }*/
+
+    if(codec->IsSupported(&CODECAPI_AVLowLatencyMode) == S_OK)
+    {
+        v = {0};
+        v.vt = VT_BOOL;
+        v.ulVal = VARIANT_FALSE;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVLowLatencyMode, &v));
+    }
+
+    if(codec->IsSupported(&CODECAPI_AVEncMPVDefaultBPictureCount) == S_OK)
+    {
+        v = {0};
+        v.vt = VT_UI4;
+        v.uintVal = 0;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncMPVDefaultBPictureCount, &v));
+    }
+
+    // the threading applies only to the software encoder;
+    // the hardware encoders are left to their own defaults
+    if(this->software && this->params.worker_threads &&
+        codec->IsSupported(&CODECAPI_AVEncNumWorkerThreads) == S_OK)
+    {
+        v = {0};
+        v.vt = VT_UI4;
+        v.ulVal = this->params.worker_threads;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncNumWorkerThreads, &v));
+    }
+
+    // the slice control size is in slices in slice control mode 2
+    if(this->software && this->params.slices &&
+        codec->IsSupported(&CODECAPI_AVEncSliceControlMode) == S_OK &&
+        codec->IsSupported(&CODECAPI_AVEncSliceControlSize) == S_OK)
+    {
+        v = {0};
+        v.vt = VT_UI4;
+        v.ulVal = 2;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncSliceControlMode, &v));
+        v = {0};
+        v.vt = VT_UI4;
+        v.ulVal = this->params.slices;
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncSliceControlSize, &v));
+    }
+
+done:
+    return hr;
+}
+
+void h264_encoder_mft::events_cb(void* unk)
+{
+    try
+    {
+        streaming::check_for_errors();
+
+        IMFAsyncResult* result = (IMFAsyncResult*)unk;
+        HRESULT hr = S_OK;
+        CComPtr<IMFMediaEvent> media_event;
+        std::shared_ptr<h264_encoder_backend::listener> listener = this->event_listener.lock();
+
+        MediaEventType type = MEUnknown;
+        HRESULT status = S_OK;
+
+        // get the event from the event queue
+        CHECK_HR(hr = this->event_generator->EndGetEvent(result, &media_event));
+
+        // process the event
+        CHECK_HR(hr = media_event->GetType(&type));
+        CHECK_HR(hr = media_event->GetStatus(&status));
+
+        if(type == MEError)
+        {
+            // status has the error code
+            throw HR_EXCEPTION(status);
+        }
+        else if(!listener)
+        {
+            // the transform has been destroyed
+        }
+        else if(type == METransformNeedInput)
+            listener->on_need_input();
+        else if(type == METransformHaveOutput)
+            listener->on_have_output();
+        else if(type == METransformDrainComplete)
+            listener->on_drain_complete();
+        else
+            assert_(false);
+
+        // set callback for the next event
+        CHECK_HR(hr = this->event_generator->BeginGetEvent(&this->events_callback->native, NULL));
+
+done:
+        if(FAILED(hr))
+            throw HR_EXCEPTION(hr);
+    }
+    catch(streaming::exception e)
+    {
+        streaming::print_error_and_abort(e.what());
+    }
+}
+
+void h264_encoder_mft::initialize(const h264_encoder_backend_params& params,
+    const std::weak_ptr<h264_encoder_backend::listener>& listener)
+{
+    HRESULT hr = S_OK;
+
+    this->params = params;
+    this->event_listener = listener;
+
+    CComPtr<IMFAttributes> attributes;
+    UINT count = 0;
+    UINT activate_index = 0;
+    const CLSID* clsid = this->clsid ? &*this->clsid : nullptr;
+    // array must be released with cotaskmemfree
+    IMFActivate** activate = NULL;
+    MFT_REGISTER_TYPE_INFO info = {MFMediaType_Video, MFVideoFormat_H264};
+    UINT32 flags = MFT_ENUM_FLAG_SORTANDFILTER;
+    if(!this->software)
+        flags |= MFT_ENUM_FLAG_HARDWARE;
+    CHECK_HR(hr = MFTEnumEx(
+        MFT_CATEGORY_VIDEO_ENCODER,
+        flags,
+        NULL,
+        &info,
+        &activate,
+        &count));
+
+    // find the requested encoder
+    if(clsid)
+    {
+        bool found = false;
+        for(UINT i = 0; i < count; i++)
+        {
+            static_assert(std::is_same_v<
+                decltype(clsid),
+                const CLSID*>);
+
+            CLSID clsid2;
+            CHECK_HR(hr = activate[i]->GetGUID(MFT_TRANSFORM_CLSID_Attribute, &clsid2));
+
+            if(std::memcmp(clsid, &clsid2, sizeof(CLSID)) == 0)
+            {
+                found = true;
+                activate_index = i;
+                break;
+            }
+        }
+
+        if(!found)
+            CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+    }
+
+    if(!count)
+        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+
+    // activate the encoder
+    CHECK_HR(hr = 
+        activate[activate_index]->ActivateObject(__uuidof(IMFTransform), (void**)&this->encoder));
+
+    // check if the encoder supports d3d11
+    CHECK_HR(hr = this->encoder->GetAttributes(&attributes));
+    if(!this->use_system_memory)
+    {
+        UINT32 d3d11_support;
+        CHECK_HR(hr = attributes->GetUINT32(MF_SA_D3D11_AWARE, &d3d11_support));
+        if(!d3d11_support)
+            CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+    }
+
+    // verify that the encoder is async
+    if(!this->software)
+    {
+        UINT32 async_support;
+        CHECK_HR(hr = attributes->GetUINT32(MF_TRANSFORM_ASYNC, &async_support));
+        if(!async_support)
+            CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+        // unlock the encoder(must be done for asynchronous transforms)
+        CHECK_HR(hr = attributes->SetUINT32(MF_TRANSFORM_ASYNC_UNLOCK, TRUE));
+    }
+
+    // check that the encoder transform has only a fixed number of streams
+    DWORD input_stream_count, output_stream_count;
+    CHECK_HR(hr = this->encoder->GetStreamCount(&input_stream_count, &output_stream_count));
+    if(input_stream_count != 1 || output_stream_count != 1)
+        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+
+    hr = this->encoder->GetStreamIDs(
+        input_stream_count, &this->input_id, output_stream_count, &this->output_id);
+    if(hr == E_NOTIMPL)
+        this->input_id = this->output_id = 0;
+    else if(FAILED(hr))
+        CHECK_HR(hr);
+
+    // associate a dxgidevicemanager with the encoder;
+    // this might fail if the adapter backing up the d3d device is
+    // incompatible with the mft
+    if(!this->use_system_memory)
+    {
+        CHECK_HR(hr = MFCreateDXGIDeviceManager(&this->reset_token, &this->devmngr));
+        CHECK_HR(hr = this->devmngr->ResetDevice(this->d3d11dev, this->reset_token));
+        CHECK_HR(hr = this->encoder->ProcessMessage(
+            MFT_MESSAGE_SET_D3D_MANAGER, (ULONG_PTR)this->devmngr.p));
+    }
+
+    // set the encoder parameters
+    CHECK_HR(hr = this->set_encoder_parameters());
+
+    // set media types for the encoder(output type must be set first)
+    CHECK_HR(hr = this->set_output_stream_type());
+    CHECK_HR(hr = this->set_input_stream_type());
+
+    // get the buffer requirements for the encoder
+    CHECK_HR(hr = this->encoder->GetInputStreamInfo(this->input_id, &this->input_stream_info));
+    CHECK_HR(hr = this->encoder->GetOutputStreamInfo(this->output_id, &this->output_stream_info));
+
+    if(this->input_stream_info.dwFlags & MFT_INPUT_STREAM_DOES_NOT_ADDREF)
+        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+
+    if(!(this->output_stream_info.dwFlags & MFT_OUTPUT_STREAM_PROVIDES_SAMPLES))
+        CHECK_HR(hr = MFCreateSample(&this->output_sample));
+
+    // get the media event generator interface
+    if(!this->software)
+    {
+        CHECK_HR(hr = this->encoder->QueryInterface(&this->event_generator));
+        // register this to the event callback function
+        this->events_callback->set_callback(this->shared_from_this<h264_encoder_mft>());
+    }
+
+    /*
+    amd holds the reference to the submitted buffer
+    amd hardware mft supports nv12 and argb32 input types
+
+    intel quicksync only supports nv12 and is not direct3d aware
+    microsoft async mft supports only nv12 and is not direct3d aware
+    */
+
+    // start the encoder
+    {
+        std::unique_lock<std::recursive_mutex> lock(*this->context_mutex, std::defer_lock);
+        if(!this->use_system_memory)
+            lock.lock();
+        if(!this->software)
+            CHECK_HR(hr = this->event_generator->BeginGetEvent(&this->events_callback->native, NULL));
+        CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL));
+        CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL));
+    }
+
+done:
+    // release allocated memory
+    if(activate)
+    {
+        for(UINT i = 0; i < count; i++)
+            activate[i]->Release();
+        CoTaskMemFree(activate);
+    }
+
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
+
+bool h264_encoder_mft::submit(const h264_encoder_frame& frame)
+{
+    HRESULT hr = S_OK;
+
+    ID3D11Texture2D* texture = (ID3D11Texture2D*)frame.native_texture;
+    CComPtr<IMFMediaBuffer> buffer;
+    CComPtr<media_buffer_wrapper> buffer_wrapper;
+    CComPtr<IMFSample> sample;
+    std::vector<BYTE> dirty_rect_info;
+
+    // the encoder is fed only with textures
+    if(!texture)
+        CHECK_HR(hr = E_UNEXPECTED);
+
+#ifdef _DEBUG
+    {
+        D3D11_TEXTURE2D_DESC desc;
+        texture->GetDesc(&desc);
+        assert_(desc.Width == this->params.frame_width && desc.Height == this->params.frame_height);
+    }
+#endif
+
+    // the dxgi surface buffer is created for each frame, because caching it would
+    // keep the textures of the upstream pools alive
+
+    // create the input sample buffer
+    CHECK_HR(hr = MFCreateDXGISurfaceBuffer(IID_ID3D11Texture2D,
+        texture, 0, FALSE, &buffer));
+    buffer_wrapper.Attach(new media_buffer_wrapper(this->context_mutex,
+        frame.owner, buffer, this->use_system_memory));
+
+    // the frame is released when the encoder releases the sample;
+    // the amd encoder probably copies the discontinuity flag to output sample,
+    // which might cause problems when the sample is passed to sinkwriter
+    sample = this->input_sample_pool->acquire_sample();
+    CHECK_HR(hr = sample->AddBuffer(buffer_wrapper));
+    CHECK_HR(hr = sample->SetSampleTime(frame.time));
+    CHECK_HR(hr = sample->SetSampleDuration(frame.duration));
+
+    // the encoders that support the dirty rects skip the motion search of the
+    // unchanged regions
+    if(frame.dirty_rects_valid)
+    {
+        const size_t rect_count = frame.dirty_rects.size();
+        const size_t size = offsetof(DIRTYRECT_INFO, DirtyRects) +
+            (rect_count ? rect_count : 1) * sizeof(RECT);
+        dirty_rect_info.assign(size, 0);
+
+        DIRTYRECT_INFO* info = (DIRTYRECT_INFO*)dirty_rect_info.data();
+        info->FrameNumber = this->frame_number;
+        info->NumDirtyRects = (UINT)rect_count;
+        for(size_t i = 0; i < rect_count; i++)
+        {
+            const h264_encoder_rect& rect = frame.dirty_rects[i];
+            info->DirtyRects[i] = {rect.left, rect.top, rect.right, rect.bottom};
+        }
+        CHECK_HR(hr = sample->SetBlob(MFSampleExtension_DirtyRects,
+            dirty_rect_info.data(), (UINT32)size));
+    }
+
+    // the forced key frame applies to the next input
+    if(this->key_frame_requested.exchange(false))
+    {
+        CComPtr<ICodecAPI> codec;
+        VARIANT v = {0};
+
+        v.vt = VT_UI4;
+        v.ulVal = 1;
+        CHECK_HR(hr = this->encoder->QueryInterface(&codec));
+        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncVideoForceKeyFrame, &v));
+    }
+
+    // feed the encoder;
+    // the synchronous encoder doesn't accept input while it has output pending
+    hr = this->encoder->ProcessInput(this->input_id, sample, 0);
+    if(hr == MF_E_NOTACCEPTING && this->software)
+        return false;
+    CHECK_HR(hr);
+    this->frame_number++;
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return true;
+}
+
+bool h264_encoder_mft::receive(h264_encoder_packet& packet)
+{
+    HRESULT hr = S_OK;
+
+    const DWORD mft_provides_samples =
+        this->output_stream_info.dwFlags & MFT_OUTPUT_STREAM_PROVIDES_SAMPLES;
+
+    MFT_OUTPUT_DATA_BUFFER output = {0};
+    DWORD status = 0;
+    CComPtr<IMFSample> sample;
+    media_buffer_packet_t buffer;
+    LONGLONG ts, dur;
+    UINT64 dts;
+
+    if(mft_provides_samples)
+        output.pSample = NULL;
+    else
+    {
+        // the encoder writes to the packet directly
+        {
+            buffer_pool_packet_t::scoped_lock lock(this->buffer_pool_packet->mutex);
+            buffer = this->buffer_pool_packet->acquire_buffer(
+                media_buffer_packet::get_pool_key(this->output_stream_info.cbSize));
+        }
+        buffer->initialize(this->output_stream_info.cbSize);
+
+        sample = this->output_sample;
+        CHECK_HR(hr = sample->RemoveAllBuffers());
+        CHECK_HR(hr = sample->DeleteAllItems());
+        CHECK_HR(hr = sample->AddBuffer(media_buffer_packet::get_media_buffer(buffer)));
+        output.pSample = sample;
+    }
+
+    output.dwStreamID = this->output_id;
+    output.dwStatus = 0;
+    output.pEvents = NULL;
+
+    hr = this->encoder->ProcessOutput(0, 1, &output, &status);
+
+    if(!sample)
+        sample.Attach(output.pSample);
+
+    if(hr == MF_E_TRANSFORM_NEED_MORE_INPUT)
+        return false;
+
+    // the output stream type will be the exact same one, but for some reason
+    // intel mft requires resetting the output type
+    if(FAILED(hr) && output.dwStatus == MFT_OUTPUT_DATA_BUFFER_FORMAT_CHANGE)
+    {
+        CHECK_HR(hr = this->set_output_stream_type());
+        return false;
+    }
+    CHECK_HR(hr);
+
+    if(!sample)
+        return false;
+
+    if(mft_provides_samples)
+    {
+        // the samples of the encoder are copied to a packet so that the encoder
+        // can reuse them
+        CComPtr<IMFMediaBuffer> media_buffer;
+        BYTE* data;
+        DWORD len;
+
+        CHECK_HR(hr = sample->ConvertToContiguousBuffer(&media_buffer));
+        CHECK_HR(hr = media_buffer->GetCurrentLength(&len));
+        {
+            buffer_pool_packet_t::scoped_lock lock(this->buffer_pool_packet->mutex);
+            buffer = this->buffer_pool_packet->acquire_buffer(
+                media_buffer_packet::get_pool_key(len));
+        }
+        buffer->initialize(len);
+
+        CHECK_HR(hr = media_buffer->Lock(&data, NULL, NULL));
+        memcpy(buffer->get_data(), data, len);
+        CHECK_HR(hr = media_buffer->Unlock());
+        buffer->set_length(len);
+    }
+
+    CHECK_HR(hr = sample->GetSampleTime(&ts));
+    CHECK_HR(hr = sample->GetSampleDuration(&dur));
+    if(FAILED(sample->GetUINT64(MFSampleExtension_DecodeTimestamp, &dts)))
+        dts = (UINT64)ts;
+    packet.pts = ts;
+    packet.dts = (int64_t)dts;
+    packet.duration = dur;
+    packet.key_frame = !!MFGetAttributeUINT32(sample, MFSampleExtension_CleanPoint, FALSE);
+    packet.buffer = std::move(buffer);
+
+done:
+    // the media buffer of the packet is released from the reused output sample
+    if(!mft_provides_samples)
+        this->output_sample->RemoveAllBuffers();
+
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return true;
+}
+
+void h264_encoder_mft::drain()
+{
+    HRESULT hr = S_OK;
+    CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0));
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
+
+bool h264_encoder_mft::request_key_frame()
+{
+    if(!this->key_frame_supported)
+        return false;
+
+    this->key_frame_requested = true;
+    return true;
+}
+
+bool h264_encoder_mft::set_quality_vs_speed(uint32_t quality_vs_speed)
+{
+    HRESULT hr = S_OK;
+    CComPtr<ICodecAPI> codec;
+    VARIANT v = {0};
+
+    CHECK_HR(hr = this->encoder->QueryInterface(&codec));
+    if(codec->IsModifiable(&CODECAPI_AVEncCommonQualityVsSpeed) != S_OK)
+        return false;
+
+    v.vt = VT_UI4;
+    v.ulVal = quality_vs_speed;
+    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonQualityVsSpeed, &v));
+    this->params.quality_vs_speed = quality_vs_speed;
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return true;
+}
+
+bool h264_encoder_mft::reconfigure(uint32_t avg_bitrate)
+{
+    HRESULT hr = S_OK;
+    CComPtr<ICodecAPI> codec;
+    VARIANT v = {0};
+
+    CHECK_HR(hr = this->encoder->QueryInterface(&codec));
+    if(codec->IsModifiable(&CODECAPI_AVEncCommonMeanBitRate) != S_OK)
+        return false;
+
+    v.vt = VT_UI4;
+    v.ulVal = avg_bitrate;
+    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonMeanBitRate, &v));
+    this->params.avg_bitrate = avg_bitrate;
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return true;
+}
\ No newline at end of file
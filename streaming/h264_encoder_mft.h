@@ -0,0 +1,97 @@
+#pragma once
+
+#include "h264_encoder_backend.h"
+#include "media_component.h"
+#include "async_callback.h"
+#include "enable_shared_from_this.h"
+#include <mfapi.h>
+#include <mftransform.h>
+#include <optional>
+#include <string>
+#include <memory>
+#include <atomic>
+
+#pragma comment(lib, "Mfplat.lib")
+
+/*
+
+hardware encoders are asynchronous media foundation transforms that are fed with
+d3d11 textures through the dxgi device manager, or with system memory textures if the encoder
+cannot use the d3d device;
+the microsoft software encoder is a synchronous transform
+
+does not use b frames by default
+
+*/
+
+class h264_encoder_mft final : public h264_encoder_backend, public enable_shared_from_this
+{
+public:
+    typedef async_callback<h264_encoder_mft> async_callback_t;
+    typedef buffer_pool<media_buffer_packet_pooled> buffer_pool_packet_t;
+private:
+    context_mutex_t context_mutex;
+    CComPtr<ID3D11Device> d3d11dev;
+    std::optional<CLSID> clsid;
+    bool use_system_memory, software;
+    h264_encoder_backend_params params;
+    std::weak_ptr<listener> event_listener;
+
+    DWORD input_id, output_id;
+    MFT_INPUT_STREAM_INFO input_stream_info;
+    MFT_OUTPUT_STREAM_INFO output_stream_info;
+    CComPtr<IMFTransform> encoder;
+    CComPtr<IMFMediaEventGenerator> event_generator;
+    CComPtr<IMFDXGIDeviceManager> devmngr;
+    CComPtr<async_callback_t> events_callback;
+    UINT reset_token;
+    CComPtr<IMFMediaType> output_type;
+    std::string sequence_header;
+    // the key frame is forced before the next input is processed
+    bool key_frame_supported;
+    std::atomic_bool key_frame_requested;
+    // the dirty rects of an input are relative to the previous input
+    UINT frame_number;
+    // the output buffers for the encoders that don't provide the output samples
+    std::shared_ptr<buffer_pool_packet_t> buffer_pool_packet;
+    // the input samples are returned to the pool when the encoder releases them,
+    // which also releases the frames
+    CComPtr<media_sample_pool> input_sample_pool;
+    // reused for each output if the encoder doesn't provide the output samples
+    CComPtr<IMFSample> output_sample;
+
+    HRESULT set_input_stream_type();
+    HRESULT set_output_stream_type();
+    HRESULT set_encoder_parameters();
+
+    void events_cb(void*);
+public:
+    // passing null d3d device implies that the system memory is used to feed the encoder;
+    // software flag selects the synchronous software encoder and overrides the d3d device;
+    // clsid is optional
+    h264_encoder_mft(const context_mutex_t&, const CComPtr<ID3D11Device>&,
+        const CLSID*, bool software);
+    ~h264_encoder_mft();
+
+    // sets the color attributes of the media type
+    static HRESULT set_color_space(const CComPtr<IMFMediaType>&, h264_encoder_color_space);
+    // creates the h264 media type of the params;
+    // the sequence header is set if it is not empty
+    static HRESULT create_output_type(const h264_encoder_backend_params&,
+        const std::string& sequence_header, CComPtr<IMFMediaType>&);
+
+    bool is_async() const override {return !this->software;}
+    // the system memory encoders read the textures through the dxgi surface buffer
+    bool uses_native_textures() const override {return true;}
+    h264_encoder_pixel_format get_input_format() const override {return H264_PIXEL_FORMAT_NV12;}
+
+    void initialize(const h264_encoder_backend_params&,
+        const std::weak_ptr<h264_encoder_backend::listener>&) override;
+    bool submit(const h264_encoder_frame&) override;
+    bool receive(h264_encoder_packet&) override;
+    void drain() override;
+    bool request_key_frame() override;
+    bool set_quality_vs_speed(uint32_t quality_vs_speed) override;
+    bool reconfigure(uint32_t avg_bitrate) override;
+    std::string get_sequence_header() const override {return this->sequence_header;}
+};
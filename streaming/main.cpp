@@ -5,8 +5,15 @@
 #include <d3d11.h>
 #include <TlHelp32.h>
 #include "gui_mainwnd.h"
+#include "h264_encoder_benchmark.h"
+#include "rtmp_throttle_simulation.h"
+#include "compositor_benchmark.h"
+#include "aac_encoder_benchmark.h"
+#include "color_converter_benchmark.h"
 #include "assert.h"
 #include <mutex>
+#include <cstring>
+#include <cstdlib>
 
 #pragma comment(lib, "Mfplat.lib")
 #pragma comment(lib, "D3D11.lib")
@@ -146,7 +153,110 @@ LONG WINAPI unhandled_exception_handler(LPEXCEPTION_POINTERS excp_pointers)
 // greater priority value has a greater priority
 //LONG capture_audio_priority = 10;
 
-int main()
+// streaming.exe --encoder-benchmark [width] [height] [fps] [bitrate in kbps] [frames]
+// [worker threads] runs the h264 encoder benchmark without the gui
+void run_encoder_benchmark(int argc, char* argv[])
+{
+    h264_encoder_benchmark::params_t params;
+    UINT32* args[] =
+    {
+        &params.width, &params.height, &params.fps_num, &params.bitrate,
+        &params.frame_count, &params.worker_threads
+    };
+
+    for(int i = 0; i < argc && i < (int)ARRAYSIZE(args); i++)
+        *args[i] = (UINT32)std::strtoul(argv[i], nullptr, 10);
+
+    if(!params.width || !params.height || (params.width | params.height) & 1 ||
+        !params.fps_num || !params.bitrate)
+    {
+        std::cout << "invalid encoder benchmark parameters" << std::endl;
+        return;
+    }
+
+    h264_encoder_benchmark::run_all(params);
+}
+
+// streaming.exe --rtmp-throttle-simulation [bitrate in kbps] [throttled capacity in kbps] [fps]
+// runs the adaptive bitrate controller against a simulated throttled rtmp connection
+void run_rtmp_throttle_simulation(int argc, char* argv[])
+{
+    rtmp_throttle_simulation::params_t params;
+    UINT32* args[] = {&params.bitrate, &params.throttled_capacity, &params.fps};
+
+    for(int i = 0; i < argc && i < (int)ARRAYSIZE(args); i++)
+        *args[i] = (UINT32)std::strtoul(argv[i], nullptr, 10);
+
+    if(!params.bitrate || !params.throttled_capacity || !params.fps)
+    {
+        std::cout << "invalid rtmp throttle simulation parameters" << std::endl;
+        return;
+    }
+
+    rtmp_throttle_simulation::run_all(params);
+}
+
+// streaming.exe --compositor-benchmark [width] [height] [frames] [frames of the sweeps]
+// runs the cpu compositor benchmark of the videomixer
+void run_compositor_benchmark(int argc, char* argv[])
+{
+    compositor_benchmark::params_t params;
+    UINT32* args[] =
+    {
+        &params.width, &params.height, &params.frame_count, &params.sweep_frame_count
+    };
+
+    for(int i = 0; i < argc && i < (int)ARRAYSIZE(args); i++)
+        *args[i] = (UINT32)std::strtoul(argv[i], nullptr, 10);
+
+    if(!params.width || !params.height || !params.frame_count || !params.sweep_frame_count)
+    {
+        std::cout << "invalid compositor benchmark parameters" << std::endl;
+        return;
+    }
+
+    compositor_benchmark::run_all(params);
+}
+
+// streaming.exe --aac-encoder-benchmark [sample rate] [bitrate in kbps] [seconds]
+// runs the aac encoder benchmark of the backends
+void run_aac_encoder_benchmark(int argc, char* argv[])
+{
+    aac_encoder_benchmark::params_t params;
+    UINT32* args[] = {&params.sample_rate, &params.bitrate, &params.seconds};
+
+    for(int i = 0; i < argc && i < (int)ARRAYSIZE(args); i++)
+        *args[i] = (UINT32)std::strtoul(argv[i], nullptr, 10);
+
+    if(params.sample_rate < 100 || !params.bitrate || !params.seconds)
+    {
+        std::cout << "invalid aac encoder benchmark parameters" << std::endl;
+        return;
+    }
+
+    aac_encoder_benchmark::run_all(params);
+}
+
+// streaming.exe --color-converter-benchmark [frames]
+// runs the cpu color converter benchmark
+void run_color_converter_benchmark(int argc, char* argv[])
+{
+    color_converter_benchmark::params_t params;
+    UINT32* args[] = {&params.frame_count};
+
+    for(int i = 0; i < argc && i < (int)ARRAYSIZE(args); i++)
+        *args[i] = (UINT32)std::strtoul(argv[i], nullptr, 10);
+
+    if(!params.frame_count)
+    {
+        std::cout << "invalid color converter benchmark parameters" << std::endl;
+        return;
+    }
+
+    color_converter_benchmark::run_all(params);
+}
+
+int main(int argc, char* argv[])
 {
     std::set_terminate(streaming::terminate_handler_f);
     SetUnhandledExceptionFilter(unhandled_exception_handler);
@@ -188,6 +298,17 @@ int main()
         _CrtSetReportHook(YourReportHook);
 #endif
 
+        if(argc > 1 && std::strcmp(argv[1], "--encoder-benchmark") == 0)
+            run_encoder_benchmark(argc - 2, argv + 2);
+        else if(argc > 1 && std::strcmp(argv[1], "--rtmp-throttle-simulation") == 0)
+            run_rtmp_throttle_simulation(argc - 2, argv + 2);
+        else if(argc > 1 && std::strcmp(argv[1], "--compositor-benchmark") == 0)
+            run_compositor_benchmark(argc - 2, argv + 2);
+        else if(argc > 1 && std::strcmp(argv[1], "--aac-encoder-benchmark") == 0)
+            run_aac_encoder_benchmark(argc - 2, argv + 2);
+        else if(argc > 1 && std::strcmp(argv[1], "--color-converter-benchmark") == 0)
+            run_color_converter_benchmark(argc - 2, argv + 2);
+        else
         {
             CMessageLoop msgloop;
             module_.AddMessageLoop(&msgloop);
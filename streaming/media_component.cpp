@@ -4,7 +4,7 @@
 #include <iostream>
 
 media_component::media_component(const media_session_t& session, instance_t instance_type) :
-    session(session), instance_type(instance_type), reset(false)
+    session(session), instance_type(instance_type), reset(false), processing_cycles(0)
 {
 }
 
@@ -34,4 +34,22 @@ void media_component::request_reinitialization(const control_class_t& pipeline)
                     pipeline->activate();
             });
     }
-}
\ No newline at end of file
+}
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+media_component_cycles_scope::media_component_cycles_scope(std::atomic_uint64_t& cycles) :
+    cycles(cycles), begin(0)
+{
+    QueryThreadCycleTime(GetCurrentThread(), &this->begin);
+}
+
+media_component_cycles_scope::~media_component_cycles_scope()
+{
+    ULONG64 end = 0;
+    if(QueryThreadCycleTime(GetCurrentThread(), &end) && end > this->begin)
+        this->cycles += end - this->begin;
+}
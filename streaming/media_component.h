@@ -33,6 +33,9 @@ private:
     std::atomic_bool reset;
 protected:
     instance_t instance_type;
+    // the cpu cycles that the component has spent processing the samples;
+    // accumulated by the components that measure their processing usage
+    std::atomic_uint64_t processing_cycles;
     // subsequent calls to this are dismissed;
     // also sets the instance_type as not shareable;
     // make sure that all locks are unlocked before calling this(so no deadlocks occur);
@@ -48,6 +51,18 @@ public:
     // cache the result because the component might change the type
     // asynchronously
     instance_t get_instance_type() const {return this->instance_type;}
+    UINT64 get_processing_cycles() const {return this->processing_cycles.load();}
 };
 
-typedef std::shared_ptr<media_component> media_component_t;
\ No newline at end of file
+typedef std::shared_ptr<media_component> media_component_t;
+
+// adds the cpu cycles that the calling thread spends in the scope to the counter
+class media_component_cycles_scope
+{
+private:
+    std::atomic_uint64_t& cycles;
+    ULONG64 begin;
+public:
+    explicit media_component_cycles_scope(std::atomic_uint64_t& cycles);
+    ~media_component_cycles_scope();
+};
\ No newline at end of file
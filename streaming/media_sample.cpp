@@ -108,6 +108,288 @@ done:
 /////////////////////////////////////////////////////////////////
 
 
+media_buffer_frame::media_buffer_frame() :
+    capacity(0),
+    width(0), height(0),
+    format(FORMAT_NV12),
+    y(nullptr), u(nullptr), v(nullptr),
+    y_pitch(0), u_pitch(0), v_pitch(0)
+{
+}
+
+void media_buffer_frame::initialize(UINT32 width, UINT32 height, format_t format)
+{
+    const UINT32 chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    const size_t luma_len = (size_t)width * height;
+    const size_t chroma_len = (size_t)chroma_width * chroma_height;
+    const size_t len = luma_len + chroma_len * 2;
+
+    this->buffer_poolable::initialize();
+
+    if(this->capacity < len)
+    {
+        this->memory.reset(new BYTE[len]);
+        this->capacity = len;
+    }
+
+    this->width = width;
+    this->height = height;
+    this->format = format;
+    this->y = this->memory.get();
+    this->y_pitch = width;
+    this->u = this->y + luma_len;
+    if(format == FORMAT_NV12)
+    {
+        this->u_pitch = chroma_width * 2;
+        this->v = nullptr;
+        this->v_pitch = 0;
+    }
+    else
+    {
+        this->u_pitch = chroma_width;
+        this->v = this->u + chroma_len;
+        this->v_pitch = chroma_width;
+    }
+}
+
+buffer_pool_key media_buffer_frame::get_pool_key(UINT32 width, UINT32 height, format_t format)
+{
+    buffer_pool_key key;
+    key.width = width;
+    key.height = height;
+    key.format = format;
+    return key;
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+ULONG media_buffer_packet::packet_media_buffer::AddRef()
+{
+    return InterlockedIncrement(&this->ref_count);
+}
+
+ULONG media_buffer_packet::packet_media_buffer::Release()
+{
+    assert_(this->ref_count > 0);
+    const ULONG count = InterlockedDecrement(&this->ref_count);
+    if(count == 0)
+    {
+        // releasing the last reference to the packet might destroy this,
+        // so that this must not be accessed afterwards
+        std::shared_ptr<media_buffer_packet> self = std::move(this->packet->self);
+    }
+    return count;
+}
+
+HRESULT media_buffer_packet::packet_media_buffer::QueryInterface(REFIID riid, void** ppv)
+{
+    if(!ppv)
+        return E_POINTER;
+    if(riid == __uuidof(IUnknown) || riid == __uuidof(IMFMediaBuffer))
+        *ppv = static_cast<IMFMediaBuffer*>(this);
+    else
+    {
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+
+    this->AddRef();
+    return S_OK;
+}
+
+HRESULT media_buffer_packet::packet_media_buffer::Lock(
+    BYTE** ppbBuffer, DWORD* pcbMaxLength, DWORD* pcbCurrentLength)
+{
+    if(!ppbBuffer)
+        return E_POINTER;
+
+    *ppbBuffer = this->packet->memory.get();
+    if(pcbMaxLength)
+        *pcbMaxLength = this->packet->capacity;
+    if(pcbCurrentLength)
+        *pcbCurrentLength = this->packet->length;
+    return S_OK;
+}
+
+HRESULT media_buffer_packet::packet_media_buffer::Unlock()
+{
+    return S_OK;
+}
+
+HRESULT media_buffer_packet::packet_media_buffer::GetCurrentLength(DWORD* pcbCurrentLength)
+{
+    if(!pcbCurrentLength)
+        return E_POINTER;
+
+    *pcbCurrentLength = this->packet->length;
+    return S_OK;
+}
+
+HRESULT media_buffer_packet::packet_media_buffer::SetCurrentLength(DWORD cbCurrentLength)
+{
+    if(cbCurrentLength > this->packet->capacity)
+        return E_INVALIDARG;
+
+    this->packet->length = cbCurrentLength;
+    return S_OK;
+}
+
+HRESULT media_buffer_packet::packet_media_buffer::GetMaxLength(DWORD* pcbMaxLength)
+{
+    if(!pcbMaxLength)
+        return E_POINTER;
+
+    *pcbMaxLength = this->packet->capacity;
+    return S_OK;
+}
+
+media_buffer_packet::media_buffer_packet() : capacity(0), length(0)
+{
+    this->media_buffer.packet = this;
+}
+
+void media_buffer_packet::uninitialize()
+{
+    assert_(this->media_buffer.ref_count == 0);
+    this->buffer_poolable::uninitialize();
+}
+
+void media_buffer_packet::initialize(DWORD len)
+{
+    const DWORD size_class = get_size_class(len);
+
+    this->buffer_poolable::initialize();
+
+    if(this->capacity < size_class)
+    {
+        this->memory.reset(new BYTE[size_class]);
+        this->capacity = size_class;
+    }
+    this->length = 0;
+}
+
+CComPtr<IMFMediaBuffer> media_buffer_packet::get_media_buffer(
+    const std::shared_ptr<media_buffer_packet>& packet)
+{
+    assert_(packet);
+    assert_(packet->media_buffer.ref_count == 0 && !packet->self);
+
+    packet->self = packet;
+    return CComPtr<IMFMediaBuffer>(&packet->media_buffer);
+}
+
+DWORD media_buffer_packet::get_size_class(DWORD len)
+{
+    DWORD size_class = min_size_class;
+    while(size_class < len)
+        size_class <<= 1;
+    return size_class;
+}
+
+buffer_pool_key media_buffer_packet::get_pool_key(DWORD len)
+{
+    buffer_pool_key key;
+    key.width = get_size_class(len);
+    return key;
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
+CComPtr<IMFSample> media_sample_pool::acquire_sample()
+{
+    HRESULT hr = S_OK;
+    CComPtr<IMFTrackedSample> tracked_sample;
+    CComPtr<IMFSample> sample;
+
+    {
+        scoped_lock lock(this->mutex);
+        if(!this->samples.empty())
+        {
+            tracked_sample = std::move(this->samples.back());
+            this->samples.pop_back();
+        }
+    }
+
+    if(!tracked_sample)
+        CHECK_HR(hr = MFCreateTrackedSample(&tracked_sample));
+
+    // the allocator is cleared after each release, so it is set for each use
+    CHECK_HR(hr = tracked_sample->SetAllocator(this, NULL));
+    CHECK_HR(hr = tracked_sample->QueryInterface(&sample));
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return sample;
+}
+
+void media_sample_pool::dispose()
+{
+    scoped_lock lock(this->mutex);
+    this->disposed = true;
+    this->samples.clear();
+}
+
+HRESULT media_sample_pool::QueryInterface(REFIID riid, void** ppv)
+{
+    if(!ppv)
+        return E_POINTER;
+    if(riid == __uuidof(IUnknown))
+        *ppv = static_cast<IUnknown*>(this);
+    else if(riid == __uuidof(IMFAsyncCallback))
+        *ppv = static_cast<IMFAsyncCallback*>(this);
+    else
+    {
+        *ppv = NULL;
+        return E_NOINTERFACE;
+    }
+
+    this->AddRef();
+    return S_OK;
+}
+
+HRESULT media_sample_pool::Invoke(IMFAsyncResult* result)
+{
+    HRESULT hr = S_OK;
+    CComPtr<IUnknown> obj;
+    CComPtr<IMFTrackedSample> tracked_sample;
+    CComPtr<IMFSample> sample;
+
+    CHECK_HR(hr = result->GetObject(&obj));
+    CHECK_HR(hr = obj->QueryInterface(&tracked_sample));
+    CHECK_HR(hr = obj->QueryInterface(&sample));
+
+    // releasing the buffers returns the packets to their pools
+    CHECK_HR(hr = sample->RemoveAllBuffers());
+    CHECK_HR(hr = sample->DeleteAllItems());
+    CHECK_HR(hr = sample->SetSampleFlags(0));
+
+    {
+        scoped_lock lock(this->mutex);
+        if(!this->disposed)
+            this->samples.push_back(std::move(tracked_sample));
+    }
+
+done:
+    // the sample is destroyed if it isn't returned to the pool
+    return hr;
+}
+
+
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+/////////////////////////////////////////////////////////////////
+
+
 void media_buffer_texture::uninitialize()
 {
     this->buffer_poolable::uninitialize();
@@ -200,6 +482,16 @@ void media_buffer_texture::initialize(const CComPtr<ID3D11Texture2D>& texture)
     this->managed_by_this = false;
 }
 
+buffer_pool_key media_buffer_texture::get_pool_key(const D3D11_TEXTURE2D_DESC& desc)
+{
+    buffer_pool_key key;
+    key.width = desc.Width;
+    key.height = desc.Height;
+    key.format = (UINT32)desc.Format;
+    key.bind_flags = desc.BindFlags;
+    return key;
+}
+
 
 /////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////
@@ -22,6 +22,7 @@
 #include "assert.h"
 #include "enable_shared_from_this.h"
 #include "buffer_pool.h"
+#include "IUnknownImpl.h"
 
 #pragma comment(lib, "Dxgi.lib")
 
@@ -82,8 +83,9 @@ public:
     media_buffer_texture() : managed_by_this(true) {}
     virtual ~media_buffer_texture() {}
 
-    // TODO: if the settings do not match, a new texture should be created
-    // and the mismatch should be printed
+    // a new texture is created if the settings do not match;
+    // the pools should acquire the buffers by the pool key of the desc so that
+    // the mismatches are avoided;
     // currently, initialize doesn't initialize the bitmap;
     // reinitialize flag is used for resetting the texture data
     void initialize(const CComPtr<ID3D11Device>&,
@@ -93,8 +95,16 @@ public:
     // TODO: this should be defined in a derived class of this, so that
     // wrapped textures aren't part of the same pool as managed textures
     void initialize(const CComPtr<ID3D11Texture2D>&);
+
+    static buffer_pool_key get_pool_key(const D3D11_TEXTURE2D_DESC&);
 };
 
+// the limits for the texture pools of the capture sources;
+// the textures of a previous resolution are evicted after they have been unused
+// for about a second
+#define TEXTURE_POOL_BUCKET_LIMIT 16
+#define TEXTURE_POOL_MAX_AGE 60
+
 typedef std::shared_ptr<media_buffer_texture> media_buffer_texture_t;
 typedef buffer_pooled<media_buffer_texture> media_buffer_pooled_texture;
 typedef std::shared_ptr<media_buffer_pooled_texture> media_buffer_pooled_texture_t;
@@ -124,18 +134,176 @@ typedef std::shared_ptr<media_buffer_memory> media_buffer_memory_t;
 typedef buffer_pooled<media_buffer_memory> media_buffer_memory_pooled;
 typedef std::shared_ptr<media_buffer_memory_pooled> media_buffer_memory_pooled_t;
 
+// a yuv 4:2:0 frame in system memory;
+// the color converter outputs these frames for the encoders that don't consume textures,
+// so that the frames aren't uploaded to textures and read back
+class media_buffer_frame : public buffer_poolable
+{
+    friend class buffer_pooled<media_buffer_frame>;
+public:
+    enum format_t : UINT32
+    {
+        // interleaved uv plane; the v plane is null
+        FORMAT_NV12 = 1,
+        // separate u and v planes
+        FORMAT_I420
+    };
+private:
+    std::unique_ptr<BYTE[]> memory;
+    size_t capacity;
+
+    void uninitialize() {this->buffer_poolable::uninitialize();}
+public:
+    UINT32 width, height;
+    format_t format;
+    // the planes are contiguous in the memory;
+    // the chroma planes are (width + 1) / 2 by (height + 1) / 2 samples
+    BYTE *y, *u, *v;
+    UINT32 y_pitch, u_pitch, v_pitch;
+
+    media_buffer_frame();
+    virtual ~media_buffer_frame() {}
+
+    // the memory is reallocated only if the frame doesn't fit in it
+    void initialize(UINT32 width, UINT32 height, format_t);
+
+    static buffer_pool_key get_pool_key(UINT32 width, UINT32 height, format_t);
+};
+
+typedef std::shared_ptr<media_buffer_frame> media_buffer_frame_t;
+typedef buffer_pooled<media_buffer_frame> media_buffer_frame_pooled;
+typedef std::shared_ptr<media_buffer_frame_pooled> media_buffer_frame_pooled_t;
+
+// pooled memory for the encoded packets;
+// the outputs receive the packet as an imfmediabuffer that keeps the packet alive,
+// so that the packet is released back to the pool only after the last output
+// has released the sample;
+// the packets are bucketed by power of two size classes
+class media_buffer_packet : public buffer_poolable
+{
+    friend class buffer_pooled<media_buffer_packet>;
+public:
+    static const DWORD min_size_class = 4096;
+private:
+    // the media buffer is a member so that handing out the packet doesn't allocate
+    class packet_media_buffer final : public IMFMediaBuffer
+    {
+    public:
+        media_buffer_packet* packet;
+        volatile long ref_count;
+
+        packet_media_buffer() : packet(nullptr), ref_count(0) {}
+
+        ULONG STDMETHODCALLTYPE AddRef();
+        ULONG STDMETHODCALLTYPE Release();
+        HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void**);
+        HRESULT STDMETHODCALLTYPE Lock(BYTE**, DWORD*, DWORD*);
+        HRESULT STDMETHODCALLTYPE Unlock();
+        HRESULT STDMETHODCALLTYPE GetCurrentLength(DWORD*);
+        HRESULT STDMETHODCALLTYPE SetCurrentLength(DWORD);
+        HRESULT STDMETHODCALLTYPE GetMaxLength(DWORD*);
+    };
+
+    packet_media_buffer media_buffer;
+    // keeps the packet out of the pool while the media buffer is referenced
+    std::shared_ptr<media_buffer_packet> self;
+    // plain memory so that the packets can be filled by the portable encoder backends
+    std::unique_ptr<BYTE[]> memory;
+    DWORD capacity, length;
+
+    void uninitialize();
+public:
+    media_buffer_packet();
+    virtual ~media_buffer_packet() {}
+
+    // the memory is reallocated only if its size class is smaller than len;
+    // the current length is reset to 0
+    void initialize(DWORD len);
+
+    BYTE* get_data() const {return this->memory.get();}
+    DWORD get_capacity() const {return this->capacity;}
+    DWORD get_length() const {return this->length;}
+    // the length must not exceed the capacity
+    void set_length(DWORD len) {assert_(len <= this->capacity); this->length = len;}
+
+    // returns the media buffer of the packet;
+    // only one media buffer of the packet can be referenced at a time;
+    // the packet is released to the pool after both the packet and the media buffer
+    // have been released
+    static CComPtr<IMFMediaBuffer> get_media_buffer(const std::shared_ptr<media_buffer_packet>&);
+    static DWORD get_size_class(DWORD len);
+    static buffer_pool_key get_pool_key(DWORD len);
+};
+
+// the limits for the packet pools of the encoders;
+// the outputs might hold the packets for several seconds while congested
+#define PACKET_POOL_BUCKET_LIMIT 32
+#define PACKET_POOL_MAX_AGE 600
+
+typedef std::shared_ptr<media_buffer_packet> media_buffer_packet_t;
+typedef buffer_pooled<media_buffer_packet> media_buffer_packet_pooled;
+typedef std::shared_ptr<media_buffer_packet_pooled> media_buffer_packet_pooled_t;
+
+// recycles the media foundation samples of the encoders, so that a sample isn't allocated
+// for each frame;
+// the sample is returned to the pool when its last reference is released, at which point
+// its buffers and attributes are removed;
+// the pool must be wrapped inside ccomptr and attached by Attach() call
+class media_sample_pool final : public IMFAsyncCallback, IUnknownImpl
+{
+public:
+    typedef std::lock_guard<std::mutex> scoped_lock;
+private:
+    std::mutex mutex;
+    std::vector<CComPtr<IMFTrackedSample>> samples;
+    bool disposed;
+public:
+    media_sample_pool() : disposed(false) {}
+
+    // creates a new sample if the pool is empty
+    CComPtr<IMFSample> acquire_sample();
+    // releases the pooled samples;
+    // the samples in use are released normally after the pool has been disposed
+    void dispose();
+
+    // IUnknown
+    ULONG STDMETHODCALLTYPE AddRef() {return IUnknownImpl::AddRef();}
+    ULONG STDMETHODCALLTYPE Release() {return IUnknownImpl::Release();}
+    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID, void**);
+
+    // IMFAsyncCallback
+    HRESULT STDMETHODCALLTYPE GetParameters(DWORD*, DWORD*) {return E_NOTIMPL;}
+    // called when the last reference to a sample of the pool is released
+    HRESULT STDMETHODCALLTYPE Invoke(IMFAsyncResult*);
+};
+
+// the alignment of the planes in planar audio buffers, in bytes
+#define AUDIO_PLANE_ALIGNMENT 16
+
+// audio is in planar float format inside the pipeline;
+// the aac encoder converts the audio to its input format
 class media_sample_audio_consecutive_frames
 {
 public:
     frame_unit pos, dur;
-    // null buffer indicates a silent frame
-    // a wrapper of the original buffer(or the original buffer)
+    // null buffer indicates a silent frame;
+    // the buffer consists of a plane for each channel; each plane is plane_stride frames long
+    // and the frames of this collection begin at the offset within each plane;
+    // splitting the frames only adjusts the offset, so the buffer is shared
     CComPtr<IMFMediaBuffer> buffer;
     // hosts the memory of the buffer; resetting this causes the buffer
     // become invalid
     media_buffer_memory_t memory_host;
+    frame_unit offset, plane_stride;
 
-    media_sample_audio_consecutive_frames() : dur(0) {}
+    media_sample_audio_consecutive_frames() : dur(0), offset(0), plane_stride(0) {}
+
+    // returns a plane stride that keeps the planes aligned
+    static frame_unit get_plane_stride(frame_unit frame_count, UINT32 bytes_per_sample)
+    {
+        const frame_unit alignment = AUDIO_PLANE_ALIGNMENT / bytes_per_sample;
+        return (frame_count + alignment - 1) / alignment * alignment;
+    }
 };
 
 template<typename FrameType, typename FrameCollection = std::vector<FrameType>>
@@ -193,8 +361,8 @@ public:
     // returns whether any frames were moved;
     // to can be null, in which case the contents from this are discarded;
     // std::numeric_limits::max can be used for moving all frames;
-    // block align is assumed to be the same for both samples
-    bool move_frames_to(media_sample_audio_frames_template* to, frame_unit end, UINT32 block_align);
+    // the planar buffers are shared between the samples
+    bool move_frames_to(media_sample_audio_frames_template* to, frame_unit end);
 };
 
 typedef media_sample_audio_frames_template<media_sample_audio_consecutive_frames> 
@@ -209,8 +377,13 @@ public:
     frame_unit pos, dur;
     // null buffer indicates a silent frame
     media_buffer_texture_t buffer;
+    // the color converter sets this instead of the buffer if the encoder consumes
+    // frames in system memory
+    media_buffer_frame_t memory_buffer;
 
     media_sample_video_frame() : dur(0) {}
+
+    bool is_silent() const {return !this->buffer && !this->memory_buffer;}
     // TODO: remove this
     explicit media_sample_video_frame(frame_unit pos) : pos(pos), dur(1) {}
 
@@ -241,11 +414,16 @@ typedef std::shared_ptr<media_sample_video_frames> media_sample_video_frames_t;
 typedef buffer_pooled<media_sample_video_frames> media_sample_video_frames_pooled;
 typedef std::shared_ptr<media_sample_video_frames_pooled> media_sample_video_frames_pooled_t;
 
+class h264_frame_info;
+
 class media_sample_h264_frame
 {
 public:
     time_unit ts, dur;
     CComPtr<IMFSample> sample;
+    // the parsed bitstream of the sample;
+    // set by the encoder stage
+    std::shared_ptr<const h264_frame_info> info;
 };
 
 class media_sample_h264_frames : public buffer_poolable
@@ -333,9 +511,14 @@ class media_component_h264_encoder_args : public media_component_args
 public:
     // must not be null;
     // frames must be ordered;
-    // null buffer frames are simply discarded
+    // silent frames are simply discarded
     media_sample_video_frames_t sample;
     bool has_frames;
+    // the regions that changed in the frames of the sample since the last frame of the
+    // previous sample, in the coordinates of the frames;
+    // the video mixer sets them in canvas coordinates and the color converter scales them;
+    // the whole frame is assumed to have changed if the rects are unset
+    std::optional<std::vector<RECT>> dirty_rects;
     bool is_valid() const {return !!this->sample;}
 };
 
@@ -370,6 +553,9 @@ public:
     // frames must be ordered
     media_sample_audio_frames_t sample;
     bool has_frames;
+    // indicates that the frames are fully silent;
+    // silent frames have null buffers
+    bool silent;
     bool is_valid() const {return !!this->sample;}
 };
 
@@ -471,7 +657,7 @@ void media_sample_frames_template<T, U>::initialize(
 
 template<typename T>
 bool media_sample_audio_frames_template<T>::move_frames_to(
-    media_sample_audio_frames_template* to, frame_unit end, UINT32 block_align)
+    media_sample_audio_frames_template* to, frame_unit end)
 {
     assert_(this->end == undef_end || !this->frames.empty());
 
@@ -501,60 +687,27 @@ bool media_sample_audio_frames_template<T>::move_frames_to(
 
         moved = true;
 
-        HRESULT hr = S_OK;
         bool remove = false;
-        CComPtr<IMFSample> sample;
-        CComPtr<IMFMediaBuffer> buffer, old_buffer;
-        DWORD buflen = 0;
         sample_t new_frames = elem;
 
-        const frame_unit frame_pos = elem.pos;
-        const frame_unit frame_dur = elem.dur;
-        const frame_unit frame_end = frame_pos + frame_dur;
-
+        const frame_unit frame_end = elem.pos + elem.dur;
         const frame_unit frame_diff_end = std::max(frame_end - end, 0LL);
-        const DWORD offset_end = (DWORD)frame_diff_end * block_align;
-        const frame_unit new_frame_pos = frame_pos;
-        const frame_unit new_frame_dur = frame_dur - frame_diff_end;
 
-        if(elem.buffer)
-        {
-            old_buffer = elem.buffer;
-            CHECK_HR(hr = old_buffer->GetCurrentLength(&buflen));
+        new_frames.dur = elem.dur - frame_diff_end;
 
-            assert_(((int)buflen - (int)offset_end) > 0);
-            CHECK_HR(hr = MFCreateMediaBufferWrapper(old_buffer, 0, buflen - offset_end, &buffer));
-            CHECK_HR(hr = buffer->SetCurrentLength(buflen - offset_end));
-        }
-
-        if(offset_end > 0)
+        if(frame_diff_end > 0)
         {
-            if(elem.buffer)
-            {
-                // remove the moved part of the old buffer
-                CComPtr<IMFMediaBuffer> new_buffer;
-                CHECK_HR(hr = MFCreateMediaBufferWrapper(
-                    old_buffer, buflen - offset_end, offset_end, &new_buffer));
-                CHECK_HR(hr = new_buffer->SetCurrentLength(offset_end));
-                elem.buffer = new_buffer;
-            }
-
-            const frame_unit new_frame_dur = offset_end / block_align;
-            const frame_unit new_frame_pos = frame_pos + frame_dur - new_frame_dur;
-
-            elem.pos = new_frame_pos;
-            elem.dur = new_frame_dur;
+            // the remaining part of the planes begins after the moved part
+            elem.pos += new_frames.dur;
+            elem.offset += new_frames.dur;
+            elem.dur = frame_diff_end;
 
             this->first = std::min(this->first, elem.pos);
         }
         else
             remove = true;
 
-        assert_((elem.memory_host && buffer) || (!elem.memory_host && !elem.buffer));
-        new_frames.memory_host = elem.memory_host;
-        new_frames.buffer = buffer;
-        new_frames.pos = new_frame_pos;
-        new_frames.dur = new_frame_dur;
+        assert_((elem.memory_host && elem.buffer) || (!elem.memory_host && !elem.buffer));
 
         if(to)
         {
@@ -563,10 +716,6 @@ bool media_sample_audio_frames_template<T>::move_frames_to(
             to->first = std::min(to->first, new_frames.pos);
         }
 
-    done:
-        if(FAILED(hr))
-            throw HR_EXCEPTION(hr);
-
         return remove;
 
     }), this->frames.end());
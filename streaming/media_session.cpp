@@ -74,8 +74,12 @@ bool media_session::request_sample(const media_stream* stream, const request_pac
     media_topology_t topology(rp.topology);
     assert_(topology);
 
+    // a stream that shares its upstream with another branch has no request connection;
+    // the upstream is requested once through the first branch and
+    // the sample is given to every branch
     media_topology::topology_t::iterator it = topology->topology_reverse.find(stream);
-    assert_(it != rp.topology->topology_reverse.end());
+    if(it == rp.topology->topology_reverse.end())
+        return true;
 
     for(auto jt = it->second.next.begin(); jt != it->second.next.end(); jt++)
     {
@@ -37,7 +37,8 @@ private:
     int topology_number;
 
     // only one request stream connection is added for a node;
-    // subsequent connections are discarded;
+    // subsequent connections are discarded, so that the upstream is requested once and
+    // its samples are given to every connected branch;
     // called by media_stream only
     void connect_streams(const media_stream_t& stream, const media_stream_t& stream2);
 public:
@@ -10,7 +10,24 @@ class output_class
 private:
 public:
     virtual ~output_class() = default;
+    // must be called before the samples are written;
+    // in variable frame rate mode the video has gaps of at most the max frame interval,
+    // in time units, which the outputs must not wait for
+    virtual void enable_vfr(time_unit /*max_frame_interval*/) {}
     virtual void write_sample(bool video, const CComPtr<IMFSample>&) = 0;
+    // the frame carries the parsed bitstream of the sample;
+    // outputs that don't use it write the sample
+    virtual void write_video_frame(const media_sample_h264_frame& frame)
+    {
+        this->write_sample(true, frame.sample);
+    }
+    // track 0 is the main audio track;
+    // outputs that support only one audio track discard the additional tracks
+    virtual void write_audio_track_sample(UINT32 track, const CComPtr<IMFSample>& sample)
+    {
+        if(track == 0)
+            this->write_sample(false, sample);
+    }
 };
 
 using output_class_t = std::shared_ptr<output_class>;
\ No newline at end of file
@@ -8,7 +8,11 @@
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
 
-output_file::output_file() : stopped(true)
+output_file::output_file() :
+    stopped(true), audio_track_count(0),
+    vfr_enabled(false),
+    video_written(false), video_tick_sent(false),
+    last_video_end(0)
 {
 }
 
@@ -24,7 +28,8 @@ void output_file::initialize(
     const std::wstring_view& path,
     ATL::CWindow recording_initiator,
     const CComPtr<IMFMediaType>& video_type,
-    const CComPtr<IMFMediaType>& audio_type)
+    const CComPtr<IMFMediaType>& audio_type,
+    const std::vector<CComPtr<IMFMediaType>>& additional_audio_types)
 {
     assert_(this->stopped);
 
@@ -49,6 +54,17 @@ void output_file::initialize(
         CHECK_HR(hr = MFCreateMPEG4MediaSink(
             this->byte_stream, this->video_type, this->audio_type, &this->mpeg_media_sink));
 
+        // add the additional audio tracks;
+        // the sink writer stream indices follow the stream sink order
+        this->audio_track_count = 1;
+        for(const auto& type : additional_audio_types)
+        {
+            CComPtr<IMFStreamSink> stream_sink;
+            CHECK_HR(hr = this->mpeg_media_sink->AddStreamSink(
+                this->audio_track_count + 1, type, &stream_sink));
+            this->audio_track_count++;
+        }
+
         // configure the sink writer
         CHECK_HR(hr = MFCreateAttributes(&sink_writer_attributes, 1));
         CHECK_HR(hr = sink_writer_attributes->SetGUID(
@@ -79,12 +95,46 @@ done:
     }
 }
 
+void output_file::enable_vfr(time_unit /*max_frame_interval*/)
+{
+    this->vfr_enabled = true;
+}
+
 void output_file::write_sample(bool video, const CComPtr<IMFSample>& sample)
 {
     if(this->stopped)
         return;
 
     HRESULT hr = S_OK;
+    // the video sample is written under the lock so that a tick isn't sent
+    // past the video sample before it is written
+    std::unique_lock<std::mutex> lock(this->tick_mutex, std::defer_lock);
+    if(this->vfr_enabled)
+    {
+        LONGLONG ts, dur;
+        CHECK_HR(hr = sample->GetSampleTime(&ts));
+
+        lock.lock();
+        if(video)
+        {
+            CHECK_HR(hr = sample->GetSampleDuration(&dur));
+            this->video_written = true;
+            this->video_tick_sent = false;
+            this->last_video_end = ts + dur;
+        }
+        else if(this->video_written && !this->video_tick_sent && ts > this->last_video_end)
+        {
+            // the audio has passed the end of the last video sample, so the video is in
+            // a gap of the unchanged frames or the encoder is behind;
+            // the next video sample starts at the end of the last one at the earliest,
+            // so the tick is valid in both cases
+            CHECK_HR(hr = this->writer->SendStreamTick(0, this->last_video_end));
+            this->video_tick_sent = true;
+        }
+        if(!video)
+            lock.unlock();
+    }
+
     CHECK_HR(hr = this->writer->WriteSample(video ? 0 : 1, sample));
 
 done:
@@ -92,6 +142,21 @@ done:
         throw HR_EXCEPTION(hr);
 }
 
+void output_file::write_audio_track_sample(UINT32 track, const CComPtr<IMFSample>& sample)
+{
+    if(this->stopped)
+        return;
+
+    assert_(track < this->audio_track_count);
+
+    HRESULT hr = S_OK;
+    CHECK_HR(hr = this->writer->WriteSample(track + 1, sample));
+
+done:
+    if(!this->stopped && FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
+
 void output_file::force_stop()
 {
     if(this->stopped)
@@ -10,6 +10,7 @@
 #include <memory>
 #include <mutex>
 #include <string_view>
+#include <vector>
 
 #define RECORDING_STOPPED_MESSAGE (WM_APP + 1)
 
@@ -24,8 +25,18 @@ private:
     ATL::CWindow recording_initiator;
     CComPtr<IMFMediaType> video_type;
     CComPtr<IMFMediaType> audio_type;
+    UINT32 audio_track_count;
     CComPtr<IMFMediaSink> mpeg_media_sink;
     CComPtr<IMFByteStream> byte_stream;
+
+    // the sink writer is told about the gaps of the video with stream ticks,
+    // so that it doesn't hold the audio back while the video has no samples;
+    // the video and audio are written from different threads, so the state is guarded
+    // by the tick mutex
+    std::mutex tick_mutex;
+    bool vfr_enabled;
+    bool video_written, video_tick_sent;
+    LONGLONG last_video_end;
 public:
     CComPtr<IMFSinkWriter> writer;
 
@@ -38,9 +49,12 @@ public:
         const std::wstring_view& path,
         ATL::CWindow recording_initiator,
         const CComPtr<IMFMediaType>& video_type,
-        const CComPtr<IMFMediaType>& audio_type);
+        const CComPtr<IMFMediaType>& audio_type,
+        const std::vector<CComPtr<IMFMediaType>>& additional_audio_types = {});
 
+    void enable_vfr(time_unit max_frame_interval) override;
     void write_sample(bool video, const CComPtr<IMFSample>& sample) override;
+    void write_audio_track_sample(UINT32 track, const CComPtr<IMFSample>& sample) override;
     void force_stop();
 };
 
@@ -7,6 +7,7 @@
 #include <intrin.h>
 #include <iostream>
 #include <limits>
+#include <chrono>
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
 #undef min
@@ -25,7 +26,13 @@ struct flv_tag
 
 output_rtmp::output_rtmp() : 
     rtmp(nullptr),
-    video_headers_sent(false), audio_headers_sent(false)
+    audio_headers_sent(false),
+    adaptive_bitrate(false),
+    vfr_enabled(false),
+    vfr_max_frame_interval(0),
+    video_received(false),
+    last_video_ts(0),
+    waiting_key_frame(true), key_frame_requested(false)
 {
 }
 
@@ -240,6 +247,7 @@ void output_rtmp::initialize(
         CHECK_HR(hr = E_UNEXPECTED);
 
     this->send_flv_metadata();
+    this->connect_time = std::chrono::steady_clock::now();
 
 done:
     if(FAILED(hr))
@@ -410,191 +418,6 @@ void output_rtmp::send_rtmp_audio_packets(const std::string_view& data, LONGLONG
         throw HR_EXCEPTION(E_UNEXPECTED);
 }
 
-std::string output_rtmp::create_avc_decoder_configuration_record(
-    const std::string_view& sps_nalu, const std::string_view& pps_nalu,
-    int start_code_prefix_len) const
-{
-    assert_(start_code_prefix_len > 0 && start_code_prefix_len <= 4);
-
-    HRESULT hr = S_OK;
-
-    if(sps_nalu.size() > std::numeric_limits<uint16_t>::max() ||
-        pps_nalu.size() > std::numeric_limits<uint16_t>::max())
-        throw HR_EXCEPTION(E_UNEXPECTED);
-
-    // http://www.staroceans.org/e-book/ISO-14496-10.pdf
-
-    // ISO/IEC 14496-15:2004(E)
-    // http://nhbzh.com/asp/admin/editor/newsfile/201011314552121.pdf
-#pragma pack(push, 1)
-    // in big endian format;
-    // ms specific: the ordering of data declared as bit fields is from low to high bit
-    struct AVCDecoderConfigurationRecord
-    {
-        uint8_t configurationVersion;
-        uint8_t AVCProfileIndication;
-        uint8_t profile_compatibility;
-        uint8_t AVCLevelIndication;
-
-        struct
-        {
-            uint8_t lengthSizeMinusOne : 2;
-            uint8_t reserved : 6; // must be filled with 1's
-        };
-        struct
-        {
-            uint8_t numOfSequenceParameterSets : 5; // 1 for now
-            uint8_t reserved2 : 3; // must be filled with 1's
-        };
-
-        //struct
-        //{
-        //    uint8_t reserved : 6; // must be filled with 1's
-        //    uint8_t lengthSizeMinusOne : 2;
-        //};
-        //struct
-        //{
-        //    uint8_t reserved2 : 3; // must be filled with 1's
-        //    uint8_t numOfSequenceParameterSets : 5; // 1 for now
-        //};
-
-        uint16_t sequenceParameterSetLength;
-        // for (i=0; i< numOfSequenceParameterSets; i++) { 
-        //    uint(8*sequenceParameterSetLength) sequenceParameterSetNALUnit
-        // }
-        // uint8_t numOfPictureParameterSets; // 1
-        // for(i = 0; i < numOfPictureParameterSets; i++) {
-        //    uint16_t pictureParameterSetLength;
-        //    uint(8*pictureParameterSetLength) pictureParameterSetNALUnit;
-        // }
-    };
-#pragma pack(pop)
-
-    std::string record_str(
-        sizeof(AVCDecoderConfigurationRecord) + sps_nalu.size() +
-        sizeof(uint8_t) + sizeof(uint16_t) + pps_nalu.size(), '\0');
-
-    AVCDecoderConfigurationRecord* record = (AVCDecoderConfigurationRecord*)record_str.data();
-    UINT32 profile_indication, level_indication;
-
-    char* p = nullptr;
-
-    record->configurationVersion = 1;
-
-    CHECK_HR(hr = this->video_type->GetUINT32(MF_MT_MPEG2_PROFILE, &profile_indication));
-    if(profile_indication > std::numeric_limits<uint8_t>::max())
-        CHECK_HR(hr = E_UNEXPECTED);
-
-    // TODO: profile_indication(=profile_idc) is located at sps_nalu.at(1)
-
-    record->AVCProfileIndication = (uint8_t)profile_indication;
-    record->profile_compatibility = sps_nalu.at(2);
-
-    CHECK_HR(hr = this->video_type->GetUINT32(MF_MT_MPEG2_LEVEL, &level_indication));
-    if(level_indication > std::numeric_limits<uint8_t>::max())
-        CHECK_HR(hr = E_UNEXPECTED);
-
-    record->AVCLevelIndication = (uint8_t)level_indication;
-    record->reserved = ~(record->reserved & 0);
-    record->lengthSizeMinusOne = (uint8_t)(start_code_prefix_len - 1);
-    record->reserved2 = ~(record->reserved2 & 0);
-    record->numOfSequenceParameterSets = 1;
-    record->sequenceParameterSetLength = _byteswap_ushort((uint16_t)sps_nalu.size());
-
-    p = (char*)memcpy(
-        record_str.data() + sizeof(AVCDecoderConfigurationRecord),
-        sps_nalu.data(),
-        sps_nalu.size());
-
-    p += sps_nalu.size();
-    *p++ = 1; // numOfPictureParameterSets
-    *(uint16_t*)p = _byteswap_ushort((uint16_t)pps_nalu.size());
-    p += sizeof(uint16_t);
-    
-    memcpy(p, pps_nalu.data(), pps_nalu.size());
-
-    assert_(p + pps_nalu.size() == record_str.data() + record_str.size());
-
-done:
-    if(FAILED(hr))
-        throw HR_EXCEPTION(hr);
-
-    return record_str;
-}
-
-// from ffmpeg(LGPL)
-const uint8_t* ff_avc_find_startcode_internal(const uint8_t* p,
-    const uint8_t* end)
-{
-    const uint8_t* a = p + 4 - ((intptr_t)p & 3);
-
-    for(end -= 3; p < a && p < end; p++) {
-        if(p[0] == 0 && p[1] == 0 && p[2] == 1)
-            return p;
-    }
-
-    for(end -= 3; p < end; p += 4) {
-        uint32_t x = *(const uint32_t*)p;
-
-        if((x - 0x01010101) & (~x) & 0x80808080) {
-            if(p[1] == 0) {
-                if(p[0] == 0 && p[2] == 1)
-                    return p;
-                if(p[2] == 0 && p[3] == 1)
-                    return p + 1;
-            }
-
-            if(p[3] == 0) {
-                if(p[2] == 0 && p[4] == 1)
-                    return p + 2;
-                if(p[4] == 0 && p[5] == 1)
-                    return p + 3;
-            }
-        }
-    }
-
-    for(end += 3; p < end; p++) {
-        if(p[0] == 0 && p[1] == 0 && p[2] == 1)
-            return p;
-    }
-
-    return end + 3;
-}
-
-std::size_t output_rtmp::find_start_code_prefix(
-    const std::string_view& data, int& start_code_prefix_len)
-{
-    start_code_prefix_len = 4;
-
-    const uint8_t* end = ff_avc_find_startcode_internal(
-        (uint8_t*)data.data(),
-        (uint8_t*)data.data() + data.size());
-
-    if(end >= (const uint8_t*)data.data() + data.size())
-        return std::string_view::npos;
-    else
-        return end - (uint8_t*)data.data();
-
-    /*std::size_t pos = data.find("\0\0", 0, 2);
-
-    for(; pos != std::string_view::npos; pos = data.find("\0\0", pos + 2, 2))
-    {
-        const char c = data.at(pos + 2);
-        if(c == 0x01)
-        {
-            start_code_prefix_len = 3;
-            break;
-        }
-        else if(c == 0x00 && data.at(pos + 3) == 0x01)
-        {
-            start_code_prefix_len = 4;
-            break;
-        }
-    }
-
-    return pos;*/
-}
-
 void output_rtmp::add_padding_nalus(UINT32 target_bitrate, double fps, std::string& payload)
 {
     const UINT32 byterate = (UINT32)(target_bitrate / 8.0 / fps);
@@ -622,21 +445,14 @@ void output_rtmp::add_padding_nalus(UINT32 target_bitrate, double fps, std::stri
     payload.append(bytes_needed, '\xff');
 }
 
-void output_rtmp::send_rtmp_video_packets(
-    const std::string_view& data, LONGLONG pts, LONGLONG dts, bool key_frame)
+void output_rtmp::send_rtmp_video_packets(const std::string_view& data,
+    const h264_frame_info& info, LONGLONG pts, LONGLONG dts)
 {
     if(pts < 0 || dts < 0)
         throw HR_EXCEPTION(E_UNEXPECTED);
 
     const uint32_t timestamp_ms = (uint32_t)((double)pts / SECOND_IN_TIME_UNIT * 1000.0);
 
-    // nalu start code prefix is either 00 00 00 01 or 00 00 01;
-    // these are unique in the data
-    int start_code_prefix_len;
-    std::size_t nalu_start = find_start_code_prefix(data, start_code_prefix_len);
-    if(nalu_start == std::string_view::npos)
-        throw HR_EXCEPTION(E_UNEXPECTED);
-
     // https://www.adobe.com/content/dam/acom/en/devnet/flv/video_file_format_spec_v10_1.pdf
 #pragma pack(push, 1)
     // big endian
@@ -660,103 +476,71 @@ void output_rtmp::send_rtmp_video_packets(
     };
 #pragma pack(pop)
 
-    // TODO: currently a 4 byte start code prefix is assumed
+    // send the sequence header when the parameter sets are first available and
+    // whenever the encoder changes them
+    if(info.parameter_sets && info.parameter_sets != this->sent_parameter_sets)
+    {
+        this->sent_parameter_sets = info.parameter_sets;
 
-    std::string payload;
+        const std::string& avc_decoder_configuration_record =
+            info.parameter_sets->avc_decoder_configuration_record;
+        const uint32_t rtmp_body_size = sizeof(flv_tag) + sizeof(flv_video_tag) +
+            (uint32_t)avc_decoder_configuration_record.size();
+        const uint32_t flv_data_size = rtmp_body_size - sizeof(flv_tag);
 
-    std::string_view data_chunk = data;
-    while(nalu_start != std::string_view::npos)
-    {
-        data_chunk = data_chunk.substr(nalu_start);
-        while(!data_chunk.at(0))
-            data_chunk = data_chunk.substr(1);
-        data_chunk = data_chunk.substr(1);
+        std::string packet(rtmp_body_size + 4, '\0');
 
-        int next_start_code_prefix_len;
-        const std::size_t next_nalu_start = 
-            find_start_code_prefix(data_chunk, next_start_code_prefix_len);
+        flv_tag* tag = (flv_tag*)packet.data();
+        tag->tag_type = RTMP_PACKET_TYPE_VIDEO;
+        tag->data_size[2] = (uint8_t)flv_data_size;
+        tag->data_size[1] = (uint8_t)(flv_data_size >> 8);
+        tag->data_size[0] = (uint8_t)(flv_data_size >> 16);
+        tag->timestamp[2] = (uint8_t)timestamp_ms;
+        tag->timestamp[1] = (uint8_t)(timestamp_ms >> 8);
+        tag->timestamp[0] = (uint8_t)(timestamp_ms >> 16);
+        tag->timestamp_extended = (uint8_t)(timestamp_ms >> 24);
+        tag->stream_id[2] = 0;
+        tag->stream_id[1] = 0;
+        tag->stream_id[0] = 0;
 
-        const std::string_view nalu = data_chunk.substr(0, next_nalu_start - 1);
-        const unsigned char nalu_header = nalu.at(0);
+        flv_video_tag* video_tag = (flv_video_tag*)(packet.data() + sizeof(flv_tag));
+        video_tag->frame_type = info.key_frame ? 1 : 2;
+        video_tag->codec_id = 7;
 
-        // check that the forbidden zero isn't set
-        if(nalu_header & 0x80)
-            throw HR_EXCEPTION(E_UNEXPECTED);
+        video_tag->avc_video_packet.avc_packet_type = 0;
+        video_tag->avc_video_packet.composition_time = 0;
 
-        // 2 bits
-        const unsigned char nalu_ref_idc = nalu_header >> 5; nalu_ref_idc;
-        // 5 bits
-        const unsigned char nalu_type = nalu_header & ~(0x80 | 0x40 | 0x20);
+        assert_(
+            sizeof(flv_tag) + sizeof(flv_video_tag) + avc_decoder_configuration_record.size() ==
+            rtmp_body_size);
+        memcpy(
+            packet.data() + sizeof(flv_tag) + sizeof(flv_video_tag),
+            avc_decoder_configuration_record.data(),
+            avc_decoder_configuration_record.size());
 
-        // store the sps and pps if no headers are sent yet
-        if(!this->video_headers_sent)
-        {
-            if(nalu_type == 7)
-                this->sps_nalu = nalu;
-            else if(nalu_type == 8)
-                this->pps_nalu = nalu;
-        }
+        *(uint32_t*)(packet.data() + rtmp_body_size) = _byteswap_ulong(rtmp_body_size - 0);
 
-        if(!this->video_headers_sent && !this->sps_nalu.empty() && !this->pps_nalu.empty())
-        {
-            this->video_headers_sent = true;
-
-            std::string avc_decoder_configuration_record =
-                this->create_avc_decoder_configuration_record(
-                    this->sps_nalu, this->pps_nalu, start_code_prefix_len);
-            const uint32_t rtmp_body_size = sizeof(flv_tag) + sizeof(flv_video_tag) +
-                (uint32_t)avc_decoder_configuration_record.size();
-            const uint32_t flv_data_size = rtmp_body_size - sizeof(flv_tag);
-
-            std::string packet(rtmp_body_size + 4, '\0');
-
-            flv_tag* tag = (flv_tag*)packet.data();
-            tag->tag_type = RTMP_PACKET_TYPE_VIDEO;
-            tag->data_size[2] = (uint8_t)flv_data_size;
-            tag->data_size[1] = (uint8_t)(flv_data_size >> 8);
-            tag->data_size[0] = (uint8_t)(flv_data_size >> 16);
-            tag->timestamp[2] = (uint8_t)timestamp_ms;
-            tag->timestamp[1] = (uint8_t)(timestamp_ms >> 8);
-            tag->timestamp[0] = (uint8_t)(timestamp_ms >> 16);
-            tag->timestamp_extended = (uint8_t)(timestamp_ms >> 24);
-            tag->stream_id[2] = 0;
-            tag->stream_id[1] = 0;
-            tag->stream_id[0] = 0;
-
-            flv_video_tag* video_tag = (flv_video_tag*)(packet.data() + sizeof(flv_tag));
-            video_tag->frame_type = key_frame ? 1 : 2;
-            video_tag->codec_id = 7;
-
-            video_tag->avc_video_packet.avc_packet_type = 0;
-            video_tag->avc_video_packet.composition_time = 0;
-
-            assert_(
-                sizeof(flv_tag) + sizeof(flv_video_tag) + avc_decoder_configuration_record.size() ==
-                rtmp_body_size);
-            memcpy(
-                packet.data() + sizeof(flv_tag) + sizeof(flv_video_tag),
-                avc_decoder_configuration_record.data(),
-                avc_decoder_configuration_record.size());
-
-            *(uint32_t*)(packet.data() + rtmp_body_size) = _byteswap_ulong(rtmp_body_size - 0);
-
-            const int res = RTMP_Write(this->rtmp, packet.data(), (int)packet.size(), 0);
-            if(!res)
-                throw HR_EXCEPTION(E_UNEXPECTED);
-        }
+        const int res = RTMP_Write(this->rtmp, packet.data(), (int)packet.size(), 0);
+        if(!res)
+            throw HR_EXCEPTION(E_UNEXPECTED);
+    }
 
-        if(nalu_type <= 5 || nalu_type == 6)
+    // the nalus are written with 4 byte lengths, as declared in the sequence header;
+    // the parameter sets are carried by the sequence header
+    std::string payload;
+    for(const h264_nalu& nalu : info.nalus)
+    {
+        if(nalu.type <= H264_NALU_SEI)
         {
-            const uint32_t nalu_size = _byteswap_ulong((uint32_t)nalu.size());
+            const uint32_t nalu_size = _byteswap_ulong(nalu.size);
             payload.append((const char*)&nalu_size, sizeof(uint32_t));
-            payload += nalu;
+            payload += info.get_nalu(data, nalu);
         }
-
-        nalu_start = next_nalu_start;
     }
 
     // add filler data
-    add_padding_nalus(this->bitrate, (double)this->fps_num / this->fps_den, payload);
+    if(!this->adaptive_bitrate || this->bitrate_control.get_bitrate() >= this->bitrate)
+        add_padding_nalus(this->bitrate, (double)this->fps_num / this->fps_den, payload);
 
     // send the payload
     const uint32_t rtmp_body_size =
@@ -779,7 +563,7 @@ void output_rtmp::send_rtmp_video_packets(
     tag->stream_id[0] = 0;
 
     flv_video_tag* video_tag = (flv_video_tag*)(packet.data() + sizeof(flv_tag));
-    video_tag->frame_type = key_frame ? 1 : 2;
+    video_tag->frame_type = info.key_frame ? 1 : 2;
     video_tag->codec_id = 7;
 
     video_tag->avc_video_packet.avc_packet_type = 1;
@@ -808,19 +592,31 @@ void output_rtmp::send_rtmp_packets()
     CComPtr<IMFMediaBuffer> media_buffer;
     BYTE* buffer = nullptr;
 
-    while(!this->video_samples.empty() && !this->audio_samples.empty())
+    while(!this->audio_samples.empty())
     {
         DWORD buffer_len;
+        bool send_video;
 
-        auto&& video_sample = this->video_samples[0];
         auto&& audio_sample = this->audio_samples[0];
-
-        CHECK_HR(hr = video_sample->GetSampleTime(&video_ts));
-        CHECK_HR(hr = video_sample->GetSampleDuration(&video_dur));
         CHECK_HR(hr = audio_sample->GetSampleTime(&audio_ts));
         CHECK_HR(hr = audio_sample->GetSampleDuration(&audio_dur));
 
-        auto& selected_sample = (video_ts <= audio_ts) ? video_sample : audio_sample;
+        if(!this->video_frames.empty())
+        {
+            CHECK_HR(hr = this->video_frames[0].sample->GetSampleTime(&video_ts));
+            CHECK_HR(hr = this->video_frames[0].sample->GetSampleDuration(&video_dur));
+            send_video = (video_ts <= audio_ts);
+        }
+        // in variable frame rate mode the next video frame comes at most the max frame
+        // interval after the last one, so the audio up to that isn't held back
+        // by the gaps of the unchanged frames
+        else if(this->vfr_enabled && this->video_received &&
+            audio_ts <= this->last_video_ts + this->vfr_max_frame_interval)
+            send_video = false;
+        else
+            break;
+
+        auto& selected_sample = send_video ? this->video_frames[0].sample : audio_sample;
 
         CHECK_HR(hr = selected_sample->GetBufferByIndex(0, &media_buffer));
         CHECK_HR(hr = media_buffer->GetCurrentLength(&buffer_len));
@@ -828,30 +624,68 @@ void output_rtmp::send_rtmp_packets()
             CHECK_HR(hr = E_UNEXPECTED);
         CHECK_HR(hr = media_buffer->Lock(&buffer, nullptr, nullptr));
 
-        if(video_ts <= audio_ts)
+        if(send_video)
         {
+            auto&& video_frame = this->video_frames[0];
+            auto&& video_sample = video_frame.sample;
             const std::string_view data((char*)buffer, buffer_len);
-            UINT32 key_frame;
             LONGLONG dts;
 
-            key_frame = MFGetAttributeUINT32(video_sample, MFSampleExtension_CleanPoint, FALSE);
             dts = MFGetAttributeUINT64(
                 video_sample, MFSampleExtension_DecodeTimestamp, video_ts);
 
             try
             {
-                this->send_rtmp_video_packets(data, video_ts, dts, (bool)key_frame);
+                // the samples that were written without the parsed bitstream
+                if(!video_frame.info)
+                    video_frame.info = this->bitstream_parser.parse(data);
             }
             catch(streaming::exception err)
             {
                 CHECK_HR(hr = err.get_hresult());
             }
-            catch(std::exception)
+
+            if(this->waiting_key_frame)
             {
-                CHECK_HR(hr = E_UNEXPECTED);
+                if(video_frame.info->key_frame)
+                {
+                    this->waiting_key_frame = false;
+                    std::cout << "rtmp time to first key frame: " <<
+                        std::chrono::duration_cast<std::chrono::milliseconds>(
+                            std::chrono::steady_clock::now() - this->connect_time).count() <<
+                        "ms" << (this->key_frame_requested ? " (requested)" : "") << std::endl;
+                }
+                else if(!this->key_frame_requested && this->request_key_frame)
+                {
+                    this->key_frame_requested = true;
+                    this->request_key_frame();
+                }
             }
 
-            this->video_samples.pop_front();
+            // the frames before the first key frame aren't decodable
+            if(!this->waiting_key_frame)
+            {
+                try
+                {
+                    this->send_rtmp_video_packets(data, *video_frame.info, video_ts, dts);
+
+                    if(this->adaptive_bitrate)
+                        this->bitrate_control.on_frame_sent(
+                            video_ts, this->clock->get_current_time(), buffer_len);
+                }
+                catch(streaming::exception err)
+                {
+                    CHECK_HR(hr = err.get_hresult());
+                }
+                catch(std::exception)
+                {
+                    CHECK_HR(hr = E_UNEXPECTED);
+                }
+            }
+
+            this->video_received = true;
+            this->last_video_ts = video_ts;
+            this->video_frames.pop_front();
         }
         else
         {
@@ -886,6 +720,31 @@ done:
         throw HR_EXCEPTION(hr);
 }
 
+void output_rtmp::enable_adaptive_bitrate(const bitrate_controller::params_t& params,
+    const media_clock_t& clock, const bitrate_controller::on_bitrate_change_t& on_bitrate_change)
+{
+    scoped_lock lock(this->write_lock);
+
+    assert_(clock);
+    this->clock = clock;
+    this->adaptive_bitrate = true;
+    this->bitrate_control.initialize(params, this->bitrate, on_bitrate_change);
+}
+
+void output_rtmp::enable_vfr(time_unit max_frame_interval)
+{
+    scoped_lock lock(this->write_lock);
+
+    this->vfr_enabled = true;
+    this->vfr_max_frame_interval = max_frame_interval;
+}
+
+void output_rtmp::set_key_frame_requester(const std::function<void()>& request_key_frame)
+{
+    scoped_lock lock(this->write_lock);
+    this->request_key_frame = request_key_frame;
+}
+
 void output_rtmp::write_sample(bool video, const CComPtr<IMFSample>& sample)
 {
     assert_(sample);
@@ -895,9 +754,23 @@ void output_rtmp::write_sample(bool video, const CComPtr<IMFSample>& sample)
     scoped_lock lock(this->write_lock);
 
     if(video)
-        this->video_samples.push_back(sample);
+    {
+        media_sample_h264_frame frame;
+        frame.sample = sample;
+        this->video_frames.push_back(std::move(frame));
+    }
     else
         this->audio_samples.push_back(sample);
 
     this->send_rtmp_packets();
+}
+
+void output_rtmp::write_video_frame(const media_sample_h264_frame& frame)
+{
+    assert_(frame.sample);
+
+    scoped_lock lock(this->write_lock);
+
+    this->video_frames.push_back(frame);
+    this->send_rtmp_packets();
 }
\ No newline at end of file
@@ -2,12 +2,17 @@
 
 #include "output_class.h"
 #include "media_sample.h"
+#include "bitrate_controller.h"
+#include "media_clock.h"
+#include "h264_bitstream.h"
 #include "wtl.h"
 #include <memory>
 #include <deque>
 #include <string>
 #include <string_view>
 #include <mutex>
+#include <chrono>
+#include <functional>
 
 #define RECORDING_STOPPED_MESSAGE (WM_APP + 1)
 
@@ -27,22 +32,44 @@ private:
     UINT32 bitrate, fps_num, fps_den;
     std::mutex write_lock;
 
-    std::deque<CComPtr<IMFSample>> video_samples, audio_samples;
+    std::deque<media_sample_h264_frame> video_frames;
+    std::deque<CComPtr<IMFSample>> audio_samples;
 
-    std::string sps_nalu, pps_nalu;
-    bool video_headers_sent, audio_headers_sent;
+    // parses the video samples that are written without the parsed bitstream
+    h264_bitstream_parser bitstream_parser;
+    // the parameter sets of the last sent sequence header
+    h264_parameter_sets_t sent_parameter_sets;
+    bool audio_headers_sent;
+
+    // the target bitrate follows the throughput of the connection if enabled;
+    // the send times are read from the clock of the session, which times the frames
+    bool adaptive_bitrate;
+    bitrate_controller bitrate_control;
+    media_clock_t clock;
+
+    // the audio is sent ahead of the video up to the max frame interval after
+    // the last video frame in variable frame rate mode
+    bool vfr_enabled;
+    time_unit vfr_max_frame_interval;
+    bool video_received;
+    LONGLONG last_video_ts;
+
+    // the video frames are discarded until the first key frame, so that the stream
+    // is decodable from the first frame
+    std::function<void()> request_key_frame;
+    bool waiting_key_frame, key_frame_requested;
+    std::chrono::steady_clock::time_point connect_time;
 
-    std::string create_avc_decoder_configuration_record(
-        const std::string_view& sps_nalu, const std::string_view& pps_nalu,
-        int start_code_prefix_len) const;
     std::string create_audio_specific_config() const;
-    static std::size_t find_start_code_prefix(const std::string_view&, int& start_code_prefix_len);
 
-    // adds filler data nalus to a frame to hit the target bitrate
+    // adds filler data nalus to a frame to hit the target bitrate;
+    // the padding is skipped while the adaptive bitrate is below the target
     static void add_padding_nalus(UINT32 target_bitrate, double fps, std::string&);
 
-    // pts and dts are in 100 nanosecond units
-    void send_rtmp_video_packets(const std::string_view&, LONGLONG pts, LONGLONG dts, bool key_frame);
+    // pts and dts are in 100 nanosecond units;
+    // the sequence header is sent whenever the parameter sets of the frame change
+    void send_rtmp_video_packets(const std::string_view&, const h264_frame_info&,
+        LONGLONG pts, LONGLONG dts);
     void send_rtmp_audio_packets(const std::string_view&, LONGLONG ts);
     void send_flv_metadata();
 
@@ -58,7 +85,19 @@ public:
         const CComPtr<IMFMediaType>& video_type,
         const CComPtr<IMFMediaType>& audio_type);
 
+    // must be called before the samples are written;
+    // the clock is the clock of the session;
+    // the callback changes the bitrate of the video encoder
+    void enable_adaptive_bitrate(const bitrate_controller::params_t&, const media_clock_t&,
+        const bitrate_controller::on_bitrate_change_t&);
+
+    void enable_vfr(time_unit max_frame_interval) override;
+
+    // the requester is called if the stream doesn't start with a key frame
+    void set_key_frame_requester(const std::function<void()>&);
+
     void write_sample(bool video, const CComPtr<IMFSample>& sample) override;
+    void write_video_frame(const media_sample_h264_frame&) override;
 };
 
 using output_rtmp_t = std::shared_ptr<output_rtmp>;
\ No newline at end of file
@@ -0,0 +1,86 @@
+#include "rtmp_throttle_simulation.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+
+#undef min
+#undef max
+
+rtmp_throttle_simulation::result_t rtmp_throttle_simulation::run(const params_t& params)
+{
+    const time_unit ms = SECOND_IN_TIME_UNIT / 1000;
+    const time_unit frame_duration = SECOND_IN_TIME_UNIT / params.fps;
+    const time_unit warmup_end = (time_unit)params.warmup * SECOND_IN_TIME_UNIT;
+    const time_unit throttled_end =
+        warmup_end + (time_unit)params.throttled * SECOND_IN_TIME_UNIT;
+    const time_unit end = throttled_end + (time_unit)params.recovery * SECOND_IN_TIME_UNIT;
+    // the latency of the pipeline before the frames reach the output
+    const time_unit pipeline_latency = 100 * ms;
+
+    bitrate_controller controller;
+    bitrate_controller::params_t controller_params;
+    result_t result;
+    // the bitrate of the stand-in encoder, which follows the controller
+    UINT32 encoder_bitrate = params.bitrate * 1000;
+
+    controller_params.max_bitrate = params.bitrate * 1000;
+    controller_params.min_bitrate = std::min(500000u, controller_params.max_bitrate);
+    controller.initialize(controller_params, encoder_bitrate,
+        [&encoder_bitrate](UINT32 bitrate) {encoder_bitrate = bitrate;});
+
+    // the time at which the link has sent the previous frame
+    time_unit link_free = 0;
+    for(time_unit media_time = 0; media_time < end; media_time += frame_duration)
+    {
+        phase_result_t& phase = media_time < warmup_end ? result.warmup :
+            (media_time < throttled_end ? result.throttled : result.recovery);
+        const time_unit phase_start = media_time < warmup_end ? 0 :
+            (media_time < throttled_end ? warmup_end : throttled_end);
+        const bool throttled = media_time >= warmup_end && media_time < throttled_end;
+        const UINT64 capacity = throttled ?
+            (UINT64)params.throttled_capacity * 1000 : (UINT64)params.bitrate * 2000;
+
+        const size_t bytes = (size_t)((UINT64)encoder_bitrate / 8 / params.fps);
+        // the write blocks until the link has sent the previous frames
+        const time_unit send_start = std::max(link_free, media_time + pipeline_latency);
+        link_free = send_start + (time_unit)(bytes * 8 * SECOND_IN_TIME_UNIT / capacity);
+
+        controller.on_frame_sent(media_time, link_free, bytes);
+
+        phase.end_bitrate = controller.get_bitrate() / 1000;
+        phase.max_backlog = std::max(phase.max_backlog, controller.get_backlog() / ms);
+        if(phase.settle_time < 0 && (throttled ?
+            controller.get_bitrate() <= capacity :
+            controller.get_bitrate() == controller_params.max_bitrate))
+            phase.settle_time = (media_time - phase_start) / ms;
+    }
+
+    return result;
+}
+
+void rtmp_throttle_simulation::run_all(const params_t& params)
+{
+    const result_t result = run(params);
+
+    std::cout << "rtmp throttle simulation: " << params.bitrate << "kbps at " <<
+        params.fps << "fps, throttled to " << params.throttled_capacity << "kbps for " <<
+        params.throttled << "s" << std::endl;
+    std::cout << "phase      kbps  max backlog ms  settle ms" << std::endl;
+
+    auto print = [](const char* name, const phase_result_t& phase)
+    {
+        std::cout << std::left << std::setw(9) << name << std::right <<
+            std::setw(6) << phase.end_bitrate <<
+            std::setw(16) << phase.max_backlog <<
+            std::setw(11) << phase.settle_time << std::endl;
+    };
+    print("warmup", result.warmup);
+    print("throttle", result.throttled);
+    print("recovery", result.recovery);
+
+    // the bitrate must fit the throttled link and recover to the target afterwards
+    const bool passed =
+        result.throttled.end_bitrate <= params.throttled_capacity &&
+        result.recovery.end_bitrate == params.bitrate;
+    std::cout << (passed ? "passed" : "FAILED") << std::endl;
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include "bitrate_controller.h"
+
+/*
+
+headless stand-in for a throttled rtmp connection;
+the frames of a constant bitrate encoder are sent over a simulated link that
+sends the bytes at its capacity and blocks the sender while it is busy, which is how
+the rtmp writes behave on a congested connection;
+the capacity drops below the encoder bitrate for the throttled phase and is restored
+afterwards, and the results report how the bitrate controller follows the capacity;
+the simulation runs on a virtual clock, so it takes no real time
+
+*/
+
+class rtmp_throttle_simulation
+{
+public:
+    struct params_t
+    {
+        // in kbps
+        UINT32 bitrate = 6000;
+        // the capacity of the link during the throttled phase, in kbps;
+        // the capacity is twice the bitrate outside the throttled phase
+        UINT32 throttled_capacity = 3000;
+        UINT32 fps = 60;
+        // the lengths of the phases before, during and after the throttling, in seconds
+        UINT32 warmup = 10, throttled = 30, recovery = 60;
+    };
+
+    struct phase_result_t
+    {
+        // in kbps
+        UINT32 end_bitrate = 0;
+        // the largest backlog of the phase, in milliseconds
+        time_unit max_backlog = 0;
+        // the time from the start of the phase until the bitrate first fitted the throttled
+        // capacity or reached the target bitrate outside the throttling, in milliseconds;
+        // -1 if it didn't
+        time_unit settle_time = -1;
+    };
+
+    struct result_t
+    {
+        phase_result_t warmup, throttled, recovery;
+    };
+private:
+    rtmp_throttle_simulation() = delete;
+public:
+    static result_t run(const params_t&);
+    // runs the simulation and prints the results
+    static void run_all(const params_t&);
+};
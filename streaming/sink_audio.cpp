@@ -34,7 +34,8 @@ stream_audio::stream_audio(const sink_audio_t& sink) :
     stopping(false),
     stop_point(std::numeric_limits<time_unit>::min()),
     requesting(false),
-    requests(0), max_requests(DEFAULT_MAX_REQUESTS)
+    requests(0), max_requests(DEFAULT_MAX_REQUESTS),
+    input_stream_count(0)
 {
 }
 
@@ -55,9 +56,9 @@ void stream_audio::dispatch_request(const request_packet& incomplete_rp, bool no
     assert_(this->unavailable <= 240);
 
     const int requests = this->requests.load();
-    if(requests < this->max_requests || no_drop)
+    if(requests < this->max_requests * this->input_stream_count || no_drop)
     {
-        this->requests++;
+        this->requests += this->input_stream_count;
         this->unavailable = 0;
 
         assert_(this->topology);
@@ -71,6 +72,12 @@ void stream_audio::dispatch_request(const request_packet& incomplete_rp, bool no
     }
 }
 
+void stream_audio::connect_streams(const media_stream_t& from, const media_topology_t& topology)
+{
+    this->media_stream_message_listener::connect_streams(from, topology);
+    this->input_stream_count++;
+}
+
 media_stream::result_t stream_audio::request_sample(const request_packet& rp, const media_stream*)
 {
     if(rp.flags & FLAG_LAST_PACKET)
@@ -44,6 +44,9 @@ private:
 
     std::atomic_int requests;
     int max_requests;
+    // each request is completed by every input stream;
+    // there are multiple input streams when recording multiple audio tracks
+    int input_stream_count;
 
     // for debug
     int unavailable;
@@ -58,6 +61,7 @@ public:
     explicit stream_audio(const sink_audio_t& sink);
 
     // media_stream
+    void connect_streams(const media_stream_t& from, const media_topology_t&) override;
     result_t request_sample(const request_packet&, const media_stream*);
     result_t process_sample(const media_component_args*, const request_packet&, const media_stream*);
 };
\ No newline at end of file
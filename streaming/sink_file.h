@@ -7,9 +7,18 @@
 #include "output_class.h"
 #include <memory>
 #include <limits>
+#include <mutex>
 
 // TODO: rename to sink_output or similar
 
+// the capture-to-output latency of the written frames;
+// the latency is the time between the end of a frame and the time it is written
+struct sink_file_metrics
+{
+    time_unit latency_avg, latency_max;
+    frame_unit written_count;
+};
+
 template<class SinkFile>
 class stream_file;
 
@@ -25,6 +34,14 @@ private:
     output_class_t output;
     LONGLONG last_timestamp;
     bool video;
+    UINT32 audio_track;
+
+    // the encoders subtract the start time from the frame timestamps
+    time_unit time_shift;
+    // capture-to-output latency measurement
+    mutable std::mutex latency_mutex;
+    time_unit latency_sum, latency_max;
+    frame_unit latency_count;
 
     // request_queue_handler
     bool on_serve(typename request_queue::request_t&) override;
@@ -32,8 +49,11 @@ private:
 public:
     explicit sink_file(const media_session_t& session);
 
-    void initialize(const output_class_t& output, bool video);
+    // audio track 0 is the main audio track
+    void initialize(const output_class_t& output, bool video, UINT32 audio_track = 0);
     media_stream_t create_stream(media_message_generator_t&&);
+
+    sink_file_metrics get_metrics() const;
 };
 
 typedef sink_file<media_component_h264_video_args_t> sink_file_video;
@@ -52,6 +72,8 @@ public:
     typedef media_stream::result_t result_t;
 private:
     sink_file_t sink;
+
+    void on_component_start(time_unit) override;
 public:
     explicit stream_file(const sink_file_t&);
 
@@ -81,15 +103,20 @@ template<typename T>
 sink_file<T>::sink_file(const media_session_t& session) : 
     media_component(session),
     last_timestamp(std::numeric_limits<LONGLONG>::min()),
-    video(false)
+    video(false),
+    audio_track(0),
+    time_shift(-1),
+    latency_sum(0), latency_max(0),
+    latency_count(0)
 {
 }
 
 template<typename T>
-void sink_file<T>::initialize(const output_class_t& output, bool video)
+void sink_file<T>::initialize(const output_class_t& output, bool video, UINT32 audio_track)
 {
     this->output = output;
     this->video = video;
+    this->audio_track = audio_track;
 }
 
 template<typename T>
@@ -109,6 +136,7 @@ bool sink_file<T>::on_serve(typename request_queue::request_t& request)
 {
     if(request.sample)
     {
+        const time_unit current_time = this->session->get_clock()->get_current_time();
         for(const auto& frame : request.sample->sample->frames)
         {
             const LONGLONG timestamp = (LONGLONG)frame.ts;
@@ -117,7 +145,19 @@ bool sink_file<T>::on_serve(typename request_queue::request_t& request)
             // TODO: print if frames in wrong order
 
             this->last_timestamp = timestamp;
-            this->output->write_sample(this->video, frame.sample);
+            if constexpr(std::is_same_v<std::decay_t<decltype(frame)>, media_sample_h264_frame>)
+                this->output->write_video_frame(frame);
+            else
+                this->output->write_audio_track_sample(this->audio_track, frame.sample);
+
+            if(this->time_shift >= 0)
+            {
+                scoped_lock lock(this->latency_mutex);
+                const time_unit latency = current_time - (timestamp + dur + this->time_shift);
+                this->latency_sum += latency;
+                this->latency_max = std::max(this->latency_max, latency);
+                this->latency_count++;
+            }
         }
 
         // currently it is assumed that the sink file is connected directly to the video_sink
@@ -133,6 +173,22 @@ typename sink_file<T>::request_queue::request_t* sink_file<T>::next_request()
     return this->requests.get();
 }
 
+template<typename T>
+sink_file_metrics sink_file<T>::get_metrics() const
+{
+    sink_file_metrics metrics = {};
+
+    scoped_lock lock(this->latency_mutex);
+    if(this->latency_count > 0)
+    {
+        metrics.latency_avg = this->latency_sum / this->latency_count;
+        metrics.latency_max = this->latency_max;
+    }
+    metrics.written_count = this->latency_count;
+
+    return metrics;
+}
+
 
 /////////////////////////////////////////////////////////////////
 /////////////////////////////////////////////////////////////////
@@ -146,6 +202,13 @@ stream_file<T>::stream_file(const sink_file_t& sink) :
 {
 }
 
+template<typename T>
+void stream_file<T>::on_component_start(time_unit t)
+{
+    if(this->sink->time_shift < 0)
+        this->sink->time_shift = t;
+}
+
 template<typename T>
 media_stream::result_t stream_file<T>::request_sample(const request_packet& rp, const media_stream*)
 {
@@ -4,6 +4,7 @@
 #include "control_video.h"
 #include "gui_previewwnd.h"
 #include <Windows.h>
+#include <algorithm>
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
 //void CHECK_HR(HRESULT hr)
@@ -15,7 +16,10 @@
 #undef max
 #undef min
 
-sink_preview2::sink_preview2(const media_session_t& session) : media_sink(session)
+sink_preview2::sink_preview2(const media_session_t& session) : media_sink(session),
+    frame_number(0),
+    preview_frame_number(0),
+    max_width(0), max_height(0)
 {
 }
 
@@ -141,13 +145,84 @@ void sink_preview2::update_preview_sample(const media_component_args* args_)
         {
             if(item.buffer && item.buffer->bitmap)
             {
-                std::atomic_store(&this->last_buffer, item.buffer);
+                // the videomixer forwards the previous composite if the scene is static;
+                // the same frame doesn't need to be downscaled again
+                if(item.buffer != this->get_last_buffer())
+                {
+                    std::atomic_store(&this->last_buffer, item.buffer);
+                    this->frame_number.fetch_add(1, std::memory_order_release);
+                }
                 break;
             }
         }
     }
 }
 
+void sink_preview2::set_max_preview_size(UINT32 max_width, UINT32 max_height)
+{
+    this->max_width = max_width;
+    this->max_height = max_height;
+}
+
+CComPtr<ID2D1Bitmap1> sink_preview2::get_preview_bitmap(UINT32 width, UINT32 height)
+{
+    HRESULT hr = S_OK;
+    media_buffer_texture_t last_buffer;
+    CComPtr<ID2D1Image> old_target;
+    D2D1_SIZE_U size = {0};
+    const UINT64 frame_number = this->get_frame_number();
+
+    // the aspect ratio is kept when the size is limited
+    FLOAT scale = 1.f;
+    if(this->max_width && width > this->max_width)
+        scale = std::min(scale, (FLOAT)this->max_width / width);
+    if(this->max_height && height > this->max_height)
+        scale = std::min(scale, (FLOAT)this->max_height / height);
+    width = std::max((UINT32)(width * scale), 1U);
+    height = std::max((UINT32)(height * scale), 1U);
+
+    if(this->preview_bitmap)
+        size = this->preview_bitmap->GetPixelSize();
+    if(this->preview_bitmap && size.width == width && size.height == height &&
+        this->preview_frame_number == frame_number)
+        return this->preview_bitmap;
+
+    last_buffer = this->get_last_buffer();
+    if(!last_buffer)
+        return nullptr;
+
+    if(!this->preview_bitmap || size.width != width || size.height != height)
+    {
+        this->preview_bitmap = nullptr;
+        CHECK_HR(hr = this->d2d1devctx->CreateBitmap(
+            D2D1::SizeU(width, height), nullptr, 0,
+            D2D1::BitmapProperties1(D2D1_BITMAP_OPTIONS_TARGET,
+                D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)),
+            &this->preview_bitmap));
+    }
+
+    // the frame is downscaled once, so that the preview window is redrawn from
+    // the small bitmap until a new frame arrives
+    this->d2d1devctx->GetTarget(&old_target);
+    this->d2d1devctx->SetTarget(this->preview_bitmap);
+    this->d2d1devctx->BeginDraw();
+    this->d2d1devctx->SetTransform(D2D1::Matrix3x2F::Identity());
+    this->d2d1devctx->DrawBitmap(last_buffer->bitmap,
+        D2D1::RectF(0.f, 0.f, (FLOAT)width, (FLOAT)height), 1.f,
+        D2D1_INTERPOLATION_MODE_LINEAR);
+    hr = this->d2d1devctx->EndDraw();
+    this->d2d1devctx->SetTarget(old_target);
+    CHECK_HR(hr);
+
+    this->preview_frame_number = frame_number;
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return this->preview_bitmap;
+}
+
 media_stream_t sink_preview2::create_stream()
 {
     return stream_preview2_t(new stream_preview2(this->shared_from_this<sink_preview2>()));
@@ -16,7 +16,17 @@ class sink_preview2 : public media_sink
 public:
     using scoped_lock = std::lock_guard<std::recursive_mutex>;
 private:
+    // the latest frame slot;
+    // the frame number is incremented after the last buffer is replaced, so that the preview
+    // can poll for new frames without loading the buffer
     media_buffer_texture_t last_buffer;
+    std::atomic<UINT64> frame_number;
+
+    // the last frame downscaled to the preview size;
+    // protected by the d2d1 context mutex
+    CComPtr<ID2D1Bitmap1> preview_bitmap;
+    UINT64 preview_frame_number;
+    UINT32 max_width, max_height;
 
     void update_preview_sample(const media_component_args*);
 public:
@@ -45,6 +55,16 @@ public:
     media_stream_t create_stream();
 
     media_buffer_texture_t get_last_buffer() const { return std::atomic_load(&this->last_buffer); }
+    UINT64 get_frame_number() const { return this->frame_number.load(std::memory_order_acquire); }
+
+    // the d2d1 context mutex must be locked;
+    // limits the size of the preview bitmap; 0 doesn't limit the size
+    void set_max_preview_size(UINT32 max_width, UINT32 max_height);
+    // the d2d1 context mutex must be locked and the device context must not be drawing;
+    // downscales the last frame to a bitmap of the given size if the frame or the size
+    // has changed since the last call;
+    // returns null if there is no frame
+    CComPtr<ID2D1Bitmap1> get_preview_bitmap(UINT32 width, UINT32 height);
 };
 
 typedef std::shared_ptr<sink_preview2> sink_preview2_t;
@@ -16,7 +16,8 @@
 sink_video::sink_video(const media_session_t& session, const media_session_t& audio_session) : 
     media_sink(session),
     audio_session(audio_session),
-    started(false), instant_switch(false)
+    started(false), instant_switch(false),
+    audio_pull_periodicity(0)
 {
 }
 
@@ -24,18 +25,26 @@ sink_video::~sink_video()
 {
 }
 
-void sink_video::initialize()
+void sink_video::initialize(frame_unit audio_pull_periodicity)
 {
+    assert_(audio_pull_periodicity > 0);
+    this->audio_pull_periodicity = audio_pull_periodicity;
 }
 
 time_unit sink_video::get_audio_pull_periodicity() const
 {
-    // audio pull periodicity is the length of one aac encoder packet
+    // by default, audio pull periodicity is the length of one aac encoder packet;
     // audio_session::frame_rate_num equals to sample rate
-    return convert_to_time_unit(1024, 
+    return convert_to_time_unit(this->audio_pull_periodicity,
         this->audio_session->frame_rate_num, this->audio_session->frame_rate_den);
 }
 
+time_unit sink_video::get_audio_bundling_threshold() const
+{
+    // bundling must not coarsen the audio pull periodicity
+    return std::min((time_unit)AUDIO_BUNDLING_THRESHOLD, this->get_audio_pull_periodicity() / 2);
+}
+
 void sink_video::switch_topologies(
     const media_topology_t& video_topology,
     const media_topology_t& audio_topology,
@@ -90,6 +99,7 @@ stream_video::stream_video(
     discontinuity(false),
     requesting(false),
     requests(0), max_requests(DEFAULT_MAX_REQUESTS),
+    input_stream_count(0),
     video_next_due_time(-1)
 {
 }
@@ -219,20 +229,22 @@ void stream_video::schedule_new(time_unit due_time)
     if(due_time == this->video_next_due_time)
         this->video_next_due_time = this->get_next_due_time(due_time);
 
+    const time_unit bundling_threshold = this->sink->get_audio_bundling_threshold();
+
     // TODO: with high enough fps, this loop might never break
     for(;;)
     {
         time_unit scheduled_time;
 
         // try bundling the audio due time to video due time
-        if((this->video_next_due_time - due_time) < AUDIO_BUNDLING_THRESHOLD)
+        if((this->video_next_due_time - due_time) < bundling_threshold)
         {
             assert_(this->video_next_due_time > due_time);
             scheduled_time = this->video_next_due_time;
         }
         else if(std::abs(
             due_time + this->sink->get_audio_pull_periodicity() - this->video_next_due_time) <
-            AUDIO_BUNDLING_THRESHOLD)
+            bundling_threshold)
             scheduled_time = this->video_next_due_time;
         else
             // bundling not possible
@@ -265,10 +277,12 @@ void stream_video::dispatch_request(const request_packet& incomplete_rp, bool no
 
     assert_(drops <= 1000);*/
 
+    // the request is dispatched even if the topology has no input streams
+    const int input_stream_count = std::max(this->input_stream_count, 1);
     const int requests = this->requests.load();
-    if(requests < this->max_requests || no_drop)
+    if(requests < this->max_requests * input_stream_count || no_drop)
     {
-        this->requests++;
+        this->requests += input_stream_count;
         this->unavailable = 0;
 
         assert_(this->topology);
@@ -288,6 +302,12 @@ void stream_video::dispatch_request(const request_packet& incomplete_rp, bool no
     }
 }
 
+void stream_video::connect_streams(const media_stream_t& from, const media_topology_t& topology)
+{
+    this->media_stream_message_listener::connect_streams(from, topology);
+    this->input_stream_count++;
+}
+
 media_stream::result_t stream_video::request_sample(const request_packet& rp, const media_stream*)
 {
     if(rp.flags & FLAG_LAST_PACKET)
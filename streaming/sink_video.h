@@ -41,14 +41,21 @@ private:
     media_topology_t pending_audio_topology;
 
     bool instant_switch;
+
+    // in audio frames
+    frame_unit audio_pull_periodicity;
 public:
     sink_video(const media_session_t& session, const media_session_t& audio_session);
     ~sink_video();
 
     // TODO: initialize fps
-    void initialize();
+    // audio pull periodicity is in audio frames
+    void initialize(frame_unit audio_pull_periodicity);
 
     time_unit get_audio_pull_periodicity() const;
+    // audio requests are bundled with video requests if the due times are within
+    // this threshold
+    time_unit get_audio_bundling_threshold() const;
 
     // these functions make sure that both topologies are switched at the same time;
     // instant switch will stop the old topology instantly when pulling a new frame
@@ -87,6 +94,9 @@ private:
     // reset the request limit
     std::atomic_int requests;
     int max_requests;
+    // each request is completed by every input stream;
+    // there are multiple input streams when recording multiple renditions
+    int input_stream_count;
 
     // for debug
     int unavailable;
@@ -112,6 +122,7 @@ public:
     // media_clock_sink
     bool get_clock(media_clock_t&) override;
     // media_stream
+    void connect_streams(const media_stream_t& from, const media_topology_t&) override;
     result_t request_sample(const request_packet&, const media_stream*) override;
     result_t process_sample(
         const media_component_args*, const request_packet&, const media_stream*) override;
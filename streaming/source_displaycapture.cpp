@@ -29,7 +29,7 @@ source_displaycapture::source_displaycapture(
     context_mutex(context_mutex),
     output_index((UINT)-1),
     same_adapter(false),
-    available_samples(new buffer_pool),
+    available_samples(new buffer_pool(TEXTURE_POOL_BUCKET_LIMIT, TEXTURE_POOL_MAX_AGE)),
     available_pointer_samples(new buffer_pool)
 {
     this->outdupl_desc.Rotation = DXGI_MODE_ROTATION_UNSPECIFIED;
@@ -307,10 +307,12 @@ capture:
     CHECK_HR(hr = frame->QueryInterface(&screen_frame));
 
     D3D11_TEXTURE2D_DESC screen_frame_desc;
-    output_frame = this->acquire_buffer(this->available_samples);
     screen_frame->GetDesc(&screen_frame_desc);
     screen_frame_desc.MiscFlags = 0;
     screen_frame_desc.Usage = D3D11_USAGE_DEFAULT;
+    // the buffers are bucketed by the desc, so that a display mode switch
+    // doesn't recycle the textures of the previous mode
+    output_frame = this->acquire_buffer(this->available_samples, screen_frame_desc);
     output_frame->initialize(this->d3d11dev2, screen_frame_desc, NULL);
 
     // pointer position update
@@ -388,6 +390,13 @@ media_buffer_texture_t source_displaycapture::acquire_buffer(const std::shared_p
     return pool->acquire_buffer();
 }
 
+media_buffer_texture_t source_displaycapture::acquire_buffer(const std::shared_ptr<buffer_pool>& pool,
+    const D3D11_TEXTURE2D_DESC& desc)
+{
+    buffer_pool::scoped_lock lock(pool->mutex);
+    return pool->acquire_buffer(media_buffer_texture::get_pool_key(desc));
+}
+
 HRESULT source_displaycapture::reinitialize(UINT output_index)
 {
     if(output_index == (UINT)-1)
@@ -67,6 +67,8 @@ private:
     void dispatch(request_t&) override;
 
     media_buffer_texture_t acquire_buffer(const std::shared_ptr<buffer_pool>&);
+    media_buffer_texture_t acquire_buffer(const std::shared_ptr<buffer_pool>&,
+        const D3D11_TEXTURE2D_DESC&);
 
     HRESULT copy_between_adapters(
         ID3D11Device* dst_dev,
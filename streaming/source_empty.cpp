@@ -52,8 +52,7 @@ void source_empty_audio::make_request(request_t& request, frame_unit frame_end)
     args.sample->add_consecutive_frames(frame);
 
     const bool limit_reached =
-        args.sample->move_frames_to(NULL, args.sample->get_end() - this->get_maximum_buffer_size(),
-            transform_audiomixer2::block_align);
+        args.sample->move_frames_to(NULL, args.sample->get_end() - this->get_maximum_buffer_size());
     if(limit_reached)
     {
         std::cout << "source_empty_audio buffer limit reached, excess frames discarded" << std::endl;
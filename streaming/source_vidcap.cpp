@@ -380,7 +380,8 @@ done:
 source_vidcap::source_vidcap(const media_session_t& session, context_mutex_t context_mutex) :
     source_base(session),
     context_mutex(context_mutex),
-    buffer_pool_texture(new buffer_pool_texture_t),
+    buffer_pool_texture(new buffer_pool_texture_t(
+        TEXTURE_POOL_BUCKET_LIMIT, TEXTURE_POOL_MAX_AGE)),
     frame_width(0), frame_height(0), 
     next_frame_pos(-1),
     is_capture_initialized(false), is_helper_initialized(false),
@@ -403,8 +404,7 @@ source_vidcap::~source_vidcap()
     }
 }
 
-void source_vidcap::initialize_buffer(const media_buffer_texture_t& buffer,
-    const D3D11_TEXTURE2D_DESC& desc)
+D3D11_TEXTURE2D_DESC source_vidcap::get_buffer_desc(const D3D11_TEXTURE2D_DESC& desc)
 {
     D3D11_TEXTURE2D_DESC desc_ = desc;
     desc_.MipLevels = 1;
@@ -417,16 +417,21 @@ void source_vidcap::initialize_buffer(const media_buffer_texture_t& buffer,
     desc_.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
     desc_.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
 
-    buffer->initialize(this->d3d11dev, desc_, NULL);
+    return desc_;
 }
 
 media_buffer_texture_t source_vidcap::acquire_buffer(const D3D11_TEXTURE2D_DESC& desc)
 {
+    const D3D11_TEXTURE2D_DESC buffer_desc = get_buffer_desc(desc);
+
+    // the buffers are bucketed by the desc, so that a renegotiated resolution
+    // doesn't recycle the textures of the previous resolution
     buffer_pool_texture_t::scoped_lock lock(this->buffer_pool_texture->mutex);
-    media_buffer_texture_t buffer = this->buffer_pool_texture->acquire_buffer();
+    media_buffer_texture_t buffer = this->buffer_pool_texture->acquire_buffer(
+        media_buffer_texture::get_pool_key(buffer_desc));
     lock.unlock();
 
-    this->initialize_buffer(buffer, desc);
+    buffer->initialize(this->d3d11dev, buffer_desc, NULL);
     return buffer;
 }
 
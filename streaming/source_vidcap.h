@@ -73,7 +73,8 @@ private:
     // transformed to lower case
     std::wstring symbolic_link;
 
-    void initialize_buffer(const media_buffer_texture_t&, const D3D11_TEXTURE2D_DESC&);
+    // returns the desc of the buffer for the desc of the captured texture
+    static D3D11_TEXTURE2D_DESC get_buffer_desc(const D3D11_TEXTURE2D_DESC&);
     media_buffer_texture_t acquire_buffer(const D3D11_TEXTURE2D_DESC&);
 
     stream_source_base_t create_derived_stream() override;
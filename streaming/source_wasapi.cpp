@@ -91,8 +91,7 @@ void source_wasapi::make_request(request_t& request, frame_unit frame_end)
         captured_audio = args.sample;
 
     scoped_lock lock(this->captured_audio_mutex);
-    const bool moved = this->captured_audio->move_frames_to(captured_audio.get(), frame_end,
-        this->resampled_block_align);
+    const bool moved = this->captured_audio->move_frames_to(captured_audio.get(), frame_end);
 
     args.frame_end = frame_end;
     // frames are simply skipped if there is no sample for the args
@@ -281,8 +280,7 @@ void source_wasapi::capture_cb(void*)
 
             // keep the buffer within the limits
             if(this->captured_audio->is_valid() && this->captured_audio->move_frames_to(
-                NULL, this->captured_audio->get_end() - this->get_maximum_buffer_size(), 
-                this->resampled_block_align))
+                NULL, this->captured_audio->get_end() - this->get_maximum_buffer_size()))
             {
                 std::cout << "source_wasapi buffer limit reached, excess frames discarded" << std::endl;
             }
@@ -423,8 +421,6 @@ void source_wasapi::initialize(const control_class_t& ctrl_pipeline,
     if(!this->capture)
         CHECK_HR(hr = this->initialize_render(device, engine_format));
 
-    this->resampled_block_align = transform_audiomixer2::block_align;
-
     // TODO: exception thrown here causes memory leak
     // initialize resampler
     this->resampler.initialize(
@@ -48,7 +48,6 @@ private:
     UINT32 block_align, samples_per_second, channels;
     REFERENCE_TIME buffer_actual_duration;
     UINT32 render_buffer_frame_count;
-    UINT32 resampled_block_align;
 
     CComPtr<async_callback_t> capture_callback;
     MFWORKITEM_KEY capture_work_key;
@@ -1,4 +1,6 @@
 #include "transform_aac_encoder.h"
+#include "aac_encoder_mft.h"
+#include "transform_audiomixer2.h"
 #include <Mferror.h>
 #include <iostream>
 
@@ -6,177 +8,250 @@
 #undef min
 #undef max
 
+// the silent frame is taken after the encoder has reached a steady state
+#define SILENT_FRAME_PRIMING_FRAMES 4
+
+std::mutex transform_aac_encoder::silent_frames_mutex;
+std::map<transform_aac_encoder::silent_frame_key_t, media_buffer_memory_t>
+transform_aac_encoder::silent_frames;
+
 transform_aac_encoder::transform_aac_encoder(const media_session_t& session) : 
     media_component(session),
     last_time_stamp(std::numeric_limits<frame_unit>::min()),
     time_shift(-1),
-    buffer_pool_memory(new buffer_pool_memory_t),
     encoded_audio(new media_sample_aac_frames),
-    dispatcher(new request_dispatcher)
+    dispatcher(new request_dispatcher),
+    pending_frames(0),
+    encoded_frame_count(0), silent_frame_count(0),
+    encode_time(0)
 {
+    this->sample_pool.Attach(new media_sample_pool);
 }
 
 transform_aac_encoder::~transform_aac_encoder()
 {
-    buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
-    this->buffer_pool_memory->dispose();
+    this->sample_pool->dispose();
 }
 
-bool transform_aac_encoder::encode(const media_sample_audio_frames* in_frames,
-    media_sample_aac_frames& out_frames, bool drain)
+void transform_aac_encoder::convert(const media_sample_audio_consecutive_frames& elem)
 {
-    assert_(out_frames.frames.empty());
+    typedef transform_audiomixer2::bit_depth_t in_bit_depth_t;
+    typedef bit_depth_t out_bit_depth_t;
 
     HRESULT hr = S_OK;
-    media_buffer_memory_t buffer;
-    CComPtr<IMFSample> out_sample;
-    CComPtr<IMFMediaBuffer> out_buffer;
+    out_bit_depth_t* out_data;
 
-    // this is just a specialized case of audio resampler's reset_sample
-    auto reset_sample = [&]()
-    {
-        HRESULT hr = S_OK;
-        DWORD buflen = 0, max_len = 0;
-        CComPtr<IMFMediaBuffer> mf_buffer = out_buffer;
+    this->interleaved.resize((size_t)elem.dur * channels);
+    out_data = this->interleaved.data();
 
-        out_sample = NULL;
-        out_buffer = NULL;
+    if(!elem.buffer)
+        // silent frames
+        std::fill(this->interleaved.begin(), this->interleaved.end(), (out_bit_depth_t)0);
+    else
+    {
+        const in_bit_depth_t* in_data_base;
+        CHECK_HR(hr = elem.buffer->Lock((BYTE**)&in_data_base, NULL, NULL));
 
-        if(mf_buffer)
+        for(UINT32 j = 0; j < channels; j++)
         {
-            CHECK_HR(hr = mf_buffer->GetCurrentLength(&buflen));
-            CHECK_HR(hr = mf_buffer->GetMaxLength(&max_len));
+            const in_bit_depth_t* in_data =
+                in_data_base + elem.plane_stride * j + elem.offset;
+            for(frame_unit i = 0; i < elem.dur; i++)
+            {
+                // clamp
+                const in_bit_depth_t sample = std::max(-1.f, std::min(in_data[i], 1.f));
+                out_data[i * channels + j] = (out_bit_depth_t)
+                    (sample * std::numeric_limits<out_bit_depth_t>::max());
+            }
         }
 
-        if((buflen + this->output_stream_info.cbSize) <= max_len)
-        {
-            CHECK_HR(hr = mf_buffer->SetCurrentLength(max_len));
-            // create a wrapper of buffer for out_buffer
-            CHECK_HR(hr = MFCreateMediaBufferWrapper(
-                mf_buffer, buflen, max_len - buflen, &out_buffer));
-        }
-        else
-        {
-            // TODO: the sink writer should call a place marker method for knowing
-            // when the output buffer is safe to reuse;
-            // currently, a new buffer must be allocated each time
-            buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
-            buffer.reset(new media_buffer_memory);
-            /*buffer = this->buffer_pool_memory->acquire_buffer();*/
-            buffer->initialize(this->output_stream_info.cbSize);
-            out_buffer = buffer->buffer;
-        }
+        CHECK_HR(hr = elem.buffer->Unlock());
+    }
 
-        CHECK_HR(hr = out_buffer->SetCurrentLength(0));
-        CHECK_HR(hr = MFCreateSample(&out_sample));
-        CHECK_HR(hr = out_sample->AddBuffer(out_buffer));
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
 
-    done:
-        if(FAILED(hr))
-            throw HR_EXCEPTION(hr);
-    };
-    auto process_sample = [&]()
+void transform_aac_encoder::encode_interleaved(frame_unit pos, frame_unit dur,
+    media_sample_aac_frames& out_frames)
+{
+    assert_(this->interleaved.size() == (size_t)dur * channels);
+
+    time_unit time = convert_to_time_unit(pos, this->session->frame_rate_num, 1) -
+        this->time_shift;
+    if(time < 0)
     {
-        // set the new duration and timestamp for the out sample
-        CComPtr<IMFMediaBuffer> mf_buffer;
-        DWORD buflen;
-        HRESULT hr = S_OK;
-        media_sample_aac_frame frame;
-        LONGLONG ts, dur;
+        std::cout << "aac encoder time shift was off by " << time << std::endl;
+        time = 0;
+    }
 
-        CHECK_HR(hr = out_sample->GetBufferByIndex(0, &mf_buffer));
-        CHECK_HR(hr = mf_buffer->GetCurrentLength(&buflen));
+    this->backend->encode(this->interleaved.data(), (uint32_t)dur, time, this->packets);
+    this->add_packets(out_frames);
 
-        CHECK_HR(hr = out_sample->GetSampleTime(&ts));
-        CHECK_HR(hr = out_sample->GetSampleDuration(&dur));
+    this->encoded_frame_count += dur;
+    this->pending_frames = (this->pending_frames + dur) % aac_encoder_backend::frame_length;
+}
 
-        frame.memory_host = buffer;
-        frame.ts = (time_unit)ts;
-        frame.dur = (time_unit)dur;
-        frame.buffer = mf_buffer;
-        frame.sample = out_sample;
+void transform_aac_encoder::add_packets(media_sample_aac_frames& out_frames)
+{
+    HRESULT hr = S_OK;
 
-        out_frames.frames.push_back(std::move(frame));
+    for(auto&& packet : this->packets)
+    {
+        media_sample_aac_frame frame;
+        frame.ts = packet.pts;
+        frame.dur = packet.duration;
+        frame.buffer = media_buffer_packet::get_media_buffer(packet.buffer);
 
-        // by empirical evidence, it seems that the encoder doesn't buffer input samples
-        this->memory_hosts.clear();
+        frame.sample = this->sample_pool->acquire_sample();
+        CHECK_HR(hr = frame.sample->AddBuffer(frame.buffer));
+        CHECK_HR(hr = frame.sample->SetSampleTime(frame.ts));
+        CHECK_HR(hr = frame.sample->SetSampleDuration(frame.dur));
 
-    done:
-        return hr;
-    };
-    auto drain_all = [&]()
-    {
-        std::cout << "drain on aac encoder" << std::endl;
+        out_frames.frames.push_back(std::move(frame));
+    }
 
-        HRESULT hr = S_OK;
-        CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0));
-        while(reset_sample(), this->process_output(out_sample))
-            CHECK_HR(hr = process_sample());
+done:
+    this->packets.clear();
 
-    done:
-        return hr;
-    };
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
 
-    // currently, the audio mixer only outputs one frame
+void transform_aac_encoder::encode_backend(const media_sample_audio_frames* in_frames,
+    media_sample_aac_frames& out_frames, bool drain)
+{
     if(in_frames)
     {
         for(const auto& elem : in_frames->get_frames())
         {
-            assert_(elem.buffer);
+            this->convert(elem);
+            this->encode_interleaved(elem.pos, elem.dur, out_frames);
+        }
+    }
 
-            // create a sample that has time and duration converted from frame unit to time unit
-            CComPtr<IMFSample> in_sample;
-            CComPtr<IMFMediaBuffer> in_buffer;
-            frame_unit frame_pos, frame_dur;
-            LONGLONG time, dur;
+    if(drain)
+    {
+        this->backend->drain(this->packets);
+        this->add_packets(out_frames);
+        this->pending_frames = 0;
+    }
+}
 
-            CHECK_HR(hr = MFCreateSample(&in_sample));
-            in_buffer = elem.buffer;
-            CHECK_HR(hr = in_sample->AddBuffer(in_buffer));
+void transform_aac_encoder::encode_silent(frame_unit pos, frame_unit end,
+    media_sample_aac_frames& out_frames)
+{
+    assert_(this->silent_frame);
 
-            frame_pos = elem.pos;
-            frame_dur = elem.dur;
-            time = (LONGLONG)(convert_to_time_unit(
-                frame_pos, this->session->frame_rate_num, 1) - this->time_shift);
-            dur = (LONGLONG)convert_to_time_unit(frame_dur, this->session->frame_rate_num, 1);
+    HRESULT hr = S_OK;
+    const frame_unit frame_length = aac_encoder_backend::frame_length;
 
-            if(time < 0)
-            {
-                LONGLONG off = time;
-                time = 0;
-                std::cout << "aac encoder time shift was off by " << off << std::endl;
-            }
+    auto encode_range = [&](frame_unit range_end)
+    {
+        this->interleaved.assign((size_t)(range_end - pos) * channels, (bit_depth_t)0);
+        this->encode_interleaved(pos, range_end - pos, out_frames);
+        pos = range_end;
+    };
 
-            CHECK_HR(hr = in_sample->SetSampleTime(time));
-            CHECK_HR(hr = in_sample->SetSampleDuration(dur));
+    // complete the frame the backend holds
+    if(this->pending_frames > 0)
+        encode_range(std::min(end, pos + frame_length - this->pending_frames));
 
-        back:
-            hr = this->encoder->ProcessInput(this->input_id, in_sample, 0);
-            if(hr == MF_E_NOTACCEPTING)
-            {
-                if(reset_sample(), this->process_output(out_sample))
-                    CHECK_HR(hr = process_sample());
+    // the backend doesn't delay frames, so the cached frames are in order
+    while(this->pending_frames == 0 && end - pos >= frame_length)
+    {
+        media_sample_aac_frame frame;
+        frame.ts = convert_to_time_unit(pos, this->session->frame_rate_num, 1) - this->time_shift;
+        frame.dur = convert_to_time_unit(frame_length, this->session->frame_rate_num, 1);
+        frame.memory_host = this->silent_frame;
+        frame.buffer = this->silent_frame->buffer;
 
-                goto back;
-            }
-            else
-            {
-                CHECK_HR(hr);
-                this->memory_hosts.push_back(elem.memory_host);
-            }
-        }
+        frame.sample = this->sample_pool->acquire_sample();
+        CHECK_HR(hr = frame.sample->AddBuffer(frame.buffer));
+        CHECK_HR(hr = frame.sample->SetSampleTime(std::max(frame.ts, (time_unit)0)));
+        CHECK_HR(hr = frame.sample->SetSampleDuration(frame.dur));
+
+        out_frames.frames.push_back(std::move(frame));
+
+        pos += frame_length;
+        this->silent_frame_count += frame_length;
     }
 
-    if(drain)
-        CHECK_HR(hr = drain_all());
+    // leftover frames are passed to the backend
+    if(pos < end)
+        encode_range(end);
 
 done:
     if(FAILED(hr))
         throw HR_EXCEPTION(hr);
+}
+
+bool transform_aac_encoder::encode(const media_sample_audio_frames* in_frames,
+    media_sample_aac_frames& out_frames, bool silent, bool drain)
+{
+    assert_(out_frames.frames.empty());
+
+    // the conversion is included in the encode time
+    const media_clock::clock_t::time_point start = media_clock::clock_t::now();
+
+    if(in_frames && silent && !drain && this->silent_frame)
+    {
+        for(const auto& elem : in_frames->get_frames())
+            this->encode_silent(elem.pos, elem.pos + elem.dur, out_frames);
+    }
+    else
+        this->encode_backend(in_frames, out_frames, drain);
+
+    this->encode_time += std::chrono::duration_cast<media_clock::time_unit_t>(
+        media_clock::clock_t::now() - start).count();
 
     return !out_frames.frames.empty();
 }
 
+media_buffer_memory_t transform_aac_encoder::create_silent_frame(const aac_encoder_params& params)
+{
+    HRESULT hr = S_OK;
+    const uint32_t frame_count = aac_encoder_backend::frame_length * SILENT_FRAME_PRIMING_FRAMES;
+    const std::vector<bit_depth_t> silence((size_t)frame_count * params.channels, 0);
+    std::vector<aac_encoder_packet> packets;
+    media_buffer_memory_t silent_frame;
+    aac_encoder_backend_t backend = this->backend->create_instance();
+    BYTE* out_data;
+
+    backend->initialize(params);
+    if(!backend->encode(silence.data(), frame_count, 0, packets))
+        CHECK_HR(hr = E_UNEXPECTED);
+
+    // copy the last frame so that the cache doesn't hold onto the encoder's memory
+    {
+        const media_buffer_packet_t& packet = packets.back().buffer;
+        const DWORD buflen = packet->get_length();
+
+        silent_frame.reset(new media_buffer_memory);
+        silent_frame->initialize(buflen);
+        CHECK_HR(hr = silent_frame->buffer->Lock(&out_data, NULL, NULL));
+        memcpy(out_data, packet->get_data(), buflen);
+        CHECK_HR(hr = silent_frame->buffer->Unlock());
+        CHECK_HR(hr = silent_frame->buffer->SetCurrentLength(buflen));
+    }
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+
+    return silent_frame;
+}
+
+double transform_aac_encoder::get_encode_throughput() const
+{
+    const time_unit encode_time = this->encode_time;
+    if(encode_time <= 0)
+        return 0.0;
+
+    return (double)this->encoded_frame_count * SECOND_IN_TIME_UNIT / encode_time;
+}
+
 bool transform_aac_encoder::on_serve(request_queue::request_t& request)
 {
     const bool not_served_request = request.sample.drain ||
@@ -187,8 +262,8 @@ bool transform_aac_encoder::on_serve(request_queue::request_t& request)
     if(not_served_request)
     {
         assert_(!args.has_value() || args->is_valid());
-        if(this->encode(args.has_value() ? (args->sample.get()) : NULL, *request.sample.out_sample, 
-            request.sample.drain))
+        if(this->encode(args.has_value() ? (args->sample.get()) : NULL, *request.sample.out_sample,
+            args.has_value() && args->silent, request.sample.drain))
         {
             out_args = std::make_optional<media_component_aac_audio_args>();
             out_args->sample = std::move(request.sample.out_sample);
@@ -216,127 +291,45 @@ transform_aac_encoder::request_queue::request_t* transform_aac_encoder::next_req
     return this->requests.get();
 }
 
-bool transform_aac_encoder::process_output(IMFSample* sample)
+void transform_aac_encoder::initialize(bitrate_t bitrate, UINT32 profile_level_indication,
+    const aac_encoder_backend_t& backend)
 {
     HRESULT hr = S_OK;
-
-    DWORD mft_provides_samples;
-    DWORD alignment;
-    DWORD min_size, buflen;
-    MFT_OUTPUT_DATA_BUFFER output;
-    DWORD status = 0;
-    CComPtr<IMFMediaBuffer> buffer;
-
-    mft_provides_samples =
-        this->output_stream_info.dwFlags & MFT_OUTPUT_STREAM_PROVIDES_SAMPLES;
-    alignment = this->output_stream_info.cbAlignment;
-    min_size = this->output_stream_info.cbSize;
-
-    CHECK_HR(hr = sample->GetBufferByIndex(0, &buffer));
-    CHECK_HR(hr = buffer->SetCurrentLength(0));
-    CHECK_HR(hr = buffer->GetMaxLength(&buflen));
-
-    if(mft_provides_samples)
+    aac_encoder_params params;
+    params.sample_rate = (UINT32)this->session->frame_rate_num;
+    params.channels = channels;
+    params.bitrate = bitrate;
+    params.profile_level_indication = profile_level_indication;
+
+    this->backend = backend ? backend : aac_encoder_backend_t(new aac_encoder_mft);
+    this->backend->initialize(params);
+    // all the backends output raw aac-lc frames, so the media type doesn't depend on
+    // the backend
+    if(FAILED(hr = aac_encoder_mft::create_output_type(params, this->output_type)))
         throw HR_EXCEPTION(hr);
-    if(buflen < min_size)
-        throw HR_EXCEPTION(hr);
-
-    output.dwStreamID = 0;
-    output.dwStatus = 0;
-    output.pEvents = NULL;
-    output.pSample = sample;
 
-    CHECK_HR(hr = this->encoder->ProcessOutput(0, 1, &output, &status));
-
-done:
-    if(hr != MF_E_TRANSFORM_NEED_MORE_INPUT && FAILED(hr))
-        throw HR_EXCEPTION(hr);
-    return SUCCEEDED(hr);
-}
-
-void transform_aac_encoder::initialize(bitrate_t bitrate, UINT32 profile_level_indication)
-{
-    HRESULT hr = S_OK;
-
-    IMFActivate** activate = NULL;
-    UINT count = 0;
-    MFT_REGISTER_TYPE_INFO info = {MFMediaType_Audio, MFAudioFormat_AAC};
-    const UINT32 flags = MFT_ENUM_FLAG_SYNCMFT | MFT_ENUM_FLAG_LOCALMFT | MFT_ENUM_FLAG_SORTANDFILTER;
-
-    CHECK_HR(hr = MFTEnumEx(
-        MFT_CATEGORY_AUDIO_ENCODER,
-        flags,
-        NULL,
-        &info,
-        &activate,
-        &count));
-
-    if(!count)
-        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
-
-    CHECK_HR(hr = activate[0]->ActivateObject(__uuidof(IMFTransform), (void**)&this->encoder));
-
-    // set input type
-    /*this->input_type = input_type;*/
-    CHECK_HR(hr = MFCreateMediaType(&this->input_type));
-    /*CHECK_HR(hr = input_type->CopyAllItems(this->input_type));*/
-    CHECK_HR(hr = this->input_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio));
-    CHECK_HR(hr = this->input_type->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_PCM));
-    CHECK_HR(hr = this->input_type->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, sizeof(bit_depth_t) * 8));
-    CHECK_HR(hr = this->input_type->SetUINT32(
-        MF_MT_AUDIO_SAMPLES_PER_SECOND, (UINT32)this->session->frame_rate_num));
-    CHECK_HR(hr = this->input_type->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, channels));
-
-    // set output type
-    CHECK_HR(hr = MFCreateMediaType(&this->output_type));
-    CHECK_HR(hr = this->output_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Audio));
-    CHECK_HR(hr = this->output_type->SetGUID(MF_MT_SUBTYPE, MFAudioFormat_AAC));
-    CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_AUDIO_BITS_PER_SAMPLE, sizeof(bit_depth_t) * 8));
-    CHECK_HR(hr = this->output_type->SetUINT32(
-        MF_MT_AUDIO_SAMPLES_PER_SECOND, (UINT32)this->session->frame_rate_num));
-    CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_AUDIO_NUM_CHANNELS, channels));
-    CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_AUDIO_AVG_BYTES_PER_SECOND, bitrate));
-    CHECK_HR(hr = this->output_type->SetUINT32(
-        MF_MT_AAC_AUDIO_PROFILE_LEVEL_INDICATION, profile_level_indication));
-    // raw_data_block elements only
-    CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_AAC_PAYLOAD_TYPE, 0));
-
-    // get streams
-    DWORD input_stream_count, output_stream_count;
-    CHECK_HR(hr = this->encoder->GetStreamCount(&input_stream_count, &output_stream_count));
-    if(input_stream_count != 1 || output_stream_count != 1)
-        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
-    hr = this->encoder->GetStreamIDs(
-        input_stream_count, &this->input_id, output_stream_count, &this->output_id);
-    if(hr == E_NOTIMPL)
-        this->input_id = this->output_id = 0;
-    else if(FAILED(hr))
-        CHECK_HR(hr);
-
-    // set stream types
-    CHECK_HR(hr = this->encoder->SetInputType(this->input_id, this->input_type, 0));
-    CHECK_HR(hr = this->encoder->SetOutputType(this->output_id, this->output_type, 0));
-
-    // get stream info
-    CHECK_HR(hr = this->encoder->GetInputStreamInfo(this->input_id, &this->input_stream_info));
-    CHECK_HR(hr = this->encoder->GetOutputStreamInfo(this->output_id, &this->output_stream_info));
-
-    CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_COMMAND_FLUSH, NULL));
-    CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL));
-    CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL));
-
-    /*CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL));*/
-
-done:
-    if(activate)
+    // get the silent frame from the cache
+    const silent_frame_key_t key(params.sample_rate, params.channels, params.bitrate,
+        params.profile_level_indication);
+    std::lock_guard<std::mutex> lock(silent_frames_mutex);
+    auto it = silent_frames.find(key);
+    if(it == silent_frames.end())
     {
-        for(UINT i = 0; i < count; i++)
-            activate[i]->Release();
-        CoTaskMemFree(activate);
+        try
+        {
+            it = silent_frames.insert(std::make_pair(key,
+                this->create_silent_frame(params))).first;
+        }
+        catch(streaming::exception err)
+        {
+            // the silence fast path is just disabled
+            std::cout << "EXCEPTION THROWN: " << err.what() << std::flush;
+            std::cout << "could not create a silent aac frame" << std::endl;
+            return;
+        }
     }
 
-    if(FAILED(hr))
-        throw HR_EXCEPTION(hr);
+    this->silent_frame = it->second;
 }
 
 media_stream_t transform_aac_encoder::create_stream(media_message_generator_t&& message_generator)
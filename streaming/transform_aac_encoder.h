@@ -4,10 +4,14 @@
 #include "media_stream.h"
 #include "request_dispatcher.h"
 #include "request_queue_handler.h"
+#include "aac_encoder_backend.h"
 #include <mfapi.h>
 #include <memory>
+#include <vector>
 #include <mutex>
 #include <atomic>
+#include <map>
+#include <tuple>
 
 #pragma comment(lib, "Mfplat.lib")
 
@@ -19,13 +23,8 @@ struct aac_encoder_transform_packet
     bool drain;
 };
 
-/*
-
-The Microsoft Media Foundation AAC encoder is a Media Foundation Transform that encodes 
-Advanced Audio Coding (AAC) Low Complexity (LC) profile, as defined by ISO/IEC 13818-7 
-(MPEG-2 Audio Part 7).
-
-*/
+// the actual encoding is done by an aac_encoder_backend;
+// the media foundation aac encoder is used by default
 
 class transform_aac_encoder : 
     public media_component,
@@ -33,7 +32,6 @@ class transform_aac_encoder :
 {
     friend class stream_aac_encoder;
 public:
-    typedef buffer_pool<media_buffer_memory_pooled> buffer_pool_memory_t;
     typedef aac_encoder_transform_packet packet;
     typedef std::lock_guard<std::mutex> scoped_lock;
     typedef request_dispatcher<::request_queue<media_component_aac_audio_args_t>::request_t>
@@ -49,27 +47,44 @@ public:
         rate_160 = (160 * 1000) / 8,
         rate_196 = (192 * 1000) / 8
     };
+    // the interleaved input format of the backend;
+    // the planar float input is converted to this format
     typedef int16_t bit_depth_t;
     static const UINT32 bit_depth = sizeof(bit_depth_t) * 8;
     /*static const UINT32 block_align = sizeof(bit_depth_t) * channels;*/
+    // sample rate, channels, bitrate, profile level indication
+    typedef std::tuple<UINT32, UINT32, UINT32, UINT32> silent_frame_key_t;
 private:
-    CComPtr<IMFTransform> encoder;
-    CComPtr<IMFMediaType> input_type;
-    MFT_INPUT_STREAM_INFO input_stream_info;
-    MFT_OUTPUT_STREAM_INFO output_stream_info;
+    // pre-encoded silent aac frames, shared between encoders
+    static std::mutex silent_frames_mutex;
+    static std::map<silent_frame_key_t, media_buffer_memory_t> silent_frames;
+
+    aac_encoder_backend_t backend;
+    // cached silent aac frame for the current parameters
+    media_buffer_memory_t silent_frame;
+    // the amount of pcm frames the backend holds that don't form a full encoder frame yet;
+    // silent frames can be emitted from the cache only when the backend holds no frames
+    frame_unit pending_frames;
 
     std::shared_ptr<request_dispatcher> dispatcher;
-    std::vector<media_buffer_memory_t> memory_hosts;
-    std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
+    // the encoded frames are wrapped into recycled samples
+    CComPtr<media_sample_pool> sample_pool;
     media_sample_aac_frames_t encoded_audio;
-
-    DWORD input_id, output_id;
+    // reused between the encode calls
+    std::vector<bit_depth_t> interleaved;
+    std::vector<aac_encoder_packet> packets;
 
     // time shift must be used instead of adjusting the time in the output_file, because
     // it seems that the encoder stores a 'hidden' time field which is
     // used by the media foundation's file sink
     time_unit time_shift;
 
+    // throughput statistics of the backend;
+    // encoded frames are counted in input pcm frames;
+    // the encode time is in time units
+    std::atomic<frame_unit> encoded_frame_count, silent_frame_count;
+    std::atomic<time_unit> encode_time;
+
     // debug
     frame_unit last_time_stamp;
 
@@ -77,15 +92,34 @@ private:
     bool on_serve(request_queue::request_t&);
     request_queue::request_t* next_request();
 
-    bool encode(const media_sample_audio_frames*, media_sample_aac_frames&, bool drain);
-    bool process_output(IMFSample*);
+    // converts the planar float frames to the interleaved input format of the backend
+    void convert(const media_sample_audio_consecutive_frames&);
+    // encodes the interleaved frames with the backend
+    void encode_interleaved(frame_unit pos, frame_unit dur, media_sample_aac_frames&);
+    // moves the packets of the backend to the output
+    void add_packets(media_sample_aac_frames&);
+    // encodes the frames with the backend
+    void encode_backend(const media_sample_audio_frames*, media_sample_aac_frames&, bool drain);
+    // encodes silent frames of the range;
+    // whole encoder frames are emitted from the silent frame cache
+    void encode_silent(frame_unit pos, frame_unit end, media_sample_aac_frames&);
+    // encodes a steady state silent frame with a new backend instance
+    media_buffer_memory_t create_silent_frame(const aac_encoder_params&);
+    bool encode(const media_sample_audio_frames*, media_sample_aac_frames&,
+        bool silent, bool drain);
 public:
     CComPtr<IMFMediaType> output_type;
 
     explicit transform_aac_encoder(const media_session_t& session);
     ~transform_aac_encoder();
 
-    void initialize(bitrate_t bitrate, UINT32 profile_level_indication);
+    // uses the media foundation backend if backend is null
+    void initialize(bitrate_t bitrate, UINT32 profile_level_indication,
+        const aac_encoder_backend_t& backend = nullptr);
+    // returns the encoding throughput in pcm frames per second of encoding time
+    double get_encode_throughput() const;
+    // returns the pcm frames that were emitted from the silent frame cache
+    frame_unit get_silent_frame_count() const {return this->silent_frame_count;}
     media_stream_t create_stream(media_message_generator_t&&);
 };
 
@@ -109,8 +109,7 @@ bool stream_audiomixer2::move_frames(in_arg_t& to, in_arg_t& from, const in_arg_
             to->sample->initialize();
         }
 
-        const bool moved = from->sample->move_frames_to(to->sample.get(), end,
-            transform_audiomixer2::block_align);
+        const bool moved = from->sample->move_frames_to(to->sample.get(), end);
         if(moved && discarded)
             std::cout << "discarded audio frames" << std::endl;
     }
@@ -153,31 +152,31 @@ void stream_audiomixer2::mix(out_arg_t& out_arg, args_t& packets,
 
     // begin mixing
     HRESULT hr = S_OK;
-    const UINT32 out_block_align = 
-        transform_aac_encoder::bit_depth / 8 * transform_aac_encoder::channels;
-    typedef transform_audiomixer2::bit_depth_t in_bit_depth_t;
-    typedef transform_aac_encoder::bit_depth_t out_bit_depth_t;
+    typedef transform_audiomixer2::bit_depth_t bit_depth_t;
+    static_assert(std::is_floating_point<bit_depth_t>::value, "float type expected");
 
     const frame_unit frame_count = end - first;
+    const frame_unit out_plane_stride = media_sample_audio_consecutive_frames::get_plane_stride(
+        frame_count, sizeof(bit_depth_t));
     media_sample_audio_frames_t frames;
     media_buffer_memory_t out_buffer;
-    const DWORD out_buffer_len = (UINT32)frame_count * out_block_align;
+    const DWORD out_buffer_len =
+        (DWORD)(out_plane_stride * transform_aac_encoder::channels * sizeof(bit_depth_t));
 
     assert_(frame_count > 0);
 
+    auto get_boost = [](const packet_t& item,
+        const media_sample_audio_mixer_frame& consec_frames)
     {
-        transform_audiomixer2::buffer_pool_memory_t::scoped_lock lock(
-            this->transform->buffer_pool_memory->mutex);
-        out_buffer = this->transform->buffer_pool_memory->acquire_buffer();
-        out_buffer->initialize(out_buffer_len);
-    }
-
-    bool has_frames = false;
-    out_bit_depth_t* out_data_base;
-    CHECK_HR(hr = out_buffer->buffer->SetCurrentLength(out_buffer_len));
-    CHECK_HR(hr = out_buffer->buffer->Lock((BYTE**)&out_data_base, NULL, NULL));
-
-    memset(out_data_base, 0, out_buffer_len);
+        bit_depth_t boost = (bit_depth_t)(consec_frames.params.boost / 100.0);
+        if(item.valid_user_params)
+            boost *= (bit_depth_t)(item.user_params.boost / 100.0);
+        return boost;
+    };
+
+    // the output is silent if none of the inputs contribute to the mix;
+    // silent output is passed as a null buffer frame, so that the mix buffer is skipped
+    bool has_frames = false, silent = true;
     for(auto&& item : packets.container)
     {
         // stream_mixer::process might create empty args and samples
@@ -194,47 +193,59 @@ void stream_audiomixer2::mix(out_arg_t& out_arg, args_t& packets,
             assert_(end >= (consec_frames.pos + consec_frames.dur));
 
             has_frames = true;
+            if(consec_frames.buffer && get_boost(item, consec_frames) != 0)
+                silent = false;
+        }
+    }
+
+    if(!silent)
+    {
+        {
+            transform_audiomixer2::buffer_pool_memory_t::scoped_lock lock(
+                this->transform->buffer_pool_memory->mutex);
+            out_buffer = this->transform->buffer_pool_memory->acquire_buffer();
+            out_buffer->initialize(out_buffer_len);
+        }
 
-            if(!consec_frames.buffer)
+        bit_depth_t* out_data_base;
+        CHECK_HR(hr = out_buffer->buffer->SetCurrentLength(out_buffer_len));
+        CHECK_HR(hr = out_buffer->buffer->Lock((BYTE**)&out_data_base, NULL, NULL));
+
+        // the output is clamped when it is converted to the encoder's input format
+        memset(out_data_base, 0, out_buffer_len);
+        for(auto&& item : packets.container)
+        {
+            if(!item.arg || !item.arg->sample)
                 continue;
 
-            const in_bit_depth_t* in_data_base;
-            CHECK_HR(hr = consec_frames.buffer->Lock((BYTE**)&in_data_base, 0, 0));
-                
-            for(frame_unit i = std::max(first, consec_frames.pos);
-                i < (consec_frames.pos + consec_frames.dur);
-                i++)
+            for(const auto& consec_frames : item.arg->sample->get_frames())
             {
-                static_assert(std::is_floating_point<transform_audiomixer2::bit_depth_t>::value,
-                    "float type expected");
+                const bit_depth_t boost = get_boost(item, consec_frames);
+                if(!consec_frames.buffer || boost == 0)
+                    continue;
 
-                out_bit_depth_t* out_data = out_data_base + 
-                    (UINT32)(i - first) * transform_aac_encoder::channels;
-                const in_bit_depth_t* in_data = in_data_base +
-                    (UINT32)(i - consec_frames.pos) * transform_aac_encoder::channels;
+                const frame_unit frame_first = std::max(first, consec_frames.pos);
+                const frame_unit frame_end = consec_frames.pos + consec_frames.dur;
+                const bit_depth_t* in_data_base;
+                CHECK_HR(hr = consec_frames.buffer->Lock((BYTE**)&in_data_base, 0, 0));
 
                 for(UINT32 j = 0; j < transform_aac_encoder::channels; j++)
                 {
-                    in_bit_depth_t boost = (in_bit_depth_t)(consec_frames.params.boost / 100.0);
-                    if(item.valid_user_params)
-                        boost *= (in_bit_depth_t)(item.user_params.boost / 100.0);
-
-                    const int64_t temp = out_data[j] + (int64_t)
-                        (in_data[j] * boost *
-                        std::numeric_limits<transform_aac_encoder::bit_depth_t>::max());
-
-                    // clamp
-                    out_data[j] = (out_bit_depth_t)std::max(
-                        (int64_t)std::numeric_limits<out_bit_depth_t>::min(),
-                        std::min(temp, (int64_t)std::numeric_limits<out_bit_depth_t>::max()));
+                    bit_depth_t* out_data = out_data_base + out_plane_stride * j +
+                        (frame_first - first);
+                    const bit_depth_t* in_data = in_data_base + consec_frames.plane_stride * j +
+                        consec_frames.offset + (frame_first - consec_frames.pos);
+
+                    for(frame_unit i = 0; i < (frame_end - frame_first); i++)
+                        out_data[i] += in_data[i] * boost;
                 }
-            }
 
-            CHECK_HR(hr = consec_frames.buffer->Unlock());
+                CHECK_HR(hr = consec_frames.buffer->Unlock());
+            }
         }
-    }
 
-    CHECK_HR(hr = out_buffer->buffer->Unlock());
+        CHECK_HR(hr = out_buffer->buffer->Unlock());
+    }
 
     {
         transform_audiomixer2::buffer_pool_audio_frames_t::scoped_lock lock(
@@ -245,10 +256,15 @@ void stream_audiomixer2::mix(out_arg_t& out_arg, args_t& packets,
 
     {
         media_sample_audio_consecutive_frames consec_frames;
-        consec_frames.memory_host = out_buffer;
-        consec_frames.buffer = out_buffer->buffer;
+        if(out_buffer)
+        {
+            consec_frames.memory_host = out_buffer;
+            consec_frames.buffer = out_buffer->buffer;
+            consec_frames.plane_stride = out_plane_stride;
+        }
         consec_frames.pos = first;
         consec_frames.dur = frame_count;
+        consec_frames.offset = 0;
         frames->add_consecutive_frames(consec_frames);
     }
 
@@ -256,6 +272,7 @@ void stream_audiomixer2::mix(out_arg_t& out_arg, args_t& packets,
     out_arg = std::make_optional<out_arg_t::value_type>();
     out_arg->sample = std::move(frames);
     out_arg->has_frames = has_frames;
+    out_arg->silent = silent;
 
 done:
     if(FAILED(hr))
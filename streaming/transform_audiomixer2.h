@@ -66,11 +66,10 @@ public:
     typedef buffer_pool<media_buffer_memory_pooled> buffer_pool_memory_t;
     typedef buffer_pool<media_sample_audio_frames_pooled> buffer_pool_audio_frames_t;
     typedef buffer_pool<media_sample_audio_mixer_frames_pooled> buffer_pool_audio_mixer_frames_t;
-    // the bit depth mixer expects for input samples;
+    // the bit depth of the planar samples mixer expects for input and outputs;
     // resampler should output to this bit depth
     typedef float bit_depth_t;
     static const UINT32 bit_depth = sizeof(bit_depth_t) * 8;
-    static const UINT32 block_align = bit_depth / 8 * transform_aac_encoder::channels;
 private:
     std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
     std::shared_ptr<buffer_pool_audio_frames_t> buffer_pool_audio_frames;
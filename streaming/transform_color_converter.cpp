@@ -3,14 +3,21 @@
 #include <iostream>
 #include <mfapi.h>
 #include <Mferror.h>
+#include <algorithm>
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
+#undef max
+#undef min
 
 transform_color_converter::transform_color_converter(
     const media_session_t& session, context_mutex_t context_mutex) :
     media_component(session),
+    converter(CONVERTER_VIDEO_PROCESSOR),
     texture_pool(new buffer_pool),
+    frame_pool(new buffer_pool_frame_t),
     buffer_pool_video_frames(new buffer_pool_video_frames_t),
+    memory_output(false),
+    memory_output_format(media_buffer_frame::FORMAT_NV12),
     context_mutex(context_mutex)
 {
 }
@@ -23,6 +30,10 @@ transform_color_converter::~transform_color_converter()
         buffer_pool::scoped_lock lock(this->texture_pool->mutex);
         this->texture_pool->dispose();
     }
+    {
+        buffer_pool_frame_t::scoped_lock lock(this->frame_pool->mutex);
+        this->frame_pool->dispose();
+    }
     {
         buffer_pool_video_frames_t::scoped_lock lock(this->buffer_pool_video_frames->mutex);
         this->buffer_pool_video_frames->dispose();
@@ -34,19 +45,33 @@ void transform_color_converter::initialize(
     UINT32 frame_width_in, UINT32 frame_height_in,
     UINT32 frame_width_out, UINT32 frame_height_out,
     DXGI_COLOR_SPACE_TYPE color_space,
-    const CComPtr<ID3D11Device>& d3d11dev, ID3D11DeviceContext* devctx)
+    const CComPtr<ID3D11Device>& d3d11dev, ID3D11DeviceContext* devctx,
+    converter_t converter, color_converter_cpu::filter_t filter)
 {
     HRESULT hr = S_OK;
 
     this->ctrl_pipeline = ctrl_pipeline;
+    this->converter = converter;
     this->d3d11dev = d3d11dev;
-    CHECK_HR(hr = this->d3d11dev->QueryInterface(&this->videodevice));
-    CHECK_HR(hr = devctx->QueryInterface(&this->videocontext));
+    this->d3d11devctx = devctx;
     this->frame_width_in = frame_width_in;
     this->frame_height_in = frame_height_in;
     this->frame_width_out = frame_width_out;
     this->frame_height_out = frame_height_out;
     this->color_space = color_space;
+
+    if(this->converter == CONVERTER_CPU)
+    {
+        if(!color_converter_cpu::is_supported(color_space))
+            CHECK_HR(hr = E_INVALIDARG);
+
+        this->cpu_converter.initialize(color_space,
+            frame_width_in, frame_height_in, frame_width_out, frame_height_out, filter);
+        goto done;
+    }
+
+    CHECK_HR(hr = this->d3d11dev->QueryInterface(&this->videodevice));
+    CHECK_HR(hr = devctx->QueryInterface(&this->videocontext));
     
     // check the supported capabilities of the video processor
     D3D11_VIDEO_PROCESSOR_CONTENT_DESC desc;
@@ -78,6 +103,12 @@ done:
         throw HR_EXCEPTION(hr);
 }
 
+void transform_color_converter::set_memory_output(media_buffer_frame::format_t format)
+{
+    this->memory_output = true;
+    this->memory_output_format = format;
+}
+
 media_stream_t transform_color_converter::create_stream()
 {
     return media_stream_t(
@@ -95,6 +126,12 @@ stream_color_converter::stream_color_converter(const transform_color_converter_t
 {
     HRESULT hr = S_OK;
 
+    if(this->transform->converter == transform_color_converter::CONVERTER_CPU)
+    {
+        this->initialize_staging_textures();
+        return;
+    }
+
     // TODO: decide if the transform should create the video processor,
     // because this might be a somewhat heavy operation
 
@@ -125,12 +162,15 @@ stream_color_converter::stream_color_converter(const transform_color_converter_t
         video_context->VideoProcessorSetStreamColorSpace1(
             this->videoprocessor, 0, DXGI_COLOR_SPACE_RGB_FULL_G22_NONE_P709);
     }
+
+    if(this->transform->memory_output)
+        this->initialize_staging_textures();
 done:
     if(FAILED(hr))
         throw HR_EXCEPTION(hr);
 }
 
-void stream_color_converter::initialize_buffer(const media_buffer_texture_t& buffer)
+D3D11_TEXTURE2D_DESC stream_color_converter::get_output_desc() const
 {
     // create output texture with nv12 color format
     D3D11_TEXTURE2D_DESC desc;
@@ -145,20 +185,294 @@ void stream_color_converter::initialize_buffer(const media_buffer_texture_t& buf
     desc.Usage = D3D11_USAGE_DEFAULT;
     desc.Format = DXGI_FORMAT_NV12;
     desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+    return desc;
+}
 
-    buffer->initialize(this->transform->d3d11dev, desc, nullptr);
+void stream_color_converter::initialize_staging_textures()
+{
+    HRESULT hr = S_OK;
+    const bool cpu_converter =
+        this->transform->converter == transform_color_converter::CONVERTER_CPU;
+
+    D3D11_TEXTURE2D_DESC desc;
+    desc.Width = this->transform->frame_width_in;
+    desc.Height = this->transform->frame_height_in;
+    desc.MipLevels = 1;
+    desc.ArraySize = 1;
+    desc.SampleDesc.Count = 1;
+    desc.SampleDesc.Quality = 0;
+    desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+    desc.MiscFlags = 0;
+    desc.Usage = D3D11_USAGE_STAGING;
+    desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+    desc.BindFlags = 0;
+    if(cpu_converter)
+        CHECK_HR(hr = this->transform->d3d11dev->CreateTexture2D(
+            &desc, NULL, &this->staging_texture_in));
+
+    // the cpu converter writes the memory output directly
+    if(cpu_converter != this->transform->memory_output)
+    {
+        desc.Width = this->transform->frame_width_out;
+        desc.Height = this->transform->frame_height_out;
+        desc.CPUAccessFlags = cpu_converter ? D3D11_CPU_ACCESS_WRITE : D3D11_CPU_ACCESS_READ;
+        desc.Format = DXGI_FORMAT_NV12;
+        CHECK_HR(hr = this->transform->d3d11dev->CreateTexture2D(
+            &desc, NULL, &this->staging_texture_out));
+    }
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
 }
 
 media_buffer_texture_t stream_color_converter::acquire_buffer()
 {
+    const D3D11_TEXTURE2D_DESC desc = this->get_output_desc();
+
     transform_color_converter::buffer_pool::scoped_lock lock(this->transform->texture_pool->mutex);
-    media_buffer_texture_t buffer = this->transform->texture_pool->acquire_buffer();
+    media_buffer_texture_t buffer = this->transform->texture_pool->acquire_buffer(
+        media_buffer_texture::get_pool_key(desc));
     lock.unlock();
 
-    this->initialize_buffer(buffer);
+    buffer->initialize(this->transform->d3d11dev, desc, nullptr);
     return buffer;
 }
 
+media_buffer_frame_t stream_color_converter::acquire_frame()
+{
+    const UINT32 width = this->transform->frame_width_out, height = this->transform->frame_height_out;
+    const media_buffer_frame::format_t format = this->transform->memory_output_format;
+
+    transform_color_converter::buffer_pool_frame_t::scoped_lock lock(
+        this->transform->frame_pool->mutex);
+    media_buffer_frame_t frame = this->transform->frame_pool->acquire_buffer(
+        media_buffer_frame::get_pool_key(width, height, format));
+    lock.unlock();
+
+    frame->initialize(width, height, format);
+    return frame;
+}
+
+HRESULT stream_color_converter::convert_video_processor(
+    const CComPtr<ID3D11Texture2D>& texture, const media_buffer_texture_t& output_buffer)
+{
+    HRESULT hr = S_OK;
+    CComPtr<ID3D11VideoProcessorOutputView> output_view;
+    CComPtr<ID3D11VideoProcessorInputView> input_view;
+    D3D11_VIDEO_PROCESSOR_OUTPUT_VIEW_DESC view_desc;
+    D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC desc;
+    D3D11_VIDEO_PROCESSOR_STREAM stream;
+    RECT dst_rect;
+    const UINT stream_count = 1;
+
+    // create the output view
+    view_desc.ViewDimension = D3D11_VPOV_DIMENSION_TEXTURE2D;
+    view_desc.Texture2D.MipSlice = 0;
+    // TODO: include this outputview in the pool aswell
+    CHECK_HR(hr = this->transform->videodevice->CreateVideoProcessorOutputView(
+        output_buffer->texture, this->transform->enumerator, &view_desc, &output_view));
+
+    // create the input view for the sample to be converted
+    desc.FourCC = 0; // uses the same format the input resource has
+    desc.ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D;
+    desc.Texture2D.MipSlice = 0;
+    desc.Texture2D.ArraySlice = 0;
+    CHECK_HR(hr = this->transform->videodevice->CreateVideoProcessorInputView(
+        texture, this->transform->enumerator, &desc, &input_view));
+
+    // convert
+    dst_rect.top = dst_rect.left = 0;
+    dst_rect.right = this->transform->frame_width_out;
+    dst_rect.bottom = this->transform->frame_height_out;
+
+    stream.Enable = TRUE;
+    stream.OutputIndex = 0;
+    stream.InputFrameOrField = 0;
+    stream.PastFrames = 0;
+    stream.FutureFrames = 0;
+    stream.ppPastSurfaces = NULL;
+    stream.pInputSurface = input_view;
+    stream.ppFutureSurfaces = NULL;
+    stream.ppPastSurfacesRight = NULL;
+    stream.pInputSurfaceRight = NULL;
+    stream.ppFutureSurfacesRight = NULL;
+
+    {
+        scoped_lock lock(*this->transform->context_mutex);
+
+        // set the target rectangle for the output
+        // (sets the rectangle where the output blit on the output texture will appear)
+        this->transform->videocontext->VideoProcessorSetOutputTargetRect(
+            this->videoprocessor, TRUE, &dst_rect);
+
+        // set the source rectangle of the stream
+        // (the part of the stream texture which will be included in the blit);
+        // false indicates that the whole source is read
+        this->transform->videocontext->VideoProcessorSetStreamSourceRect(
+            this->videoprocessor, 0, FALSE, &dst_rect);
+
+        // set the destination rectangle of the stream
+        // (where the stream will appear in the output blit)
+        this->transform->videocontext->VideoProcessorSetStreamDestRect(
+            this->videoprocessor, 0, TRUE, &dst_rect);
+
+        // blit
+        CHECK_HR(hr = this->transform->videocontext->VideoProcessorBlt(
+            this->videoprocessor, output_view,
+            0, stream_count, &stream));
+    }
+
+done:
+    return hr;
+}
+
+HRESULT stream_color_converter::convert_cpu(const CComPtr<ID3D11Texture2D>& texture,
+    const media_buffer_texture_t& output_buffer, const media_buffer_frame_t& output_frame)
+{
+    HRESULT hr = S_OK;
+    D3D11_MAPPED_SUBRESOURCE mapped_in, mapped_out;
+    color_converter_cpu::planes_t planes;
+    color_converter_cpu::format_t format = color_converter_cpu::FORMAT_NV12;
+    const CComPtr<ID3D11DeviceContext>& devctx = this->transform->d3d11devctx;
+
+    {
+        scoped_lock lock(*this->transform->context_mutex);
+        devctx->CopyResource(this->staging_texture_in, texture);
+        CHECK_HR(hr = devctx->Map(this->staging_texture_in, 0, D3D11_MAP_READ, 0, &mapped_in));
+        if(!output_frame &&
+            FAILED(hr = devctx->Map(this->staging_texture_out, 0, D3D11_MAP_WRITE, 0, &mapped_out)))
+        {
+            devctx->Unmap(this->staging_texture_in, 0);
+            goto done;
+        }
+    }
+
+    // the mapped textures aren't used by the device context until they are unmapped,
+    // so the conversion doesn't need to hold the context lock;
+    // the scaling is done in the same pass
+    if(output_frame)
+    {
+        planes.y = output_frame->y;
+        planes.y_pitch = output_frame->y_pitch;
+        planes.u = output_frame->u;
+        planes.u_pitch = output_frame->u_pitch;
+        planes.v = output_frame->v;
+        planes.v_pitch = output_frame->v_pitch;
+        if(output_frame->format == media_buffer_frame::FORMAT_I420)
+            format = color_converter_cpu::FORMAT_I420;
+    }
+    else
+    {
+        // the uv plane follows the y plane in the nv12 texture
+        planes.y = (BYTE*)mapped_out.pData;
+        planes.y_pitch = mapped_out.RowPitch;
+        planes.u = planes.y + (size_t)mapped_out.RowPitch * this->transform->frame_height_out;
+        planes.u_pitch = mapped_out.RowPitch;
+        planes.v = NULL;
+        planes.v_pitch = 0;
+    }
+    this->transform->cpu_converter.convert((const BYTE*)mapped_in.pData, mapped_in.RowPitch,
+        format, planes, &this->transform->processing_cycles);
+
+    {
+        scoped_lock lock(*this->transform->context_mutex);
+        devctx->Unmap(this->staging_texture_in, 0);
+        if(!output_frame)
+        {
+            devctx->Unmap(this->staging_texture_out, 0);
+            devctx->CopyResource(output_buffer->texture, this->staging_texture_out);
+        }
+    }
+
+done:
+    return hr;
+}
+
+HRESULT stream_color_converter::read_frame(const CComPtr<ID3D11Texture2D>& texture,
+    const media_buffer_frame_t& output_frame)
+{
+    HRESULT hr = S_OK;
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    const CComPtr<ID3D11DeviceContext>& devctx = this->transform->d3d11devctx;
+    const UINT32 width = output_frame->width, height = output_frame->height;
+    const UINT32 chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+
+    {
+        scoped_lock lock(*this->transform->context_mutex);
+        devctx->CopyResource(this->staging_texture_out, texture);
+        CHECK_HR(hr = devctx->Map(this->staging_texture_out, 0, D3D11_MAP_READ, 0, &mapped));
+    }
+
+    // the mapped staging texture isn't accessed by the device context until it is unmapped,
+    // so the copy doesn't hold the context mutex
+    {
+        const BYTE* y = (const BYTE*)mapped.pData;
+        const BYTE* uv = y + (size_t)mapped.RowPitch * height;
+
+        for(UINT32 row = 0; row < height; row++)
+            memcpy(output_frame->y + (size_t)row * output_frame->y_pitch,
+                y + (size_t)row * mapped.RowPitch, width);
+
+        if(output_frame->format == media_buffer_frame::FORMAT_NV12)
+        {
+            for(UINT32 row = 0; row < chroma_height; row++)
+                memcpy(output_frame->u + (size_t)row * output_frame->u_pitch,
+                    uv + (size_t)row * mapped.RowPitch, chroma_width * 2);
+        }
+        else
+        {
+            // deinterleave the chroma plane
+            for(UINT32 row = 0; row < chroma_height; row++)
+            {
+                const BYTE* src = uv + (size_t)row * mapped.RowPitch;
+                BYTE* dst_u = output_frame->u + (size_t)row * output_frame->u_pitch;
+                BYTE* dst_v = output_frame->v + (size_t)row * output_frame->v_pitch;
+                for(UINT32 x = 0; x < chroma_width; x++)
+                {
+                    dst_u[x] = src[x * 2];
+                    dst_v[x] = src[x * 2 + 1];
+                }
+            }
+        }
+    }
+
+    {
+        scoped_lock lock(*this->transform->context_mutex);
+        devctx->Unmap(this->staging_texture_out, 0);
+    }
+
+done:
+    return hr;
+}
+
+void stream_color_converter::scale_dirty_rects(std::vector<RECT>& dirty_rects) const
+{
+    const INT64 width_in = this->transform->frame_width_in,
+        height_in = this->transform->frame_height_in;
+    const LONG width_out = (LONG)this->transform->frame_width_out,
+        height_out = (LONG)this->transform->frame_height_out;
+
+    for(auto&& rect : dirty_rects)
+    {
+        // the scaling filter spreads the changed pixels to their neighbours, so the rects
+        // are expanded by a pixel and aligned to the subsampled chroma of the output
+        LONG left = (LONG)((rect.left * width_out) / width_in) - 1;
+        LONG top = (LONG)((rect.top * height_out) / height_in) - 1;
+        LONG right = (LONG)((rect.right * width_out + width_in - 1) / width_in) + 1;
+        LONG bottom = (LONG)((rect.bottom * height_out + height_in - 1) / height_in) + 1;
+
+        rect.left = std::max(left & ~1L, 0L);
+        rect.top = std::max(top & ~1L, 0L);
+        rect.right = std::min((right + 1) & ~1L, width_out);
+        rect.bottom = std::min((bottom + 1) & ~1L, height_out);
+    }
+
+    dirty_rects.erase(std::remove_if(dirty_rects.begin(), dirty_rects.end(),
+        [](const RECT& rect) { return rect.left >= rect.right || rect.top >= rect.bottom; }),
+        dirty_rects.end());
+}
+
 void stream_color_converter::process(media_component_h264_encoder_args_t& this_args,
     const request_packet& this_rp)
 {
@@ -181,14 +495,28 @@ void stream_color_converter::process(media_component_h264_encoder_args_t& this_a
     {
         media_sample_video_frame frame(item.pos);
 
-        if(item.buffer)
+        if(item.buffer && item.buffer == this->last_input)
         {
+            frame.buffer = this->last_output;
+            frame.memory_buffer = this->last_output_frame;
+        }
+        else if(item.buffer)
+        {
+            const bool cpu_converter =
+                this->transform->converter == transform_color_converter::CONVERTER_CPU;
             // TODO: acquire buffer here should also allocate device resources the same way
             // videomixer does
             CComPtr<ID3D11Texture2D> texture = item.buffer->texture;
-            media_buffer_texture_t output_buffer = this->acquire_buffer();
+            media_buffer_frame_t output_frame;
+            media_buffer_texture_t output_buffer;
             assert_(texture);
 
+            // the video processor output is read back for the memory output
+            if(this->transform->memory_output)
+                output_frame = this->acquire_frame();
+            if(!this->transform->memory_output || !cpu_converter)
+                output_buffer = this->acquire_buffer();
+
 #ifdef _DEBUG
             {
                 D3D11_TEXTURE2D_DESC desc;
@@ -198,69 +526,27 @@ void stream_color_converter::process(media_component_h264_encoder_args_t& this_a
             }
 #endif
 
-            // create the output view
-            CComPtr<ID3D11VideoProcessorOutputView> output_view;
-            D3D11_VIDEO_PROCESSOR_OUTPUT_VIEW_DESC view_desc;
-            view_desc.ViewDimension = D3D11_VPOV_DIMENSION_TEXTURE2D;
-            view_desc.Texture2D.MipSlice = 0;
-            // TODO: include this outputview in the pool aswell
-            CHECK_HR(hr = this->transform->videodevice->CreateVideoProcessorOutputView(
-                output_buffer->texture, this->transform->enumerator, &view_desc, &output_view));
-
-            // create the input view for the sample to be converted
-            CComPtr<ID3D11VideoProcessorInputView> input_view;
-            D3D11_VIDEO_PROCESSOR_INPUT_VIEW_DESC desc;
-            desc.FourCC = 0; // uses the same format the input resource has
-            desc.ViewDimension = D3D11_VPIV_DIMENSION_TEXTURE2D;
-            desc.Texture2D.MipSlice = 0;
-            desc.Texture2D.ArraySlice = 0;
-            CHECK_HR(hr = this->transform->videodevice->CreateVideoProcessorInputView(
-                texture, this->transform->enumerator, &desc, &input_view));
-
-            // convert
-            D3D11_VIDEO_PROCESSOR_STREAM stream;
-            RECT dst_rect;
-            dst_rect.top = dst_rect.left = 0;
-            dst_rect.right = this->transform->frame_width_out;
-            dst_rect.bottom = this->transform->frame_height_out;
-
-            stream.Enable = TRUE;
-            stream.OutputIndex = 0;
-            stream.InputFrameOrField = 0;
-            stream.PastFrames = 0;
-            stream.FutureFrames = 0;
-            stream.ppPastSurfaces = NULL;
-            stream.pInputSurface = input_view;
-            stream.ppFutureSurfaces = NULL;
-            stream.ppPastSurfacesRight = NULL;
-            stream.pInputSurfaceRight = NULL;
-            stream.ppFutureSurfacesRight = NULL;
-
-            scoped_lock lock(*this->transform->context_mutex);
-
-            // set the target rectangle for the output
-            // (sets the rectangle where the output blit on the output texture will appear)
-            this->transform->videocontext->VideoProcessorSetOutputTargetRect(
-                this->videoprocessor, TRUE, &dst_rect);
-
-            // set the source rectangle of the stream
-            // (the part of the stream texture which will be included in the blit);
-            // false indicates that the whole source is read
-            this->transform->videocontext->VideoProcessorSetStreamSourceRect(
-                this->videoprocessor, 0, FALSE, &dst_rect);
-
-            // set the destination rectangle of the stream
-            // (where the stream will appear in the output blit)
-            this->transform->videocontext->VideoProcessorSetStreamDestRect(
-                this->videoprocessor, 0, TRUE, &dst_rect);
-
-            // blit
-            const UINT stream_count = 1;
-            CHECK_HR(hr = this->transform->videocontext->VideoProcessorBlt(
-                this->videoprocessor, output_view,
-                0, stream_count, &stream));
+            {
+                media_component_cycles_scope cycles_scope(this->transform->processing_cycles);
+                if(cpu_converter)
+                    hr = this->convert_cpu(texture, output_buffer, output_frame);
+                else
+                {
+                    hr = this->convert_video_processor(texture, output_buffer);
+                    if(SUCCEEDED(hr) && output_frame)
+                        hr = this->read_frame(output_buffer->texture, output_frame);
+                }
+            }
+            CHECK_HR(hr);
 
+            // the texture of the video processor isn't passed with the memory output
+            if(output_frame)
+                output_buffer = nullptr;
             frame.buffer = output_buffer;
+            frame.memory_buffer = output_frame;
+            this->last_input = item.buffer;
+            this->last_output = output_buffer;
+            this->last_output_frame = output_frame;
         }
 
         frames->add_consecutive_frames(frame);
@@ -275,7 +561,14 @@ done:
 
     args = this_args;
     if(args)
+    {
         args->sample = frames;
+        // the changed regions are unknown if the conversion failed
+        if(FAILED(hr))
+            args->dirty_rects.reset();
+        else if(args->dirty_rects)
+            this->scale_dirty_rects(*args->dirty_rects);
+    }
 
     // set the args in pending packet to null so that the sample can be reused
     this_args.reset();
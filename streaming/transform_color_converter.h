@@ -3,6 +3,7 @@
 #include "media_component.h"
 #include "media_stream.h"
 #include "async_callback.h"
+#include "color_converter_cpu.h"
 #include <d3d11.h>
 #include <atlbase.h>
 #include <memory>
@@ -11,7 +12,11 @@
 
 // color space converter
 
-// TODO: allow upscaling and downscaling of the source texture
+// the input frames are scaled to the output size;
+// the cpu converter allows recording on adapters without video processor support;
+// the frames are read back to system memory, converted and uploaded to the output textures;
+// for the encoders that consume frames in system memory the output is pooled memory frames
+// instead, which the cpu converter writes directly
 
 class transform_color_converter : public media_component
 {
@@ -20,17 +25,30 @@ public:
     typedef std::lock_guard<std::recursive_mutex> scoped_lock;
     typedef buffer_pool<media_sample_video_frames_pooled> buffer_pool_video_frames_t;
     typedef buffer_pool<media_buffer_pooled_texture> buffer_pool;
+    typedef ::buffer_pool<media_buffer_frame_pooled> buffer_pool_frame_t;
+    enum converter_t : int
+    {
+        CONVERTER_VIDEO_PROCESSOR,
+        CONVERTER_CPU
+    };
 private:
     control_class_t ctrl_pipeline;
+    converter_t converter;
+    color_converter_cpu cpu_converter;
 
     CComPtr<ID3D11Device> d3d11dev;
+    CComPtr<ID3D11DeviceContext> d3d11devctx;
     CComPtr<ID3D11VideoDevice> videodevice;
     CComPtr<ID3D11VideoContext> videocontext;
     CComPtr<ID3D11VideoProcessorEnumerator> enumerator;
 
     std::shared_ptr<buffer_pool> texture_pool;
+    std::shared_ptr<buffer_pool_frame_t> frame_pool;
     std::shared_ptr<buffer_pool_video_frames_t> buffer_pool_video_frames;
 
+    bool memory_output;
+    media_buffer_frame::format_t memory_output_format;
+
     UINT32 frame_width_in, frame_height_in;
     UINT32 frame_width_out, frame_height_out;
     DXGI_COLOR_SPACE_TYPE color_space;
@@ -44,7 +62,15 @@ public:
         UINT32 frame_width_in, UINT32 frame_height_in,
         UINT32 frame_width_out, UINT32 frame_height_out,
         DXGI_COLOR_SPACE_TYPE,
-        const CComPtr<ID3D11Device>&, ID3D11DeviceContext* devctx);
+        const CComPtr<ID3D11Device>&, ID3D11DeviceContext* devctx,
+        converter_t converter = CONVERTER_VIDEO_PROCESSOR,
+        color_converter_cpu::filter_t = color_converter_cpu::FILTER_BICUBIC);
+    // must be called before initialize;
+    // the frames are output in system memory in the format instead of textures
+    void set_memory_output(media_buffer_frame::format_t);
+    bool is_memory_output() const {return this->memory_output;}
+    media_buffer_frame::format_t get_memory_output_format() const
+    {return this->memory_output_format;}
     media_stream_t create_stream();
 };
 
@@ -57,9 +83,28 @@ public:
 private:
     transform_color_converter_t transform;
     CComPtr<ID3D11VideoProcessor> videoprocessor;
+    // the input and output of the cpu converter are mapped from these textures;
+    // the output of the video processor is read back from the output staging texture
+    // for the memory output
+    CComPtr<ID3D11Texture2D> staging_texture_in, staging_texture_out;
+    // the videomixer forwards the same buffer while the canvas is unchanged,
+    // so the last conversion is forwarded aswell;
+    // this keeps the buffer identity for the encoder
+    media_buffer_texture_t last_input, last_output;
+    media_buffer_frame_t last_output_frame;
 
-    void initialize_buffer(const media_buffer_texture_t&);
+    D3D11_TEXTURE2D_DESC get_output_desc() const;
+    void initialize_staging_textures();
     media_buffer_texture_t acquire_buffer();
+    media_buffer_frame_t acquire_frame();
+    HRESULT convert_video_processor(const CComPtr<ID3D11Texture2D>&, const media_buffer_texture_t&);
+    // converts to the output frame if it is not null, otherwise to the output buffer
+    HRESULT convert_cpu(const CComPtr<ID3D11Texture2D>&, const media_buffer_texture_t&,
+        const media_buffer_frame_t&);
+    // reads the nv12 texture back to the frame
+    HRESULT read_frame(const CComPtr<ID3D11Texture2D>&, const media_buffer_frame_t&);
+    // scales the dirty rects from the input to the output frame coordinates
+    void scale_dirty_rects(std::vector<RECT>&) const;
     void process(media_component_h264_encoder_args_t& args, const request_packet&);
 public:
     explicit stream_color_converter(const transform_color_converter_t& transform);
@@ -1,12 +1,9 @@
 #include "transform_h264_encoder.h"
+#include "h264_encoder_mft.h"
 #include <Mferror.h>
-#include <initguid.h>
-#include <evr.h>
 #include <iostream>
+#include <thread>
 #include "assert.h"
-#include "IUnknownImpl.h"
-
-#pragma comment(lib, "dxguid.lib")
 
 //void CHECK_HR(HRESULT hr)
 //{
@@ -17,114 +14,71 @@
 #undef max
 #undef min
 
-DEFINE_GUID(media_sample_tracker_guid,
-    0xd84fe03a, 0xcb44, 0x43ec, 0x10, 0xac, 0x94, 0x00, 0xb, 0xcc, 0xef, 0x38);
+// the maximum number of dirty rects before they are merged to their bounds
+#define MAX_DIRTY_RECTS 8
 
-// wraps a texture sample
-class media_buffer_wrapper : public IMFMediaBuffer, IUnknownImpl
+// adds the rects to the dirty rects;
+// the dirty rects stay unset if either is unset
+static void add_dirty_rects(std::optional<std::vector<RECT>>& dirty_rects,
+    const std::optional<std::vector<RECT>>& rects)
 {
-private:
-    const bool use_system_memory;
-    // memory corruption occurs if media_buffer_wrapper outlives media_sample_tracker
-    media_buffer_texture_t buffer;
-    CComPtr<IMFMediaBuffer> media_buffer;
-public:
-    explicit media_buffer_wrapper(const context_mutex_t& /*context_mutex*/,
-        const media_buffer_texture_t& buffer,
-        const CComPtr<IMFMediaBuffer>& media_buffer,
-        bool use_system_memory = false) :
-        buffer(buffer), media_buffer(media_buffer), use_system_memory(use_system_memory)
+    if(!dirty_rects || !rects)
     {
+        dirty_rects.reset();
+        return;
     }
 
-    ULONG STDMETHODCALLTYPE AddRef() {return IUnknownImpl::AddRef();}
-    ULONG STDMETHODCALLTYPE Release() {return IUnknownImpl::Release();}
-    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv)
-    {
-        // workaround for intel encoder where the encoder would try to use the directx
-        // buffer that has been allocated by a separate adapter
-        if(this->use_system_memory && riid == __uuidof(IMFDXGIBuffer))
-            return E_NOINTERFACE;
-
-        return this->media_buffer->QueryInterface(riid, ppv);
-    }
-
-    HRESULT STDMETHODCALLTYPE Lock(BYTE **ppbBuffer, DWORD *pcbMaxLength, DWORD *pcbCurrentLength)
-    {
-        return this->media_buffer->Lock(ppbBuffer, pcbMaxLength, pcbCurrentLength);
-    }
-    HRESULT STDMETHODCALLTYPE Unlock()
-    {
-        return this->media_buffer->Unlock();
-    }
-    HRESULT STDMETHODCALLTYPE GetCurrentLength(DWORD *pcbCurrentLength)
+    dirty_rects->insert(dirty_rects->end(), rects->begin(), rects->end());
+    if(dirty_rects->size() > MAX_DIRTY_RECTS)
     {
-        return this->media_buffer->GetCurrentLength(pcbCurrentLength);
+        RECT bounds = dirty_rects->front();
+        for(const auto& rect : *dirty_rects)
+            UnionRect(&bounds, &bounds, &rect);
+        dirty_rects->assign(1, bounds);
     }
-    HRESULT STDMETHODCALLTYPE SetCurrentLength(DWORD cbCurrentLength)
-    {
-        return this->media_buffer->SetCurrentLength(cbCurrentLength);
-    }
-    HRESULT STDMETHODCALLTYPE GetMaxLength(DWORD *pcbMaxLength)
-    {
-        return this->media_buffer->GetMaxLength(pcbMaxLength);
-    }
-};
-
-// ensures the lifetime of texture sample so that it won't be deleted while being used
-// by the encoder
-class media_sample_tracker : public IUnknown, IUnknownImpl
-{
-public:
-    CComPtr<media_buffer_wrapper> buffer_wrapper;
-
-    explicit media_sample_tracker(const CComPtr<media_buffer_wrapper>& buffer_wrapper) :
-        buffer_wrapper(buffer_wrapper) {}
-    ULONG STDMETHODCALLTYPE AddRef() { return IUnknownImpl::AddRef(); }
-    ULONG STDMETHODCALLTYPE Release() { return IUnknownImpl::Release(); }
-    HRESULT STDMETHODCALLTYPE QueryInterface(REFIID riid, void** ppv)
-    {
-        if(!ppv)
-            return E_POINTER;
-        if(riid == __uuidof(IUnknown))
-            *ppv = static_cast<IUnknown*>(this);
-        else
-        {
-            *ppv = NULL;
-            return E_NOINTERFACE;
-        }
-
-        this->AddRef();
-        return S_OK;
-    }
-};
+}
 
 transform_h264_encoder::transform_h264_encoder(const media_session_t& session, 
     context_mutex_t context_mutex) :
     media_component(session),
     encoder_requests(0),
+    queue_depth(DEFAULT_ENCODE_QUEUE_DEPTH),
+    queued_requests(0),
+    degradation_enabled(false),
+    degraded_quality_vs_speed(0), degraded_frame_decimation(1),
+    frame_decimation(1),
+    vfr_enabled(false),
+    vfr_max_frame_interval(0), vfr_last_timestamp(0),
+    vfr_skipped_count(0),
+    vfr_force_frame(false),
+    serving_request(false),
+    request_frame_submitted(false),
+    last_submitted_time(std::numeric_limits<time_unit>::min()),
+    latency_sum(0), latency_max(0),
+    latency_count(0),
+    encode_time_sum(0),
+    frames_in_flight_sum(0), frames_in_flight_max(0),
     last_time_stamp(std::numeric_limits<time_unit>::min()),
     last_time_stamp2(std::numeric_limits<time_unit>::min()),
     last_packet(std::numeric_limits<int>::min()),
     context_mutex(context_mutex),
-    use_system_memory(false),
-    software(false),
+    params(),
+    async(false),
     draining(false),
     first_sample(true),
     time_shift(-1),
-    buffer_pool_h264_frames(new buffer_pool_h264_frames_t),
     buffer_pool_memory(new buffer_pool_memory_t),
+    buffer_pool_h264_frames(new buffer_pool_h264_frames_t),
     dispatcher(new request_dispatcher)
 {
-    this->events_callback.Attach(new async_callback_t(&transform_h264_encoder::events_cb));
+    this->serve_callback.Attach(new async_callback_t(&transform_h264_encoder::serve_cb));
+    this->sample_pool.Attach(new media_sample_pool);
 }
 
 transform_h264_encoder::~transform_h264_encoder()
 {
-    HRESULT hr = S_OK;
-    CComPtr<IMFShutdown> shutdown;
-    if(this->encoder && SUCCEEDED(hr = this->encoder->QueryInterface(&shutdown)))
-        hr = shutdown->Shutdown();
+    // the backend shuts down the encoder
+    this->backend = nullptr;
 
     {
         buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
@@ -134,184 +88,119 @@ transform_h264_encoder::~transform_h264_encoder()
         buffer_pool_h264_frames_t::scoped_lock lock(this->buffer_pool_h264_frames->mutex);
         this->buffer_pool_h264_frames->dispose();
     }
+    this->sample_pool->dispose();
 }
 
-HRESULT transform_h264_encoder::set_color_space(
-    const CComPtr<IMFMediaType>& type, DXGI_COLOR_SPACE_TYPE color_space)
+void transform_h264_encoder::read_frame(const CComPtr<ID3D11Texture2D>& texture,
+    const media_buffer_memory_t& memory, h264_encoder_frame& frame)
 {
     HRESULT hr = S_OK;
+    D3D11_MAPPED_SUBRESOURCE mapped;
+    bool mapped_texture = false;
+    BYTE* data = nullptr;
+    const UINT32 width = this->params.frame_width, height = this->params.frame_height;
+    const UINT32 chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    const DWORD len = (DWORD)(width * height + chroma_width * chroma_height * 2);
 
-    switch(color_space)
+    if(!this->staging_texture)
     {
-    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P709:
-        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_PRIMARIES, MFVideoPrimaries_BT709));
-        CHECK_HR(hr = type->SetUINT32(MF_MT_TRANSFER_FUNCTION, MFVideoTransFunc_709));
-        CHECK_HR(hr = type->SetUINT32(MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT709));
-        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_CHROMA_SITING, MFVideoChromaSubsampling_MPEG2));
-        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_0_255));
-
-        break;
-    case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709:
-        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_PRIMARIES, MFVideoPrimaries_BT709));
-        CHECK_HR(hr = type->SetUINT32(MF_MT_TRANSFER_FUNCTION, MFVideoTransFunc_709));
-        CHECK_HR(hr = type->SetUINT32(MF_MT_YUV_MATRIX, MFVideoTransferMatrix_BT709));
-        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_CHROMA_SITING, MFVideoChromaSubsampling_MPEG2));
-        CHECK_HR(hr = type->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, MFNominalRange_16_235));
+        CComPtr<ID3D11Device> d3d11dev;
+        D3D11_TEXTURE2D_DESC desc;
 
-        break;
-    default:
-        CHECK_HR(hr = E_UNEXPECTED);
+        texture->GetDevice(&d3d11dev);
+        texture->GetDesc(&desc);
+        desc.MipLevels = 1;
+        desc.ArraySize = 1;
+        desc.Usage = D3D11_USAGE_STAGING;
+        desc.BindFlags = 0;
+        desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+        desc.MiscFlags = 0;
+        CHECK_HR(hr = d3d11dev->CreateTexture2D(&desc, NULL, &this->staging_texture));
+        d3d11dev->GetImmediateContext(&this->d3d11devctx);
     }
 
-done:
-    return hr;
-}
-
-HRESULT transform_h264_encoder::set_input_stream_type()
-{
-    HRESULT hr = S_OK;
-
-    CComPtr<IMFMediaType> input_type;
-    CHECK_HR(hr = MFCreateMediaType(&input_type));
-    CHECK_HR(hr = input_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
-    CHECK_HR(hr = input_type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12));
-    CHECK_HR(hr = set_color_space(input_type, this->input_color_space));
-
-    /*CHECK_HR(hr = input_type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_ARGB32));*/
-
-    CHECK_HR(hr = MFSetAttributeRatio(input_type, MF_MT_FRAME_RATE, 
-        (UINT32)this->session->frame_rate_num, (UINT32)this->session->frame_rate_den));
-    CHECK_HR(hr = MFSetAttributeSize(input_type, MF_MT_FRAME_SIZE, 
-        this->frame_width, this->frame_height));
-    CHECK_HR(hr = input_type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
-    CHECK_HR(hr = input_type->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE));
-    CHECK_HR(hr = MFSetAttributeRatio(input_type, MF_MT_PIXEL_ASPECT_RATIO, 1, 1));
-
-    CHECK_HR(hr = this->encoder->SetInputType(this->input_id, input_type, 0));
-done:
-    return hr;
-}
-
-HRESULT transform_h264_encoder::set_output_stream_type()
-{
-    HRESULT hr = S_OK;
-    this->output_type = NULL;
-
-    CHECK_HR(hr = MFCreateMediaType(&this->output_type));
-    CHECK_HR(hr = this->output_type->SetGUID(MF_MT_MAJOR_TYPE, MFMediaType_Video));
-    CHECK_HR(hr = this->output_type->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_H264));
-    CHECK_HR(hr = set_color_space(this->output_type, this->input_color_space));
-    CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_AVG_BITRATE, this->avg_bitrate));
-    CHECK_HR(hr = MFSetAttributeRatio(this->output_type, MF_MT_FRAME_RATE, 
-        this->frame_rate_num, this->frame_rate_den));
-    CHECK_HR(hr = MFSetAttributeSize(this->output_type, MF_MT_FRAME_SIZE, 
-        this->frame_width, this->frame_height));
-    CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
-    // intel mft only supports main profile
-    // (There is no support for Baseline, Extended, or High-10 Profiles.);
-    // twitch requires main/high
-    CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_MPEG2_PROFILE, this->encoder_profile));
-    // twitch requires level 4.2
-    CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_MPEG2_LEVEL, eAVEncH264VLevel4_2));
-    /*CHECK_HR(hr = this->output_type->SetUINT32(MF_MT_ALL_SAMPLES_INDEPENDENT, TRUE));*/
-    CHECK_HR(hr = MFSetAttributeRatio(this->output_type, MF_MT_PIXEL_ASPECT_RATIO, 1, 1));
-
-    CHECK_HR(hr = this->encoder->SetOutputType(this->output_id, this->output_type, 0));
-done:
-    return hr;
-}
-
-HRESULT transform_h264_encoder::set_encoder_parameters()
-{
-    HRESULT hr = S_OK;
-    CComPtr<ICodecAPI> codec;
-    VARIANT v = {0};
-
-    CHECK_HR(hr = this->encoder->QueryInterface(&codec));
+    memory->initialize(len);
+    CHECK_HR(hr = memory->buffer->Lock(&data, NULL, NULL));
 
-    v = {0};
-    v.vt = VT_UI4;
-    v.ulVal = eAVEncCommonRateControlMode_CBR;
-    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonRateControlMode, &v));
-    v = {0};
-    v.vt = VT_UI4;
-    v.ullVal = this->quality_vs_speed;
-    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonQualityVsSpeed, &v));
-    v = {0};
-    v.vt = VT_UI4;
-    v.ullVal = this->avg_bitrate;
-    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonMeanBitRate, &v));
-
-
-
-    /*{
-        VARIANT max_bitrate = {0};
-        max_bitrate.vt = VT_UI4;
-        max_bitrate.ullVal = this->avg_bitrate;
-        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonMaxBitRate, &max_bitrate));
-
-        max_bitrate = {0};
-        max_bitrate.vt = VT_UI4;
-        max_bitrate.ullVal = this->avg_bitrate * 8;
-        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncCommonBufferSize, &max_bitrate));
-    }*/
-
-    /*v.vt = VT_UI4;
-    v.ullVal = 1;
-    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncVideoForceKeyFrame, &v));*/
-    if(codec->IsSupported(&CODECAPI_AVLowLatencyMode) == S_OK)
     {
-        v = {0};
-        v.vt = VT_BOOL;
-        v.ulVal = VARIANT_FALSE;
-        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVLowLatencyMode, &v));
+        std::lock_guard<std::recursive_mutex> lock(*this->context_mutex);
+        this->d3d11devctx->CopyResource(this->staging_texture, texture);
+        CHECK_HR(hr = this->d3d11devctx->Map(this->staging_texture, 0, D3D11_MAP_READ, 0, &mapped));
+        mapped_texture = true;
     }
 
-    if(codec->IsSupported(&CODECAPI_AVEncMPVDefaultBPictureCount) == S_OK)
+    // the mapped staging texture isn't accessed by the device context until it is unmapped,
+    // so the conversion doesn't hold the context mutex
     {
-        v = {0};
-        v.vt = VT_UI4;
-        v.uintVal = 0;
-        CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncMPVDefaultBPictureCount, &v));
-    }
+        const BYTE* y = (const BYTE*)mapped.pData;
+        const BYTE* uv = y + (size_t)mapped.RowPitch * height;
+        BYTE* out_y = data;
+        BYTE* out_u = out_y + (size_t)width * height;
+        BYTE* out_v = out_u + (size_t)chroma_width * chroma_height;
 
-    /*v.vt = VT_UI4;
-    v.ulVal = 0;
-    CHECK_HR(hr = codec->SetValue(&CODECAPI_AVEncNumWorkerThreads, &v));*/
+        for(UINT32 row = 0; row < height; row++)
+            memcpy(out_y + (size_t)row * width, y + (size_t)row * mapped.RowPitch, width);
 
-done:
-    return hr;
-}
+        frame.planes[0] = out_y;
+        frame.strides[0] = width;
 
-HRESULT transform_h264_encoder::feed_encoder(const media_sample_video_frame& frame)
-{
-    HRESULT hr = S_OK;
+        if(this->backend->get_input_format() == H264_PIXEL_FORMAT_NV12)
+        {
+            for(UINT32 row = 0; row < chroma_height; row++)
+                memcpy(out_u + (size_t)row * chroma_width * 2,
+                    uv + (size_t)row * mapped.RowPitch, chroma_width * 2);
+
+            frame.planes[1] = out_u;
+            frame.strides[1] = chroma_width * 2;
+            frame.planes[2] = nullptr;
+            frame.strides[2] = 0;
+        }
+        else
+        {
+            // deinterleave the chroma plane
+            for(UINT32 row = 0; row < chroma_height; row++)
+            {
+                const BYTE* src = uv + (size_t)row * mapped.RowPitch;
+                BYTE* dst_u = out_u + (size_t)row * chroma_width;
+                BYTE* dst_v = out_v + (size_t)row * chroma_width;
+                for(UINT32 x = 0; x < chroma_width; x++)
+                {
+                    dst_u[x] = src[x * 2];
+                    dst_v[x] = src[x * 2 + 1];
+                }
+            }
+
+            frame.planes[1] = out_u;
+            frame.planes[2] = out_v;
+            frame.strides[1] = frame.strides[2] = chroma_width;
+        }
+    }
 
-    CComPtr<IMFMediaBuffer> buffer;
-    CComPtr<media_buffer_wrapper> buffer_wrapper;
-    CComPtr<IMFSample> sample;
-    CComPtr<IUnknown> sample_tracker;
+    CHECK_HR(hr = memory->buffer->SetCurrentLength(len));
 
-#ifdef _DEBUG
+done:
+    if(mapped_texture)
     {
-        D3D11_TEXTURE2D_DESC desc;
-        frame.buffer->texture->GetDesc(&desc);
-        assert_(desc.Width == this->frame_width && desc.Height == this->frame_height);
+        std::lock_guard<std::recursive_mutex> lock(*this->context_mutex);
+        this->d3d11devctx->Unmap(this->staging_texture, 0);
     }
-#endif
-
-    // sample tracker should be used for each texture individually
+    // the memory of the aligned buffers stays valid after unlocking
+    if(data)
+        memory->buffer->Unlock();
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
 
+void transform_h264_encoder::feed_encoder(const media_sample_video_frame& frame,
+    const dirty_rects_t& dirty_rects)
+{
     time_unit sample_time = convert_to_time_unit(frame.pos,
         this->session->frame_rate_num, this->session->frame_rate_den);
-    const time_unit sample_duration = convert_to_time_unit(1,
+    // the decimated frames are covered by the duration of the encoded frame
+    const time_unit sample_duration = convert_to_time_unit(this->frame_decimation.load(),
         this->session->frame_rate_num, this->session->frame_rate_den);
 
-    // create the input sample buffer
-    CHECK_HR(hr = MFCreateDXGISurfaceBuffer(IID_ID3D11Texture2D,
-        frame.buffer->texture, 0, FALSE, &buffer));
-    buffer_wrapper.Attach(new media_buffer_wrapper(this->context_mutex,
-        frame.buffer, buffer, this->use_system_memory));
+    h264_encoder_frame encoder_frame = {};
 
     assert_(frame.dur == 1);
 
@@ -322,106 +211,106 @@ HRESULT transform_h264_encoder::feed_encoder(const media_sample_video_frame& fra
         sample_time = 0;
     }
 
-    // create sample
-    CHECK_HR(hr = MFCreateSample(&sample));
-    CHECK_HR(hr = sample->AddBuffer(buffer_wrapper));
-    CHECK_HR(hr = sample->SetSampleTime(sample_time));
-    CHECK_HR(hr = sample->SetSampleDuration(sample_duration));
-    // the amd encoder probably copies the discontinuity flag to output sample,
-    // which might cause problems when the sample is passed to sinkwriter
-    //if((request.rp.flags & FLAG_DISCONTINUITY) || this->first_sample)
-    //{
-    //    /*CHECK_HR(hr = sample->SetUINT32(MFSampleExtension_Discontinuity, TRUE));*/
-    //    this->first_sample = false;
-    //}
-    /*else
-        CHECK_HR(hr = sample->SetUINT32(MFSampleExtension_Discontinuity, FALSE));*/
-    // add the tracker to the sample
-    sample_tracker.Attach(new media_sample_tracker(buffer_wrapper));
-    CHECK_HR(hr = sample->SetUnknown(media_sample_tracker_guid, sample_tracker));
-
-    // feed the encoder
+    encoder_frame.time = sample_time;
+    encoder_frame.duration = sample_duration;
+    encoder_frame.format = this->backend->get_input_format();
+    encoder_frame.dirty_rects_valid = dirty_rects.has_value();
+    if(dirty_rects)
+        for(const auto& rect : *dirty_rects)
+            encoder_frame.dirty_rects.push_back({rect.left, rect.top, rect.right, rect.bottom});
+    if(this->backend->uses_native_textures())
     {
-        /*std::unique_lock<std::recursive_mutex> lock(*this->context_mutex, std::defer_lock);
-        if(!this->use_system_memory)
-            lock.lock();*/
-        CHECK_HR(hr = this->encoder->ProcessInput(this->input_id, sample, 0));
+        assert_(frame.buffer);
+        encoder_frame.native_texture = frame.buffer->texture.p;
+        encoder_frame.owner = frame.buffer;
     }
-
-done:
-    return hr;
-}
-
-void transform_h264_encoder::events_cb(void* unk)
-{
-    try
+    else if(frame.memory_buffer)
     {
-        streaming::check_for_errors();
-
-        IMFAsyncResult* result = (IMFAsyncResult*)unk;
-        HRESULT hr = S_OK;
-        CComPtr<IMFMediaEvent> media_event;
+        // the color converter outputs the frames in the input format of the backend
+        const media_buffer_frame_t& memory = frame.memory_buffer;
+        assert_((memory->format == media_buffer_frame::FORMAT_I420) ==
+            (encoder_frame.format == H264_PIXEL_FORMAT_I420));
 
-        MediaEventType type = MEUnknown;
-        HRESULT status = S_OK;
+        encoder_frame.planes[0] = memory->y;
+        encoder_frame.planes[1] = memory->u;
+        encoder_frame.planes[2] = memory->v;
+        encoder_frame.strides[0] = memory->y_pitch;
+        encoder_frame.strides[1] = memory->u_pitch;
+        encoder_frame.strides[2] = memory->v_pitch;
+        encoder_frame.owner = memory;
+    }
+    else
+    {
+        media_buffer_memory_t memory;
+        {
+            buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
+            memory = this->buffer_pool_memory->acquire_buffer();
+        }
 
-        // get the event from the event queue
-        CHECK_HR(hr = this->event_generator->EndGetEvent(result, &media_event));
+        media_component_cycles_scope cycles_scope(this->processing_cycles);
+        this->read_frame(frame.buffer->texture, memory, encoder_frame);
+        encoder_frame.owner = memory;
+    }
 
-        // process the event
-        CHECK_HR(hr = media_event->GetType(&type));
-        CHECK_HR(hr = media_event->GetStatus(&status));
+    {
+        scoped_lock lock(this->process_output_mutex);
+        this->frames_in_flight.emplace_back(sample_time,
+            this->session->get_clock()->get_current_time());
+        this->last_submitted_time = sample_time;
+        this->frames_in_flight_sum += this->frames_in_flight.size();
+        this->frames_in_flight_max =
+            std::max(this->frames_in_flight_max, this->frames_in_flight.size());
+    }
 
-        if(type == METransformNeedInput)
-        {
-            this->encoder_requests++;
-            this->serve();
-        }
-        else if(type == METransformHaveOutput)
+    for(;;)
+    {
         {
-            this->process_output_cb(NULL);
+            media_component_cycles_scope cycles_scope(this->processing_cycles);
+            const time_unit start = this->session->get_clock()->get_current_time();
+            const bool submitted = this->backend->submit(encoder_frame);
+            this->encode_time_sum += this->session->get_clock()->get_current_time() - start;
+            if(submitted)
+                break;
         }
-        else if(type == METransformDrainComplete)
-        {
-            media_sample_h264_frames_t out_sample;
-            request_t request = this->last_request;
-            this->last_request = request_t();
-            {
-                scoped_lock lock(this->process_output_mutex);
-                out_sample = std::move(this->out_sample);
-            }
 
-            this->process_request(out_sample, request);
-        }
-        else if(type == MEError)
-        {
-            // status has the error code
-            throw HR_EXCEPTION(status);
-        }
-        else
-            assert_(false);
+        // a synchronous backend doesn't accept input before its output is received
+        assert_(!this->async);
+        this->process_output();
+    }
+}
 
-        // set callback for the next event
-        CHECK_HR(hr = this->event_generator->BeginGetEvent(&this->events_callback->native, NULL));
+void transform_h264_encoder::on_need_input()
+{
+    this->encoder_requests++;
+    this->serve();
+}
 
-done:
-        if(FAILED(hr))
-            throw HR_EXCEPTION(hr);
-    }
-    catch(streaming::exception e)
+void transform_h264_encoder::on_have_output()
+{
+    this->process_output();
+}
+
+void transform_h264_encoder::on_drain_complete()
+{
+    media_sample_h264_frames_t out_sample;
+    request_t request = this->last_request;
+    this->last_request = request_t();
     {
-        streaming::print_error_and_abort(e.what());
+        scoped_lock lock(this->process_output_mutex);
+        out_sample = std::move(this->out_sample);
     }
+
+    this->process_request(out_sample, request);
 }
 
 bool transform_h264_encoder::extract_frame(media_sample_video_frame& frame, const request_t& request)
 {
-    assert_(!frame.buffer);
+    assert_(frame.is_silent());
 
     if(!request.sample.args)
         return true;
 
-    while(!request.sample.args->sample->get_frames().empty() && !frame.buffer)
+    while(!request.sample.args->sample->get_frames().empty() && frame.is_silent())
     {
         // TODO: h264 encoder should copy the frames container and modify that
         // TODO: vector should be used for media_sample_video_frames_template
@@ -437,23 +326,70 @@ bool transform_h264_encoder::extract_frame(media_sample_video_frame& frame, cons
 
 bool transform_h264_encoder::on_serve(request_queue::request_t& request)
 {
-    // TODO: software encoder drain
-
     // output is only attached to requests that contain valid input data;
     // this really doesn't pose a problem, because the encoder itself outputs frames
-    // only when it has been given enough input frames
-
-    HRESULT hr = S_OK;
+    // only when it has been given enough input frames;
+    // the output is attached to the request that is served after it was received
+    // instead of the request of the input frame, because holding the requests until the
+    // encoder latency has passed would stall the pipeline;
+    // the request of the input frame has been served at the latest at that point,
+    // so the output frames are never attached to an earlier request than their input,
+    // and the outputs time the frames by their sample time
 
     const bool not_served_request = !request.sample.already_served;
     media_sample_video_frame video_frame;
     const bool pop_request = this->extract_frame(video_frame, request);
 
+    // the dirty rects are taken when the first frame of the request is served;
+    // a request without a sample has no changes
+    if(!this->serving_request)
+    {
+        this->serving_request = true;
+        this->request_frame_submitted = false;
+        this->request_dirty_rects = request.sample.args ?
+            request.sample.args->dirty_rects : std::make_optional<std::vector<RECT>>();
+    }
+
     // there must be a valid texture if the buffer is present
     assert_(!video_frame.buffer || video_frame.buffer->texture);
 
+    // the decimated frames are dropped before the encoder
+    {
+        const UINT32 frame_decimation = this->frame_decimation;
+        if(!video_frame.is_silent() && frame_decimation > 1 &&
+            video_frame.pos % frame_decimation)
+        {
+            video_frame.buffer = nullptr;
+            video_frame.memory_buffer = nullptr;
+        }
+    }
+
+    // the unchanged frames are skipped;
+    // the outputs keep the timestamps of the encoded frames, so the gaps are preserved
+    if(!video_frame.is_silent() && this->vfr_enabled)
+    {
+        const time_unit timestamp = convert_to_time_unit(video_frame.pos,
+            this->session->frame_rate_num, this->session->frame_rate_den);
+        const bool force_frame = this->vfr_force_frame.exchange(false);
+
+        if(!force_frame && video_frame.buffer == this->vfr_last_buffer &&
+            video_frame.memory_buffer == this->vfr_last_memory_buffer &&
+            timestamp - this->vfr_last_timestamp < this->vfr_max_frame_interval)
+        {
+            video_frame.buffer = nullptr;
+            video_frame.memory_buffer = nullptr;
+            this->vfr_skipped_count++;
+        }
+        else
+        {
+            this->vfr_last_buffer = video_frame.buffer;
+            this->vfr_last_memory_buffer = video_frame.memory_buffer;
+            this->vfr_last_timestamp = timestamp;
+        }
+    }
+
     // feed the encoder
-    if(video_frame.buffer)
+    if(!video_frame.is_silent())
     {
         const time_unit timestamp = convert_to_time_unit(video_frame.pos,
             this->session->frame_rate_num, this->session->frame_rate_den);
@@ -463,41 +399,53 @@ bool transform_h264_encoder::on_serve(request_queue::request_t& request)
             assert_(false);
         }
 
-    back:
-        if(!this->software)
+        if(this->async)
             this->encoder_requests--;
 
-        hr = this->feed_encoder(video_frame);
+        // the encoded frame also covers the changes of the skipped frames
+        dirty_rects_t dirty_rects = this->pending_dirty_rects;
+        add_dirty_rects(dirty_rects, this->request_dirty_rects);
+        this->feed_encoder(video_frame, dirty_rects);
+        this->request_frame_submitted = true;
+        this->pending_dirty_rects = std::make_optional<std::vector<RECT>>();
 
         if(timestamp >= 0)
             this->last_time_stamp = timestamp;
 
-        if(this->software)
-        {
-            if(hr == MF_E_NOTACCEPTING)
-            {
-                this->process_output_cb(NULL);
-                goto back;
-            }
-            else if(SUCCEEDED(hr))
-            {
-                DWORD status;
-                CHECK_HR(hr = this->encoder->GetOutputStatus(&status));
-                if(status & MFT_OUTPUT_STATUS_SAMPLE_READY)
-                    this->process_output_cb(NULL);
-            }
-        }
+        // collect the output that became available
+        if(!this->async)
+            while(this->process_output());
 
-        CHECK_HR(hr);
         assert_(this->encoder_requests >= 0);
     }
 
+    if(pop_request)
+    {
+        if(!this->request_frame_submitted)
+            add_dirty_rects(this->pending_dirty_rects, this->request_dirty_rects);
+        this->serving_request = false;
+    }
+
     if(pop_request && not_served_request)
     {
+        {
+            scoped_lock lock(this->queue_mutex);
+            this->queued_requests--;
+        }
+        this->queue_cv.notify_all();
+
         // event callback will dispatch the last request
-        if(!request.sample.drain || this->software)
+        if(!request.sample.drain || !this->async)
         {
             media_sample_h264_frames_t out_sample;
+
+            if(request.sample.drain)
+            {
+                std::cout << "drain on h264 encoder" << std::endl;
+                this->backend->drain();
+                while(this->process_output());
+            }
+
             {
                 scoped_lock lock(this->process_output_mutex);
                 out_sample = std::move(this->out_sample);
@@ -510,21 +458,17 @@ bool transform_h264_encoder::on_serve(request_queue::request_t& request)
             std::cout << "drain on h264 encoder" << std::endl;
             this->last_request = request;
             this->draining = true;
-            CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0));
+            this->backend->drain();
         }
     }
 
-done:
-    if(FAILED(hr))
-        throw HR_EXCEPTION(hr);
-
     return pop_request;
 }
 
 transform_h264_encoder::request_queue::request_t* transform_h264_encoder::next_request()
 {
     request_queue::request_t* request = this->requests.get();
-    if(request && (this->encoder_requests || this->software))
+    if(request && (this->encoder_requests || !this->async))
         return request;
     else
         return NULL;
@@ -541,7 +485,7 @@ void transform_h264_encoder::process_request(
     {
         args = std::make_optional<media_component_h264_video_args>();
         args->sample = sample;
-        args->software = this->software;
+        args->software = !this->async;
     }
 
     this->last_packet = request.rp.packet_number;
@@ -564,110 +508,97 @@ void transform_h264_encoder::process_request(
     });
 }
 
-bool transform_h264_encoder::process_output(CComPtr<IMFSample>& sample)
+bool transform_h264_encoder::process_output()
 {
-    HRESULT hr = S_OK;
-
-    const DWORD mft_provides_samples =
-        this->output_stream_info.dwFlags & MFT_OUTPUT_STREAM_PROVIDES_SAMPLES;
-
-    MFT_OUTPUT_DATA_BUFFER output = {0};
-    DWORD status = 0;
-    CComPtr<IMFMediaBuffer> buffer;
+    std::unique_lock<std::mutex> lock(this->process_output_mutex);
 
-    if(mft_provides_samples)
-        output.pSample = NULL;
-    else
+    h264_encoder_packet packet;
+    media_sample_h264_frame frame;
     {
-        media_buffer_memory_t buffer;
-
-        CHECK_HR(hr = MFCreateSample(&sample));
-        {
-            // TODO: the sink writer should call a place marker method for knowing
-            // when the output buffer is safe to reuse;
-            // currently, a new buffer must be allocated each time
-            buffer_pool_memory_t::scoped_lock lock(this->buffer_pool_memory->mutex);
-            buffer.reset(new media_buffer_memory);
-            /*buffer = this->buffer_pool_memory->acquire_buffer();*/
-            buffer->initialize(this->output_stream_info.cbSize);
-        }
-        
-        CHECK_HR(hr = sample->AddBuffer(buffer->buffer));
-        output.pSample = sample;
+        media_component_cycles_scope cycles_scope(this->processing_cycles);
+        const time_unit start = this->session->get_clock()->get_current_time();
+        const bool received = this->backend->receive(packet);
+        this->encode_time_sum += this->session->get_clock()->get_current_time() - start;
+        if(!received)
+            return false;
     }
 
-    output.dwStreamID = this->output_id;
-    output.dwStatus = 0;
-    output.pEvents = NULL;
+    // the output is always of a frame that has been submitted
+    assert_(packet.pts <= this->last_submitted_time);
 
+    // match the output to the submitted frame;
+    // the frames that the encoder dropped are discarded
+    while(!this->frames_in_flight.empty() && this->frames_in_flight.front().first < packet.pts)
+        this->frames_in_flight.pop_front();
+    if(!this->frames_in_flight.empty() && this->frames_in_flight.front().first == packet.pts)
     {
-        // TODO: decide if context mutex is really needed here
-        /*std::unique_lock<std::recursive_mutex> lock(*this->context_mutex, std::defer_lock);
-        if(!this->use_system_memory)
-            lock.lock();*/
-        hr = this->encoder->ProcessOutput(0, 1, &output, &status);
+        const time_unit latency = this->session->get_clock()->get_current_time() -
+            this->frames_in_flight.front().second;
+        this->latency_sum += latency;
+        this->latency_max = std::max(this->latency_max, latency);
+        this->latency_count++;
+        this->frames_in_flight.pop_front();
     }
 
-    // the output stream type will be the exact same one, but for some reason
-    // intel mft requires resetting the output type
-    if(FAILED(hr) && output.dwStatus == MFT_OUTPUT_DATA_BUFFER_FORMAT_CHANGE)
-        CHECK_HR(hr = this->set_output_stream_type())
-    else
-        CHECK_HR(hr)
+    frame.ts = packet.pts;
+    frame.dur = packet.duration;
+    this->create_sample(packet, frame.sample);
+    this->parse_frame(frame, packet);
 
-done:
-    if(!sample)
-        sample.Attach(output.pSample);
+    if(!this->out_sample)
+    {
+        buffer_pool_h264_frames_t::scoped_lock lock(this->buffer_pool_h264_frames->mutex);
+        this->out_sample = this->buffer_pool_h264_frames->acquire_buffer();
+        this->out_sample->initialize();
+    }
 
-    if(hr != MF_E_TRANSFORM_NEED_MORE_INPUT && FAILED(hr))
-        throw HR_EXCEPTION(hr);
-    return (SUCCEEDED(hr) && sample);
+    this->out_sample->frames.push_back(std::move(frame));
+    return true;
 }
 
-void transform_h264_encoder::process_output_cb(void*)
+h264_encoder_metrics transform_h264_encoder::get_metrics() const
 {
-    std::unique_lock<std::mutex> lock(this->process_output_mutex);
+    h264_encoder_metrics metrics = {};
 
-    HRESULT hr = S_OK;
-    CComPtr<IMFSample> sample;
+    scoped_lock lock(this->process_output_mutex);
+    if(this->latency_count > 0)
+    {
+        metrics.latency_avg = this->latency_sum / this->latency_count;
+        metrics.latency_max = this->latency_max;
+        metrics.frames_in_flight_avg = (double)this->frames_in_flight_sum / this->latency_count;
+        metrics.frames_in_flight_max = this->frames_in_flight_max;
+    }
+    metrics.encoded_count = this->latency_count;
+    metrics.vfr_skipped_count = this->vfr_skipped_count.load();
+    if(!this->async && this->latency_count > 0 && this->encode_time_sum > 0)
+        metrics.throughput =
+            (double)this->latency_count * SECOND_IN_TIME_UNIT / this->encode_time_sum.load();
 
-    this->process_output(sample);
+    return metrics;
+}
 
-    if(sample)
-    {
-        // remove sample tracker from the sample
-        CComPtr<IUnknown> obj;
-        hr = sample->GetUnknown(media_sample_tracker_guid, __uuidof(IUnknown), (LPVOID*)&obj);
-        if(SUCCEEDED(hr))
-            // release the buffer so that it is available for reuse
-            sample->SetUnknown(media_sample_tracker_guid, nullptr);
-        else if(hr != MF_E_ATTRIBUTENOTFOUND)
-            CHECK_HR(hr);
-        hr = S_OK;
-
-        if(!this->out_sample)
-        {
-            buffer_pool_h264_frames_t::scoped_lock lock(this->buffer_pool_h264_frames->mutex);
-            this->out_sample = this->buffer_pool_h264_frames->acquire_buffer();
-            this->out_sample->initialize();
-        }
+void transform_h264_encoder::create_sample(const h264_encoder_packet& packet,
+    CComPtr<IMFSample>& sample)
+{
+    HRESULT hr = S_OK;
 
-        media_sample_h264_frame frame;
-        LONGLONG ts, dur;
-        CHECK_HR(hr = sample->GetSampleTime(&ts));
-        CHECK_HR(hr = sample->GetSampleDuration(&dur));
-        frame.ts = (time_unit)ts;
-        frame.dur = (time_unit)dur;
-        frame.sample = sample;
-        this->out_sample->frames.push_back(frame);
-    }
+    sample = this->sample_pool->acquire_sample();
+    CHECK_HR(hr = sample->AddBuffer(media_buffer_packet::get_media_buffer(packet.buffer)));
+    CHECK_HR(hr = sample->SetSampleTime(packet.pts));
+    CHECK_HR(hr = sample->SetSampleDuration(packet.duration));
+    CHECK_HR(hr = sample->SetUINT32(MFSampleExtension_CleanPoint, packet.key_frame));
+    CHECK_HR(hr = sample->SetUINT64(MFSampleExtension_DecodeTimestamp, (UINT64)packet.dts));
 
 done:
     if(FAILED(hr))
-    {
-        // TODO: psample is leaked on audio pipeline
         throw HR_EXCEPTION(hr);
-    }
+}
+
+void transform_h264_encoder::parse_frame(media_sample_h264_frame& frame,
+    const h264_encoder_packet& packet)
+{
+    frame.info = this->bitstream_parser.parse(std::string_view(
+        (const char*)packet.buffer->get_data(), packet.buffer->get_length()));
 }
 
 void transform_h264_encoder::initialize(const control_class_t& ctrl_pipeline,
@@ -680,166 +611,193 @@ void transform_h264_encoder::initialize(const control_class_t& ctrl_pipeline,
     const CLSID* clsid,
     bool software)
 {
-    HRESULT hr = S_OK;
+    // the gop settings are set before initializing
+    h264_encoder_backend_params params = this->params;
+    params.frame_rate_num = frame_rate_num;
+    params.frame_rate_den = frame_rate_den;
+    params.frame_width = frame_width;
+    params.frame_height = frame_height;
+    params.avg_bitrate = avg_bitrate;
+    params.quality_vs_speed = quality_vs_speed;
+
+    switch(encoder_profile)
+    {
+    case eAVEncH264VProfile_Base:
+        params.profile = H264_PROFILE_BASELINE;
+        break;
+    case eAVEncH264VProfile_High:
+        params.profile = H264_PROFILE_HIGH;
+        break;
+    default:
+        params.profile = H264_PROFILE_MAIN;
+    }
 
-    this->ctrl_pipeline = ctrl_pipeline;
-    this->use_system_memory = !d3d11dev || software;
-    this->software = software;
-    this->frame_rate_num = frame_rate_num;
-    this->frame_rate_den = frame_rate_den;
-    this->frame_width = frame_width;
-    this->frame_height = frame_height;
-    this->avg_bitrate = avg_bitrate;
-    this->quality_vs_speed = quality_vs_speed;
-    this->encoder_profile = encoder_profile;
-    this->input_color_space = input_color_space;
-
-    CComPtr<IMFAttributes> attributes;
-    UINT count = 0;
-    UINT activate_index = 0;
-    // array must be released with cotaskmemfree
-    IMFActivate** activate = NULL;
-    MFT_REGISTER_TYPE_INFO info = {MFMediaType_Video, MFVideoFormat_H264};
-    UINT32 flags = MFT_ENUM_FLAG_SORTANDFILTER;
-    if(!software)
-        flags |= MFT_ENUM_FLAG_HARDWARE;
-    CHECK_HR(hr = MFTEnumEx(
-        MFT_CATEGORY_VIDEO_ENCODER,
-        flags,
-        NULL,
-        &info,
-        &activate,
-        &count));
-
-    // find the requested encoder
-    if(clsid)
-    {
-        bool found = false;
-        for(UINT i = 0; i < count; i++)
-        {
-            static_assert(std::is_same_v<
-                decltype(clsid),
-                const CLSID*>);
+    switch(input_color_space)
+    {
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P709:
+        params.color_space = H264_COLOR_SPACE_BT709_FULL;
+        break;
+    case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P709:
+        params.color_space = H264_COLOR_SPACE_BT709_LIMITED;
+        break;
+    case DXGI_COLOR_SPACE_YCBCR_FULL_G22_LEFT_P601:
+        params.color_space = H264_COLOR_SPACE_BT601_FULL;
+        break;
+    case DXGI_COLOR_SPACE_YCBCR_STUDIO_G22_LEFT_P601:
+        params.color_space = H264_COLOR_SPACE_BT601_LIMITED;
+        break;
+    default:
+        throw HR_EXCEPTION(E_UNEXPECTED);
+    }
 
-            CLSID clsid2;
-            CHECK_HR(hr = activate[i]->GetGUID(MFT_TRANSFORM_CLSID_Attribute, &clsid2));
+    h264_encoder_backend_t backend(
+        new h264_encoder_mft(this->context_mutex, d3d11dev, clsid, software));
 
-            if(std::memcmp(clsid, &clsid2, sizeof(CLSID)) == 0)
-            {
-                found = true;
-                activate_index = i;
-                break;
-            }
-        }
+    this->initialize(ctrl_pipeline, backend, params);
+}
 
-        if(!found)
-            CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
-    }
+void transform_h264_encoder::initialize(const control_class_t& ctrl_pipeline,
+    const h264_encoder_backend_t& backend, const h264_encoder_backend_params& params)
+{
+    assert_(backend);
 
-    if(!count)
-        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+    this->ctrl_pipeline = ctrl_pipeline;
+    this->backend = backend;
+    this->params = params;
+    this->async = backend->is_async();
 
-    // activate the encoder
-    CHECK_HR(hr = 
-        activate[activate_index]->ActivateObject(__uuidof(IMFTransform), (void**)&this->encoder));
+    HRESULT hr = S_OK;
 
-    // check if the encoder supports d3d11
-    CHECK_HR(hr = this->encoder->GetAttributes(&attributes));
-    if(!this->use_system_memory)
+    this->backend->initialize(params, this->shared_from_this<transform_h264_encoder>());
+    CHECK_HR(hr = h264_encoder_mft::create_output_type(
+        params, this->backend->get_sequence_header(), this->output_type));
+
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
+
+void transform_h264_encoder::schedule_serve()
+{
+    HRESULT hr = S_OK;
+
+    // the need input events of asynchronous backends serve the requests aswell
+    if(this->async || this->queue_depth == 0)
     {
-        UINT32 d3d11_support;
-        CHECK_HR(hr = attributes->GetUINT32(MF_SA_D3D11_AWARE, &d3d11_support));
-        if(!d3d11_support)
-            CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+        this->serve();
+        return;
     }
 
-    // verify that the encoder is async
-    if(!this->software)
+    CHECK_HR(hr = this->serve_callback->mf_put_work_item(
+        this->shared_from_this<transform_h264_encoder>()));
+
+    // the queued frames hold the textures of the upstream pools,
+    // so the pipeline thread waits until the queue has room
     {
-        UINT32 async_support;
-        CHECK_HR(hr = attributes->GetUINT32(MF_TRANSFORM_ASYNC, &async_support));
-        if(!async_support)
-            CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
-        // unlock the encoder(must be done for asynchronous transforms)
-        CHECK_HR(hr = attributes->SetUINT32(MF_TRANSFORM_ASYNC_UNLOCK, TRUE));
+        std::unique_lock<std::mutex> lock(this->queue_mutex);
+        this->queue_cv.wait(lock, [this] {return this->queued_requests <= this->queue_depth;});
     }
 
-    // check that the encoder transform has only a fixed number of streams
-    DWORD input_stream_count, output_stream_count;
-    CHECK_HR(hr = this->encoder->GetStreamCount(&input_stream_count, &output_stream_count));
-    if(input_stream_count != 1 || output_stream_count != 1)
-        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+done:
+    if(FAILED(hr))
+        throw HR_EXCEPTION(hr);
+}
 
-    hr = this->encoder->GetStreamIDs(
-        input_stream_count, &this->input_id, output_stream_count, &this->output_id);
-    if(hr == E_NOTIMPL)
-        this->input_id = this->output_id = 0;
-    else if(FAILED(hr))
-        CHECK_HR(hr);
+void transform_h264_encoder::serve_cb(void*)
+{
+    this->serve();
+}
 
-    // associate a dxgidevicemanager with the encoder;
-    // this might fail if the adapter backing up the d3d device is
-    // incompatible with the mft
-    if(!this->use_system_memory)
+void transform_h264_encoder::apply_degradation()
+{
+    UINT32 quality_vs_speed, frame_decimation;
     {
-        CHECK_HR(hr = MFCreateDXGIDeviceManager(&this->reset_token, &this->devmngr));
-        CHECK_HR(hr = this->devmngr->ResetDevice(d3d11dev, this->reset_token));
-        CHECK_HR(hr = this->encoder->ProcessMessage(
-            MFT_MESSAGE_SET_D3D_MANAGER, (ULONG_PTR)this->devmngr.p));
+        scoped_lock lock(this->queue_mutex);
+        quality_vs_speed =
+            this->degradation.is_step_active(degradation_controller::STEP_QUALITY) ?
+            this->degraded_quality_vs_speed : this->params.quality_vs_speed;
+        frame_decimation =
+            this->degradation.is_step_active(degradation_controller::STEP_FRAME_RATE) ?
+            this->degraded_frame_decimation : 1;
     }
 
-    // set the encoder parameters
-    CHECK_HR(hr = this->set_encoder_parameters());
+    // the frame rate step is applied even if the encoder rejects the quality change
+    this->frame_decimation = frame_decimation;
+    try
+    {
+        if(!this->backend->set_quality_vs_speed(quality_vs_speed))
+            std::cout << "the video encoder doesn't support changing the quality" << std::endl;
+    }
+    catch(streaming::exception err)
+    {
+        std::cout << "EXCEPTION THROWN: " << err.what() << std::flush;
+        std::cout << "the video encoder rejected the quality change" << std::endl;
+    }
+}
 
-    // set media types for the encoder(output type must be set first)
-    CHECK_HR(hr = this->set_output_stream_type());
-    CHECK_HR(hr = this->set_input_stream_type());
+std::vector<degradation_controller::event_t> transform_h264_encoder::get_degradation_events() const
+{
+    scoped_lock lock(this->queue_mutex);
+    return std::vector<degradation_controller::event_t>(
+        this->degradation.get_events().begin(), this->degradation.get_events().end());
+}
 
-    // get the buffer requirements for the encoder
-    CHECK_HR(hr = this->encoder->GetInputStreamInfo(this->input_id, &this->input_stream_info));
-    CHECK_HR(hr = this->encoder->GetOutputStreamInfo(this->output_id, &this->output_stream_info));
+void transform_h264_encoder::enable_degradation(const degradation_controller::params_t& params,
+    UINT32 quality_vs_speed, UINT32 frame_decimation)
+{
+    scoped_lock lock(this->queue_mutex);
 
-    if(this->input_stream_info.dwFlags & MFT_INPUT_STREAM_DOES_NOT_ADDREF)
-        CHECK_HR(hr = MF_E_TOPO_CODEC_NOT_FOUND);
+    this->degradation_enabled = true;
+    this->degradation.initialize(params);
+    this->degraded_quality_vs_speed = quality_vs_speed;
+    this->degraded_frame_decimation = std::max(frame_decimation, (UINT32)1);
+}
 
-    // get the media event generator interface
-    if(!this->software)
-    {
-        CHECK_HR(hr = this->encoder->QueryInterface(&this->event_generator));
-        // register this to the event callback function
-        this->events_callback->set_callback(this->shared_from_this<transform_h264_encoder>());
-    }
+void transform_h264_encoder::set_gop(UINT32 gop_size, bool closed_gop)
+{
+    assert_(!this->backend);
 
-    /*
-    amd holds the reference to the submitted buffer
-    amd hardware mft supports nv12 and argb32 input types
+    this->params.gop_size = gop_size;
+    this->params.closed_gop = closed_gop;
+}
 
-    intel quicksync only supports nv12 and is not direct3d aware
-    microsoft async mft supports only nv12 and is not direct3d aware
-    */
+void transform_h264_encoder::set_threading(UINT32 worker_threads, UINT32 slices,
+    UINT32 reserved_threads)
+{
+    assert_(!this->backend);
 
-    // start the encoder
-    {
-        std::unique_lock<std::recursive_mutex> lock(*this->context_mutex, std::defer_lock);
-        if(!this->use_system_memory)
-            lock.lock();
-        if(!this->software)
-            CHECK_HR(hr = this->event_generator->BeginGetEvent(&this->events_callback->native, NULL));
-        CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, NULL));
-        CHECK_HR(hr = this->encoder->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, NULL));
-    }
+    // hardware concurrency is 0 if it is unknown
+    const UINT32 cores = std::thread::hardware_concurrency();
+    if(worker_threads && cores)
+        worker_threads = std::min(worker_threads,
+            cores > reserved_threads ? cores - reserved_threads : 1);
 
-done:
-    // release allocated memory
-    if(activate)
-    {
-        for(UINT i = 0; i < count; i++)
-            activate[i]->Release();
-        CoTaskMemFree(activate);
-    }
+    this->params.worker_threads = worker_threads;
+    this->params.slices = slices;
+}
 
-    if(FAILED(hr))
-        throw HR_EXCEPTION(hr);
+void transform_h264_encoder::enable_vfr(time_unit max_frame_interval)
+{
+    assert_(max_frame_interval > 0);
+
+    this->vfr_enabled = true;
+    this->vfr_max_frame_interval = max_frame_interval;
+}
+
+bool transform_h264_encoder::request_key_frame()
+{
+    // the key frame isn't delayed by the skipped frames
+    this->vfr_force_frame = true;
+    return this->backend->request_key_frame();
+}
+
+bool transform_h264_encoder::reconfigure(UINT32 avg_bitrate)
+{
+    if(!this->backend->reconfigure(avg_bitrate))
+        return false;
+
+    this->params.avg_bitrate = avg_bitrate;
+    return true;
 }
 
 media_stream_t transform_h264_encoder::create_stream(media_message_generator_t&& event_generator)
@@ -899,8 +857,24 @@ media_stream::result_t stream_h264_encoder::process_sample(
     request.sample.already_served = !request.sample.drain &&
         (!request.sample.args || !request.sample.args->has_frames);
     request.rp = rp;
+    bool degradation_changed = false;
+    if(!request.sample.already_served)
+    {
+        transform_h264_encoder::scoped_lock lock(this->transform->queue_mutex);
+        this->transform->queued_requests++;
+
+        // the encoder is overloaded if the requests queue up
+        if(this->transform->degradation_enabled)
+            degradation_changed = this->transform->degradation.on_frame(
+                this->transform->session->get_clock()->get_current_time(),
+                this->transform->queued_requests >
+                std::max(this->transform->queue_depth.load(), (UINT32)1));
+    }
     this->transform->requests.push(request);
 
+    if(degradation_changed)
+        this->transform->apply_degradation();
+
     // TODO: the stored request should be served on process_output_cb;
     // the request packet numbering can be reordered; last packet needs to have the last number
     // though
@@ -934,7 +908,7 @@ media_stream::result_t stream_h264_encoder::process_sample(
         this->transform->request_reinitialization(this->transform->ctrl_pipeline);
     count++;*/
 
-    this->transform->serve();
+    this->transform->schedule_serve();
 
     return OK;
 }
\ No newline at end of file
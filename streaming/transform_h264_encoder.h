@@ -6,14 +6,25 @@
 #include "request_dispatcher.h"
 #include "request_queue_handler.h"
 #include "control_class.h"
+#include "h264_encoder_backend.h"
+#include "degradation_controller.h"
+#include "h264_bitstream.h"
 #include <d3d11.h>
 #include <atlbase.h>
 #include <mfapi.h>
 #include <codecapi.h>
 #include <memory>
 #include <mutex>
+#include <condition_variable>
 #include <atomic>
 #include <vector>
+#include <deque>
+#include <utility>
+#include <optional>
+
+// the number of requests that can wait for the encoding work queue before the pipeline thread
+// waits for the encoder
+#define DEFAULT_ENCODE_QUEUE_DEPTH 2
 
 // h264 encoder
 class stream_h264_encoder;
@@ -26,14 +37,27 @@ struct h264_encoder_transform_packet
     media_component_h264_encoder_args_t args; 
 };
 
-/*
-
-does not use b frames by default
+// the statistics of the encoder since the initialization
+struct h264_encoder_metrics
+{
+    // the time from submitting a frame to receiving its output, in time units
+    time_unit latency_avg, latency_max;
+    double frames_in_flight_avg;
+    size_t frames_in_flight_max;
+    frame_unit encoded_count;
+    // the unchanged frames that weren't encoded in variable frame rate mode
+    frame_unit vfr_skipped_count;
+    // the encoding rate that a synchronous backend could sustain, in frames per second;
+    // 0 for asynchronous backends
+    double throughput;
+};
 
-*/
+// the actual encoding is done by an h264_encoder_backend;
+// the media foundation encoders are used by default
 
 class transform_h264_encoder : 
     public media_component,
+    public h264_encoder_backend::listener,
     request_queue_handler<h264_encoder_transform_packet>
 {
     friend class stream_h264_encoder;
@@ -56,31 +80,86 @@ private:
     control_class_t ctrl_pipeline;
     context_mutex_t context_mutex;
 
-    UINT32 frame_rate_num, frame_rate_den;
-    UINT32 frame_width, frame_height;
-    UINT32 avg_bitrate, quality_vs_speed;
-    eAVEncH264VProfile encoder_profile;
-    DXGI_COLOR_SPACE_TYPE input_color_space;
-
-    DWORD input_id, output_id;
-    MFT_INPUT_STREAM_INFO input_stream_info;
-    MFT_OUTPUT_STREAM_INFO output_stream_info;
-    CComPtr<IMFTransform> encoder;
-    CComPtr<IMFMediaEventGenerator> event_generator;
-    CComPtr<IMFDXGIDeviceManager> devmngr;
-    CComPtr<async_callback_t> events_callback;
-    UINT reset_token;
-
-    std::mutex process_output_mutex;
+    h264_encoder_backend_t backend;
+    h264_encoder_backend_params params;
+    // synchronous backends are fed and drained by the serving thread
+    bool async;
+
+    // the frames are read back to system memory for the backends that don't
+    // consume textures if the color converter doesn't output them in system memory;
+    // accessed by the serving thread
+    CComPtr<ID3D11DeviceContext> d3d11devctx;
+    CComPtr<ID3D11Texture2D> staging_texture;
+    std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
+
+    mutable std::mutex process_output_mutex;
     std::atomic_int32_t encoder_requests;
 
+    // synchronous backends are served on a work queue so that the encoding doesn't
+    // block the pipeline thread;
+    // the requests are served in order by the request queue
+    CComPtr<async_callback_t> serve_callback;
+    std::atomic_uint32_t queue_depth;
+    // the pipeline thread waits while the queue is full
+    mutable std::mutex queue_mutex;
+    std::condition_variable queue_cv;
+    UINT32 queued_requests;
+
+    // the encoding load is stepped down while the requests queue up;
+    // guarded by the queue mutex
+    bool degradation_enabled;
+    degradation_controller degradation;
+    UINT32 degraded_quality_vs_speed, degraded_frame_decimation;
+    // only every nth frame is encoded
+    std::atomic_uint32_t frame_decimation;
+
+    // in variable frame rate mode the unchanged frames aren't encoded until
+    // the max frame interval has passed;
+    // a frame is unchanged if it has the same buffers as the last encoded frame;
+    // accessed by the serving thread
+    bool vfr_enabled;
+    time_unit vfr_max_frame_interval, vfr_last_timestamp;
+    media_buffer_texture_t vfr_last_buffer;
+    media_buffer_frame_t vfr_last_memory_buffer;
+    std::atomic<frame_unit> vfr_skipped_count;
+    // the next frame is encoded after a key frame request
+    std::atomic_bool vfr_force_frame;
+
+    // the dirty rects of a request are passed with each of its encoded frames;
+    // the rects are carried over to the next request until a frame is encoded;
+    // unset rects mark the whole frame as changed;
+    // accessed by the serving thread
+    typedef std::optional<std::vector<RECT>> dirty_rects_t;
+    bool serving_request;
+    bool request_frame_submitted;
+    dirty_rects_t request_dirty_rects, pending_dirty_rects;
+
+    // the sample time and the submit time of the frames in the encoder;
+    // the outputs are matched by the sample time;
+    // guarded by the process output mutex
+    std::deque<std::pair<time_unit, time_unit>> frames_in_flight;
+    // the sample time of the last submitted frame;
+    // guarded by the process output mutex
+    time_unit last_submitted_time;
+    time_unit latency_sum, latency_max;
+    frame_unit latency_count;
+    // the time spent in the submit and receive calls of a synchronous backend,
+    // which is the time it takes to encode the frames
+    std::atomic_int64_t encode_time_sum;
+    size_t frames_in_flight_sum, frames_in_flight_max;
+
+    // the output frames are parsed once for all of the outputs;
+    // guarded by the process output mutex
+    h264_bitstream_parser bitstream_parser;
+
     std::shared_ptr<request_dispatcher> dispatcher;
     request_t last_request;
     std::atomic_bool draining;
     bool first_sample;
 
     std::shared_ptr<buffer_pool_h264_frames_t> buffer_pool_h264_frames;
-    std::shared_ptr<buffer_pool_memory_t> buffer_pool_memory;
+    // the samples that wrap the packets for the outputs
+    CComPtr<media_sample_pool> sample_pool;
     media_sample_h264_frames_t out_sample;
 
     // time shift must be used instead of adjusting the time in the output_file, because
@@ -88,21 +167,32 @@ private:
     // used by the media foundation's file sink
     time_unit time_shift;
 
-    bool use_system_memory, software;
-
     // debug
     time_unit last_time_stamp, last_time_stamp2;
     int last_packet;
 
-    static HRESULT set_color_space(const CComPtr<IMFMediaType>&, DXGI_COLOR_SPACE_TYPE);
-    HRESULT set_input_stream_type();
-    HRESULT set_output_stream_type();
-    HRESULT set_encoder_parameters();
-
-    HRESULT feed_encoder(const media_sample_video_frame&);
+    // copies the nv12 texture to the planes of the memory in the input format of the backend
+    void read_frame(const CComPtr<ID3D11Texture2D>&, const media_buffer_memory_t&,
+        h264_encoder_frame&);
+    // submits the frame to the backend;
+    // the output of a synchronous backend is received until it accepts the frame
+    void feed_encoder(const media_sample_video_frame&, const dirty_rects_t&);
 
     void process_request(const media_sample_h264_frames_t&, request_t&);
-    bool process_output(CComPtr<IMFSample>&);
+    // receives one frame from the backend;
+    // returns false if no output was available
+    bool process_output();
+    // wraps the packet to a sample for the outputs
+    void create_sample(const h264_encoder_packet&, CComPtr<IMFSample>&);
+    // attaches the parsed bitstream of the packet to the frame
+    void parse_frame(media_sample_h264_frame&, const h264_encoder_packet&);
+
+    // serves the requests on the work queue for synchronous backends;
+    // waits while the queue is full
+    void schedule_serve();
+    void serve_cb(void*);
+    // applies the steps of the current degradation level
+    void apply_degradation();
 
     // returns whether the request can be served
     bool extract_frame(media_sample_video_frame&, const request_t&);
@@ -111,8 +201,10 @@ private:
     bool on_serve(request_queue::request_t&);
     request_queue::request_t* next_request();
 
-    void events_cb(void*);
-    void process_output_cb(void*);
+    // h264_encoder_backend::listener
+    void on_need_input() override;
+    void on_have_output() override;
+    void on_drain_complete() override;
 public:
     CComPtr<IMFMediaType> output_type;
 
@@ -120,7 +212,16 @@ public:
     ~transform_h264_encoder();
 
     bool is_encoder_overloading() const {return this->encoder_requests.load() == 0;}
+    // valid after initialize;
+    // the backends that don't use native textures consume the frames in system memory
+    // in the input format
+    bool uses_native_textures() const {return this->backend->uses_native_textures();}
+    h264_encoder_pixel_format get_input_format() const {return this->backend->get_input_format();}
+    h264_encoder_metrics get_metrics() const;
+    // returns the latest transitions of the degradation levels
+    std::vector<degradation_controller::event_t> get_degradation_events() const;
 
+    // initializes the transform with the media foundation backend;
     // passing null d3d device implies that the system memory is used to feed the encoder;
     // software encoder flag overrides d3d device arg;
     // quality_vs_speed: 0: low quality, 100: high quality;
@@ -135,6 +236,35 @@ public:
         DXGI_COLOR_SPACE_TYPE input_color_space,
         const CLSID*,
         bool software);
+    // the backend must be uninitialized
+    void initialize(const control_class_t&, const h264_encoder_backend_t&,
+        const h264_encoder_backend_params&);
+    // the number of requests that can be queued for a synchronous backend;
+    // 0 encodes the frames on the pipeline thread
+    void set_queue_depth(UINT32 depth) {this->queue_depth = depth;}
+    // must be called before initialize;
+    // gop size is in frames, 0 uses the default of the encoder
+    void set_gop(UINT32 gop_size, bool closed_gop);
+    // must be called before initialize;
+    // the threading of a software encoder;
+    // the worker threads are capped to the cores that are left after the
+    // reserved threads of the pipeline;
+    // 0 worker threads and 0 slices use the defaults of the encoder
+    void set_threading(UINT32 worker_threads, UINT32 slices, UINT32 reserved_threads);
+    // enables stepping down the encoding load when the encoder is overloaded;
+    // quality_vs_speed and frame decimation are the values of the quality and
+    // frame rate steps
+    void enable_degradation(const degradation_controller::params_t&,
+        UINT32 quality_vs_speed, UINT32 frame_decimation);
+    // must be called before the first frame;
+    // the unchanged frames are skipped for at most the max frame interval, in time units
+    void enable_vfr(time_unit max_frame_interval);
+    // the next frame is encoded as an idr frame;
+    // returns false if the encoder doesn't support forcing key frames
+    bool request_key_frame();
+    // changes the average bitrate of the running encoder;
+    // returns false if the backend doesn't support reconfiguration
+    bool reconfigure(UINT32 avg_bitrate);
     media_stream_t create_stream(media_message_generator_t&&);
 };
 
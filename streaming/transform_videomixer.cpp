@@ -6,15 +6,21 @@
 
 #define CHECK_HR(hr_) {if(FAILED(hr_)) [[unlikely]] {goto done;}}
 
+// the maximum number of disjoint dirty rects before they are merged to their bounds
+#define MAX_DIRTY_RECTS 8
+// the number of mixes after which an unused layer geometry or bitmap is evicted
+#define MAX_CACHE_AGE 8
+
 struct transform_videomixer::device_context_resources : media_buffer_texture
 {
-    bool drawing;
+    // the canvas of the cpu compositor
+    std::unique_ptr<BYTE[]> canvas;
     CComPtr<ID2D1DeviceContext> ctx;
     // the texture that is bound to this brush must be immutable;
     // it is assumed that the input samples are immutable
     CComPtr<ID2D1BitmapBrush1> bitmap_brush;
 
-    device_context_resources() : drawing(false) {}
+    device_context_resources() {}
     virtual ~device_context_resources() {}
     void uninitialize() {this->media_buffer_texture::uninitialize();}
 };
@@ -23,6 +29,10 @@ transform_videomixer::transform_videomixer(
     const media_session_t& session, context_mutex_t context_mutex) :
     transform_videomixer_base(session), 
     context_mutex(context_mutex), 
+    compositor(COMPOSITOR_D2D),
+    reused_frame_count(0),
+    geometry_cache_hits(0), geometry_cache_misses(0),
+    bitmap_cache_hits(0), bitmap_cache_misses(0),
     texture_pool(new buffer_pool),
     buffer_pool_video_frames(new buffer_pool_video_frames_t),
     buffer_pool_video_mixer_frames(new buffer_pool_video_mixer_frames_t)
@@ -51,7 +61,8 @@ void transform_videomixer::initialize(
     const CComPtr<ID2D1Factory1>& d2d1factory,
     const CComPtr<ID2D1Device>& d2d1dev,
     const CComPtr<ID3D11Device>& d3d11dev,
-    const CComPtr<ID3D11DeviceContext>& devctx)
+    const CComPtr<ID3D11DeviceContext>& devctx,
+    compositor_t compositor)
 {
     this->ctrl_pipeline = ctrl_pipeline;
     this->d3d11dev = d3d11dev;
@@ -60,6 +71,8 @@ void transform_videomixer::initialize(
     this->d2d1dev = d2d1dev;
     this->canvas_width = canvas_width;
     this->canvas_height = canvas_height;
+    this->compositor = compositor;
+    this->cpu_compositor.initialize();
 }
 
 transform_videomixer::stream_mixer_t transform_videomixer::create_derived_stream()
@@ -76,11 +89,12 @@ transform_videomixer::stream_mixer_t transform_videomixer::create_derived_stream
 
 stream_videomixer::stream_videomixer(const transform_videomixer_t& transform) :
     stream_mixer(transform),
-    transform(transform)
+    transform(transform),
+    mix_count(0)
 {
 }
 
-void stream_videomixer::initialize_texture(const media_buffer_texture_t& texture)
+D3D11_TEXTURE2D_DESC stream_videomixer::get_canvas_desc() const
 {
     D3D11_TEXTURE2D_DESC desc;
     desc.Width = this->transform->canvas_width;
@@ -94,7 +108,12 @@ void stream_videomixer::initialize_texture(const media_buffer_texture_t& texture
     desc.Usage = D3D11_USAGE_DEFAULT;
     desc.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
     desc.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
-    texture->initialize(this->transform->d3d11dev, desc, NULL);
+    return desc;
+}
+
+void stream_videomixer::initialize_texture(const media_buffer_texture_t& texture)
+{
+    texture->initialize(this->transform->d3d11dev, this->get_canvas_desc(), NULL);
 }
 
 void stream_videomixer::initialize_resources(const device_context_resources_t& resources)
@@ -125,10 +144,14 @@ done:
 
 stream_videomixer::device_context_resources_t stream_videomixer::acquire_buffer()
 {
+    // the cpu canvas of the resources has the size of the canvas texture,
+    // so that the key covers both of them
+    const buffer_pool_key key = media_buffer_texture::get_pool_key(this->get_canvas_desc());
+
     transform_videomixer::buffer_pool::scoped_lock lock(this->transform->texture_pool->mutex);
-    if(this->transform->texture_pool->is_empty())
+    if(this->transform->texture_pool->is_empty(key))
     {
-        device_context_resources_t resources = this->transform->texture_pool->acquire_buffer();
+        device_context_resources_t resources = this->transform->texture_pool->acquire_buffer(key);
         lock.unlock();
 
         this->initialize_resources(resources);
@@ -136,7 +159,7 @@ stream_videomixer::device_context_resources_t stream_videomixer::acquire_buffer(
     }
     else
     {
-        device_context_resources_t resources = this->transform->texture_pool->acquire_buffer();
+        device_context_resources_t resources = this->transform->texture_pool->acquire_buffer(key);
         lock.unlock();
 
         // common buffer pool objects must be initialized every time
@@ -146,6 +169,465 @@ stream_videomixer::device_context_resources_t stream_videomixer::acquire_buffer(
     }
 }
 
+void stream_videomixer::get_transforms(const params_t& params, const params_t& user_params,
+    D2D1::Matrix3x2F& world, D2D1::Matrix3x2F& brush)
+{
+    using namespace D2D1;
+    Matrix3x2F src_to_dest, src2_to_dest2;
+    bool invert;
+
+    // src_rect_m * M = dest_rect_m <=> M = src_rect_t -1 * dest_rect_m
+    src_to_dest = Matrix3x2F::Scale(
+        params.source_rect.right - params.source_rect.left,
+        params.source_rect.bottom - params.source_rect.top) *
+        Matrix3x2F::Translation(params.source_rect.left, params.source_rect.top);
+    invert = src_to_dest.Invert();
+    src_to_dest = src_to_dest * Matrix3x2F::Scale(
+        params.dest_rect.right - params.dest_rect.left,
+        params.dest_rect.bottom - params.dest_rect.top) *
+        Matrix3x2F::Translation(params.dest_rect.left, params.dest_rect.top) *
+        params.dest_m;
+
+    src2_to_dest2 = Matrix3x2F::Scale(
+        user_params.source_rect.right - user_params.source_rect.left,
+        user_params.source_rect.bottom - user_params.source_rect.top) *
+        Matrix3x2F::Translation(
+            user_params.source_rect.left, user_params.source_rect.top) *
+        user_params.source_m;
+    invert = src2_to_dest2.Invert();
+    src2_to_dest2 = src2_to_dest2 * Matrix3x2F::Scale(
+        user_params.dest_rect.right - user_params.dest_rect.left,
+        user_params.dest_rect.bottom - user_params.dest_rect.top) *
+        Matrix3x2F::Translation(user_params.dest_rect.left, user_params.dest_rect.top) *
+        user_params.dest_m;
+
+    world = src_to_dest * src2_to_dest2;
+    brush = params.source_m;
+}
+
+videomixer_cpu_layer stream_videomixer::get_cpu_layer(const layer_t& layer)
+{
+    videomixer_cpu_layer cpu_layer = {};
+    cpu_layer.source_rect = layer.params.source_rect;
+    cpu_layer.world = layer.geometry->world;
+    cpu_layer.brush = layer.geometry->brush;
+    cpu_layer.clip_rect = layer.user_params.dest_rect;
+    cpu_layer.clip_m = layer.user_params.dest_m;
+    cpu_layer.axis_aligned_clip = layer.user_params.axis_aligned_clip;
+    return cpu_layer;
+}
+
+stream_videomixer::layer_geometry_t stream_videomixer::create_geometry(
+    const params_t& params, const params_t& user_params) const
+{
+    layer_geometry_t geometry(new layer_geometry);
+    geometry->params_version = params.version;
+    geometry->user_params_version = user_params.version;
+    geometry->last_use = this->mix_count;
+    get_transforms(params, user_params, geometry->world, geometry->brush);
+
+    geometry->clip = geometry->world;
+    geometry->clip.Invert();
+    geometry->clip = user_params.dest_m * geometry->clip;
+
+    videomixer_cpu_layer cpu_layer = {};
+    cpu_layer.source_rect = params.source_rect;
+    cpu_layer.world = geometry->world;
+    cpu_layer.brush = geometry->brush;
+    cpu_layer.clip_rect = user_params.dest_rect;
+    cpu_layer.clip_m = user_params.dest_m;
+    cpu_layer.axis_aligned_clip = user_params.axis_aligned_clip;
+
+    // the bounds are extended by a pixel to cover the antialiased edges and
+    // the bilinear filtering
+    RECT& bounds = geometry->bounds;
+    const D2D1_RECT_F bounds_f = videomixer_cpu_compositor::get_bounds(cpu_layer);
+    bounds.left = std::max((LONG)std::floor(bounds_f.left) - 1, 0L);
+    bounds.top = std::max((LONG)std::floor(bounds_f.top) - 1, 0L);
+    bounds.right = std::min((LONG)std::ceil(bounds_f.right) + 1,
+        (LONG)this->transform->canvas_width);
+    bounds.bottom = std::min((LONG)std::ceil(bounds_f.bottom) + 1,
+        (LONG)this->transform->canvas_height);
+    if(bounds.left >= bounds.right || bounds.top >= bounds.bottom)
+        bounds = {0, 0, 0, 0};
+
+    return geometry;
+}
+
+stream_videomixer::layer_geometry_t stream_videomixer::get_geometry(
+    const params_t& params, const params_t& user_params)
+{
+    if(params.version && user_params.version)
+    {
+        for(const auto& geometry : this->geometry_cache)
+        {
+            if(geometry->params_version == params.version &&
+                geometry->user_params_version == user_params.version)
+            {
+                geometry->last_use = this->mix_count;
+                this->transform->geometry_cache_hits++;
+                return geometry;
+            }
+        }
+    }
+
+    this->transform->geometry_cache_misses++;
+
+    layer_geometry_t geometry = this->create_geometry(params, user_params);
+    if(params.version && user_params.version)
+        this->geometry_cache.push_back(geometry);
+
+    return geometry;
+}
+
+stream_videomixer::layer_t stream_videomixer::make_layer(const media_buffer_texture_t& buffer,
+    const params_t& params, const params_t& user_params)
+{
+    layer_t layer;
+    layer.buffer = buffer;
+    layer.params = params;
+    layer.user_params = user_params;
+    layer.geometry = this->get_geometry(params, user_params);
+
+    return layer;
+}
+
+HRESULT stream_videomixer::get_bitmap(const CComPtr<ID3D11Texture2D>& texture,
+    CComPtr<ID2D1Bitmap1>& bitmap)
+{
+    HRESULT hr = S_OK;
+    CComPtr<IDXGISurface> surface;
+
+    // the cached bitmap holds a reference to the texture, so that
+    // the texture identity isn't reused while the bitmap is cached
+    for(auto& item : this->bitmap_cache)
+    {
+        if(item.texture == texture)
+        {
+            item.last_use = this->mix_count;
+            bitmap = item.bitmap;
+            this->transform->bitmap_cache_hits++;
+            return hr;
+        }
+    }
+
+    this->transform->bitmap_cache_misses++;
+
+    CHECK_HR(hr = texture->QueryInterface(&surface));
+    CHECK_HR(hr = this->canvas->ctx->CreateBitmapFromDxgiSurface(
+        surface,
+        D2D1::BitmapProperties1(
+            D2D1_BITMAP_OPTIONS_NONE,
+            D2D1::PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)),
+        &bitmap));
+
+    this->bitmap_cache.push_back({texture, bitmap, this->mix_count});
+
+done:
+    return hr;
+}
+
+void stream_videomixer::evict_caches()
+{
+    auto is_old = [this](UINT64 last_use) { return this->mix_count - last_use > MAX_CACHE_AGE; };
+
+    this->geometry_cache.erase(std::remove_if(
+        this->geometry_cache.begin(), this->geometry_cache.end(),
+        [&](const layer_geometry_t& geometry) { return is_old(geometry->last_use); }),
+        this->geometry_cache.end());
+    this->bitmap_cache.erase(std::remove_if(
+        this->bitmap_cache.begin(), this->bitmap_cache.end(),
+        [&](const cached_bitmap& item) { return is_old(item.last_use); }),
+        this->bitmap_cache.end());
+}
+
+void stream_videomixer::get_dirty_rects(const layers_t& layers, dirty_rects_t& dirty_rects) const
+{
+    dirty_rects.clear();
+
+    // the whole canvas is dirty if there's no previous composite
+    if(!this->canvas)
+    {
+        dirty_rects.push_back({0, 0,
+            (LONG)this->transform->canvas_width, (LONG)this->transform->canvas_height});
+        return;
+    }
+
+    auto add_rect = [&](const RECT& rect)
+    {
+        if(!IsRectEmpty(&rect))
+            dirty_rects.push_back(rect);
+    };
+
+    // a layer is damaged if its buffer or params changed;
+    // new buffers are always damaged, while the padding frames repeat the previous buffer
+    const size_t layer_count = std::max(layers.size(), this->canvas_layers.size());
+    for(size_t i = 0; i < layer_count; i++)
+    {
+        const layer_t* old_layer = (i < this->canvas_layers.size()) ? &this->canvas_layers[i] : NULL;
+        const layer_t* new_layer = (i < layers.size()) ? &layers[i] : NULL;
+
+        if(old_layer && new_layer && old_layer->buffer == new_layer->buffer &&
+            old_layer->params == new_layer->params &&
+            old_layer->user_params == new_layer->user_params)
+            continue;
+
+        if(old_layer)
+            add_rect(old_layer->geometry->bounds);
+        if(new_layer)
+            add_rect(new_layer->geometry->bounds);
+    }
+
+    merge_dirty_rects(dirty_rects);
+}
+
+void stream_videomixer::merge_dirty_rects(dirty_rects_t& dirty_rects)
+{
+    // merge the overlapping rects so that every pixel is composited once
+    for(bool merged = true; merged;)
+    {
+        merged = false;
+        for(size_t i = 0; i < dirty_rects.size() && !merged; i++)
+            for(size_t j = i + 1; j < dirty_rects.size() && !merged; j++)
+            {
+                RECT intersection;
+                if(IntersectRect(&intersection, &dirty_rects[i], &dirty_rects[j]))
+                {
+                    UnionRect(&dirty_rects[i], &dirty_rects[i], &dirty_rects[j]);
+                    dirty_rects.erase(dirty_rects.begin() + j);
+                    merged = true;
+                }
+            }
+    }
+
+    if(dirty_rects.size() > MAX_DIRTY_RECTS)
+    {
+        RECT bounds = dirty_rects[0];
+        for(const auto& rect : dirty_rects)
+            UnionRect(&bounds, &bounds, &rect);
+        dirty_rects.assign(1, bounds);
+    }
+}
+
+HRESULT stream_videomixer::compose(const layers_t& layers, const dirty_rects_t& dirty_rects)
+{
+    HRESULT hr = S_OK;
+
+    if(!this->canvas)
+        this->canvas = this->acquire_buffer();
+
+    CHECK_HR(hr = (this->transform->compositor == transform_videomixer::COMPOSITOR_CPU) ?
+        this->compose_cpu(layers, dirty_rects) : this->compose_d2d(layers, dirty_rects));
+
+    this->canvas_layers = layers;
+
+done:
+    if(FAILED(hr))
+    {
+        // the canvas is fully recomposited on the next call
+        this->canvas = NULL;
+        this->canvas_layers.clear();
+        this->last_frame = NULL;
+        // the bitmaps are recreated for the new canvas
+        this->bitmap_cache.clear();
+    }
+
+    return hr;
+}
+
+HRESULT stream_videomixer::compose_d2d(const layers_t& layers, const dirty_rects_t& dirty_rects)
+{
+    HRESULT hr = S_OK;
+    const CComPtr<ID2D1DeviceContext>& ctx = this->canvas->ctx;
+
+    ctx->BeginDraw();
+    ctx->SetTarget(this->canvas->bitmap);
+
+    for(const auto& rect : dirty_rects)
+    {
+        ctx->SetTransform(D2D1::Matrix3x2F::Identity());
+        ctx->PushAxisAlignedClip(
+            D2D1::RectF((FLOAT)rect.left, (FLOAT)rect.top, (FLOAT)rect.right, (FLOAT)rect.bottom),
+            D2D1_ANTIALIAS_MODE_ALIASED);
+        ctx->Clear(D2D1::ColorF(D2D1::ColorF::Black));
+
+        for(const auto& layer : layers)
+        {
+            RECT intersection;
+            if(IntersectRect(&intersection, &layer.geometry->bounds, &rect))
+                if(FAILED(hr = this->draw_d2d(layer)))
+                    break;
+        }
+
+        ctx->PopAxisAlignedClip();
+        CHECK_HR(hr);
+    }
+
+done:
+    const HRESULT hr2 = ctx->EndDraw();
+    return FAILED(hr) ? hr : hr2;
+}
+
+HRESULT stream_videomixer::compose_cpu(const layers_t& layers, const dirty_rects_t& dirty_rects)
+{
+    HRESULT hr = S_OK;
+    const videomixer_cpu_image canvas = this->get_canvas();
+    std::vector<videomixer_cpu_layer> cpu_layers;
+
+    for(const auto& layer : layers)
+    {
+        bool damaged = false;
+        RECT intersection;
+        for(const auto& rect : dirty_rects)
+            damaged = damaged || IntersectRect(&intersection, &layer.geometry->bounds, &rect);
+        if(!damaged)
+            continue;
+
+        // the layer is composited from a staging copy of the texture
+        videomixer_cpu_layer cpu_layer = get_cpu_layer(layer);
+        if(FAILED(hr = this->map_texture(layer.buffer->texture, cpu_layers.size(),
+            cpu_layer.source)))
+        {
+            this->unmap_textures(cpu_layers.size());
+            goto done;
+        }
+
+        cpu_layers.push_back(cpu_layer);
+    }
+
+    // the dirty rects are disjoint
+    this->transform->cpu_compositor.compose(canvas, cpu_layers, dirty_rects);
+    this->unmap_textures(cpu_layers.size());
+
+    // upload the dirty rects to the canvas texture
+    {
+        std::lock_guard<std::recursive_mutex> lock(*this->transform->context_mutex);
+        for(const auto& rect : dirty_rects)
+        {
+            const D3D11_BOX box = {(UINT)rect.left, (UINT)rect.top, 0,
+                (UINT)rect.right, (UINT)rect.bottom, 1};
+            this->transform->d3d11devctx->UpdateSubresource(this->canvas->texture, 0, &box,
+                canvas.data + (size_t)rect.top * canvas.pitch + (size_t)rect.left * 4,
+                canvas.pitch, 0);
+        }
+    }
+
+done:
+    return hr;
+}
+
+videomixer_cpu_image stream_videomixer::get_canvas()
+{
+    const UINT32 pitch = this->transform->canvas_width * 4;
+    if(!this->canvas->canvas)
+        this->canvas->canvas.reset(new BYTE[(size_t)pitch * this->transform->canvas_height]);
+
+    return {this->canvas->canvas.get(),
+        this->transform->canvas_width, this->transform->canvas_height, pitch};
+}
+
+HRESULT stream_videomixer::draw_d2d(const layer_t& layer_)
+{
+    using namespace D2D1;
+    HRESULT hr = S_OK;
+    const device_context_resources_t& frame = this->canvas;
+    const params_t& params = layer_.params;
+    const params_t& user_params = layer_.user_params;
+    const layer_geometry_t& geometry = layer_.geometry;
+    CComPtr<ID2D1Bitmap1> bitmap;
+
+    CHECK_HR(hr = this->get_bitmap(layer_.buffer->texture, bitmap));
+
+    frame->bitmap_brush->SetBitmap(bitmap);
+    /*frame->bitmap_brush->SetInterpolationMode1(D2D1_INTERPOLATION_MODE_HIGH_QUALITY_CUBIC);*/
+    frame->bitmap_brush->SetTransform(geometry->brush);
+
+    if(!user_params.axis_aligned_clip)
+    {
+        if(!geometry->clip_geometry)
+            CHECK_HR(hr = this->transform->d2d1factory->CreateRectangleGeometry(
+                user_params.dest_rect, &geometry->clip_geometry));
+
+        const D2D1_LAYER_PARAMETERS1 layer_params = LayerParameters1(
+            InfiniteRect(), geometry->clip_geometry, D2D1_ANTIALIAS_MODE_PER_PRIMITIVE,
+            geometry->clip);
+
+        frame->ctx->SetTransform(geometry->world);
+        frame->ctx->PushLayer(layer_params, NULL);
+    }
+    else
+    {
+        frame->ctx->SetTransform(user_params.dest_m);
+        // the world transform is applied to the axis aligned clip when push is called
+        frame->ctx->PushAxisAlignedClip(
+            user_params.dest_rect,
+            D2D1_ANTIALIAS_MODE_PER_PRIMITIVE);
+
+        frame->ctx->SetTransform(geometry->world);
+    }
+
+    frame->ctx->FillRectangle(params.source_rect, frame->bitmap_brush);
+
+    if(!user_params.axis_aligned_clip)
+        frame->ctx->PopLayer();
+    else
+        frame->ctx->PopAxisAlignedClip();
+
+done:
+    return hr;
+}
+
+HRESULT stream_videomixer::map_texture(const CComPtr<ID3D11Texture2D>& texture,
+    size_t index, videomixer_cpu_image& image)
+{
+    HRESULT hr = S_OK;
+    D3D11_TEXTURE2D_DESC desc;
+    D3D11_MAPPED_SUBRESOURCE mapped;
+
+    texture->GetDesc(&desc);
+
+    if(this->staging_textures.size() <= index)
+        this->staging_textures.resize(index + 1);
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(*this->transform->context_mutex);
+        CComPtr<ID3D11Texture2D>& staging_texture = this->staging_textures[index];
+
+        D3D11_TEXTURE2D_DESC staging_desc = {0};
+        if(staging_texture)
+            staging_texture->GetDesc(&staging_desc);
+        if(!staging_texture || staging_desc.Width != desc.Width ||
+            staging_desc.Height != desc.Height || staging_desc.Format != desc.Format)
+        {
+            staging_texture = NULL;
+
+            staging_desc = desc;
+            staging_desc.Usage = D3D11_USAGE_STAGING;
+            staging_desc.BindFlags = 0;
+            staging_desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+            staging_desc.MiscFlags = 0;
+            CHECK_HR(hr = this->transform->d3d11dev->CreateTexture2D(
+                &staging_desc, NULL, &staging_texture));
+        }
+
+        this->transform->d3d11devctx->CopyResource(staging_texture, texture);
+        CHECK_HR(hr = this->transform->d3d11devctx->Map(
+            staging_texture, 0, D3D11_MAP_READ, 0, &mapped));
+    }
+
+    image = {(BYTE*)mapped.pData, desc.Width, desc.Height, mapped.RowPitch};
+
+done:
+    return hr;
+}
+
+void stream_videomixer::unmap_textures(size_t count)
+{
+    std::lock_guard<std::recursive_mutex> lock(*this->transform->context_mutex);
+    for(size_t i = 0; i < count; i++)
+        this->transform->d3d11devctx->Unmap(this->staging_textures[i], 0);
+}
+
 bool stream_videomixer::move_frames(in_arg_t& to, in_arg_t& from, const in_arg_t& reference,
     frame_unit end, bool discarded)
 {
@@ -231,6 +713,8 @@ void stream_videomixer::mix(out_arg_t& out_arg, args_t& packets,
     const frame_unit frame_count = end - first;
     assert_(frame_count > 0);
 
+    this->mix_count++;
+
     // limit the processing videomixer does in a single take;
     // this greatly reduces the amount of vram being allocated when the pipeline is overloaded
     constexpr size_t maximum_frame_count = 1;
@@ -273,8 +757,14 @@ void stream_videomixer::mix(out_arg_t& out_arg, args_t& packets,
     // TODO: the end of samples in case if the sample is empty should be properly defined
 
     media_sample_video_frames_t sample;
-
-    // draw
+    // the layers of each frame in z order;
+    // a frame is drawn only if it is allowed
+    std::vector<layers_t> frame_layers((size_t)frame_count);
+    std::vector<bool> frame_allowed((size_t)frame_count, false);
+    // the dirty rects of the sample are the union of the dirty rects of its frames
+    dirty_rects_t dirty_rects, sample_dirty_rects;
+
+    // collect the layers
     for(auto&& item : packets.container)
     {
         // stream_mixer::process might create empty args and samples
@@ -311,136 +801,56 @@ void stream_videomixer::mix(out_arg_t& out_arg, args_t& packets,
                     continue;
 
                 const size_t index = (size_t)(pos - first);
-                device_context_resources_t frame =
-                    std::static_pointer_cast<transform_videomixer::device_context_resources>(
-                        frames[index].buffer);
-                if(!frame)
-                {
-                    frame = this->acquire_buffer();
-                    frames[index].buffer = frame;
-
-                    frame->ctx->BeginDraw();
-                    frame->drawing = true;
-                    frame->ctx->SetTarget(frame->bitmap);
-                    frame->ctx->Clear(D2D1::ColorF(D2D1::ColorF::Black));
-                }
+                frame_allowed[index] = true;
 
                 if(frame_.buffer)
                 {
-                    CComPtr<ID3D11Texture2D> texture = frame_.buffer->texture;
                     // params is valid only when the frame stores a non silent buffer
                     const auto& params = frame_.params;
                     const auto& user_params = item.valid_user_params ? item.user_params : params;
 
-                    /////////////////////////////////////////////////////////////////
-                    /////////////////////////////////////////////////////////////////
-                    /////////////////////////////////////////////////////////////////
-
-                    // TODO: cache geometry
-
-                    using namespace D2D1;
-                    CComPtr<ID2D1Bitmap1> bitmap;
-                    CComPtr<IDXGISurface> surface;
-                    Matrix3x2F src_to_dest, src2_to_dest2;
-                    Matrix3x2F world, brush;
-                    bool invert;
-
-                    // src_rect_m * M = dest_rect_m <=> M = src_rect_t -1 * dest_rect_m
-                    src_to_dest = Matrix3x2F::Scale(
-                        params.source_rect.right - params.source_rect.left,
-                        params.source_rect.bottom - params.source_rect.top) *
-                        Matrix3x2F::Translation(params.source_rect.left, params.source_rect.top);
-                    invert = src_to_dest.Invert();
-                    src_to_dest = src_to_dest * Matrix3x2F::Scale(
-                        params.dest_rect.right - params.dest_rect.left,
-                        params.dest_rect.bottom - params.dest_rect.top) *
-                        Matrix3x2F::Translation(params.dest_rect.left, params.dest_rect.top) *
-                        params.dest_m;
-
-                    src2_to_dest2 = Matrix3x2F::Scale(
-                        user_params.source_rect.right - user_params.source_rect.left,
-                        user_params.source_rect.bottom - user_params.source_rect.top) *
-                        Matrix3x2F::Translation(
-                            user_params.source_rect.left, user_params.source_rect.top) *
-                        user_params.source_m;
-                    invert = src2_to_dest2.Invert();
-                    src2_to_dest2 = src2_to_dest2 * Matrix3x2F::Scale(
-                        user_params.dest_rect.right - user_params.dest_rect.left,
-                        user_params.dest_rect.bottom - user_params.dest_rect.top) *
-                        Matrix3x2F::Translation(user_params.dest_rect.left, user_params.dest_rect.top) *
-                        user_params.dest_m;
-
-                    world = src_to_dest * src2_to_dest2;
-                    brush = params.source_m;
-
-                    CHECK_HR(hr = texture->QueryInterface(&surface));
-                    CHECK_HR(hr = frame->ctx->CreateBitmapFromDxgiSurface(
-                        surface,
-                        BitmapProperties1(
-                            D2D1_BITMAP_OPTIONS_NONE,
-                            PixelFormat(DXGI_FORMAT_B8G8R8A8_UNORM, D2D1_ALPHA_MODE_PREMULTIPLIED)),
-                        &bitmap));
-
-                    frame->bitmap_brush->SetBitmap(bitmap);
-                    /*frame->bitmap_brush->SetInterpolationMode1(D2D1_INTERPOLATION_MODE_HIGH_QUALITY_CUBIC);*/
-                    frame->bitmap_brush->SetTransform(brush);
-
-                    if(!user_params.axis_aligned_clip)
-                    {
-                        CComPtr<ID2D1RectangleGeometry> geometry;
-                        D2D1_LAYER_PARAMETERS1 layer_params;
-                        Matrix3x2F world_inverted, layer;
-
-                        world_inverted = world;
-                        invert = world_inverted.Invert();
-                        layer = user_params.dest_m * world_inverted;
-
-                        CHECK_HR(hr = this->transform->d2d1factory->CreateRectangleGeometry(
-                            user_params.dest_rect, &geometry));
-                        layer_params = LayerParameters1(
-                            InfiniteRect(), geometry, D2D1_ANTIALIAS_MODE_PER_PRIMITIVE, layer);
-
-                        frame->ctx->SetTransform(world);
-                        frame->ctx->PushLayer(layer_params, NULL);
-                    }
-                    else
-                    {
-                        frame->ctx->SetTransform(user_params.dest_m);
-                        // the world transform is applied to the axis aligned clip when push is called
-                        frame->ctx->PushAxisAlignedClip(
-                            user_params.dest_rect,
-                            D2D1_ANTIALIAS_MODE_PER_PRIMITIVE);
-
-                        frame->ctx->SetTransform(world);
-                    }
-
-                    frame->ctx->FillRectangle(params.source_rect, frame->bitmap_brush);
-
-                    if(!user_params.axis_aligned_clip)
-                        frame->ctx->PopLayer();
-                    else
-                        frame->ctx->PopAxisAlignedClip();
+                    frame_layers[index].push_back(
+                        this->make_layer(frame_.buffer, params, user_params));
                 }
             }
         }
     }
 
-done:
-    // call end draw for every frame
-    for(frame_unit i = 0; i < frame_count; i++)
+    // draw;
+    // only the damaged regions of the persistent canvas are recomposited and
+    // the output frames are copied from the canvas
+    for(size_t i = 0; i < frame_layers.size(); i++)
     {
-        device_context_resources_t frame =
-            std::static_pointer_cast<transform_videomixer::device_context_resources>(
-                frames[(size_t)i].buffer);
-        if(frame && frame->drawing)
+        if(!frame_allowed[i])
+            continue;
+
+        this->get_dirty_rects(frame_layers[i], dirty_rects);
+
+        // the scene is static;
+        // the previous composite is forwarded instead of drawing and copying a new one
+        if(dirty_rects.empty() && this->last_frame)
         {
-            frame->drawing = false;
-            const HRESULT hr2 = frame->ctx->EndDraw();
-            if(FAILED(hr2) && hr == S_OK)
-                hr = hr2;
+            frames[i].buffer = this->last_frame;
+            this->transform->reused_frame_count++;
+            continue;
         }
+
+        CHECK_HR(hr = this->compose(frame_layers[i], dirty_rects));
+
+        sample_dirty_rects.insert(sample_dirty_rects.end(),
+            dirty_rects.begin(), dirty_rects.end());
+        merge_dirty_rects(sample_dirty_rects);
+
+        this->last_frame = this->acquire_buffer();
+        {
+            std::lock_guard<std::recursive_mutex> lock(*this->transform->context_mutex);
+            this->transform->d3d11devctx->CopyResource(
+                this->last_frame->texture, this->canvas->texture);
+        }
+        frames[i].buffer = this->last_frame;
     }
 
+done:
     if(FAILED(hr))
     {
         if(hr != D2DERR_RECREATE_TARGET)
@@ -464,6 +874,9 @@ done:
         out_arg = std::make_optional<out_arg_t::value_type>();
         out_arg->sample = std::move(sample);
         out_arg->has_frames = has_frames;
+        out_arg->dirty_rects = std::move(sample_dirty_rects);
+
+        this->evict_caches();
     }
 }
 
@@ -479,8 +892,33 @@ void stream_videomixer_controller::get_params(params_t& params) const
     params = this->params;
 }
 
+std::atomic<UINT64> stream_videomixer_controller::last_version(0);
+
 void stream_videomixer_controller::set_params(const params_t& params)
 {
     scoped_lock lock(this->mutex);
-    this->params = params;
+
+    // the new params are compared by value because the version of the new params
+    // might have been copied from the current params;
+    // the version is kept if the params didn't change
+    params_t new_params = params;
+    new_params.version = 0;
+    if(this->params.version && this->params == new_params)
+        return;
+
+    this->params = new_params;
+    this->params.version = ++last_version;
+}
+
+bool stream_videomixer_controller::params_t::operator==(const params_t& other) const
+{
+    // equal versions imply equal params
+    if(this->version && this->version == other.version)
+        return true;
+
+    return memcmp(&this->source_rect, &other.source_rect, sizeof(D2D1_RECT_F)) == 0 &&
+        memcmp(&this->dest_rect, &other.dest_rect, sizeof(D2D1_RECT_F)) == 0 &&
+        memcmp(&this->source_m, &other.source_m, sizeof(D2D1::Matrix3x2F)) == 0 &&
+        memcmp(&this->dest_m, &other.dest_m, sizeof(D2D1::Matrix3x2F)) == 0 &&
+        this->axis_aligned_clip == other.axis_aligned_clip;
 }
\ No newline at end of file
@@ -2,12 +2,14 @@
 
 #include "transform_mixer.h"
 #include "control_class.h"
+#include "videomixer_cpu_compositor.h"
 #include <d3d11.h>
 #include <d2d1_1.h>
 #include <dxgi1_2.h>
 #include <atlbase.h>
 #include <memory>
 #include <mutex>
+#include <atomic>
 #include <vector>
 
 #pragma comment(lib, "D2d1.lib")
@@ -28,8 +30,17 @@ public:
         D2D1::Matrix3x2F source_m, dest_m;
         // only for the user dest param
         bool axis_aligned_clip;
+        // assigned by set_params;
+        // the version is unique across the controllers and changes only when the params
+        // change, so that the state derived from the params can be cached by the version;
+        // 0 is unversioned
+        UINT64 version = 0;
+
+        bool operator==(const params_t&) const;
     };
 private:
+    static std::atomic<UINT64> last_version;
+
     mutable std::mutex mutex;
     params_t params;
 public:
@@ -82,10 +93,25 @@ public:
     typedef buffer_pool<media_sample_video_frames_pooled> buffer_pool_video_frames_t;
     typedef buffer_pool<media_sample_video_mixer_frames_pooled> buffer_pool_video_mixer_frames_t;
     typedef buffer_pool<device_context_resources_pooled> buffer_pool;
+    // the compositor cpu backend reads the input textures back to system memory and
+    // uploads the composited canvas to the output texture
+    enum compositor_t : int
+    {
+        COMPOSITOR_D2D,
+        COMPOSITOR_CPU
+    };
 private:
     control_class_t ctrl_pipeline;
     context_mutex_t context_mutex;
     UINT32 canvas_width, canvas_height;
+    compositor_t compositor;
+    videomixer_cpu_compositor cpu_compositor;
+    // the number of frames that forwarded the previous composite because
+    // the scene didn't change
+    std::atomic<frame_unit> reused_frame_count;
+    // the hit counts of the layer geometry and bitmap caches of the streams
+    std::atomic<UINT64> geometry_cache_hits, geometry_cache_misses;
+    std::atomic<UINT64> bitmap_cache_hits, bitmap_cache_misses;
 
     std::shared_ptr<buffer_pool> texture_pool;
     std::shared_ptr<buffer_pool_video_frames_t> buffer_pool_video_frames;
@@ -103,6 +129,11 @@ public:
 
     void get_canvas_size(UINT32& width, UINT32& height) const
     { width = this->canvas_width; height = this->canvas_height; }
+    frame_unit get_reused_frame_count() const {return this->reused_frame_count;}
+    void get_geometry_cache_stats(UINT64& hits, UINT64& misses) const
+    { hits = this->geometry_cache_hits; misses = this->geometry_cache_misses; }
+    void get_bitmap_cache_stats(UINT64& hits, UINT64& misses) const
+    { hits = this->bitmap_cache_hits; misses = this->bitmap_cache_misses; }
 
     void initialize(
         const control_class_t&,
@@ -110,7 +141,8 @@ public:
         const CComPtr<ID2D1Factory1>&,
         const CComPtr<ID2D1Device>&,
         const CComPtr<ID3D11Device>&,
-        const CComPtr<ID3D11DeviceContext>&);
+        const CComPtr<ID3D11DeviceContext>&,
+        compositor_t compositor = COMPOSITOR_D2D);
 };
 
 typedef std::shared_ptr<transform_videomixer> transform_videomixer_t;
@@ -119,12 +151,95 @@ class stream_videomixer final : public stream_videomixer_base
 {
 private:
     typedef transform_videomixer::device_context_resources_t device_context_resources_t;
+    typedef stream_videomixer_controller::params_t params_t;
+    typedef std::vector<RECT> dirty_rects_t;
+    // the state that is derived from the params of a layer;
+    // cached by the params versions and shared between the frames
+    struct layer_geometry
+    {
+        UINT64 params_version, user_params_version;
+        // the mix count of the last use
+        UINT64 last_use;
+        // world maps the source rect to the canvas and brush maps the texture to the brush space
+        D2D1::Matrix3x2F world, brush;
+        // the layer transform of the non axis aligned clip
+        D2D1::Matrix3x2F clip;
+        // created on first use by the direct2d compositor
+        CComPtr<ID2D1RectangleGeometry> clip_geometry;
+        // the canvas area that the layer covers
+        RECT bounds;
+    };
+    typedef std::shared_ptr<layer_geometry> layer_geometry_t;
+    struct layer_t
+    {
+        media_buffer_texture_t buffer;
+        params_t params, user_params;
+        layer_geometry_t geometry;
+    };
+    typedef std::vector<layer_t> layers_t;
+    // the direct2d bitmap of an input texture;
+    // the input textures are recycled by the source buffer pools, so that
+    // the bitmaps are reused
+    struct cached_bitmap
+    {
+        CComPtr<ID3D11Texture2D> texture;
+        CComPtr<ID2D1Bitmap1> bitmap;
+        UINT64 last_use;
+    };
+
     transform_videomixer_t transform;
 
+    // the persistent composite that the output frames are copied from
+    device_context_resources_t canvas;
+    // the layers that the canvas was composited from;
+    // the buffers are held so that an unchanged buffer identity implies unchanged content
+    layers_t canvas_layers;
+    // the output frame that was copied from the canvas last;
+    // it is forwarded as is if the canvas isn't damaged
+    device_context_resources_t last_frame;
+    // the input textures are copied to these textures for the cpu compositor;
+    // the damaged layers are mapped at the same time, so that the canvas can be composed
+    // in parallel tiles
+    std::vector<CComPtr<ID3D11Texture2D>> staging_textures;
+    // the cache entries that haven't been used in a while are evicted
+    std::vector<layer_geometry_t> geometry_cache;
+    std::vector<cached_bitmap> bitmap_cache;
+    UINT64 mix_count;
+
+    D3D11_TEXTURE2D_DESC get_canvas_desc() const;
     void initialize_texture(const media_buffer_texture_t&);
     void initialize_resources(const device_context_resources_t& resources);
     device_context_resources_t acquire_buffer();
 
+    // world maps the source rect to the canvas and brush maps the texture to the brush space
+    static void get_transforms(const params_t& params, const params_t& user_params,
+        D2D1::Matrix3x2F& world, D2D1::Matrix3x2F& brush);
+    // the source image of the returned layer is not set
+    static videomixer_cpu_layer get_cpu_layer(const layer_t&);
+    layer_geometry_t create_geometry(const params_t& params, const params_t& user_params) const;
+    // returns the cached geometry if both of the params are versioned
+    layer_geometry_t get_geometry(const params_t& params, const params_t& user_params);
+    layer_t make_layer(const media_buffer_texture_t&,
+        const params_t& params, const params_t& user_params);
+    HRESULT get_bitmap(const CComPtr<ID3D11Texture2D>&, CComPtr<ID2D1Bitmap1>&);
+    void evict_caches();
+
+    // returns the disjoint canvas regions that differ between the canvas and the layers
+    void get_dirty_rects(const layers_t&, dirty_rects_t&) const;
+    // merges the overlapping rects and collapses them to their bounds if there are too many
+    static void merge_dirty_rects(dirty_rects_t&);
+    // recomposites the dirty rects of the canvas
+    HRESULT compose(const layers_t&, const dirty_rects_t&);
+    HRESULT compose_d2d(const layers_t&, const dirty_rects_t&);
+    HRESULT compose_cpu(const layers_t&, const dirty_rects_t&);
+    HRESULT draw_d2d(const layer_t&);
+    // allocates the cpu canvas on first use
+    videomixer_cpu_image get_canvas();
+    // maps a copy of the texture to the staging texture at index
+    HRESULT map_texture(const CComPtr<ID3D11Texture2D>&, size_t index, videomixer_cpu_image&);
+    // unmaps the staging textures [0, count)
+    void unmap_textures(size_t count);
+
     bool move_frames(in_arg_t& to, in_arg_t& from, const in_arg_t& reference,
         frame_unit end, bool discarded) override;
     void mix(out_arg_t& out_arg, args_t&, frame_unit first, frame_unit end) override;
@@ -0,0 +1,393 @@
+#include "videomixer_cpu_compositor.h"
+#include <algorithm>
+#include <execution>
+#include <vector>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#define VIDEOMIXER_CPU_COMPOSITOR_SSE2
+#include <emmintrin.h>
+#endif
+
+#undef min
+#undef max
+
+namespace
+{
+
+// opaque black
+constexpr UINT32 clear_color = 0xFF000000;
+
+struct bounds_t
+{
+    float left, top, right, bottom;
+};
+
+bounds_t get_bounds(const D2D1_RECT_F& rect, const D2D1::Matrix3x2F& m)
+{
+    const D2D1_POINT_2F corners[] =
+    {
+        m.TransformPoint(D2D1::Point2F(rect.left, rect.top)),
+        m.TransformPoint(D2D1::Point2F(rect.right, rect.top)),
+        m.TransformPoint(D2D1::Point2F(rect.left, rect.bottom)),
+        m.TransformPoint(D2D1::Point2F(rect.right, rect.bottom)),
+    };
+
+    bounds_t bounds = {corners[0].x, corners[0].y, corners[0].x, corners[0].y};
+    for(const auto& corner : corners)
+    {
+        bounds.left = std::min(bounds.left, corner.x);
+        bounds.top = std::min(bounds.top, corner.y);
+        bounds.right = std::max(bounds.right, corner.x);
+        bounds.bottom = std::max(bounds.bottom, corner.y);
+    }
+
+    return bounds;
+}
+
+int to_fixed(float f)
+{
+    return (int)std::floor(f * 65536.f);
+}
+
+// narrows [begin, end) to the steps k for which lo <= v + k * dv < hi
+void clip_span(float v, float dv, float lo, float hi, int& begin, int& end)
+{
+    if(dv == 0.f)
+    {
+        if(v < lo || v >= hi)
+            end = begin;
+        return;
+    }
+
+    float first = (lo - v) / dv, last = (hi - v) / dv;
+    if(dv < 0.f)
+        std::swap(first, last);
+
+    begin = std::max(begin, (int)std::ceil(std::max(first, -1.f)));
+    end = std::min(end, (int)std::ceil(std::min(last, (float)end)));
+    end = std::max(begin, end);
+}
+
+// the sampling is clamped to the edges of the image, like the default extend mode of
+// the bitmap brush
+UINT32 fetch(const videomixer_cpu_image& image, int x, int y)
+{
+    x = std::clamp(x, 0, (int)image.width - 1);
+    y = std::clamp(y, 0, (int)image.height - 1);
+    return *(const UINT32*)(image.data + (size_t)y * image.pitch + (size_t)x * 4);
+}
+
+// fetches the 2x2 texels at (x, y)
+void fetch_quad(const videomixer_cpu_image& image, int x, int y, UINT32 (&texels)[4])
+{
+    if(x >= 0 && y >= 0 && x + 1 < (int)image.width && y + 1 < (int)image.height)
+    {
+        const UINT32* row0 = (const UINT32*)(image.data + (size_t)y * image.pitch) + x;
+        const UINT32* row1 = (const UINT32*)((const BYTE*)row0 + image.pitch);
+        texels[0] = row0[0]; texels[1] = row0[1];
+        texels[2] = row1[0]; texels[3] = row1[1];
+    }
+    else
+    {
+        texels[0] = fetch(image, x, y); texels[1] = fetch(image, x + 1, y);
+        texels[2] = fetch(image, x, y + 1); texels[3] = fetch(image, x + 1, y + 1);
+    }
+}
+
+// interpolates the texels bilinearly by the weights fx / 256 and fy / 256 and
+// blends the premultiplied sample over dst
+#ifdef VIDEOMIXER_CPU_COMPOSITOR_SSE2
+void blend(UINT32* dst, const UINT32 (&texels)[4], int fx, int fy)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i wx = _mm_unpacklo_epi64(
+        _mm_set1_epi16((short)(256 - fx)), _mm_set1_epi16((short)fx));
+
+    // the weighted sums fit in unsigned 16 bits because the weights sum to 256
+    __m128i row0 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(
+        _mm_cvtsi32_si128((int)texels[0]), _mm_cvtsi32_si128((int)texels[1])), zero);
+    __m128i row1 = _mm_unpacklo_epi8(_mm_unpacklo_epi32(
+        _mm_cvtsi32_si128((int)texels[2]), _mm_cvtsi32_si128((int)texels[3])), zero);
+    row0 = _mm_mullo_epi16(row0, wx);
+    row1 = _mm_mullo_epi16(row1, wx);
+    row0 = _mm_srli_epi16(_mm_add_epi16(row0, _mm_srli_si128(row0, 8)), 8);
+    row1 = _mm_srli_epi16(_mm_add_epi16(row1, _mm_srli_si128(row1, 8)), 8);
+
+    __m128i src = _mm_add_epi16(
+        _mm_mullo_epi16(row0, _mm_set1_epi16((short)(256 - fy))),
+        _mm_mullo_epi16(row1, _mm_set1_epi16((short)fy)));
+    src = _mm_srli_epi16(src, 8);
+
+    // dst = src + dst * (255 - src.a) / 255
+    const __m128i inv_alpha = _mm_sub_epi16(
+        _mm_set1_epi16(255), _mm_shufflelo_epi16(src, _MM_SHUFFLE(3, 3, 3, 3)));
+    __m128i d = _mm_unpacklo_epi8(_mm_cvtsi32_si128((int)*dst), zero);
+    d = _mm_add_epi16(_mm_mullo_epi16(d, inv_alpha), _mm_set1_epi16(128));
+    d = _mm_srli_epi16(_mm_add_epi16(d, _mm_srli_epi16(d, 8)), 8);
+
+    const __m128i out = _mm_add_epi16(src, d);
+    *dst = (UINT32)_mm_cvtsi128_si32(_mm_packus_epi16(out, out));
+}
+#else
+void blend(UINT32* dst, const UINT32 (&texels)[4], int fx, int fy)
+{
+    const UINT32 p00 = texels[0], p01 = texels[1], p10 = texels[2], p11 = texels[3];
+
+    UINT32 src[4];
+    for(int c = 0; c < 4; c++)
+    {
+        const int shift = c * 8;
+        const UINT32 top = (((p00 >> shift) & 0xFF) * (256 - fx) +
+            ((p01 >> shift) & 0xFF) * fx) >> 8;
+        const UINT32 bottom = (((p10 >> shift) & 0xFF) * (256 - fx) +
+            ((p11 >> shift) & 0xFF) * fx) >> 8;
+        src[c] = (top * (256 - fy) + bottom * fy) >> 8;
+    }
+
+    const UINT32 inv_alpha = 255 - src[3];
+    UINT32 out = 0;
+    for(int c = 0; c < 4; c++)
+    {
+        const int shift = c * 8;
+        UINT32 d = ((*dst >> shift) & 0xFF) * inv_alpha + 128;
+        d = (d + (d >> 8)) >> 8;
+        out |= std::min(src[c] + d, 255u) << shift;
+    }
+
+    *dst = out;
+}
+#endif
+
+// the per layer state that is shared by the bands and the tiles
+struct prepared_layer
+{
+    const videomixer_cpu_layer* layer;
+    D2D1::Matrix3x2F canvas_to_brush, canvas_to_source, canvas_to_clip;
+    bounds_t clip_bounds;
+    // the drawn pixels, limited to the target
+    RECT rect;
+};
+
+// returns false if the layer produces no output
+bool prepare_layer(const videomixer_cpu_image& target, const videomixer_cpu_layer& layer,
+    prepared_layer& prepared)
+{
+    D2D1::Matrix3x2F brush_to_source = layer.brush;
+    prepared.layer = &layer;
+    prepared.canvas_to_brush = layer.world;
+    prepared.canvas_to_clip = layer.clip_m;
+    // degenerate transforms produce no output, like in direct2d
+    if(!prepared.canvas_to_brush.Invert() || !brush_to_source.Invert() ||
+        !prepared.canvas_to_clip.Invert())
+        return false;
+    prepared.canvas_to_source = prepared.canvas_to_brush * brush_to_source;
+
+    prepared.clip_bounds = get_bounds(layer.clip_rect, layer.clip_m);
+    const D2D1_RECT_F bounds = videomixer_cpu_compositor::get_bounds(layer);
+    prepared.rect.left = std::max(0, (int)std::floor(bounds.left));
+    prepared.rect.top = std::max(0, (int)std::floor(bounds.top));
+    prepared.rect.right = std::min((int)target.width, (int)std::ceil(bounds.right));
+    prepared.rect.bottom = std::min((int)target.height, (int)std::ceil(bounds.bottom));
+
+    return prepared.rect.left < prepared.rect.right && prepared.rect.top < prepared.rect.bottom;
+}
+
+// blends the columns [x0, x1) of the rows [y_begin, y_end) of the layer over the target
+void draw_rows(const videomixer_cpu_image& target, const prepared_layer& prepared,
+    int x0, int x1, int y_begin, int y_end)
+{
+    using namespace D2D1;
+
+    const videomixer_cpu_layer& layer = *prepared.layer;
+    const Matrix3x2F& canvas_to_brush = prepared.canvas_to_brush;
+    const Matrix3x2F& canvas_to_source = prepared.canvas_to_source;
+    const Matrix3x2F& canvas_to_clip = prepared.canvas_to_clip;
+    const bounds_t& clip_bounds = prepared.clip_bounds;
+    const int dsx = to_fixed(canvas_to_source._11), dsy = to_fixed(canvas_to_source._12);
+
+    for(int y = y_begin; y < y_end; y++)
+    {
+        UINT32* row = (UINT32*)(target.data + (size_t)y * target.pitch);
+
+        // the points are evaluated at pixel centers;
+        // the covered pixels of a row form a single span because the
+        // rectangles are convex
+        const D2D1_POINT_2F p = Point2F(x0 + 0.5f, y + 0.5f);
+        const D2D1_POINT_2F b = canvas_to_brush.TransformPoint(p);
+        const D2D1_POINT_2F s = canvas_to_source.TransformPoint(p);
+        int begin = 0, end = x1 - x0;
+
+        clip_span(b.x, canvas_to_brush._11,
+            layer.source_rect.left, layer.source_rect.right, begin, end);
+        clip_span(b.y, canvas_to_brush._12,
+            layer.source_rect.top, layer.source_rect.bottom, begin, end);
+        if(layer.axis_aligned_clip)
+        {
+            clip_span(p.x, 1.f, clip_bounds.left, clip_bounds.right, begin, end);
+            clip_span(p.y, 0.f, clip_bounds.top, clip_bounds.bottom, begin, end);
+        }
+        else
+        {
+            const D2D1_POINT_2F c = canvas_to_clip.TransformPoint(p);
+            clip_span(c.x, canvas_to_clip._11,
+                layer.clip_rect.left, layer.clip_rect.right, begin, end);
+            clip_span(c.y, canvas_to_clip._12,
+                layer.clip_rect.top, layer.clip_rect.bottom, begin, end);
+        }
+
+        // the source position is in 16.16 fixed point and stepped incrementally;
+        // the weights are the upper 8 bits of the fraction;
+        // texel centers are at half integers
+        int sx = to_fixed(s.x - 0.5f) + dsx * begin, sy = to_fixed(s.y - 0.5f) + dsy * begin;
+        for(int x = x0 + begin; x < x0 + end; x++, sx += dsx, sy += dsy)
+        {
+            UINT32 texels[4];
+            fetch_quad(layer.source, sx >> 16, sy >> 16, texels);
+            blend(row + x, texels, (sx >> 8) & 0xFF, (sy >> 8) & 0xFF);
+        }
+    }
+}
+
+}
+
+videomixer_cpu_compositor::videomixer_cpu_compositor() : parallel(true)
+{
+}
+
+void videomixer_cpu_compositor::initialize(bool parallel)
+{
+    this->parallel = parallel;
+}
+
+D2D1_RECT_F videomixer_cpu_compositor::get_bounds(const videomixer_cpu_layer& layer)
+{
+    // the drawn area is the intersection of the filled rectangle and the clip
+    const bounds_t fill_bounds = ::get_bounds(layer.source_rect, layer.world);
+    const bounds_t clip_bounds = ::get_bounds(layer.clip_rect, layer.clip_m);
+    return D2D1::RectF(
+        std::max(fill_bounds.left, clip_bounds.left),
+        std::max(fill_bounds.top, clip_bounds.top),
+        std::min(fill_bounds.right, clip_bounds.right),
+        std::min(fill_bounds.bottom, clip_bounds.bottom));
+}
+
+void videomixer_cpu_compositor::clear(const videomixer_cpu_image& target, const RECT* rect) const
+{
+    const RECT full_rect = {0, 0, (LONG)target.width, (LONG)target.height};
+    if(!rect)
+        rect = &full_rect;
+
+    for(LONG y = std::max(rect->top, 0L); y < std::min(rect->bottom, (LONG)target.height); y++)
+    {
+        UINT32* row = (UINT32*)(target.data + (size_t)y * target.pitch);
+        std::fill(row + std::max(rect->left, 0L),
+            row + std::max(std::min(rect->right, (LONG)target.width), rect->left),
+            clear_color);
+    }
+}
+
+void videomixer_cpu_compositor::draw(const videomixer_cpu_image& target,
+    const videomixer_cpu_layer& layer, const RECT* rect) const
+{
+    prepared_layer prepared;
+    if(!prepare_layer(target, layer, prepared))
+        return;
+
+    int x0 = prepared.rect.left, y0 = prepared.rect.top,
+        x1 = prepared.rect.right, y1 = prepared.rect.bottom;
+    if(rect)
+    {
+        x0 = std::max(x0, (int)rect->left);
+        y0 = std::max(y0, (int)rect->top);
+        x1 = std::min(x1, (int)rect->right);
+        y1 = std::min(y1, (int)rect->bottom);
+    }
+    if(x0 >= x1 || y0 >= y1)
+        return;
+
+    if(!this->parallel)
+    {
+        draw_rows(target, prepared, x0, x1, y0, y1);
+        return;
+    }
+
+    // the bands write to disjoint rows
+    std::vector<int> bands;
+    for(int y = y0; y < y1; y += (int)band_height)
+        bands.push_back(y);
+    std::for_each(std::execution::par, bands.begin(), bands.end(),
+        [&](int y) { draw_rows(target, prepared, x0, x1, y, std::min(y + (int)band_height, y1)); });
+}
+
+void videomixer_cpu_compositor::compose(const videomixer_cpu_image& target,
+    const std::vector<videomixer_cpu_layer>& layers, const std::vector<RECT>& rects) const
+{
+    struct tile_t
+    {
+        RECT rect;
+        // the range of the layer bin in tile_layers
+        size_t first_layer, layer_count;
+    };
+
+    std::vector<prepared_layer> prepared_layers;
+    prepared_layers.reserve(layers.size());
+    for(const auto& layer : layers)
+    {
+        prepared_layer prepared;
+        if(prepare_layer(target, layer, prepared))
+            prepared_layers.push_back(prepared);
+    }
+
+    // split the rects into tiles and bin the layers that intersect each tile;
+    // the bins keep the order of the layers
+    std::vector<tile_t> tiles;
+    std::vector<const prepared_layer*> tile_layers;
+    for(const auto& rect : rects)
+    {
+        const LONG left = std::max(rect.left, 0L), top = std::max(rect.top, 0L),
+            right = std::min(rect.right, (LONG)target.width),
+            bottom = std::min(rect.bottom, (LONG)target.height);
+        for(LONG y = top; y < bottom; y += (LONG)tile_height)
+        {
+            for(LONG x = left; x < right; x += (LONG)tile_width)
+            {
+                tile_t tile;
+                tile.rect = {x, y,
+                    std::min(x + (LONG)tile_width, right), std::min(y + (LONG)tile_height, bottom)};
+                tile.first_layer = tile_layers.size();
+
+                for(const auto& prepared : prepared_layers)
+                {
+                    RECT intersection;
+                    if(IntersectRect(&intersection, &prepared.rect, &tile.rect))
+                        tile_layers.push_back(&prepared);
+                }
+
+                tile.layer_count = tile_layers.size() - tile.first_layer;
+                tiles.push_back(tile);
+            }
+        }
+    }
+
+    // each tile is cleared and composed in one pass, so that the tile stays in the cache
+    // while the layers are blended over it
+    auto compose_tile = [&](const tile_t& tile)
+    {
+        this->clear(target, &tile.rect);
+        for(size_t i = tile.first_layer; i < tile.first_layer + tile.layer_count; i++)
+        {
+            const prepared_layer& prepared = *tile_layers[i];
+            draw_rows(target, prepared,
+                std::max(tile.rect.left, prepared.rect.left),
+                std::min(tile.rect.right, prepared.rect.right),
+                std::max(tile.rect.top, prepared.rect.top),
+                std::min(tile.rect.bottom, prepared.rect.bottom));
+        }
+    };
+
+    if(!this->parallel)
+        std::for_each(tiles.begin(), tiles.end(), compose_tile);
+    else
+        std::for_each(std::execution::par, tiles.begin(), tiles.end(), compose_tile);
+}
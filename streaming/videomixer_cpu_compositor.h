@@ -0,0 +1,68 @@
+#pragma once
+
+#include <d2d1_1.h>
+#include <d2d1_1helper.h>
+#include <Windows.h>
+#include <vector>
+
+// cpu implementation of the videomixer composition;
+// follows the semantics of the direct2d path in stream_videomixer::mix;
+// the images are in premultiplied bgra format
+
+struct videomixer_cpu_image
+{
+    BYTE* data;
+    UINT32 width, height;
+    // in bytes
+    UINT32 pitch;
+};
+
+struct videomixer_cpu_layer
+{
+    videomixer_cpu_image source;
+    // the filled rectangle in brush space
+    D2D1_RECT_F source_rect;
+    // world maps the brush space to the canvas;
+    // brush maps the source image to the brush space
+    D2D1::Matrix3x2F world, brush;
+    // the clip rectangle is transformed by clip_m;
+    // an axis aligned clip uses the bounds of the transformed rectangle
+    D2D1_RECT_F clip_rect;
+    D2D1::Matrix3x2F clip_m;
+    bool axis_aligned_clip;
+};
+
+class videomixer_cpu_compositor
+{
+public:
+    // the rows are blended in bands of this height;
+    // the bands are processed in parallel
+    static const UINT32 band_height = 32;
+    // compose splits the rects into tiles of this size;
+    // a tile of the target fits in the l1 or l2 cache of a core
+    static const UINT32 tile_width = 128, tile_height = 64;
+private:
+    bool parallel;
+public:
+    videomixer_cpu_compositor();
+
+    // parallel enables row parallel blending
+    void initialize(bool parallel = true);
+
+    // the bounds of the drawn area of the layer
+    static D2D1_RECT_F get_bounds(const videomixer_cpu_layer&);
+
+    // clears the target to opaque black;
+    // rect limits the cleared area if not null
+    void clear(const videomixer_cpu_image& target, const RECT* rect = nullptr) const;
+    // blends the layer over the target with bilinear sampling;
+    // the edges are not antialiased;
+    // rect limits the drawn area if not null
+    void draw(const videomixer_cpu_image& target, const videomixer_cpu_layer&,
+        const RECT* rect = nullptr) const;
+    // clears the rects and blends the layers over them in order;
+    // the rects are split into tiles and the layers are binned to the tiles by their bounds;
+    // the tiles are composed in parallel, so the rects must not overlap
+    void compose(const videomixer_cpu_image& target, const std::vector<videomixer_cpu_layer>&,
+        const std::vector<RECT>& rects) const;
+};